@@ -23,11 +23,139 @@
 
 #pragma mark --- function prototypes ---
 
-static errno_t prepareTSO4(mbuf_t m, UInt32 *mssHeaderSize, UInt32 *payloadSize);
-static errno_t prepareTSO6(mbuf_t m, UInt32 *mssHeaderSize, UInt32 *payloadSize);
+static errno_t prepareTSO4(mbuf_t *mp, UInt32 l3Offset, UInt32 l4Offset, UInt32 *mssHeaderSize, UInt32 *payloadSize);
+static errno_t prepareTSO6(mbuf_t *mp, UInt32 l3Offset, UInt32 l4Offset, UInt32 *mssHeaderSize, UInt32 *payloadSize);
+static bool txParseOffsets(mbuf_t m, struct MausiHdrOffsets *offs);
+static errno_t txSoftwareChecksum(mbuf_t m, UInt32 start, UInt32 len, UInt32 stuff, bool udp);
+
+/*
+ * Get the number of descriptors a packet needs at most, which is a
+ * data descriptor for every page it touches plus a context descriptor
+ * and one more in case the headers have to be pulled up for TSO.
+ */
+static inline UInt32 txPacketDescs(mbuf_t m)
+{
+    uintptr_t d;
+    size_t len;
+    UInt32 n = 0;
+    
+    for (; m; m = mbuf_next(m)) {
+        len = mbuf_len(m);
+        
+        if (len) {
+            d = (uintptr_t)mbuf_data(m);
+            n += (UInt32)(((d + len - 1) >> PAGE_SHIFT) - (d >> PAGE_SHIFT) + 1);
+        }
+    }
+    return min(n, (UInt32)kMaxSegs) + 2;
+}
+
+/* Get the statistics entry of the histogram bucket for numSegs. */
+static inline UInt32 txSegsHistogramIndex(UInt32 numSegs)
+{
+    if (numSegs <= 4)
+        return kDrvStatTxSegs1 + numSegs - 1;
+    else if (numSegs <= 8)
+        return kDrvStatTxSegs5to8;
+    else if (numSegs <= 16)
+        return kDrvStatTxSegs9to16;
+    else
+        return kDrvStatTxSegs17up;
+}
+
+/*
+ * Get the header offsets of a packet. The headers are parsed in place
+ * if possible, otherwise they are copied to a buffer on the stack.
+ */
+static bool txParseOffsets(mbuf_t m, struct MausiHdrOffsets *offs)
+{
+    UInt8 hdr[kGSOMaxHdrLen];
+    UInt32 pktLen = (UInt32)mbuf_pkthdr_len(m);
+    UInt32 len = (UInt32)mbuf_len(m);
+    bool result = false;
+    
+    if ((len >= kGSOMaxHdrLen) || (len == pktLen)) {
+        result = gsoParseOffsets((const UInt8 *)mbuf_data(m), min(len, (UInt32)kGSOMaxHdrLen), offs);
+    } else {
+        len = min(pktLen, (UInt32)kGSOMaxHdrLen);
+        
+        if (!mbuf_copydata(m, 0, len, hdr))
+            result = gsoParseOffsets(hdr, len, offs);
+    }
+    return result;
+}
+
+/*
+ * Compute the internet checksum of len bytes starting at offset start
+ * and store it at start + stuff. The checksum field is expected to be
+ * preset with the pseudo header sum or zero.
+ */
+static errno_t txSoftwareChecksum(mbuf_t pkt, UInt32 start, UInt32 len, UInt32 stuff, bool udp)
+{
+    mbuf_t m;
+    const UInt8 *p;
+    UInt64 sum = 0;
+    UInt32 offset = 0;
+    UInt32 pos = 0;
+    UInt32 n;
+    UInt16 csum;
+    
+    for (m = pkt; m && len; m = mbuf_next(m)) {
+        n = (UInt32)mbuf_len(m);
+        
+        if ((offset + n) <= start) {
+            offset += n;
+            continue;
+        }
+        p = (const UInt8 *)mbuf_data(m);
+        
+        if (offset < start) {
+            p += start - offset;
+            n -= start - offset;
+        }
+        offset = start;
+        n = min(n, len);
+        len -= n;
+        
+        for (; n > 0; n--, pos++)
+            sum += (pos & 1) ? *p++ : ((UInt32)*p++ << 8);
+    }
+    if (len)
+        return EINVAL;
+    
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    
+    csum = ~((UInt16)sum);
+    
+    /* A zero UDP checksum means no checksum. */
+    if (udp && (csum == 0))
+        csum = 0xffff;
+    
+    csum = htons(csum);
+    
+    return mbuf_copyback(pkt, start + stuff, sizeof(csum), &csum, MBUF_DONTWAIT);
+}
 
 #pragma mark --- private data ---
 
+/*
+ * Service classes in the order of their priority. The first
+ * kTxNumPriorityClasses are latency sensitive.
+ */
+static const IOMbufServiceClass txServiceClasses[kTxNumServiceClasses] = {
+    kIOMbufServiceClassCTL,
+    kIOMbufServiceClassVO,
+    kIOMbufServiceClassVI,
+    kIOMbufServiceClassAV,
+    kIOMbufServiceClassRV,
+    kIOMbufServiceClassOAM,
+    kIOMbufServiceClassRD,
+    kIOMbufServiceClassBE,
+    kIOMbufServiceClassBK,
+    kIOMbufServiceClassBKSYS
+};
+
 static const struct intelDevice deviceTable[] = {
     { .pciDevId = E1000_DEV_ID_ICH8_IFE, .device = board_ich8lan, .deviceName = "82562V", .deviceInfo = &e1000_ich8_info },
 	{ .pciDevId = E1000_DEV_ID_ICH8_IFE_G, .device = board_ich8lan, .deviceName = "82562G", .deviceInfo = &e1000_ich8_info },
@@ -160,6 +288,8 @@ bool IntelMausi::init(OSDictionary *properties)
         netif = NULL;
         netStats = NULL;
         etherStats = NULL;
+        drvStatsDict = NULL;
+        txLastContext.valid = false;
         baseMap = NULL;
         baseAddr = NULL;
         flashMap = NULL;
@@ -167,9 +297,53 @@ bool IntelMausi::init(OSDictionary *properties)
         rxBufDesc = NULL;
         rxBufArrayMem = NULL;
         rxBufArray = NULL;
+        rxHdrDmaCmd = NULL;
+        rxHdrBufDesc = NULL;
+        rxHdrPhyAddr = 0;
+        rxHdrArray = NULL;
+        rxPSMode = false;
+        rxPagePool = NULL;
+        rxPageArray = NULL;
+        rxFlipMode = false;
         rxMapMem = NULL;
         rxPool = NULL;
         txMbufCursor = NULL;
+        txBounceDmaCmd = NULL;
+        txBounceBufDesc = NULL;
+        txBounceArray = NULL;
+        txBouncePhyAddr = 0;
+        txCopyBreak = 0;
+        txReportInterval = kTxReportIntervalDefault;
+        txUnreportedPkts = 0;
+        txLastEOPIndex = 0;
+        txHeadCompletion = false;
+        cachedRings = false;
+        txPriorityMode = false;
+        txBulkLimit = 0;
+        txBulkDescs = 0;
+        txPktFlags = 0;
+        txPktBytes = 0;
+        txByteLimitMode = false;
+        bzero(&txByteLimit, sizeof(txByteLimit));
+        txFQ = NULL;
+        txMapCache = NULL;
+        txMapCacheMem = NULL;
+        txMapCacheSize = kTxMapCacheDefault;
+        txFQMode = false;
+        numTxDesc = kNumDescDefault;
+        numRxDesc = kNumDescDefault;
+        txDescMask = kNumDescDefault - 1;
+        rxDescMask = kNumDescDefault - 1;
+        numTxMemDesc = kNumTxMemDesc(kNumDescDefault);
+        txMemDescMask = numTxMemDesc - 1;
+        numRxMemDesc = kNumRxMemDesc(kNumDescDefault);
+        txWakeThreshold = kTxQueueWakeTreshhold(kNumDescDefault);
+        txStallDescs = 0;
+        txPendingPkt = NULL;
+        txGSO.nextSeg = 0;
+        txFreeHead = NULL;
+        txFreeTail = NULL;
+        txFreeCount = 0;
         rxPacketHead = NULL;
         rxPacketTail = NULL;
         rxPacketSize = 0;
@@ -197,6 +371,10 @@ bool IntelMausi::init(OSDictionary *properties)
         enableTSO4 = false;
         enableTSO6 = false;
         enableCSO6 = false;
+        softTSO4 = false;
+        softTSO6 = false;
+        safeTSO4 = false;
+        safeTSO6 = false;
         useAppleVTD = false;
         pciPMCtrlOffset = 0;
         maxLatency = 0;
@@ -227,6 +405,7 @@ void IntelMausi::free()
     RELEASE(commandGate);
     RELEASE(txQueue);
     RELEASE(mediumDict);
+    RELEASE(drvStatsDict);
     
     for (i = MEDIUM_INDEX_AUTO; i < MEDIUM_INDEX_COUNT; i++)
         mediumTable[i] = NULL;
@@ -295,6 +474,10 @@ bool IntelMausi::start(IOService *provider)
         IOLog("Failed to setup medium dictionary.\n");
         goto error_gate;
     }
+    if (!setupDriverStats()) {
+        IOLog("Failed to setup statistics dictionary.\n");
+        goto error_gate;
+    }
     commandGate = getCommandGate();
     
     if (!commandGate) {
@@ -548,10 +731,10 @@ done:
 IOReturn IntelMausi::outputStart(IONetworkInterface *interface, IOOptionBits options)
 {
     IOPhysicalSegment txSegments[kMaxSegs];
-    struct e1000_data_desc *desc;
-    struct e1000_context_desc *contDesc;
     mbuf_t m;
     IOReturn result = kIOReturnNoResources;
+    IOReturn status;
+    UInt32 budget;
     UInt32 numDescs;
     UInt32 cmd;
     UInt32 opts;
@@ -560,14 +743,19 @@ IOReturn IntelMausi::outputStart(IONetworkInterface *interface, IOOptionBits opt
     UInt32 mss;
     UInt32 ipConfig;
     UInt32 tcpConfig;
-    UInt32 word1;
+    UInt32 lastCmd;
     UInt32 numSegs;
-    UInt32 lastSeg;
     UInt32 index;
     UInt32 offloadFlags;
+    UInt32 pktLen;
+    UInt32 l3Offset;
+    UInt32 l4Offset;
+    UInt32 stallDescs;
+    UInt16 bufFlags;
     UInt16 vlanTag;
-    UInt16 i;
     UInt16 count;
+    mbuf_svc_class_t svc;
+    bool newContext;
     
     //DebugLog("outputStart() ===>\n");
     count = 0;
@@ -576,205 +764,265 @@ IOReturn IntelMausi::outputStart(IONetworkInterface *interface, IOOptionBits opt
         DebugLog("Interface down. Dropping packets.\n");
         goto done;
     }
-    while ((txNumFreeDesc >= (kMaxSegs + 3)) && (interface->dequeueOutputPackets(1, &m, NULL, NULL, NULL) == kIOReturnSuccess)) {
-        numDescs = 0;
-        cmd = 0;
-        opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
-        word2 = 0;
-        len = 0;
-        mss = 0;
-        ipConfig = 0;
-        tcpConfig = 0;
-        offloadFlags = 0;
-        
-        if (mbuf_get_tso_requested(m, &offloadFlags, &mss)) {
-            DebugLog("mbuf_get_tso_requested() failed. Dropping packet.\n");
-            mbuf_freem_list(m);
-            continue;
+    
+again:
+    stallDescs = 0;
+    
+    while (txNumFreeDesc >= (kTxMinPktDescs + kTxDescReserve)) {
+        /*
+         * Dequeue a burst of packets and update the tail pointer only
+         * once after all of them have been processed. Packets which
+         * don't fit into the free descriptors stay pending.
+         */
+        if (!txPendingPkt) {
+            if (txByteLimitReached())
+                break;
+            
+            budget = min(txNumFreeDesc / kTxMinPktDescs, kTxBatchSize);
+            
+            if (pktGen.active) {
+                if (!pktGenDequeue(budget))
+                    break;
+            } else if (txFQMode) {
+                if (!txDequeueFromFQ(interface, budget))
+                    break;
+            } else if (txPriorityMode) {
+                if (!txDequeueByServiceClass(interface, budget))
+                    break;
+            } else if (interface->dequeueOutputPackets(budget, &txPendingPkt, NULL, NULL, NULL) != kIOReturnSuccess) {
+                break;
+            }
         }
-        
-        /* First prepare the header and the command bits. */
-        if (offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) {
-            numDescs = 1;
-            opts = E1000_TXD_CMD_IFCS;
+        /*
+         * Packets which are segmented in software may not fit into
+         * the ring. They stay at the head of the pending chain until
+         * there are enough free descriptors.
+         */
+        while (txPendingPkt && (txNumFreeDesc >= (kTxMinPktDescs + kTxDescReserve))) {
+            if (txByteLimitReached())
+                goto update;
             
-            if (offloadFlags & MBUF_TSO_IPV4) {
-                /* Correct the pseudo header checksum and extract the header size. */
-                if (prepareTSO4(m, &mss, &len))
-                    continue;
-                
-                /* Prepare the context descriptor. */
-                ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
-                len |= (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
+            /* Admit the packet only if it's sure to fit into the ring. */
+            m = txPendingPkt;
+            numDescs = txPacketDescs(m);
+            
+            if (!txPacketFits(txNumFreeDesc, numDescs)) {
+                stallDescs = numDescs + kTxDescReserve;
+                goto update;
+            }
+            txPendingPkt = mbuf_nextpkt(m);
+            mbuf_setnextpkt(m, NULL);
                 
-                //DebugLog("Ethernet [IntelMausi]: TSO4 mssHeaderLen=0x%08x, payload=0x%08x\n", mss, len);
+            numDescs = 0;
+            cmd = 0;
+            opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS);
+            word2 = 0;
+            len = 0;
+            mss = 0;
+            ipConfig = 0;
+            tcpConfig = 0;
+            offloadFlags = 0;
+            
+            /* Packets of all but the latency sensitive classes are bulk traffic. */
+            txPktFlags = (pktGen.injected) ? kTxBufFlagPktGen : 0;
+            txPktBytes = (UInt32)mbuf_pkthdr_len(m);
+            
+            if (txPriorityMode) {
+                svc = mbuf_get_service_class(m);
                 
-                /* Setup the command bits for TSO over IPv4. */
-                cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_DTYP_D);
-                word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-            } else {
-                /* Correct the pseudo header checksum and extract the header size. */
-                if (prepareTSO6(m, &mss, &len))
-                    continue;
+                if ((svc == MBUF_SC_CTL) || (svc == MBUF_SC_VO) || (svc == MBUF_SC_VI))
+                    drvStats[kDrvStatTxPriorityPackets]++;
+                else
+                    txPktFlags = kTxBufFlagBulk;
+            }
+            if (mbuf_get_tso_requested(m, &offloadFlags, &mss)) {
+                DebugLog("mbuf_get_tso_requested() failed. Dropping packet.\n");
+                mbuf_freem_list(m);
+                continue;
+            }
+            if (((offloadFlags & MBUF_TSO_IPV4) && (softTSO4 || safeTSO4)) ||
+                ((offloadFlags & MBUF_TSO_IPV6) && (softTSO6 || safeTSO6))) {
+                index = txNextDescIndex;
+                status = txSegmentPacket(m, mss, (offloadFlags & MBUF_TSO_IPV4) ? safeTSO4 : safeTSO6);
                 
-                /* Prepare the context descriptor. */
-                ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-                tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
-                len |= (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_TCP);
+                /* A part of the packet may have been posted. */
+                if (txNextDescIndex != index)
+                    count++;
                 
-                /* Setup the command bits for TSO over IPv6. */
-                cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_DTYP_D);
-                word2 = E1000_TXD_OPTS_TXSM;
+                if (status == kIOReturnNoResources) {
+                    mbuf_setnextpkt(m, txPendingPkt);
+                    txPendingPkt = m;
+                    stallDescs = txGSO.needDescs;
+                    goto update;
+                }
+                continue;
             }
-        } else {
-            mbuf_get_csum_requested(m, &offloadFlags, &mss);
             
-            if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
+            /* First prepare the header and the command bits. */
+            if (offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) {
                 numDescs = 1;
-                cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+                opts = E1000_TXD_CMD_IFCS;
                 
-                if (offloadFlags & kChecksumTCP) {
-                    ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                    tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
-                    len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
-                    mss = 0;
+                if (offloadFlags & MBUF_TSO_IPV4) {
+                    /* Correct the pseudo header checksum and extract the header size. */
+                    txGetHeaderOffsets(m, kGSOTypeIPv4, IPPROTO_TCP, &l3Offset, &l4Offset);
                     
-                    word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-                } else if (offloadFlags & kChecksumUDP) {
-                    ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                    tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart);
-                    len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-                    mss = 0;
+                    if (prepareTSO4(&m, l3Offset, l4Offset, &mss, &len)) {
+                        etherStats->dot3TxExtraEntry.resourceErrors++;
+                        continue;
+                    }
+                    
+                    /* Prepare the context descriptor. */
+                    ipConfig = (((l4Offset - 1) << 16) | ((l3Offset + offsetof(struct ip, ip_sum)) << 8) | l3Offset);
+                    tcpConfig = (((l4Offset + offsetof(struct tcphdr, th_sum)) << 8) | l4Offset);
+                    len |= (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
                     
+                    //DebugLog("Ethernet [IntelMausi]: TSO4 mssHeaderLen=0x%08x, payload=0x%08x\n", mss, len);
+                    
+                    /* Setup the command bits for TSO over IPv4. */
+                    cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_DTYP_D);
                     word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-                } else if (offloadFlags & kChecksumIP) {
-                    ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                    tcpConfig = 0;
-                    mss = 0;
-                    len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
+                } else {
+                    /* Correct the pseudo header checksum and extract the header size. */
+                    txGetHeaderOffsets(m, kGSOTypeIPv6, IPPROTO_TCP, &l3Offset, &l4Offset);
                     
-                    word2 = E1000_TXD_OPTS_IXSM;
-                } else if (offloadFlags & kChecksumTCPIPv6) {
-                    ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-                    tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
-                    len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
-                    mss = 0;
+                    if (prepareTSO6(&m, l3Offset, l4Offset, &mss, &len)) {
+                        etherStats->dot3TxExtraEntry.resourceErrors++;
+                        continue;
+                    }
                     
+                    /* Prepare the context descriptor. */
+                    ipConfig = l3Offset;
+                    tcpConfig = (((l4Offset + offsetof(struct tcphdr, th_sum)) << 8) | l4Offset);
+                    len |= (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_TCP);
+                    
+                    /* Setup the command bits for TSO over IPv6. */
+                    cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_DTYP_D);
                     word2 = E1000_TXD_OPTS_TXSM;
-                } else if (offloadFlags & kChecksumUDPIPv6) {
-                    ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-                    tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart);
-                    len = E1000_TXD_CMD_DEXT;
+                }
+            } else {
+                mbuf_get_csum_requested(m, &offloadFlags, &mss);
+                
+                if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
+                    status = txPrepareChecksum(m, offloadFlags, mss, &ipConfig, &tcpConfig, &len, &word2);
                     mss = 0;
                     
-                    word2 = E1000_TXD_OPTS_TXSM;
+                    if (status == kIOReturnSuccess) {
+                        numDescs = 1;
+                        cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+                    } else if (status != kIOReturnUnsupported) {
+                        DebugLog("txPrepareChecksum() failed. Dropping packet.\n");
+                        etherStats->dot3TxExtraEntry.resourceErrors++;
+                        mbuf_freem_list(m);
+                        continue;
+                    }
                 }
             }
-        }
-        
-        /* Next get the VLAN tag and command bit. */
-        if (!mbuf_get_vlan_tag(m, &vlanTag)) {
-            opts |= E1000_TXD_CMD_VLE;
-            word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
-        }
-        /* Finally get the physical segments. */
-        if (useAppleVTD)
-            numSegs = txMapPacket(m, txSegments, kMaxSegs);
-        else
-            numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, txSegments, kMaxSegs);
-
-        numDescs += numSegs;
-        
-        if (!numSegs) {
-            DebugLog("getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
-            etherStats->dot3TxExtraEntry.resourceErrors++;
-            mbuf_freem_list(m);
-            continue;
-        }
-        OSAddAtomic(-numDescs, &txNumFreeDesc);
-        index = txNextDescIndex;
-        txNextDescIndex = (txNextDescIndex + numDescs) & kTxDescMask;
-        lastSeg = numSegs - 1;
-        
-        /* Setup the context descriptor for checksum offload. */
-        if (offloadFlags) {
-            contDesc = (struct e1000_context_desc *)&txDescArray[index];
             
-            txBufArray[index].mbuf = NULL;
-            txBufArray[index].numDescs = 0;
-            
-#ifdef DEBUG
-            txBufArray[index].pad = numSegs;
-#endif
+            /*
+             * The hardware keeps the last context loaded, so that a checksum
+             * offload context needs to be written only when it has changed.
+             * TSO packets always get a context of their own, like in Linux'
+             * e1000_tso(), as there is no documented guarantee that the TSO
+             * engine starts from a reused context correctly.
+             */
+            if (numDescs && !(offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) &&
+                txContextCached(ipConfig, tcpConfig, len, mss))
+                numDescs = 0;
             
-            contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
-            contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
-            contDesc->cmd_and_length = OSSwapHostToLittleInt32(len);
-            contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(mss);
+            newContext = (numDescs != 0);
+
+            /* Next get the VLAN tag and command bit. */
+            if (!mbuf_get_vlan_tag(m, &vlanTag)) {
+                opts |= E1000_TXD_CMD_VLE;
+                word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+            }
+            /* Finally get the physical segments. */
+            pktLen = (UInt32)mbuf_pkthdr_len(m);
+            bufFlags = 0;
             
-            ++index &= kTxDescMask;
-        }
-        /* And finally fill in the data descriptors. */
-        if (offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) {
-            for (i = 0; i < numSegs; i++) {
-                desc = &txDescArray[index];
-                word1 = (cmd | (txSegments[i].length & 0x000fffff));
+            if (!(offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) && (pktLen <= txCopyBreak)) {
+                /*
+                 * Copy small packets to the bounce buffer of their data
+                 * descriptor, which is already mapped, and free the mbuf
+                 * right away.
+                 */
+                index = (txNextDescIndex + numDescs) & txDescMask;
                 
-                if (i == 0) {
-                    word1 |= opts;
-                    txBufArray[index].mbuf = NULL;
-                    txBufArray[index].numDescs = 0;
-                } else if (i == lastSeg) {
-                    word1 |= (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS);
-                    txBufArray[index].mbuf = m;
-                    txBufArray[index].numDescs = numDescs;
-                } else {
-                    txBufArray[index].mbuf = NULL;
-                    txBufArray[index].numDescs = 0;
+                if (mbuf_copydata(m, 0, pktLen, &txBounceArray[index * kTxBounceBufSize])) {
+                    DebugLog("mbuf_copydata() failed. Dropping packet.\n");
+                    etherStats->dot3TxExtraEntry.resourceErrors++;
+                    mbuf_freem_list(m);
+                    continue;
                 }
+                mbuf_freem_list(m);
+                m = NULL;
                 
-#ifdef DEBUG
-                txBufArray[index].pad = (UInt32)txSegments[i].length;
-#endif
-                
-                desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-                desc->lower.data = OSSwapHostToLittleInt32(word1);
-                desc->upper.data = OSSwapHostToLittleInt32(word2);
-                
-                ++index &= kTxDescMask;
+                txSegments[0].location = txBouncePhyAddr + index * kTxBounceBufSize;
+                txSegments[0].length = pktLen;
+                numSegs = 1;
+                drvStats[kDrvStatTxCopiedPackets]++;
+            } else if (useAppleVTD) {
+                numSegs = txMapPacket(m, txSegments, kMaxSegs);
+                bufFlags = kTxBufFlagMapped;
+            } else {
+                numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, txSegments, kMaxSegs);
             }
-        } else {
-            for (i = 0; i < numSegs; i++) {
-                desc = &txDescArray[index];
-                word1 = (cmd | (txSegments[i].length & 0x000fffff));
-                
-                if (i == lastSeg) {
-                    word1 |= opts;
-                    txBufArray[index].mbuf = m;
-                    txBufArray[index].numDescs = numDescs;
-                } else {
-                    txBufArray[index].mbuf = NULL;
-                    txBufArray[index].numDescs = 0;
-                }
-                
-#ifdef DEBUG
-                txBufArray[index].pad = (UInt32)txSegments[i].length;
-#endif
-                
-                desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-                desc->lower.data = OSSwapHostToLittleInt32(word1);
-                desc->upper.data = OSSwapHostToLittleInt32(word2);
-                
-                ++index &= kTxDescMask;
+            numDescs += numSegs;
+            
+            if (!numSegs) {
+                DebugLog("getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
+                etherStats->dot3TxExtraEntry.resourceErrors++;
+                mbuf_freem_list(m);
+                continue;
             }
+            drvStats[txSegsHistogramIndex(numSegs)]++;
+            
+            OSAddAtomic(-numDescs, &txNumFreeDesc);
+            index = txNextDescIndex;
+            txNextDescIndex = (txNextDescIndex + numDescs) & txDescMask;
+            
+            /* Setup the context descriptor for checksum offload. */
+            if (newContext) {
+                txWriteContext(index, ipConfig, tcpConfig, len, mss);
+                ++index &= txDescMask;
+            }
+            /* And finally fill in the data descriptors. */
+            lastCmd = txFinishPacket(((index + numSegs - 1) & txDescMask), m, numDescs, bufFlags);
+            
+            if (offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6))
+                txFillDataDescs(txDescArray, txDescMask, index, txSegments, numSegs, cmd, opts, (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | lastCmd), word2);
+            else
+                txFillDataDescs(txDescArray, txDescMask, index, txSegments, numSegs, cmd, 0, (opts | lastCmd), word2);
+            
+            count++;
         }
-        count++;
     }
-    if (count)
+
+update:
+    if (count) {
         intelUpdateTxDescTail(txNextDescIndex);
+        count = 0;
+    }
+    if (txNumFreeDesc < (kTxMinPktDescs + kTxDescReserve))
+        stallDescs = max(stallDescs, (UInt32)(kTxMinPktDescs + kTxDescReserve));
     
-    result = (txNumFreeDesc >= (kMaxSegs + 3)) ? kIOReturnSuccess : kIOReturnNoResources;
+    if (stallDescs) {
+        /*
+         * Too few free descriptors. Wait for the interrupt handler to
+         * wake us up unless it has freed enough of them meanwhile.
+         */
+        if (!txStallQueue(stallDescs))
+            goto again;
+        
+        drvStats[kDrvStatTxQueueStalls]++;
+        result = kIOReturnNoResources;
+    } else if (txPendingPkt) {
+        /* Held back by the byte limit. */
+        result = kIOReturnNoResources;
+    } else {
+        result = kIOReturnSuccess;
+    }
     
     //DebugLog("outputStart() <===\n");
     
@@ -857,14 +1105,15 @@ bool IntelMausi::configureInterface(IONetworkInterface *interface)
             goto done;
         }
     }
-    error = interface->configureOutputPullModel(384, 0, 0, IONetworkInterface::kOutputPacketSchedulingModelNormal);
+    /* With service class priority the driver schedules the packets itself. */
+    error = interface->configureOutputPullModel(384, 0, 0, ((txPriorityMode || txFQMode) ? IONetworkInterface::kOutputPacketSchedulingModelDriverManaged : IONetworkInterface::kOutputPacketSchedulingModelNormal));
     
     if (error != kIOReturnSuccess) {
         IOLog("configureOutputPullModel() failed\n.");
         result = false;
         goto done;
     }
-    error = interface->configureInputPacketPolling(kNumRxDesc, kIONetworkWorkLoopSynchronous);
+    error = interface->configureInputPacketPolling(numRxDesc, kIONetworkWorkLoopSynchronous);
     
     if (error != kIOReturnSuccess) {
         IOLog("configureInputPacketPolling() failed\n.");
@@ -1016,10 +1265,10 @@ UInt32 IntelMausi::getFeatures() const
     
     DebugLog("getFeatures() ===>\n");
     
-    if (enableTSO4)
+    if (enableTSO4 || softTSO4 || safeTSO4)
         features |= kIONetworkFeatureTSOIPv4;
     
-    if (enableTSO6)
+    if (enableTSO6 || softTSO6 || safeTSO6)
         features |= kIONetworkFeatureTSOIPv6;
 
     DebugLog("getFeatures() <===\n");
@@ -1168,93 +1417,748 @@ IOReturn IntelMausi::setMaxPacketSize(UInt32 maxSize)
     return result;
 }
 
-#pragma mark --- common interrupt methods ---
+#pragma mark --- tx helper methods ---
 
-void IntelMausi::txInterrupt()
+/*
+ * Check if the hardware's offload context matches the one a packet needs.
+ */
+bool IntelMausi::txContextCached(UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss)
 {
-    UInt32 descStatus;
-    SInt32 cleaned;
+    bool result = false;
     
-    while (txDirtyIndex != txCleanBarrierIndex) {
-        if (txBufArray[txDirtyIndex].mbuf) {
-            descStatus = OSSwapLittleToHostInt32(txDescArray[txDirtyIndex].upper.data);
-            
-            if (!(descStatus & E1000_TXD_STAT_DD))
-                goto done;
-            
-            if (useAppleVTD)
-                txUnmapPacket();
+    if (txContextMatches(&txLastContext, ipConfig, tcpConfig, cmdLength, mss)) {
+        drvStats[kDrvStatTxContextsSkipped]++;
+        result = true;
+    }
+    return result;
+}
 
-            /* First free the attached mbuf and clean up the buffer info. */
-            mbuf_freem_list(txBufArray[txDirtyIndex].mbuf);
-            txBufArray[txDirtyIndex].mbuf = NULL;
-            
-            cleaned = txBufArray[txDirtyIndex].numDescs;
-            txBufArray[txDirtyIndex].numDescs = 0;
-            
-            /* Finally update the number of free descriptors. */
-            OSAddAtomic(cleaned, &txNumFreeDesc);
-            txDescDoneCount += cleaned;
-        }
-        /* Increment txDirtyIndex. */
-        ++txDirtyIndex &= kTxDescMask;
+/*
+ * Write a context descriptor and remember it as the current context.
+ */
+void IntelMausi::txWriteContext(UInt32 index, UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss)
+{
+    txSetContextDesc(&txDescArray[index], &txLastContext, ipConfig, tcpConfig, cmdLength, mss);
+    drvStats[kDrvStatTxContextsEmitted]++;
+}
+
+/*
+ * Get the offsets of the network and the transport header of a packet.
+ * Fall back to an untagged frame without IP options or extension headers
+ * in case the headers can't be parsed or don't match what the stack
+ * requested, which is what the driver used to assume for all packets.
+ * @type    kGSOTypeIPv4 or kGSOTypeIPv6.
+ * @proto   Expected transport protocol, 0 for any.
+ */
+void IntelMausi::txGetHeaderOffsets(mbuf_t m, UInt8 type, UInt8 proto, UInt32 *l3Offset, UInt32 *l4Offset)
+{
+    struct MausiHdrOffsets offs;
+    
+    if (txParseOffsets(m, &offs) && (offs.type == type) &&
+        (!proto || (offs.l4Proto == proto))) {
+        *l3Offset = offs.l3Offset;
+        *l4Offset = offs.l4Offset;
+        
+        if ((*l3Offset != ETHER_HDR_LEN) ||
+            (*l4Offset != ((type == kGSOTypeIPv4) ? kMinL4HdrOffsetV4 : kMinL4HdrOffsetV6)))
+            drvStats[kDrvStatTxCsumOtherLayout]++;
+    } else {
+        *l3Offset = ETHER_HDR_LEN;
+        *l4Offset = (type == kGSOTypeIPv4) ? kMinL4HdrOffsetV4 : kMinL4HdrOffsetV6;
+        drvStats[kDrvStatTxCsumParseErrors]++;
     }
+}
 
-    //DebugLog("txInterrupt oldIndex=%u newIndex=%u\n", oldDirtyIndex, txDirtyDescIndex);
+/*
+ * Prepare the offload context for a packet which requests checksum
+ * offload. The offsets are taken from the packet's headers, so that
+ * VLAN tags in the payload, IPv4 options and IPv6 extension headers
+ * are handled correctly. The offset of the checksum field within the
+ * transport header is provided by the stack in csumOffset.
+ *
+ * The context's offset fields are 8 bits wide. In case the checksum
+ * field is beyond their reach, the checksums are computed in software
+ * and kIOReturnUnsupported is returned, meaning that the packet has to
+ * be sent without an offload context.
+ */
+IOReturn IntelMausi::txPrepareChecksum(mbuf_t m, UInt32 flags, UInt32 csumOffset, UInt32 *ipConfig,
+                                       UInt32 *tcpConfig, UInt32 *cmdLength, UInt32 *word2)
+{
+    UInt32 l3Offset, l4Offset, stuff, maxStuff;
+    UInt32 pktLen = (UInt32)mbuf_pkthdr_len(m);
+    UInt16 zero = 0;
+    UInt8 type, proto;
+    bool ipv6 = (flags & (kChecksumTCPIPv6 | kChecksumUDPIPv6));
+    bool tcp = (flags & (kChecksumTCP | kChecksumTCPIPv6));
+    bool udp = (flags & (kChecksumUDP | kChecksumUDPIPv6));
+    IOReturn result = kIOReturnSuccess;
+    
+    type = (ipv6) ? kGSOTypeIPv6 : kGSOTypeIPv4;
+    proto = (tcp) ? IPPROTO_TCP : ((udp) ? IPPROTO_UDP : 0);
+    txGetHeaderOffsets(m, type, proto, &l3Offset, &l4Offset);
+    
+    if (tcp) {
+        maxStuff = sizeof(struct tcphdr) - sizeof(UInt16);
+        stuff = offsetof(struct tcphdr, th_sum);
+    } else {
+        maxStuff = sizeof(struct udphdr) - sizeof(UInt16);
+        stuff = offsetof(struct udphdr, uh_sum);
+    }
+    if (csumOffset && (csumOffset <= maxStuff))
+        stuff = csumOffset;
+    
+    if ((tcp || udp) && ((l4Offset + stuff) > 0xff)) {
+        result = kIOReturnError;
+        
+        if (txSoftwareChecksum(m, l4Offset, pktLen - l4Offset, stuff, udp))
+            goto done;
+        
+        if ((flags & kChecksumIP) &&
+            (mbuf_copyback(m, l3Offset + offsetof(struct ip, ip_sum), sizeof(zero), &zero, MBUF_DONTWAIT) ||
+             txSoftwareChecksum(m, l3Offset, l4Offset - l3Offset, offsetof(struct ip, ip_sum), false)))
+            goto done;
+        
+        drvStats[kDrvStatTxSoftChecksums]++;
+        *word2 = 0;
+        result = kIOReturnUnsupported;
+        goto done;
+    }
+    txChecksumContext(ipv6, tcp, udp, l3Offset, l4Offset, stuff, ipConfig, tcpConfig, cmdLength, word2);
     
 done:
-    if (txNumFreeDesc > kTxQueueWakeTreshhold)
-        netif->signalOutputThread();
+    return result;
 }
 
-UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+/*
+ * Book-keeping for the packet whose last descriptor is at index. The
+ * packet is appended to the queue of packets in flight.
+ * @index       Index of the packet's last descriptor.
+ * @m           The packet's mbuf, NULL if there is nothing to free.
+ * @numDescs    Number of descriptors used by the packet.
+ * @flags       Flags of the packet, see kTxBufFlagMapped.
+ *
+ * Decide if the hardware has to report the completion of the packet
+ * and return the RS bit accordingly. Status is requested for every
+ * txReportInterval-th packet and for all packets once the ring is
+ * getting full. As the last packet before a tail update always reports
+ * its status, see intelUpdateTxDescTail(), completions are delayed by
+ * no more than one burst.
+ */
+UInt32 IntelMausi::txFinishPacket(UInt32 index, mbuf_t m, UInt32 numDescs, UInt16 flags)
 {
-    union e1000_rx_desc_extended *desc = &rxDescArray[rxNextDescIndex];
-    mbuf_t bufPkt, newPkt;
-    UInt64 addr;
-    UInt32 status;
-    UInt32 goodPkts = 0;
-    UInt32 pktSize;
-    UInt16 vlanTag;
-    bool replaced;
+    UInt64 now;
+    UInt16 tail = txInflightTail;
+    UInt32 result = 0;
     
-    while (((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
-        addr = rxBufArray[rxNextDescIndex].phyAddr;
-        bufPkt = rxBufArray[rxNextDescIndex].mbuf;
-        pktSize = OSSwapLittleToHostInt16(desc->wb.upper.length);
-        vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.upper.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
+    txLastEOPIndex = index;
+    
+    txInflight.mbuf[tail] = m;
+    txInflight.eopIndex[tail] = index;
+    txInflight.numDescs[tail] = numDescs;
+    
+    /*
+     * Account for the packet's bytes. When a packet is split into
+     * several units, all bytes are accounted to the first one.
+     */
+    txInflight.bytes[tail] = txPktBytes;
+    bqlPosted(&txByteLimit, txPktBytes);
+    txPktBytes = 0;
+    
+    /* Account for descriptors used by bulk traffic. */
+    if (txPktFlags & kTxBufFlagBulk) {
+        flags |= kTxBufFlagBulk;
+        OSAddAtomic(numDescs, &txBulkDescs);
+    }
+    if (txPktFlags & kTxBufFlagPktGen) {
+        flags |= kTxBufFlagPktGen;
         
-        /* Skip bad packet. */
-        if (status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) {
-            DebugLog("Bad packet.\n");
-            etherStats->dot3StatsEntry.internalMacReceiveErrors++;
-            discardPacketFragment();
-            goto nextDesc;
+        if (pktGenPosted(&pktGen, txInflight.bytes[tail], numDescs)) {
+            clock_get_uptime(&now);
+            pktGenStartProbe(&pktGen, tail, now);
         }
-        newPkt = rxPool->replaceOrCopyPacket(&bufPkt, pktSize, &replaced);
+    }
+    if ((++txUnreportedPkts >= txReportInterval) || (txNumFreeDesc < txWakeThreshold)) {
+        flags |= kTxBufFlagReport;
+        txUnreportedPkts = 0;
+        drvStats[kDrvStatTxStatusReports]++;
+        result = E1000_TXD_CMD_RS;
+    }
+    txInflight.flags[tail] = flags;
+    txInflightTail = (tail + 1) & txDescMask;
+    
+    return result;
+}
+
+/*
+ * Check if the bytes in flight have reached the byte limit, see
+ * bqlReached().
+ */
+bool IntelMausi::txByteLimitReached()
+{
+    return txByteLimitMode && bqlReached(&txByteLimit, &drvStats[kDrvStatTxByteLimitStalls]);
+}
+
+/*
+ * Publish the number of free descriptors the output thread is waiting
+ * for. txInterrupt() reads and clears txStallDescs concurrently, so that
+ * it's updated atomically and only ever raised here. As the descriptors
+ * may have been freed before the value became visible, the wake condition
+ * of txInterrupt() is checked once more afterwards.
+ * @numDescs    Number of free descriptors needed.
+ * @result      true in case the queue has to stall, false in case there
+ *              are enough free descriptors now and the stall is cancelled.
+ */
+bool IntelMausi::txStallQueue(UInt32 numDescs)
+{
+    UInt32 old;
+    bool result = true;
+    
+    do {
+        old = (UInt32)txStallDescs;
         
-        if (!newPkt) {
-            /* Allocation of a new packet failed so that we must leave the original packet in place. */
-            DebugLog("replaceOrCopyPacket() failed.\n");
-            etherStats->dot3RxExtraEntry.resourceErrors++;
-            discardPacketFragment();
-            goto nextDesc;
-        }
+        if (old >= numDescs)
+            break;
+    } while (!OSCompareAndSwap(old, numDescs, (volatile UInt32 *)&txStallDescs));
+    
+    old = (UInt32)txStallDescs;
+    
+    if (old && txQueueWakes(txNumFreeDesc, txWakeThreshold, old)) {
+        OSCompareAndSwap(old, 0, (volatile UInt32 *)&txStallDescs);
+        result = false;
+    }
+    return result;
+}
+
+/*
+ * Dequeue up to maxCount packets in the order of their service class'
+ * priority. Latency sensitive classes may use the whole ring while all
+ * other classes share txBulkLimit descriptors, see txClassQuota(). This
+ * way latency sensitive packets wait behind no more than txBulkLimit
+ * descriptors of packets with the minimum number of descriptors.
+ */
+bool IntelMausi::txDequeueByServiceClass(IONetworkInterface *interface, UInt32 maxCount)
+{
+    mbuf_t head, tail;
+    mbuf_t last = NULL;
+    SInt32 bulkDescs = txBulkDescs;
+    UInt32 quota;
+    UInt32 count;
+    UInt32 i;
+    
+    for (i = 0; (i < kTxNumServiceClasses) && maxCount; i++) {
+        /* Bulk classes follow the latency sensitive ones. */
+        quota = txClassQuota(i, bulkDescs, txBulkLimit, maxCount);
         
-        /* If the packet was replaced we have to update the descriptor's buffer address. */
-        if (replaced) {
-            if (mbuf_next(bufPkt) != NULL) {
-                DebugLog("getPhysicalSegments() failed.\n");
-                etherStats->dot3RxExtraEntry.resourceErrors++;
-                mbuf_freem_list(bufPkt);
-                discardPacketFragment();
-                goto nextDesc;
-            }
-            rxBufArray[rxNextDescIndex].mbuf = bufPkt;
-            addr = mbuf_data_to_physical(mbuf_datastart(bufPkt));
-            rxBufArray[rxNextDescIndex].phyAddr = addr;
+        if (!quota) {
+            drvStats[kDrvStatTxBulkDeferred]++;
+            break;
         }
-        /* Set the length of the buffer. */
+        head = tail = NULL;
+        count = 0;
+        
+        if ((interface->dequeueOutputPacketsWithServiceClass(quota, txServiceClasses[i], &head, &tail, &count, NULL) != kIOReturnSuccess) || !head)
+            continue;
+        
+        if (last)
+            mbuf_setnextpkt(last, head);
+        else
+            txPendingPkt = head;
+        
+        last = tail;
+        maxCount -= count;
+        
+        /* Reserve the bulk share for the packets until they are posted. */
+        if (i >= kTxNumPriorityClasses)
+            bulkDescs += count * kTxMinPktDescs;
+    }
+    return (txPendingPkt != NULL);
+}
+
+/*
+ * Move as many packets from the stack's queues to the FQ-CoDel
+ * scheduler as it can hold, latency sensitive classes first, and
+ * dequeue up to maxCount packets from the scheduler. As the packets
+ * are posted right away, the sojourn time CoDel works with is the
+ * time from enqueue to descriptor post.
+ */
+bool IntelMausi::txDequeueFromFQ(IONetworkInterface *interface, UInt32 maxCount)
+{
+    mbuf_t head, tail, m;
+    mbuf_t last = NULL;
+    UInt64 now;
+    UInt32 space;
+    UInt32 count;
+    UInt32 i;
+    
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now, &now);
+    
+    for (i = 0; i < kTxNumServiceClasses; i++) {
+        space = txFQ->getSpace();
+        
+        if (!space)
+            break;
+        
+        head = tail = NULL;
+        count = 0;
+        
+        if ((interface->dequeueOutputPacketsWithServiceClass(space, txServiceClasses[i], &head, &tail, &count, NULL) != kIOReturnSuccess) || !head)
+            continue;
+        
+        while (head) {
+            m = head;
+            head = mbuf_nextpkt(m);
+            txFQ->enqueue(m, now);
+        }
+    }
+    for (i = 0; i < maxCount; i++) {
+        m = txFQ->dequeue(now);
+        
+        if (!m)
+            break;
+        
+        if (last)
+            mbuf_setnextpkt(last, m);
+        else
+            txPendingPkt = m;
+        
+        last = m;
+    }
+    return (txPendingPkt != NULL);
+}
+
+/*
+ * Segment a TSO packet. The headers of each unit are built in the
+ * bounce buffer of the unit's first descriptor while the payload
+ * descriptors point directly to the packet's data.
+ *
+ * In software mode a unit is a single segment and all units share
+ * the same checksum offload context. In safe TSO mode a unit is a
+ * chunk of segments which is handed to the hardware with a TSO
+ * context of its own. Chunks are kept small enough to stay clear of
+ * the conditions known to hang the hardware: the payload of a chunk is
+ * limited to kSafeTSOMaxPayload, a chunk uses at most kSafeTSOMaxDescs
+ * descriptors and the headers are always in a descriptor of their own.
+ * A single segment which is spread over too many physical segments to
+ * meet the limits is sent without TSO, using checksum offload only.
+ *
+ * A packet which doesn't fit into the free descriptors is posted in
+ * several parts of whole units. The packet stays at the head of
+ * txPendingPkt and txGSO keeps its headers, its physical segments and
+ * the first segment still to be posted, so that it's mapped only once
+ * and the following parts can't fail. The mbuf and the mapping are
+ * attached to the packet's very last unit.
+ *
+ * Returns kIOReturnNoResources in case there aren't enough free
+ * descriptors for the rest of the packet, kIOReturnSuccess when the
+ * packet has been posted completely and kIOReturnError when it had to
+ * be dropped.
+ */
+IOReturn IntelMausi::txSegmentPacket(mbuf_t m, UInt32 mss, bool hwTSO)
+{
+    struct MausiGSOInfo *gso = &txGSO.info;
+    IOPhysicalSegment *txSegments = txGSO.segs;
+    IOPhysicalAddress64 addr;
+    IOReturn result = kIOReturnError;
+    UInt32 pktLen = (UInt32)mbuf_pkthdr_len(m);
+    UInt32 hdrLen = min(pktLen, (UInt32)kGSOMaxHdrLen);
+    UInt32 maxSegs;
+    UInt32 firstSeg;
+    UInt32 endSeg;
+    UInt32 numSegs;
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    UInt32 cmdLength;
+    UInt32 cmd;
+    UInt32 unitCmd;
+    UInt32 opts;
+    UInt32 word1;
+    UInt32 word2;
+    UInt32 unitSegs;
+    UInt32 unitLen;
+    UInt32 segOffset;
+    UInt32 len;
+    UInt32 index;
+    UInt32 seg;
+    UInt32 i;
+    UInt16 numDescs;
+    UInt16 totalDescs;
+    UInt16 bufFlags;
+    UInt16 vlanTag;
+    
+    firstSeg = txGSO.nextSeg;
+    
+    if (!firstSeg && (mbuf_copydata(m, 0, hdrLen, txGSO.hdr) || !gsoParseHeader(txGSO.hdr, hdrLen, pktLen, mss, gso))) {
+        DebugLog("Can't segment packet. Dropping packet.\n");
+        goto error;
+    }
+    /*
+     * Each unit needs a header descriptor, at least one payload descriptor
+     * and in safe TSO mode a context descriptor. Every boundary between two
+     * physical segments and every kSafeTSOMaxPerDesc bytes of payload may
+     * add one more descriptor. Post as many segments as are sure to fit.
+     */
+    maxSegs = txSegmentsThatFit(txNumFreeDesc, (kMaxSegs + 1 + kTxDescReserve), gso->mss);
+    
+    if (!maxSegs) {
+        txGSO.needDescs = txSegmentDescs(gso->mss) + kMaxSegs + 1 + kTxDescReserve;
+        result = kIOReturnNoResources;
+        goto done;
+    }
+    endSeg = min(firstSeg + maxSegs, (UInt32)gso->numSegs);
+    
+    if (!firstSeg) {
+        if (useAppleVTD) {
+            numSegs = txMapPacket(m, txSegments, kMaxSegs);
+            bufFlags = kTxBufFlagMapped;
+        } else {
+            numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, txSegments, kMaxSegs);
+            bufFlags = 0;
+        }
+        if (!numSegs) {
+            DebugLog("getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
+            etherStats->dot3TxExtraEntry.resourceErrors++;
+            mbuf_freem_list(m);
+            goto done;
+        }
+        txGSO.numSegs = numSegs;
+        txGSO.bufFlags = bufFlags;
+    } else {
+        /* The packet's bytes have been accounted to the first part. */
+        txPktBytes = 0;
+        bufFlags = txGSO.bufFlags;
+    }
+    /* Setup the offload context using the real header offsets. */
+    ipConfig = ((gso->l4Offset - 1) << 16) | ((gso->l3Offset + offsetof(struct ip, ip_sum)) << 8) | gso->l3Offset;
+    tcpConfig = ((gso->l4Offset + offsetof(struct tcphdr, th_sum)) << 8) | gso->l4Offset;
+    cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+    opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS);
+    
+    if (gso->type == kGSOTypeIPv4) {
+        cmdLength = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
+        word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
+    } else {
+        ipConfig = gso->l3Offset;
+        cmdLength = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
+        word2 = E1000_TXD_OPTS_TXSM;
+    }
+    if (hwTSO) {
+        cmd |= E1000_TXD_CMD_TSE;
+        cmdLength |= E1000_TXD_CMD_TSE;
+    }
+    if (!mbuf_get_vlan_tag(m, &vlanTag)) {
+        opts |= E1000_TXD_CMD_VLE;
+        word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+    }
+    index = txNextDescIndex;
+    numDescs = 0;
+    totalDescs = 0;
+    
+    if (!hwTSO && !txContextCached(ipConfig, tcpConfig, cmdLength, 0)) {
+        txWriteContext(index, ipConfig, tcpConfig, cmdLength, 0);
+        ++index &= txDescMask;
+        numDescs++;
+    }
+    /* Skip the headers and the payload which has already been posted. */
+    i = 0;
+    segOffset = gso->hdrLen + firstSeg * gso->mss;
+    
+    while (segOffset >= txSegments[i].length) {
+        segOffset -= txSegments[i].length;
+        i++;
+    }
+    for (seg = firstSeg; seg < endSeg; seg += unitSegs) {
+        unitSegs = 1;
+        unitCmd = (cmd & ~E1000_TXD_CMD_TSE);
+        
+        if (hwTSO) {
+            /* Add segments to the chunk as long as it stays within the limits. */
+            len = gso->payloadLen - seg * mss;
+            unitSegs = txSafeTSOChunkSegs(txSegments, i, segOffset, mss, len, endSeg - seg);
+            unitLen = min(unitSegs * mss, len);
+            
+            if (txSafeTSOFits(txSegments, i, segOffset, unitLen)) {
+                /* Each chunk gets a context of its own because the length differs. */
+                txWriteContext(index, ipConfig, tcpConfig, (cmdLength | unitLen), ((mss << 16) | (gso->hdrLen << 8)));
+                unitCmd = cmd;
+                
+                drvStats[kDrvStatTxSafeTSOChunks]++;
+            } else {
+                txWriteContext(index, ipConfig, tcpConfig, (cmdLength & ~E1000_TXD_CMD_TSE), 0);
+                
+                drvStats[kDrvStatTxSafeTSOSoftSegments]++;
+            }
+            ++index &= txDescMask;
+            numDescs++;
+        }
+        /* Build the unit's headers in the bounce buffer. */
+        if (unitCmd & E1000_TXD_CMD_TSE)
+            unitLen = gsoChunkHeader(gso, txGSO.hdr, &txBounceArray[index * kTxBounceBufSize], seg, unitSegs);
+        else
+            unitLen = gsoSegmentHeader(gso, txGSO.hdr, &txBounceArray[index * kTxBounceBufSize], seg);
+        
+        addr = txBouncePhyAddr + index * kTxBounceBufSize;
+        
+        txSetDataDesc(&txDescArray[index], addr, (unitCmd | E1000_TXD_CMD_IFCS | gso->hdrLen), word2);
+        
+        ++index &= txDescMask;
+        numDescs++;
+        
+        /* Now add the payload which may span several physical segments. */
+        while (unitLen) {
+            len = txNextPayloadSlice(txSegments, &i, &segOffset, unitLen, &addr);
+            numDescs++;
+            unitLen -= len;
+            
+            if (unitLen) {
+                word1 = (unitCmd | len);
+            } else if ((seg + unitSegs) >= gso->numSegs) {
+                /* The mbuf is attached to the last unit. */
+                word1 = (unitCmd | opts | len | txFinishPacket(index, m, numDescs, bufFlags));
+            } else {
+                word1 = (unitCmd | opts | len | txFinishPacket(index, NULL, numDescs, 0));
+            }
+            txSetDataDesc(&txDescArray[index], addr, word1, word2);
+            ++index &= txDescMask;
+        }
+        totalDescs += numDescs;
+        numDescs = 0;
+    }
+    OSAddAtomic(-totalDescs, &txNumFreeDesc);
+    txNextDescIndex = index;
+    
+    if (endSeg < gso->numSegs) {
+        /* Wait until the next part fits. */
+        txGSO.nextSeg = endSeg;
+        txGSO.needDescs = txSegmentDescs(gso->mss) + kMaxSegs + 1 + kTxDescReserve;
+        drvStats[kDrvStatTxSegmentedParts]++;
+        result = kIOReturnNoResources;
+        goto done;
+    }
+    txGSO.nextSeg = 0;
+    
+    if (hwTSO) {
+        drvStats[kDrvStatTxSafeTSOPackets]++;
+    } else {
+        drvStats[kDrvStatTxSoftTSOPackets]++;
+        drvStats[kDrvStatTxSoftTSOSegments] += gso->numSegs;
+    }
+    result = kIOReturnSuccess;
+    
+done:
+    return result;
+    
+error:
+    etherStats->dot3TxExtraEntry.resourceErrors++;
+    mbuf_freem_list(m);
+    goto done;
+}
+
+#pragma mark --- common interrupt methods ---
+
+/*
+ * Free all packets from txDirtyIndex up to, but not including endIndex.
+ * The packets are popped from the queue of packets in flight, so that
+ * only one entry per packet has to be looked at. The mbufs are collected
+ * in txFreeHead and released by txInterrupt() in one go, so that the
+ * allocator's locks are taken once per interrupt instead of once per
+ * packet.
+ */
+void IntelMausi::txReclaimPackets(UInt16 endIndex)
+{
+    mbuf_t m;
+    UInt32 start = txDirtyIndex;
+    SInt32 cleaned;
+    UInt16 head = txInflightHead;
+    UInt16 index;
+    
+    while (head != txInflightTail) {
+        index = txInflight.eopIndex[head];
+        
+        /* Stop at the first packet which hasn't been completed yet. */
+        if (!descInRange(index, start, endIndex, txDescMask))
+            break;
+        
+        if (txInflight.flags[head] & kTxBufFlagMapped)
+            txUnmapPacket();
+        
+        /*
+         * First queue the attached mbuf for release. Packets which have
+         * been copied don't have an mbuf anymore.
+         */
+        m = txInflight.mbuf[head];
+        
+        if (m) {
+            if (txFreeTail)
+                mbuf_setnextpkt(txFreeTail, m);
+            else
+                txFreeHead = m;
+            
+            txFreeTail = m;
+            txFreeCount++;
+            txInflight.mbuf[head] = NULL;
+        }
+        cleaned = txInflight.numDescs[head];
+        
+        if (txInflight.flags[head] & kTxBufFlagBulk)
+            OSAddAtomic(-cleaned, &txBulkDescs);
+        
+        if (txInflight.flags[head] & kTxBufFlagPktGen)
+            pktGenComplete(head);
+        
+        bqlCompleted(&txByteLimit, txInflight.bytes[head]);
+        
+        /* Finally update the number of free descriptors. */
+        OSAddAtomic(cleaned, &txNumFreeDesc);
+        txDescDoneCount += cleaned;
+        drvStats[kDrvStatTxCompletedPackets]++;
+        
+        txDirtyIndex = (index + 1) & txDescMask;
+        ++head &= txDescMask;
+    }
+    txInflightHead = head;
+}
+
+void IntelMausi::txInterrupt()
+{
+    SInt32 stallDescs;
+    UInt32 descStatus;
+    UInt16 index;
+    UInt16 i;
+    
+    drvStats[kDrvStatTxCompletionPasses]++;
+    
+    if (txHeadCompletion) {
+        /*
+         * The hardware has processed all descriptors in front of the
+         * head pointer, so that a single register read is sufficient
+         * to find all completed packets.
+         */
+        if (txDirtyIndex != txCleanBarrierIndex) {
+            index = intelReadMem32(E1000_TDH(0)) & txDescMask;
+            drvStats[kDrvStatTxHeadReads]++;
+            
+            /* Ignore bogus values, e.g. after a surprise removal. */
+            if (descDistance(txDirtyIndex, index, txDescMask) <= descDistance(txDirtyIndex, txCleanBarrierIndex, txDescMask))
+                txReclaimPackets(index);
+        }
+        goto done;
+    }
+    while (txDirtyIndex != txCleanBarrierIndex) {
+        /*
+         * Only packets flagged with kTxBufFlagReport get their status
+         * written back. Find the next one in front of the barrier and
+         * check if it's done.
+         */
+        for (i = txInflightHead; i != txInflightTail; ++i &= txDescMask) {
+            index = txInflight.eopIndex[i];
+            
+            if (!descInRange(index, txDirtyIndex, txCleanBarrierIndex, txDescMask))
+                goto done;
+            
+            if (txInflight.flags[i] & kTxBufFlagReport)
+                break;
+        }
+        if (i == txInflightTail)
+            goto done;
+        
+        descStatus = OSSwapLittleToHostInt32(txDescArray[index].upper.data);
+        
+        if (!(descStatus & E1000_TXD_STAT_DD))
+            goto done;
+        
+        /* All packets up to the reported one have been sent. */
+        txReclaimPackets((index + 1) & txDescMask);
+    }
+
+    //DebugLog("txInterrupt oldIndex=%u newIndex=%u\n", oldDirtyIndex, txDirtyDescIndex);
+    
+done:
+    if (txFreeHead) {
+        mbuf_freem_list(txFreeHead);
+        
+        drvStats[kDrvStatTxFreeBatches]++;
+        drvStats[kDrvStatTxFreedPackets] += txFreeCount;
+        
+        if (txFreeCount > drvStats[kDrvStatTxMaxFreeBatch])
+            drvStats[kDrvStatTxMaxFreeBatch] = txFreeCount;
+        
+        txFreeHead = txFreeTail = NULL;
+        txFreeCount = 0;
+    }
+    if (txByteLimitMode)
+        bqlUpdate(&txByteLimit, false);
+    
+    if (pktGen.active)
+        pktGenCheckDone();
+    
+    /*
+     * A stalled queue is woken up once there is room for the packet it
+     * stalled on and at least txWakeThreshold free descriptors, so that
+     * it doesn't stall again right away.
+     */
+    stallDescs = txStallDescs;
+    
+    if (txQueueWakes(txNumFreeDesc, txWakeThreshold, stallDescs)) {
+        /* Don't lose a stall which has been published in the meantime. */
+        if (stallDescs && OSCompareAndSwap(stallDescs, 0, (volatile UInt32 *)&txStallDescs))
+            drvStats[kDrvStatTxQueueWakes]++;
+        
+        netif->signalOutputThread();
+    }
+}
+
+UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+{
+    union e1000_rx_desc_extended *desc = &rxDescArray[rxNextDescIndex];
+    mbuf_t bufPkt, newPkt;
+    UInt64 addr;
+    UInt32 status;
+    UInt32 goodPkts = 0;
+    UInt32 pktSize;
+    UInt16 vlanTag;
+    bool replaced;
+    
+    while (((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+        /* Don't read other descriptor fields before the status. */
+        dma_rmb();
+        
+        addr = rxBufArray[rxNextDescIndex].phyAddr;
+        bufPkt = rxBufArray[rxNextDescIndex].mbuf;
+        pktSize = OSSwapLittleToHostInt16(desc->wb.upper.length);
+        vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.upper.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
+        
+        /* Skip bad packet. */
+        if (status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) {
+            DebugLog("Bad packet.\n");
+            etherStats->dot3StatsEntry.internalMacReceiveErrors++;
+            discardPacketFragment();
+            goto nextDesc;
+        }
+        newPkt = rxPool->replaceOrCopyPacket(&bufPkt, pktSize, &replaced);
+        
+        if (!newPkt) {
+            /* Allocation of a new packet failed so that we must leave the original packet in place. */
+            DebugLog("replaceOrCopyPacket() failed.\n");
+            etherStats->dot3RxExtraEntry.resourceErrors++;
+            discardPacketFragment();
+            goto nextDesc;
+        }
+        
+        /* If the packet was replaced we have to update the descriptor's buffer address. */
+        if (replaced) {
+            if (mbuf_next(bufPkt) != NULL) {
+                DebugLog("getPhysicalSegments() failed.\n");
+                etherStats->dot3RxExtraEntry.resourceErrors++;
+                mbuf_freem_list(bufPkt);
+                discardPacketFragment();
+                goto nextDesc;
+            }
+            rxBufArray[rxNextDescIndex].mbuf = bufPkt;
+            addr = mbuf_data_to_physical(mbuf_datastart(bufPkt));
+            rxBufArray[rxNextDescIndex].phyAddr = addr;
+        }
+        /* Set the length of the buffer. */
         mbuf_setlen(newPkt, pktSize);
 
         if (status & E1000_RXD_STAT_EOP) {
@@ -1306,25 +2210,298 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
         desc->read.buffer_addr = OSSwapHostToLittleInt64(addr);
         desc->read.reserved = 0;
         
-        ++rxNextDescIndex &= kRxDescMask;
+        ++rxNextDescIndex &= rxDescMask;
         desc = &rxDescArray[rxNextDescIndex];
         rxCleanedCount++;
     }
     if (rxCleanedCount >= E1000_RX_BUFFER_WRITE) {
+        dma_wmb();
+        
         /*
          * Prevent the tail from reaching the head in order to avoid a false
          * buffer queue full condition.
          */
         if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-            intelUpdateRxDescTail((rxNextDescIndex - 1) & kRxDescMask);
+            intelUpdateRxDescTail(descPrev(rxNextDescIndex, rxDescMask));
+        else
+            intelWriteMem32(E1000_RDT(0), descPrev(rxNextDescIndex, rxDescMask));
+        
+        rxCleanedCount = 0;
+    }
+    /* Use the remaining budget to top up the buffer pool. */
+    if (goodPkts < maxCount)
+        rxPool->refillNow(maxCount - goodPkts);
+    
+    return goodPkts;
+}
+
+/*
+ * Packet split receive. As packet split is limited to standard frames,
+ * a packet always fits into one descriptor. Like in Linux, the headers
+ * are copied from the driver's header buffer to a small mbuf, so that
+ * the header buffer stays in place. Small payloads are copied too,
+ * larger ones are chained to the headers and their page is replaced.
+ */
+UInt32 IntelMausi::rxInterruptPS(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+{
+    union e1000_rx_desc_packet_split *desc = &rxPSDescArray[rxNextDescIndex];
+    struct MausiRxPSInfo info;
+    mbuf_t bufPkt, newPkt, payload;
+    UInt8 *hdr;
+    UInt32 status;
+    UInt32 goodPkts = 0;
+    UInt32 hdrSize, bufSize, action;
+    bool replaced;
+    
+    while (((status = OSSwapLittleToHostInt32(desc->wb.middle.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+        /* Don't read other descriptor fields before the status. */
+        dma_rmb();
+        
+        rxPSReadWriteBack(desc, status, &info);
+        action = rxPSClassify(&info, kRxPSHdrSize, rxBufferSize);
+        hdr = &rxHdrArray[rxNextDescIndex * kRxPSHdrSize];
+        bufPkt = rxBufArray[rxNextDescIndex].mbuf;
+        hdrSize = info.hdrSize;
+        bufSize = info.bufSize;
+        
+        /* Skip bad packets, packets spanning multiple descriptors and bogus lengths. */
+        if (action == kRxPSDrop) {
+            DebugLog("Bad packet.\n");
+            etherStats->dot3StatsEntry.internalMacReceiveErrors++;
+            goto nextDesc;
+        }
+        if (action == kRxPSWhole) {
+            /* The headers couldn't be split off so that the whole packet is in the page. */
+            newPkt = rxPool->replaceOrCopyPacket(&bufPkt, bufSize, &replaced);
+            
+            if (!newPkt) {
+                DebugLog("replaceOrCopyPacket() failed.\n");
+                etherStats->dot3RxExtraEntry.resourceErrors++;
+                goto nextDesc;
+            }
+            if (replaced) {
+                if (mbuf_next(bufPkt) != NULL) {
+                    DebugLog("getPhysicalSegments() failed.\n");
+                    etherStats->dot3RxExtraEntry.resourceErrors++;
+                    mbuf_freem_list(bufPkt);
+                    goto nextDesc;
+                }
+                rxBufArray[rxNextDescIndex].mbuf = bufPkt;
+                rxBufArray[rxNextDescIndex].phyAddr = mbuf_data_to_physical(mbuf_datastart(bufPkt));
+            }
+            mbuf_setlen(newPkt, bufSize);
+        } else {
+            /* Headers longer than a small mbuf need a cluster. */
+            if (mbuf_gethdr(MBUF_DONTWAIT, MBUF_TYPE_DATA, &newPkt)) {
+                DebugLog("mbuf_gethdr() failed.\n");
+                etherStats->dot3RxExtraEntry.resourceErrors++;
+                goto nextDesc;
+            }
+            if ((hdrSize > mbuf_maxlen(newPkt)) && mbuf_mclget(MBUF_DONTWAIT, MBUF_TYPE_DATA, &newPkt)) {
+                DebugLog("mbuf_mclget() failed.\n");
+                etherStats->dot3RxExtraEntry.resourceErrors++;
+                mbuf_freem(newPkt);
+                goto nextDesc;
+            }
+            bcopy(hdr, mbuf_data(newPkt), hdrSize);
+            mbuf_setlen(newPkt, hdrSize);
+            
+            if (rxPSCopyPayload(&info, kRxPSCopyBreak, (UInt32)mbuf_maxlen(newPkt))) {
+                /* Copy small payloads so that the page stays in place. */
+                if (bufSize)
+                    bcopy(mbuf_data(bufPkt), (UInt8 *)mbuf_data(newPkt) + hdrSize, bufSize);
+                
+                mbuf_setlen(newPkt, hdrSize + bufSize);
+                drvStats[kDrvStatRxSplitCopies]++;
+            } else {
+                payload = bufPkt;
+                bufPkt = rxPool->getPacket(rxBufferSize, MBUF_DONTWAIT);
+                
+                if (!bufPkt) {
+                    /* Leave both original buffers in place. */
+                    DebugLog("getPacket() failed.\n");
+                    etherStats->dot3RxExtraEntry.resourceErrors++;
+                    mbuf_freem(newPkt);
+                    goto nextDesc;
+                }
+                rxBufArray[rxNextDescIndex].mbuf = bufPkt;
+                rxBufArray[rxNextDescIndex].phyAddr = mbuf_data_to_physical(mbuf_datastart(bufPkt));
+
+                mbuf_setlen(payload, bufSize);
+                mbuf_setflags_mask(payload, 0, MBUF_PKTHDR);
+                mbuf_setnext(newPkt, payload);
+                drvStats[kDrvStatRxSplitPackets]++;
+            }
+        }
+        intelGetChecksumResult(newPkt, status);
+        
+        /* Also get the VLAN tag if there is any. */
+        if (info.vlanTag)
+            setVlanTag(newPkt, info.vlanTag);
+        
+        mbuf_pkthdr_setlen(newPkt, hdrSize + bufSize);
+        interface->enqueueInputPacket(newPkt, pollQueue);
+        goodPkts++;
+        
+        /* Finally update the descriptor and get the next one to examine. */
+    nextDesc:
+        rxPSSetDesc(desc, rxHdrPhyAddr + rxNextDescIndex * kRxPSHdrSize, rxBufArray[rxNextDescIndex].phyAddr);
+        
+        ++rxNextDescIndex &= rxDescMask;
+        desc = &rxPSDescArray[rxNextDescIndex];
+        rxCleanedCount++;
+    }
+    if (rxCleanedCount >= E1000_RX_BUFFER_WRITE) {
+        dma_wmb();
+        
+        if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
+            intelUpdateRxDescTail(descPrev(rxNextDescIndex, rxDescMask));
+        else
+            intelWriteMem32(E1000_RDT(0), descPrev(rxNextDescIndex, rxDescMask));
+        
+        rxCleanedCount = 0;
+    }
+    /* Use the remaining budget to top up the buffer pool. */
+    if (goodPkts < maxCount)
+        rxPool->refillNow(maxCount - goodPkts);
+    
+    return goodPkts;
+}
+
+/*
+ * Receive with page flipping. Each descriptor owns a page and receives
+ * into one of its halves. A half is passed upstream without copying and
+ * the descriptor flips to the other half, provided that one has been
+ * released by the stack. Otherwise the descriptor gets another page from
+ * the pool. Only if the pool is empty, the packet is copied into a newly
+ * allocated mbuf and the half stays in place.
+ */
+UInt32 IntelMausi::rxInterruptFlip(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+{
+    union e1000_rx_desc_extended *desc = &rxDescArray[rxNextDescIndex];
+    intelRxPageInfo *info;
+    struct MausiRxPage *page, *newPage;
+    mbuf_t newPkt;
+    UInt32 status;
+    UInt32 goodPkts = 0;
+    UInt32 pktSize;
+    UInt32 copyBreak = (UInt32)mbuf_get_mhlen();
+    UInt16 vlanTag;
+    
+    while (((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+        /* Don't read other descriptor fields before the status. */
+        dma_rmb();
+        
+        info = &rxPageArray[rxNextDescIndex];
+        page = info->page;
+        pktSize = OSSwapLittleToHostInt16(desc->wb.upper.length);
+        vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.upper.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
+        
+        /* Skip bad packets. Standard frames always fit into one buffer. */
+        if ((status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) || !(status & E1000_RXD_STAT_EOP)) {
+            DebugLog("Bad packet.\n");
+            etherStats->dot3StatsEntry.internalMacReceiveErrors++;
+            goto nextDesc;
+        }
+        newPkt = NULL;
+        
+        if (pktSize > copyBreak) {
+            if (rxPagePool->canFlip(page)) {
+                newPkt = rxPagePool->attachHalf(page, info->offset, pktSize);
+                
+                if (newPkt)
+                    info->offset ^= kPageHalfSize;
+                
+            } else if ((newPage = rxPagePool->getPage()) != NULL) {
+                /* The other half is still upstream so that we need another page. */
+                newPkt = rxPagePool->attachHalf(page, info->offset, pktSize);
+                
+                if (newPkt) {
+                    rxPagePool->putPage(page);
+                    info->page = newPage;
+                    info->offset = 0;
+                } else {
+                    rxPagePool->putPage(newPage);
+                }
+            }
+            if (newPkt) {
+                rxBufArray[rxNextDescIndex].phyAddr = info->page->phyAddr + info->offset;
+                drvStats[kDrvStatRxRecycleHits]++;
+            } else {
+                drvStats[kDrvStatRxFallbackAllocs]++;
+            }
+        }
+        if (!newPkt) {
+            /* Copy the packet and leave the buffer in place. */
+            newPkt = rxPool->getPacket(pktSize, MBUF_DONTWAIT);
+            
+            if (!newPkt) {
+                DebugLog("getPacket() failed.\n");
+                etherStats->dot3RxExtraEntry.resourceErrors++;
+                goto nextDesc;
+            }
+            bcopy(page->addr + info->offset, mbuf_data(newPkt), pktSize);
+            mbuf_setlen(newPkt, pktSize);
+            mbuf_pkthdr_setlen(newPkt, pktSize);
+        }
+        intelGetChecksumResult(newPkt, status);
+        
+        /* Also get the VLAN tag if there is any. */
+        if (vlanTag)
+            setVlanTag(newPkt, vlanTag);
+        
+        interface->enqueueInputPacket(newPkt, pollQueue);
+        goodPkts++;
+        
+        /* Finally update the descriptor and get the next one to examine. */
+    nextDesc:
+        desc->read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[rxNextDescIndex].phyAddr);
+        desc->read.reserved = 0;
+        
+        ++rxNextDescIndex &= rxDescMask;
+        desc = &rxDescArray[rxNextDescIndex];
+        rxCleanedCount++;
+    }
+    if (rxCleanedCount >= E1000_RX_BUFFER_WRITE) {
+        dma_wmb();
+        
+        if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
+            intelUpdateRxDescTail(descPrev(rxNextDescIndex, rxDescMask));
         else
-            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & kRxDescMask);
+            intelWriteMem32(E1000_RDT(0), descPrev(rxNextDescIndex, rxDescMask));
         
         rxCleanedCount = 0;
     }
+    /* Use the remaining budget to top up the buffer pool. */
+    if (goodPkts < maxCount)
+        rxPool->refillNow(maxCount - goodPkts);
+    
     return goodPkts;
 }
 
+/*
+ * Write the buffer addresses to the receive ring using the descriptor
+ * layout of the current mode. With packet split enabled, the ring is
+ * large enough for either layout.
+ */
+void IntelMausi::rxPSInitDescriptors()
+{
+    union e1000_rx_desc_packet_split *desc;
+    UInt32 i;
+    
+    if (rxPSMode) {
+        for (i = 0; i < numRxDesc; i++) {
+            desc = &rxPSDescArray[i];
+            rxPSSetDesc(desc, rxHdrPhyAddr + i * kRxPSHdrSize, rxBufArray[i].phyAddr);
+        }
+    } else {
+        for (i = 0; i < numRxDesc; i++) {
+            rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[i].phyAddr);
+            rxDescArray[i].read.reserved = 0;
+        }
+    }
+}
+
 void IntelMausi::checkLinkStatus()
 {
 	struct e1000_hw *hw = &adapterData.hw;
@@ -1380,7 +2557,12 @@ void IntelMausi::interruptOccurred(OSObject *client, IOInterruptEventSource *src
         }
 
         if (icr & (E1000_ICR_RXQ0 | E1000_ICR_RXT0 | E1000_ICR_RXDMT0)) {
-            packets = rxInterrupt(netif, kNumRxDesc, NULL, NULL);
+            if (rxPSMode)
+                packets = rxInterruptPS(netif, numRxDesc, NULL, NULL);
+            else if (rxFlipMode)
+                packets = rxInterruptFlip(netif, numRxDesc, NULL, NULL);
+            else
+                packets = rxInterrupt(netif, numRxDesc, NULL, NULL);
             etherStats->dot3RxExtraEntry.interrupts++;
 
             if (packets)
@@ -1434,6 +2616,10 @@ void IntelMausi::pollInputPackets(IONetworkInterface *interface, uint32_t maxCou
     if (polling) {
         if (useAppleVTD)
             rxInterruptVTD(interface, maxCount, pollQueue, context);
+        else if (rxPSMode)
+            rxInterruptPS(interface, maxCount, pollQueue, context);
+        else if (rxFlipMode)
+            rxInterruptFlip(interface, maxCount, pollQueue, context);
         else
             rxInterrupt(interface, maxCount, pollQueue, context);
         
@@ -1630,6 +2816,9 @@ void IntelMausi::setLinkUp()
     netif->setPacketPollingParameters(&pollParams, 0);
     DebugLog("pollIntervalTime: %lluus\n", (pollParams.pollIntervalTime / 1000));
 
+    bqlSetup(&txByteLimit, adapterData.link_speed, mtu + ETH_HLEN + ETH_FCS_LEN);
+    DebugLog("Tx byte limit: %u [%u; %u]\n", txByteLimit.limit, txByteLimit.min, txByteLimit.max);
+    
     /* Start output thread, statistics update and watchdog. */
     netif->startOutputThread();
     IOLog("Link up on en%u, %s, %s, %s%s\n", netif->getUnitNumber(), speedName, duplexName, flowName, eeeName);
@@ -1944,6 +3133,15 @@ void IntelMausi::timerAction(IOTimerEventSource *timer)
 
         eeeMode = 0;
     }
+    if (txByteLimitMode)
+        bqlUpdate(&txByteLimit, true);
+    
+    if (pktGen.active)
+        pktGenCheckDone();
+    
+    /* Adapt the receive buffer pool to the demand of the last period. */
+    rxPool->updateCapacity();
+    
     updateStatistics(&adapterData);
     timerSource->setTimeoutMS(kTimeoutMS);
     
@@ -2031,6 +3229,8 @@ void IntelMausi::updateStatistics(struct e1000_adapter *adapter)
     etherStats->dot3StatsEntry.missedFrames = (UInt32)adapter->stats.mpc;
     
     etherStats->dot3RxExtraEntry.frameTooShorts = (UInt32)adapter->stats.ruc;
+    
+    updateDriverStats();
 }
 
 bool IntelMausi::checkForDeadlock()
@@ -2044,9 +3244,9 @@ bool IntelMausi::checkForDeadlock()
         eeeMode = 0;
     }
     
-    if ((txDescDoneCount == txDescDoneLast) && (txNumFreeDesc < kNumTxDesc)) {
+    if ((txDescDoneCount == txDescDoneLast) && (txNumFreeDesc < (SInt32)numTxDesc)) {
         if (++deadlockWarn >= kTxDeadlockTreshhold) {
-            mbuf_t m = txBufArray[txDirtyIndex].mbuf;
+            mbuf_t m = (txInflightHead != txInflightTail) ? txInflight.mbuf[txInflightHead] : NULL;
             UInt32 pktSize;
             UInt16 index;
             
@@ -2060,9 +3260,9 @@ bool IntelMausi::checkForDeadlock()
 
 #ifdef DEBUG
             for (i = 0; i < 30; i++) {
-                index = ((stalledIndex - 20 + i) & kTxDescMask);
+                index = ((stalledIndex - 20 + i) & txDescMask);
 
-                IOLog("desc[%u]: lower=0x%08x, upper=0x%08x, addr=0x%016llx, mbuf=0x%016llx, len=%u.\n", index, txDescArray[index].lower.data, txDescArray[index].upper.data, txDescArray[index].buffer_addr, (UInt64)txBufArray[index].mbuf, txBufArray[index].pad);
+                IOLog("desc[%u]: lower=0x%08x, upper=0x%08x, addr=0x%016llx.\n", index, txDescArray[index].lower.data, txDescArray[index].upper.data, txDescArray[index].buffer_addr);
             }
 #endif
             if (m) {
@@ -2087,64 +3287,90 @@ bool IntelMausi::checkForDeadlock()
 
 #pragma mark --- TSO support functions ---
 
-static errno_t prepareTSO4(mbuf_t m, UInt32 *mssHeaderSize, UInt32 *payloadSize)
+/*
+ * Make sure that the headers of a TSO packet are contiguous in the first
+ * mbuf before they are accessed. Note that mbuf_pullup() frees the
+ * packet in case it fails.
+ */
+static errno_t pullupTSOHeader(mbuf_t *mp, UInt32 l4Offset, UInt32 *hdrLen)
 {
-    struct iphdr *ipHdr = (struct iphdr *)((UInt8 *)mbuf_data(m) + ETHER_HDR_LEN);
-    struct tcphdr *tcpHdr = (struct tcphdr *)((UInt8 *)ipHdr + sizeof(struct iphdr));
-    UInt16 *addr = (UInt16 *)&ipHdr->saddr;
-    UInt32 csum32 = 6;
-    UInt32 plen = (UInt32)mbuf_pkthdr_len(m);
-    UInt32 hlen = (tcpHdr->th_off << 2) + kMinL4HdrOffsetV4;
-    int i;
+    struct tcphdr *tcpHdr;
+    UInt32 hlen = l4Offset + sizeof(struct tcphdr);
+    errno_t err = 0;
     
-    ipHdr->tot_len = 0;
+    if (mbuf_len(*mp) < hlen) {
+        err = mbuf_pullup(mp, hlen);
+        
+        if (err)
+            goto done;
+    }
+    tcpHdr = (struct tcphdr *)((UInt8 *)mbuf_data(*mp) + l4Offset);
+    hlen = l4Offset + (tcpHdr->th_off << 2);
+    
+    if (mbuf_len(*mp) < hlen)
+        err = mbuf_pullup(mp, hlen);
 
-    for (i = 0; i < 4; i++) {
-        csum32 += ntohs(*addr++);
-        csum32 += (csum32 >> 16);
-        csum32 &= 0xffff;
+done:
+    if (err) {
+        DebugLog("mbuf_pullup(%u) failed: %d\n", hlen, err);
     }
-    tcpHdr->th_sum = htons((UInt16)csum32);
+    *hdrLen = hlen;
+    
+    return err;
+}
+
+static errno_t prepareTSO4(mbuf_t *mp, UInt32 l3Offset, UInt32 l4Offset, UInt32 *mssHeaderSize, UInt32 *payloadSize)
+{
+    struct iphdr *ipHdr;
+    struct tcphdr *tcpHdr;
+    UInt32 hlen;
+    errno_t err;
+    
+    err = pullupTSOHeader(mp, l4Offset, &hlen);
+    
+    if (err)
+        goto done;
+    
+    ipHdr = (struct iphdr *)((UInt8 *)mbuf_data(*mp) + l3Offset);
+    tcpHdr = (struct tcphdr *)((UInt8 *)mbuf_data(*mp) + l4Offset);
+    
+    ipHdr->tot_len = 0;
+    tcpHdr->th_sum = htons(foldSum(gsoAddrSum((const UInt8 *)&ipHdr->saddr, 8) + IPPROTO_TCP));
     
     wmb();
     
     *mssHeaderSize = ((*mssHeaderSize << 16) | (hlen << 8));
-    *payloadSize = plen - hlen;
-        
-    i = mbuf_pullup(&m, 16);
-    
-    if (i) {
-        DebugLog("tcp_len(): %d, mbuf_pullup(): %d \n", (int)(tcpHdr->th_off << 2), i);
-    }
+    *payloadSize = (UInt32)mbuf_pkthdr_len(*mp) - hlen;
 
-    return i;
+done:
+    return err;
 }
 
-static errno_t prepareTSO6(mbuf_t m, UInt32 *mssHeaderSize, UInt32 *payloadSize)
+static errno_t prepareTSO6(mbuf_t *mp, UInt32 l3Offset, UInt32 l4Offset, UInt32 *mssHeaderSize, UInt32 *payloadSize)
 {
-    struct ip6_hdr *ip6Hdr = (struct ip6_hdr *)((UInt8 *)mbuf_data(m) + ETHER_HDR_LEN);
-    struct tcphdr *tcpHdr = (struct tcphdr *)((UInt8 *)ip6Hdr + sizeof(struct ip6_hdr));
-    UInt16 *addr = (UInt16 *)&ip6Hdr->ip6_src;
-    UInt32 csum32 = 6;
-    UInt32 hlen = (tcpHdr->th_off << 2) + kMinL4HdrOffsetV6;
-    UInt32 i;
+    struct ip6_hdr *ip6Hdr;
+    struct tcphdr *tcpHdr;
+    UInt32 hlen;
+    errno_t err;
+    
+    err = pullupTSOHeader(mp, l4Offset, &hlen);
+    
+    if (err)
+        goto done;
+    
+    ip6Hdr = (struct ip6_hdr *)((UInt8 *)mbuf_data(*mp) + l3Offset);
+    tcpHdr = (struct tcphdr *)((UInt8 *)mbuf_data(*mp) + l4Offset);
     
     ip6Hdr->ip6_ctlun.ip6_un1.ip6_un1_plen = 0;
 
-    for (i = 0; i < 16; i++) {
-        csum32 += ntohs(*addr++);
-        csum32 += (csum32 >> 16);
-        csum32 &= 0xffff;
-    }
     /* Fill in the pseudo header checksum for TSOv6. */
-    tcpHdr->th_sum = htons((UInt16)csum32);
+    tcpHdr->th_sum = htons(foldSum(gsoAddrSum((const UInt8 *)&ip6Hdr->ip6_src, 32) + IPPROTO_TCP));
 
     wmb();
     
     *mssHeaderSize = ((*mssHeaderSize << 16) | (hlen << 8));
-    *payloadSize = (UInt32)mbuf_pkthdr_len(m) - hlen;
+    *payloadSize = (UInt32)mbuf_pkthdr_len(*mp) - hlen;
     
-    i = mbuf_pullup(&m, 16);
-    
-    return i;
+done:
+    return err;
 }
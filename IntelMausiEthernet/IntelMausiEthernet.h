@@ -19,11 +19,21 @@
  */
 
 #include "MausiRxPool.hpp"
+#include "MausiPagePool.hpp"
+#include "MausiGSO.hpp"
+#include "MausiFQCoDel.hpp"
 
 extern "C" {
     #include "e1000.h"
 }
 
+#include "MausiTxDesc.hpp"
+#include "MausiDescRing.hpp"
+#include "MausiTxSched.hpp"
+#include "MausiTxMapCache.hpp"
+#include "MausiPktGen.hpp"
+#include "MausiRxDesc.hpp"
+
 #ifdef DEBUG
 #define DebugLog(args...) IOLog(args)
 #else
@@ -84,50 +94,81 @@ enum {
 /* With up to 32 segments we should be on the save side. */
 #define kMaxSegs 32
 
-/* The number of descriptors must be a power of 2. */
-#define kNumTxDesc      512    /* Number of Tx descriptors */
-#define kNumRxDesc      512     /* Number of Rx descriptors */
-#define kTxLastDesc    (kNumTxDesc - 1)
-#define kRxLastDesc    (kNumRxDesc - 1)
-#define kTxDescMask    (kNumTxDesc - 1)
-#define kRxDescMask    (kNumRxDesc - 1)
-#define kTxDescSize    (kNumTxDesc*sizeof(struct e1000_data_desc))
-#define kRxDescSize    (kNumRxDesc*sizeof(union e1000_rx_desc_extended))
-#define kRxBufArraySize (kNumRxDesc * sizeof(intelRxBufferInfo))
-#define kTxBufArraySize (kNumTxDesc * sizeof(intelTxBufferInfo))
-
-/* Numbers of IOMemoryDescriptors and IORanges for tx */
-#define kNumTxMemDesc       (kNumTxDesc / 2)
-#define kTxMemDescMask      (kNumTxMemDesc - 1)
-#define kNumTxRanges        (kNumTxDesc + kMaxSegs)
-#define kTxRangeMask        kTxDescMask
-#define kTxMapMemSize       sizeof(struct intelTxMapInfo)
-
-/* Numbers of IOMemoryDescriptors and batch size for rx */
+/* Maximum number of packets dequeued at once in outputStart(). */
+#define kTxBatchSize 32
+
+#define kTxDescSize(n)  ((n) * sizeof(struct e1000_data_desc))
+#define kRxDescSize(n)  ((n) * sizeof(union e1000_rx_desc_extended))
+#define kRxPSDescSize(n)    ((n) * sizeof(union e1000_rx_desc_packet_split))
+#define kRxBufArraySize(n) ((n) * sizeof(intelRxBufferInfo))
+#define kTxInflightSize(n)    ((n) * (sizeof(mbuf_t) + sizeof(UInt32) + 3 * sizeof(UInt16)))
+
+/* Tx bounce buffers for small packets, one per descriptor. */
+#define kTxBounceBufSize    256
+#define kTxBounceSize(n)    ((n) * kTxBounceBufSize)
+#define kTxCopyBreakDefault 128
+
+/* Request a status report every n packets by default. */
+#define kTxReportIntervalDefault    1
+
+/*
+ * Limit of a data descriptor built from merged segments, like Linux'
+ * E1000_MAX_PER_TXD. Safe TSO still splits them at kSafeTSOMaxPerDesc.
+ */
+#define kTxMaxMergedSegSize 8192
+
+/*
+ * Numbers of IOMemoryDescriptors and IORanges for tx with n descriptors.
+ * The arrays are allocated together with the map info.
+ */
+#define kNumTxMemDesc(n)    ((n) / 2)
+#define kNumTxRanges(n)     ((n) + kMaxSegs)
+#define kTxMapMemSize(n)    (sizeof(struct intelTxMapInfo) + kNumTxRanges(n) * sizeof(IOAddressRange) + kNumTxMemDesc(n) * sizeof(IOMemoryDescriptor *))
+
+/*
+ * Cache of IOMMU mapped pages for tx with n descriptors and c pages.
+ * Each IOMemoryDescriptor slot records the cache entries its packet
+ * holds, the first element being their number.
+ */
+#define kTxMapCacheDefault  0
+#define kTxMapCacheMin      64
+#define kTxMapCacheMax      4096
+#define kTxMapCacheRefs     (kMaxSegs + 1)
+#define kTxMapCacheMemSize(n, c)    (sizeof(struct intelTxMapCache) + (c) * sizeof(struct intelTxMapCacheEntry) + kTxMapCacheBuckets * sizeof(UInt16) + kNumTxMemDesc(n) * kTxMapCacheRefs * sizeof(UInt16))
+
+/* Numbers of IOMemoryDescriptors and batch size for rx with n descriptors */
 #define kRxMemBaseShift 4
-#define kNumRxMemDesc   (kNumRxDesc >> kRxMemBaseShift)
-#define kRxMapMemSize   (sizeof(struct intelRxMapInfo))
-#define kRxMemBatchSize (kNumRxDesc / kNumRxMemDesc)
+#define kNumRxMemDesc(n)    ((n) >> kRxMemBaseShift)
+#define kRxMapMemSize(n)    (sizeof(struct intelRxMapInfo) + (n) * sizeof(IOAddressRange) + kNumRxMemDesc(n) * sizeof(IOMemoryDescriptor *))
+#define kRxMemBatchSize (1 << kRxMemBaseShift)
 #define kRxMemDescMask  (kRxMemBatchSize - 1)
 #define kRxMemBaseMask  ~kRxMemDescMask
 
-/* This is the receive buffer size (must be large enough to hold a packet). */
-#define kRxBufferSize   PAGE_SIZE
+/*
+ * Packet split receive: the headers go to a small buffer and the payload
+ * to a page. The header buffers are owned by the driver and the headers
+ * are copied to a small mbuf. Payloads up to kRxPSCopyBreak are copied
+ * too, so that the page can be reused.
+ */
+#define kRxPSHdrSize    256     /* multiple of 128 */
+#define kRxPSCopyBreak  256
+#define kRxPSHdrArraySize(n)    ((n) * kRxPSHdrSize)
+
+/* Spare pages for page flipping, in addition to one page per descriptor. */
+#define kRxFlipSpares(n)    ((n) >> 1)
+
 #define kMCFilterLimit  32
 #define kMaxRxQueques   1
 #define kMaxMtu         9000
 #define kMaxPacketSize  (kMaxMtu + ETH_HLEN + ETH_FCS_LEN)
 
-/* MausiRxPool capacities */
-#define kRxPoolClstCap   100    /* mbufs with 4k cluster*/
+/* Initial MausiRxPool capacities, which adapt to the demand at runtime. */
+#define kRxPoolClstCap   100    /* mbufs with a cluster of rxBufferSize */
 #define kRxPoolMbufCap   50     /* mbufs without clusters */
 
 /* statitics timer period in ms. */
 #define kTimeoutMS 1000
 
-/* Treshhold value to wake a stalled queue */
-#define kTxQueueWakeTreshhold (kNumTxDesc / 8)
-
 /* transmitter deadlock treshhold in seconds. */
 #define kTxDeadlockTreshhold 2
 
@@ -138,30 +179,6 @@ enum {
 #define kMinL4HdrOffsetV4 34
 #define kMinL4HdrOffsetV6 54
 
-#define kIPv4CSumStart      ETH_HLEN
-#define kIPv4CSumOffset     (offsetof(struct iphdr, check) + kIPv4CSumStart)
-#define kIPv4CSumEnd        (sizeof(struct iphdr) + kIPv4CSumStart - 1)
-
-#define kUDPv4CSumStart     kMinL4HdrOffsetV4
-#define kUDPv4CSumOffset    (offsetof(struct udphdr, uh_sum) + kMinL4HdrOffsetV4)
-#define kUDPv4CSumEnd       0
-
-#define kTCPv4CSumStart     kMinL4HdrOffsetV4
-#define kTCPv4CSumOffset    (offsetof(struct tcphdr, th_sum) + kMinL4HdrOffsetV4)
-#define kTCPv4CSumEnd       0
-
-#define kIPv6CSumStart      ETH_HLEN
-#define kIPv6CSumOffset     0
-#define kIPv6CSumEnd        0
-
-#define kTCPv6CSumStart     kMinL4HdrOffsetV6
-#define kTCPv6CSumOffset    (offsetof(struct tcphdr, th_sum) + kMinL4HdrOffsetV6)
-#define kTCPv6CSumEnd       0
-
-#define kUDPv6CSumStart     kMinL4HdrOffsetV6
-#define kUDPv6CSumOffset    (offsetof(struct udphdr, uh_sum) + kMinL4HdrOffsetV6)
-#define kUDPv6CSumEnd       0
-
 #define SPEED_MODE_BIT (1 << 21)
 #define E1000_TARC_QUEUE_EN   0x00000400
 
@@ -195,9 +212,6 @@ enum {
 #define E1000_TX_FLAGS_VLAN_MASK	0xffff0000
 #define E1000_TX_FLAGS_VLAN_SHIFT	16
 
-#define E1000_TXD_OPTS_IXSM     0x00000100
-#define E1000_TXD_OPTS_TXSM     0x00000200
-
 #define E1000_RCTL_FLXB_SHIFT   27
 
 #define E1000_ICR_TXQE          0x00000002      /* Transmit queue empty */
@@ -252,9 +266,14 @@ enum
 };
 
 #define kParamName "Driver Parameters"
+#define kCachedRingsName "cachedRings"
 #define kEnableTSO4Name "enableTSO4"
 #define kEnableTSO6Name "enableTSO6"
 #define kEnableCSO6Name "enableCSO6"
+#define kEnableFQCoDelName "enableFQCoDel"
+#define kEnablePktGenName "enablePktGen"
+#define kEnableSafeTSOName "enableSafeTSO"
+#define kEnableSoftTSOName "enableSoftTSO"
 #define kEnableWoMName "enableWakeOnAddrMatch"
 #define kEnableWakeS5Name "enableWakeS5"
 #define kIntrRate10Name "maxIntrRate10"
@@ -271,6 +290,85 @@ enum
 #define kRxDelayTime100Name "rxDelayTime100"
 #define kRxDelayTime1000Name "rxDelayTime1000"
 
+#define kTxCopyBreakName "txCopyBreak"
+#define kTxReportIntervalName "txReportInterval"
+#define kTxHeadCompletionName "txHeadCompletion"
+#define kTxRingSizeName "txRingSize"
+#define kTxPriorityName "txServiceClassPriority"
+#define kTxByteLimitsName "txByteLimits"
+#define kTxMapCacheSizeName "txMapCacheSize"
+#define kRxPacketSplitName "rxPacketSplit"
+#define kRxPageFlipName "rxPageFlip"
+#define kRxRingSizeName "rxRingSize"
+
+#define kDriverStatsName "DriverStatistics"
+
+/* Packet generator control and results. */
+#define kPktGenName "PktGen"
+#define kPktGenResultsName "PktGenResults"
+#define kPktGenCountName "count"
+#define kPktGenMinSizeName "minSize"
+#define kPktGenMaxSizeName "maxSize"
+#define kPktGenVlanTagName "vlanTag"
+#define kPktGenChecksumName "checksumOffload"
+
+/* Driver internal statistics published in the I/O registry. */
+enum
+{
+    kDrvStatTxContextsEmitted = 0,
+    kDrvStatTxContextsSkipped,
+    kDrvStatTxCopiedPackets,
+    kDrvStatTxSoftTSOPackets,
+    kDrvStatTxSoftTSOSegments,
+    kDrvStatTxSafeTSOPackets,
+    kDrvStatTxSafeTSOChunks,
+    kDrvStatTxSafeTSOSoftSegments,
+    kDrvStatTxSegmentedParts,
+    kDrvStatTxStatusReports,
+    kDrvStatTxCompletionPasses,
+    kDrvStatTxCompletedPackets,
+    kDrvStatTxHeadReads,
+    kDrvStatTxPriorityPackets,
+    kDrvStatTxBulkDeferred,
+    kDrvStatTxByteLimitStalls,
+    kDrvStatTxInflightBytes,
+    kDrvStatTxByteLimit,
+    kDrvStatTxFQCoDelDrops,
+    kDrvStatTxFQOverlimitDrops,
+    kDrvStatTxFQBacklog,
+    kDrvStatTxMapCacheHits,
+    kDrvStatTxMapCacheMisses,
+    kDrvStatTxMapCacheEvictions,
+    kDrvStatTxMergedSegments,
+    kDrvStatTxQueueStalls,
+    kDrvStatTxQueueWakes,
+    kDrvStatTxFreeBatches,
+    kDrvStatTxFreedPackets,
+    kDrvStatTxMaxFreeBatch,
+    kDrvStatTxCsumOtherLayout,
+    kDrvStatTxCsumParseErrors,
+    kDrvStatTxSoftChecksums,
+    kDrvStatPktGenAllocFailures,
+    kDrvStatRxSplitPackets,
+    kDrvStatRxSplitCopies,
+    kDrvStatRxRecycleHits,
+    kDrvStatRxFallbackAllocs,
+    kDrvStatRxPoolMbufs,        /* depth of the rx buffer pool */
+    kDrvStatRxPoolMbufLowWater,
+    kDrvStatRxPoolMbufCapacity,
+    kDrvStatRxPoolClusters,
+    kDrvStatRxPoolClusterLowWater,
+    kDrvStatRxPoolClusterCapacity,
+    kDrvStatTxSegs1,            /* histogram of data descriptors per packet */
+    kDrvStatTxSegs2,
+    kDrvStatTxSegs3,
+    kDrvStatTxSegs4,
+    kDrvStatTxSegs5to8,
+    kDrvStatTxSegs9to16,
+    kDrvStatTxSegs17up,
+    kDrvStatCount
+};
+
 struct intelDevice {
     UInt16 pciDevId;
     UInt16 device;
@@ -280,17 +378,54 @@ struct intelDevice {
 
 #define kInvalidRingIndex 0xffffffff;
 
-typedef struct intelTxBufferInfo {
-    mbuf_t mbuf;
-    UInt32 numDescs;
-    UInt32 pad;
-} intelTxBufferInfo;
+/*
+ * Queue of the packets in flight in the order they have been posted,
+ * one entry per packet or per unit of a packet segmented in software.
+ * The fields are kept in separate arrays so that finding completed
+ * packets touches only the compact eopIndex and flags arrays. The mbuf
+ * is NULL in case the packet has been copied to a bounce buffer and
+ * for all but the last unit of a segmented packet.
+ */
+typedef struct intelTxInflight {
+    mbuf_t *mbuf;
+    UInt32 *bytes;
+    UInt16 *eopIndex;   /* last descriptor of the packet */
+    UInt16 *numDescs;
+    UInt16 *flags;
+} intelTxInflight;
+
+enum
+{
+    kTxBufFlagMapped = 0x0001,  /* packet has to be unmapped (AppleVTD) */
+    kTxBufFlagReport = 0x0002,  /* RS bit set in the last descriptor */
+    kTxBufFlagBulk = 0x0004,    /* descriptors count against txBulkLimit */
+    kTxBufFlagPktGen = 0x0008,  /* built by the packet generator */
+};
+
+/*
+ * A TSO packet which is segmented by the driver and posted in several
+ * parts because it doesn't fit into the free descriptors at once.
+ */
+typedef struct intelTxGSOState {
+    struct MausiGSOInfo info;
+    IOPhysicalSegment segs[kMaxSegs];
+    UInt32 numSegs;
+    UInt32 nextSeg;     /* first segment not posted yet, 0 if none */
+    UInt32 needDescs;   /* free descriptors needed for the next part */
+    UInt16 bufFlags;
+    UInt8 hdr[kGSOMaxHdrLen];
+} intelTxGSOState;
 
 typedef struct intelRxBufferInfo {
     mbuf_t mbuf;
     IOPhysicalAddress64 phyAddr;
 } intelRxBufferInfo;
 
+typedef struct intelRxPageInfo {
+    struct MausiRxPage *page;
+    UInt32 offset;      /* half of the page in use */
+} intelRxPageInfo;
+
 /*
  * Indicates if a tx IOMemoryDescriptor is in the prepared
  * (active) or completed state (inactive).
@@ -305,14 +440,14 @@ typedef struct intelTxMapInfo {
     UInt16 txNextMem2Use;
     UInt16 txNextMem2Free;
     SInt16 txNumFreeMem;
-    IOMemoryDescriptor *txMemIO[kNumTxMemDesc];
-    IOAddressRange txMemRange[kNumTxRanges];
+    IOMemoryDescriptor **txMemIO;
+    IOAddressRange *txMemRange;
     IOAddressRange txSCRange[kMaxSegs];
 } intelTxMapInfo;
 
 typedef struct intelRxMapInfo {
-    IOMemoryDescriptor *rxMemIO[kNumRxMemDesc];
-    IOAddressRange rxMemRange[kNumRxDesc];
+    IOMemoryDescriptor **rxMemIO;
+    IOAddressRange *rxMemRange;
 } intelRxMapInfo;
 
 struct IntelRxDesc {
@@ -421,6 +556,9 @@ public:
     virtual UInt32 getFeatures() const override;
     virtual IOReturn getMaxPacketSize(UInt32 * maxSize) const override;
     virtual IOReturn setMaxPacketSize(UInt32 maxSize) override;
+    
+    /* Start the packet generator. */
+    virtual IOReturn setProperties(OSObject *properties) override;
 
 private:
     bool initPCIConfigSpace(IOPCIDevice *provider);
@@ -430,20 +568,55 @@ private:
     static IOReturn setPowerStateSleepAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
     void getParams();
     bool setupMediumDict();
+    bool setupDriverStats();
+    void updateDriverStats();
     bool initEventSources(IOService *provider);
     void interruptOccurred(OSObject *client, IOInterruptEventSource *src, int count);
     void interruptOccurredVTD(OSObject *client, IOInterruptEventSource *src, int count);
+    void txReclaimPackets(UInt16 endIndex);
     void txInterrupt();
     
     UInt32 rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context);
     UInt32 rxInterruptVTD(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context);
+    UInt32 rxInterruptPS(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context);
+    void rxPSInitDescriptors();
+    bool rxPSSetupHdrBuffers();
+    void rxPSFreeHdrBuffers();
+    UInt32 rxInterruptFlip(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context);
+
+    bool txContextCached(UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss);
+    void txWriteContext(UInt32 index, UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss);
+    UInt32 txFinishPacket(UInt32 index, mbuf_t m, UInt32 numDescs, UInt16 flags);
+    bool txDequeueByServiceClass(IONetworkInterface *interface, UInt32 maxCount);
+    bool txDequeueFromFQ(IONetworkInterface *interface, UInt32 maxCount);
+    void txGetHeaderOffsets(mbuf_t m, UInt8 type, UInt8 proto, UInt32 *l3Offset, UInt32 *l4Offset);
+    IOReturn txPrepareChecksum(mbuf_t m, UInt32 flags, UInt32 csumOffset, UInt32 *ipConfig, UInt32 *tcpConfig, UInt32 *cmdLength, UInt32 *word2);
+    bool txByteLimitReached();
+    bool txStallQueue(UInt32 numDescs);
+    IOReturn txSegmentPacket(mbuf_t m, UInt32 mss, bool hwTSO);
+
+    static IOReturn pktGenStartAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
+    IOReturn pktGenStart(OSDictionary *params);
+    mbuf_t pktGenBuildPacket(UInt32 size);
+    bool pktGenDequeue(UInt32 maxCount);
+    void pktGenComplete(UInt16 slot);
+    void pktGenCheckDone();
 
     UInt32 txMapPacket(mbuf_t packet, IOPhysicalSegment *vector, UInt32 maxSegs);
     void txUnmapPacket();
+    bool setupTxMapCache();
+    void freeTxMapCache();
+    void txMapCacheFlush();
+    void txMapCacheRelease();
+    UInt16 txMapCacheGet(IOVirtualAddress page, IOPhysicalAddress64 phys);
     UInt16 rxMapBuffers(UInt16 index, UInt16 count, bool update);
 
     bool setupRxResources();
     void freeRxResources();
+    UInt32 rxBufferSizeForMtu(UInt32 newMtu);
+    bool rxResizeBuffers(UInt32 size);
+    bool rxFlipBindPages();
+    void rxFlipUnbindPages();
     bool setupTxResources();
     void freeTxResources();
 
@@ -536,29 +709,77 @@ private:
     IOPhysicalAddress64 txPhyAddr;
     struct e1000_data_desc *txDescArray;
     IOMbufNaturalMemoryCursor *txMbufCursor;
-    void *txBufArrayMem;
-    intelTxBufferInfo *txBufArray;
+    void *txInflightMem;
+    intelTxInflight txInflight;
+    UInt16 txInflightHead;
+    UInt16 txInflightTail;
     intelTxMapInfo *txMapInfo;
     void *txMapMem;
+    intelTxMapCache *txMapCache;
+    void *txMapCacheMem;
+    UInt32 txMapCacheSize;
     UInt64 txDescDoneCount;
     UInt64 txDescDoneLast;
     SInt32 txNumFreeDesc;
     UInt32 mtu;
     UInt32 maxLatency;
+    UInt32 numTxDesc;
+    UInt32 txDescMask;
+    UInt32 numTxMemDesc;
+    UInt32 txMemDescMask;
+    SInt32 txWakeThreshold;
+    volatile SInt32 txStallDescs;
     UInt16 txNextDescIndex;
     UInt16 txDirtyIndex;
     UInt16 txCleanBarrierIndex;
+    struct MausiTxContext txLastContext;
+    IODMACommand *txBounceDmaCmd;
+    IOBufferMemoryDescriptor *txBounceBufDesc;
+    IOPhysicalAddress64 txBouncePhyAddr;
+    UInt8 *txBounceArray;
+    UInt32 txCopyBreak;
+    UInt32 txReportInterval;
+    UInt32 txUnreportedPkts;
+    UInt16 txLastEOPIndex;
+    bool txHeadCompletion;
+    bool txPriorityMode;
+    UInt32 txBulkLimit;
+    SInt32 txBulkDescs;
+    UInt16 txPktFlags;
+    UInt32 txPktBytes;
+    bool txByteLimitMode;
+    struct MausiByteLimit txByteLimit;
+    MausiFQCoDel *txFQ;
+    bool txFQMode;
+    intelPktGen pktGen;
+    bool pktGenEnabled;
+    mbuf_t txPendingPkt;
+    intelTxGSOState txGSO;
+    mbuf_t txFreeHead;
+    mbuf_t txFreeTail;
+    UInt32 txFreeCount;
     
     /* receiver data */
     IODMACommand *rxDescDmaCmd;
     IOBufferMemoryDescriptor *rxBufDesc;
     IOPhysicalAddress64 rxPhyAddr;
     union e1000_rx_desc_extended *rxDescArray;
+    union e1000_rx_desc_packet_split *rxPSDescArray;
     MausiRxPool *rxPool;
     intelRxBufferInfo *rxBufArray;
+    IODMACommand *rxHdrDmaCmd;
+    IOBufferMemoryDescriptor *rxHdrBufDesc;
+    IOPhysicalAddress64 rxHdrPhyAddr;
+    UInt8 *rxHdrArray;
+    MausiPagePool *rxPagePool;
+    intelRxPageInfo *rxPageArray;
     void *rxBufArrayMem;
     void *rxMapMem;
     intelRxMapInfo *rxMapInfo;
+    UInt32 numRxDesc;
+    UInt32 rxDescMask;
+    UInt32 rxBufferSize;
+    UInt32 numRxMemDesc;
     mbuf_t rxPacketHead;
     mbuf_t rxPacketTail;
     UInt32 rxPacketSize;
@@ -567,6 +788,10 @@ private:
     UInt16 rxNextDescIndex;
     UInt16 rxMapNextIndex;
     UInt16 rxCleanedCount;
+    bool rxPSEnabled;
+    bool rxPSMode;
+    bool rxFlipEnabled;
+    bool rxFlipMode;
     
     /* power management data */
     unsigned long powerState;
@@ -575,6 +800,9 @@ private:
     UInt32 deadlockWarn;
     IONetworkStats *netStats;
 	IOEthernetStats *etherStats;
+    OSDictionary *drvStatsDict;
+    OSNumber *drvStatsNum[kDrvStatCount];
+    UInt64 drvStats[kDrvStatCount];
     
     UInt32 chip;
     UInt32 chipType;
@@ -613,6 +841,11 @@ private:
     bool enableTSO4;
     bool enableTSO6;
     bool enableCSO6;
+    bool softTSO4;
+    bool softTSO6;
+    bool safeTSO4;
+    bool safeTSO6;
+    bool cachedRings;
     bool enableWoM;
     bool enableWakeS5;
     bool useAppleVTD;
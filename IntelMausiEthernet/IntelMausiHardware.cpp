@@ -491,7 +491,7 @@ void IntelMausi::intelConfigureTx(struct e1000_adapter *adapter)
 void IntelMausi::intelSetupRxControl(struct e1000_adapter *adapter)
 {
 	struct e1000_hw *hw = &adapter->hw;
-	u32 rctl, rfctl;
+	u32 rctl, rfctl, psrctl;
     
 	/* Workaround Si errata on PCHx - configure jumbo frame flow.
 	 * If jumbo frames not set, program related MAC/PHY registers
@@ -548,9 +548,27 @@ void IntelMausi::intelSetupRxControl(struct e1000_adapter *adapter)
 		e1e_wphy(hw, 22, phy_data);
 	}
     
-	/* Set buffer sizes to 2048 */
+	/* Set the buffer size to rxBufferSize. */
     //rctl |= (0x2 << E1000_RCTL_FLXB_SHIFT);
     rctl &= ~(E1000_RCTL_SZ_256 | E1000_RCTL_BSEX);
+    rctl |= rxCtrlBufferSize(rxBufferSize);
+    
+    /*
+     * Packet split puts the headers into a small buffer and the payload
+     * into a page. It's restricted to standard frames which always fit
+     * into one page so that a packet never spans multiple descriptors.
+     */
+    rxPSMode = (rxPSEnabled && (mtu <= ETH_DATA_LEN));
+    
+    if (rxPSMode) {
+        psrctl = (kRxPSHdrSize >> E1000_PSRCTL_BSIZE0_SHIFT) & E1000_PSRCTL_BSIZE0_MASK;
+        psrctl |= (rxBufferSize >> E1000_PSRCTL_BSIZE1_SHIFT) & E1000_PSRCTL_BSIZE1_MASK;
+        intelWriteMem32(E1000_PSRCTL, psrctl);
+        
+        rctl |= E1000_RCTL_DTYP_PS;
+    } else {
+        rctl &= ~E1000_RCTL_DTYP_PS;
+    }
     
 	/* Enable Extended Status in all Receive Descriptors */
 	rfctl = intelReadMem32(E1000_RFCTL);
@@ -1105,6 +1123,8 @@ void IntelMausi::intelSetupRssHash(struct e1000_adapter *adapter)
 
 void IntelMausi::intelRestart()
 {
+    UInt32 size;
+    
     /* Stop output thread and flush txQueue */
     netif->stopOutputThread();
     netif->flushOutputQueue();
@@ -1120,6 +1140,16 @@ void IntelMausi::intelRestart()
     intelDisableIRQ();
 	intelReset(&adapterData);
     
+    /*
+     * A new MTU may require a different receive buffer size. Replace
+     * the buffers before clearDescriptors() writes their addresses to
+     * the ring.
+     */
+    size = rxBufferSizeForMtu(mtu);
+    
+    if ((size != rxBufferSize) && !rxResizeBuffers(size))
+        IOLog("Failed to resize receive buffers.\n");
+    
     clearDescriptors();
     rxCleanedCount = rxNextDescIndex = 0;
     rxMapNextIndex = 0;
@@ -1142,24 +1172,33 @@ void IntelMausi::intelInitTxRing()
 {
 	intelWriteMem32(E1000_TDBAL(0), (txPhyAddr & 0xffffffff));
 	intelWriteMem32(E1000_TDBAH(0), (txPhyAddr >> 32));
-	intelWriteMem32(E1000_TDLEN(0), kTxDescSize);
+	intelWriteMem32(E1000_TDLEN(0), kTxDescSize(numTxDesc));
 	intelWriteMem32(E1000_TDH(0), 0);
 	intelWriteMem32(E1000_TDT(0), 0);
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txInflightHead = txInflightTail = 0;
+    txNumFreeDesc = numTxDesc;
+    txLastContext.valid = false;
+    txUnreportedPkts = 0;
+    txBulkDescs = 0;
+    bqlReset(&txByteLimit);
 }
 
 void IntelMausi::intelInitRxRing()
 {
 	intelWriteMem32(E1000_RDBAL(0), (rxPhyAddr & 0xffffffff));
 	intelWriteMem32(E1000_RDBAH(0), (rxPhyAddr >> 32));
-	intelWriteMem32(E1000_RDLEN(0), kRxDescSize);
+	intelWriteMem32(E1000_RDLEN(0), (rxPSMode) ? kRxPSDescSize(numRxDesc) : kRxDescSize(numRxDesc));
 	intelWriteMem32(E1000_RDH(0), 0);
     
+    /* The descriptor layout depends on the mode selected by intelSetupRxControl(). */
+    if (rxPSEnabled)
+        rxPSInitDescriptors();
+    
     if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-        intelUpdateRxDescTail(kRxLastDesc);
+        intelUpdateRxDescTail(numRxDesc - 1);
     else
-        intelWriteMem32(E1000_RDT(0), kRxLastDesc);
+        intelWriteMem32(E1000_RDT(0), numRxDesc - 1);
     
     rxCleanedCount = rxNextDescIndex = 0;
     rxMapNextIndex = 0;
@@ -1167,6 +1206,16 @@ void IntelMausi::intelInitRxRing()
 
 void IntelMausi::intelUpdateTxDescTail(UInt32 index)
 {
+    /* Make sure that the hardware reports the status of the last packet. */
+    if (txUnreportedPkts) {
+        txDescArray[txLastEOPIndex].lower.data |= OSSwapHostToLittleInt32(E1000_TXD_CMD_RS);
+        txInflight.flags[(txInflightTail - 1) & txDescMask] |= kTxBufFlagReport;
+        txUnreportedPkts = 0;
+        drvStats[kDrvStatTxStatusReports]++;
+    }
+    /* Descriptor writes must be visible before the tail is updated. */
+    dma_wmb();
+    
     if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA) {
         struct e1000_hw *hw = &adapterData.hw;
         s32 ret = __ew32_prepare(hw);
@@ -1259,7 +1308,7 @@ void IntelMausi::intelFlushTxRing(struct e1000_adapter *adapter)
 
     OSAddAtomic(-1, &txNumFreeDesc);
     desc = &txDescArray[txNextDescIndex++];
-    txNextDescIndex &= kTxDescMask;
+    txNextDescIndex &= txDescMask;
 
     desc->buffer_addr = OSSwapHostToLittleInt64(txPhyAddr);
     desc->lower.data = OSSwapHostToLittleInt32(txdLower | size);
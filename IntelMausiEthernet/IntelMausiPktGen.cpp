@@ -0,0 +1,321 @@
+/* IntelMausiPktGen.cpp -- IntelMausi in-driver packet generator.
+ *
+ * Copyright (c) 2026 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * This driver is based on Intel's E1000e driver for Linux.
+ */
+
+#include <IOKit/IOUserClient.h>
+
+#include "IntelMausiEthernet.h"
+
+/*
+ * The generator sends UDP datagrams to the discard port using addresses
+ * from the benchmarking range of RFC 2544.
+ */
+#define kPktGenSrcAddr      0xc6120001  /* 198.18.0.1 */
+#define kPktGenDstAddr      0xc6130001  /* 198.19.0.1 */
+#define kPktGenPort         9
+#define kPktGenTTL          64
+
+#define kPktGenIPOffset     ETHER_HDR_LEN
+#define kPktGenUDPOffset    (ETHER_HDR_LEN + sizeof(struct ip))
+
+static void setResult(OSDictionary *dict, const char *key, UInt64 value)
+{
+    OSNumber *num = OSNumber::withNumber(value, 64);
+
+    if (num) {
+        dict->setObject(key, num);
+        num->release();
+    }
+}
+
+static inline UInt32 getParam(OSDictionary *params, const char *key, UInt32 defValue)
+{
+    OSNumber *num = OSDynamicCast(OSNumber, params->getObject(key));
+
+    return (num) ? num->unsigned32BitValue() : defValue;
+}
+
+#pragma mark --- packet generator ---
+
+/*
+ * A run of the packet generator is started by setting the driver's
+ * property kPktGenName to a dictionary with the run's parameters using
+ * IORegistryEntrySetCFProperties(). All other properties are handled
+ * by our superclass. As a run takes over the transmitter, only
+ * administrators may start it.
+ */
+IOReturn IntelMausi::setProperties(OSObject *properties)
+{
+    OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+    OSDictionary *params;
+    IOReturn result;
+
+    if (dict && (params = OSDynamicCast(OSDictionary, dict->getObject(kPktGenName)))) {
+        if (!pktGenEnabled)
+            result = kIOReturnNotPermitted;
+        else if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+            result = kIOReturnNotPrivileged;
+        else
+            result = commandGate->runAction(pktGenStartAction, params);
+    } else {
+        result = super::setProperties(properties);
+    }
+    return result;
+}
+
+IOReturn IntelMausi::pktGenStartAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4)
+{
+    IntelMausi *ethCtlr = OSDynamicCast(IntelMausi, owner);
+    IOReturn result = kIOReturnError;
+
+    if (ethCtlr)
+        result = ethCtlr->pktGenStart((OSDictionary *)arg1);
+
+    return result;
+}
+
+/*
+ * Prepare a run of the packet generator and kick the output thread.
+ * From now on, outputStart() takes its packets from the generator
+ * instead of the network stack until the run is over.
+ */
+IOReturn IntelMausi::pktGenStart(OSDictionary *params)
+{
+    OSBoolean *csum;
+    UInt8 *hdr = pktGen.header;
+    UInt32 maxFrame = mtu + ETHER_HDR_LEN;
+    IOReturn result = kIOReturnBusy;
+
+    if (!(isEnabled && linkUp) || forceReset) {
+        result = kIOReturnNotReady;
+        goto done;
+    }
+    if (pktGen.active)
+        goto done;
+
+    bzero(&pktGen, sizeof(pktGen));
+
+    pktGen.count = getParam(params, kPktGenCountName, kPktGenCountDefault);
+    pktGen.minSize = getParam(params, kPktGenMinSizeName, kPktGenSizeDefault);
+    pktGen.maxSize = getParam(params, kPktGenMaxSizeName, pktGen.minSize);
+    pktGen.vlanTag = (UInt16)getParam(params, kPktGenVlanTagName, 0) & E1000_RXD_SPC_VLAN_MASK;
+
+    csum = OSDynamicCast(OSBoolean, params->getObject(kPktGenChecksumName));
+    pktGen.checksumOffload = (csum) ? csum->getValue() : false;
+
+    if ((pktGen.count == 0) || (pktGen.count > kPktGenCountMax) ||
+        (pktGen.minSize < kPktGenMinSize) || (pktGen.maxSize > maxFrame) ||
+        (pktGen.minSize > pktGen.maxSize)) {
+        IOLog("Invalid packet generator parameters.\n");
+        result = kIOReturnBadArgument;
+        goto done;
+    }
+    /*
+     * Build the header template. The length fields and the checksums
+     * are filled in for each packet.
+     */
+    memcpy(&hdr[0], adapterData.hw.mac.addr, ETHER_ADDR_LEN);
+    memcpy(&hdr[ETHER_ADDR_LEN], adapterData.hw.mac.addr, ETHER_ADDR_LEN);
+    putBE16(&hdr[ETHER_HDR_LEN - 2], ETHERTYPE_IP);
+
+    hdr[kPktGenIPOffset] = 0x45;
+    putBE16(&hdr[kPktGenIPOffset + offsetof(struct ip, ip_off)], IP_DF);
+    hdr[kPktGenIPOffset + offsetof(struct ip, ip_ttl)] = kPktGenTTL;
+    hdr[kPktGenIPOffset + offsetof(struct ip, ip_p)] = IPPROTO_UDP;
+    putBE32(&hdr[kPktGenIPOffset + offsetof(struct ip, ip_src)], kPktGenSrcAddr);
+    putBE32(&hdr[kPktGenIPOffset + offsetof(struct ip, ip_dst)], kPktGenDstAddr);
+
+    putBE16(&hdr[kPktGenUDPOffset + offsetof(struct udphdr, uh_sport)], kPktGenPort);
+    putBE16(&hdr[kPktGenUDPOffset + offsetof(struct udphdr, uh_dport)], kPktGenPort);
+
+    IOLog("Packet generator: sending %u packets of %u-%u bytes.\n", pktGen.count, pktGen.minSize, pktGen.maxSize);
+
+    removeProperty(kPktGenResultsName);
+
+    clock_get_uptime(&pktGen.startTime);
+    pktGen.active = true;
+
+    netif->signalOutputThread();
+    result = kIOReturnSuccess;
+
+done:
+    return result;
+}
+
+/*
+ * Build a packet from the header template with a zeroed payload.
+ */
+mbuf_t IntelMausi::pktGenBuildPacket(UInt32 size)
+{
+    UInt8 hdr[kPktGenHdrLen];
+    UInt8 *ip = &hdr[kPktGenIPOffset];
+    UInt8 *udp = &hdr[kPktGenUDPOffset];
+    mbuf_t m = NULL;
+    mbuf_t n;
+    UInt32 len;
+    UInt32 left = size;
+
+    if (mbuf_allocpacket(MBUF_DONTWAIT, size, NULL, &m))
+        goto done;
+
+    for (n = m; n && left; n = mbuf_next(n)) {
+        len = min(left, (UInt32)mbuf_maxlen(n));
+        mbuf_setlen(n, len);
+        bzero(mbuf_data(n), len);
+        left -= len;
+    }
+    mbuf_pkthdr_setlen(m, size);
+
+    memcpy(hdr, pktGen.header, kPktGenHdrLen);
+    putBE16(&ip[offsetof(struct ip, ip_len)], (UInt16)(size - ETHER_HDR_LEN));
+    putBE16(&ip[offsetof(struct ip, ip_id)], (UInt16)pktGen.built);
+    len = size - kPktGenUDPOffset;
+    putBE16(&udp[offsetof(struct udphdr, uh_ulen)], (UInt16)len);
+
+    if (pktGen.checksumOffload) {
+        /* Let the hardware do it, just like the stack would. */
+        putBE16(&udp[offsetof(struct udphdr, uh_sum)],
+                foldSum(sumWords(&ip[offsetof(struct ip, ip_src)], 8) + IPPROTO_UDP + len));
+
+        mbuf_set_csum_requested(m, (mbuf_csum_request_flags_t)(MBUF_CSUM_REQ_IP | MBUF_CSUM_REQ_UDP),
+                                offsetof(struct udphdr, uh_sum));
+    } else {
+        /* A zero UDP checksum means no checksum. */
+        putBE16(&ip[offsetof(struct ip, ip_sum)], ~foldSum(sumWords(ip, sizeof(struct ip))));
+    }
+    mbuf_copyback(m, 0, kPktGenHdrLen, hdr, MBUF_DONTWAIT);
+
+    if (pktGen.vlanTag)
+        mbuf_set_vlan_tag(m, pktGen.vlanTag);
+
+done:
+    return m;
+}
+
+/*
+ * Fill txPendingPkt with up to maxCount generated packets. Returns
+ * false when there is nothing to send, which is also the case after
+ * all packets of the run have been posted, so that the network stack's
+ * packets don't disturb the measurement until the run is over.
+ */
+bool IntelMausi::pktGenDequeue(UInt32 maxCount)
+{
+    mbuf_t m;
+    mbuf_t tail = NULL;
+    UInt32 range = pktGen.maxSize - pktGen.minSize + 1;
+    UInt32 size;
+
+    while ((maxCount > 0) && (pktGen.built < pktGen.count)) {
+        size = pktGen.minSize;
+
+        if (range > 1)
+            size += random() % range;
+
+        m = pktGenBuildPacket(size);
+
+        if (!m) {
+            drvStats[kDrvStatPktGenAllocFailures]++;
+            break;
+        }
+        if (tail)
+            mbuf_setnextpkt(tail, m);
+        else
+            txPendingPkt = m;
+
+        tail = m;
+        pktGen.built++;
+        maxCount--;
+    }
+    if (txPendingPkt)
+        pktGen.injected = true;
+    else if (pktGen.built == pktGen.count)
+        pktGenSetAllPosted(&pktGen);
+
+    return (txPendingPkt != NULL);
+}
+
+/*
+ * Account for a generated packet which has been reclaimed. The time a
+ * single packet in flight, the probe, spent in the ring gives a sample
+ * of the reclaim latency.
+ */
+void IntelMausi::pktGenComplete(UInt16 slot)
+{
+    UInt64 now;
+
+    pktGen.completed++;
+
+    if (pktGenIsProbe(&pktGen, slot)) {
+        clock_get_uptime(&now);
+        absolutetime_to_nanoseconds(now - pktGen.probeTime, &now);
+
+        pktGen.latencySum += now;
+        pktGen.latencySamples++;
+
+        if (now > pktGen.latencyMax)
+            pktGen.latencyMax = now;
+
+        pktGenEndProbe(&pktGen);
+    }
+}
+
+/*
+ * Finish the run once all generated packets have been reclaimed and
+ * publish the results in the registry. Called from the tx interrupt
+ * and the watchdog timer.
+ */
+void IntelMausi::pktGenCheckDone()
+{
+    OSDictionary *results;
+    UInt64 elapsed;
+    UInt64 now;
+
+    if (!pktGenRunDone(&pktGen))
+        return;
+
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - pktGen.startTime, &elapsed);
+
+    if (elapsed == 0)
+        elapsed = 1;
+
+    results = OSDictionary::withCapacity(9);
+
+    if (results) {
+        setResult(results, "packets", pktGen.posted);
+        setResult(results, "bytes", pktGen.bytes);
+        setResult(results, "descriptors", pktGen.descs);
+        setResult(results, "elapsedNs", elapsed);
+        setResult(results, "packetsPerSec", pktGenRate(pktGen.posted, elapsed));
+        setResult(results, "bytesPerSec", pktGenRate(pktGen.bytes, elapsed));
+        setResult(results, "descsPer100Packets", (pktGen.posted) ? ((pktGen.descs * 100) / pktGen.posted) : 0);
+        setResult(results, "reclaimLatencyAvgNs", (pktGen.latencySamples) ? (pktGen.latencySum / pktGen.latencySamples) : 0);
+        setResult(results, "reclaimLatencyMaxNs", pktGen.latencyMax);
+
+        setProperty(kPktGenResultsName, results);
+        results->release();
+    }
+    IOLog("Packet generator: %llu packets, %llu bytes in %llu ns.\n", pktGen.posted, pktGen.bytes, elapsed);
+
+    pktGen.active = false;
+    pktGen.injected = false;
+
+    /* Let the network stack's packets flow again. */
+    netif->signalOutputThread();
+}
@@ -53,9 +53,83 @@ static UInt32 mediumSpeedArray[MEDIUM_INDEX_COUNT] = {
     100 * MBit
 };
 
+static const char *drvStatsNames[kDrvStatCount] = {
+    "txContextsEmitted",
+    "txContextsSkipped",
+    "txCopiedPackets",
+    "txSoftTSOPackets",
+    "txSoftTSOSegments",
+    "txSafeTSOPackets",
+    "txSafeTSOChunks",
+    "txSafeTSOSoftSegments",
+    "txSegmentedParts",
+    "txStatusReports",
+    "txCompletionPasses",
+    "txCompletedPackets",
+    "txHeadReads",
+    "txPriorityPackets",
+    "txBulkDeferred",
+    "txByteLimitStalls",
+    "txInflightBytes",
+    "txByteLimit",
+    "txFQCoDelDrops",
+    "txFQOverlimitDrops",
+    "txFQBacklog",
+    "txMapCacheHits",
+    "txMapCacheMisses",
+    "txMapCacheEvictions",
+    "txMergedSegments",
+    "txQueueStalls",
+    "txQueueWakes",
+    "txFreeBatches",
+    "txFreedPackets",
+    "txMaxFreeBatch",
+    "txCsumOtherLayout",
+    "txCsumParseErrors",
+    "txSoftChecksums",
+    "pktGenAllocFailures",
+    "rxSplitPackets",
+    "rxSplitCopies",
+    "rxRecycleHits",
+    "rxFallbackAllocs",
+    "rxPoolMbufs",
+    "rxPoolMbufLowWater",
+    "rxPoolMbufCapacity",
+    "rxPoolClusters",
+    "rxPoolClusterLowWater",
+    "rxPoolClusterCapacity",
+    "txSegs1",
+    "txSegs2",
+    "txSegs3",
+    "txSegs4",
+    "txSegs5to8",
+    "txSegs9to16",
+    "txSegs17up",
+};
+
 static const char *onName = "enabled";
 static const char *offName = "disabled";
 
+/*
+ * Get a ring size from the config data. Invalid values are replaced
+ * by the default.
+ */
+static UInt32 getRingSize(OSDictionary *params, const char *key)
+{
+    OSNumber *num = OSDynamicCast(OSNumber, params->getObject(key));
+    UInt32 size = kNumDescDefault;
+    
+    if (num) {
+        size = num->unsigned32BitValue();
+        
+        if (!descRingSizeValid(size)) {
+            IOLog("Invalid %s %u, using %u.\n", key, size, kNumDescDefault);
+            size = kNumDescDefault;
+        }
+    }
+    return size;
+}
+
 #pragma mark --- data structure initialization methods ---
 
 void IntelMausi::getParams()
@@ -67,6 +141,16 @@ void IntelMausi::getParams()
     OSBoolean *tso4;
     OSBoolean *tso6;
     OSBoolean *csoV6;
+    OSBoolean *safeTSO;
+    OSBoolean *softTSO;
+    OSBoolean *headCompletion;
+    OSBoolean *cached;
+    OSBoolean *priority;
+    OSBoolean *byteLimits;
+    OSBoolean *fqCoDel;
+    OSBoolean *generator;
+    OSBoolean *split;
+    OSBoolean *flip;
     OSBoolean *wom;
     OSBoolean *ws5;
     UInt32 newIntrRate10;
@@ -111,6 +195,20 @@ void IntelMausi::getParams()
         
         IOLog("TCP/IPv6 checksum offload %s.\n", enableCSO6 ? onName : offName);
         
+        /* Safe TSO overrides both, plain hardware TSO and software TSO. */
+        safeTSO = OSDynamicCast(OSBoolean, params->getObject(kEnableSafeTSOName));
+        safeTSO4 = (safeTSO) ? safeTSO->getValue() : false;
+        safeTSO6 = safeTSO4;
+        
+        IOLog("Safe TCP segmentation offload %s.\n", (safeTSO4 || safeTSO6) ? onName : offName);
+        
+        /* Segment in software what the hardware isn't allowed to. */
+        softTSO = OSDynamicCast(OSBoolean, params->getObject(kEnableSoftTSOName));
+        softTSO4 = (softTSO && softTSO->getValue() && !enableTSO4 && !safeTSO4);
+        softTSO6 = (softTSO && softTSO->getValue() && !enableTSO6 && !safeTSO6);
+        
+        IOLog("Software TCP segmentation offload %s.\n", (softTSO4 || softTSO6) ? onName : offName);
+        
         wom = OSDynamicCast(OSBoolean, params->getObject(kEnableWoMName));
         enableWoM = (wom) ? wom->getValue() : false;
 
@@ -230,9 +328,114 @@ void IntelMausi::getParams()
         } else {
             rxDelayTime1000 = 0;
         }
+        /* Get txCopyBreak from config data */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxCopyBreakName));
+        
+        if (num) {
+            txCopyBreak = num->unsigned32BitValue();
+            
+            if (txCopyBreak > kTxBounceBufSize)
+                txCopyBreak = kTxBounceBufSize;
+        } else {
+            txCopyBreak = kTxCopyBreakDefault;
+        }
+        /* Get the number of packets per tx status report. */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxReportIntervalName));
+        
+        if (num) {
+            txReportInterval = num->unsigned32BitValue();
+            
+            if (txReportInterval < 1)
+                txReportInterval = 1;
+            else if (txReportInterval > kTxBatchSize)
+                txReportInterval = kTxBatchSize;
+        } else {
+            txReportInterval = kTxReportIntervalDefault;
+        }
+        /* Get the sizes of the descriptor rings. */
+        numTxDesc = getRingSize(params, kTxRingSizeName);
+        numRxDesc = getRingSize(params, kRxRingSizeName);
+        
+        /* Find completed tx packets using the head pointer instead of the DD bit. */
+        headCompletion = OSDynamicCast(OSBoolean, params->getObject(kTxHeadCompletionName));
+        txHeadCompletion = (headCompletion) ? headCompletion->getValue() : false;
+        
+        IOLog("Tx completion based on %s.\n", txHeadCompletion ? "head pointer" : "descriptor status");
+        
+        /* Descriptor rings in cacheable memory. */
+        cached = OSDynamicCast(OSBoolean, params->getObject(kCachedRingsName));
+        cachedRings = (cached) ? cached->getValue() : false;
+        
+        IOLog("Cached descriptor rings %s.\n", cachedRings ? onName : offName);
+        
+        /* Serve latency sensitive service classes first. */
+        priority = OSDynamicCast(OSBoolean, params->getObject(kTxPriorityName));
+        txPriorityMode = (priority) ? priority->getValue() : false;
+        
+        IOLog("Tx service class priority %s.\n", txPriorityMode ? onName : offName);
+        
+        /* Limit the number of bytes in flight. */
+        byteLimits = OSDynamicCast(OSBoolean, params->getObject(kTxByteLimitsName));
+        txByteLimitMode = (byteLimits) ? byteLimits->getValue() : false;
+        
+        IOLog("Tx byte queue limits %s.\n", txByteLimitMode ? onName : offName);
+        
+        /* Number of pages which stay mapped for tx with AppleVTD. */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxMapCacheSizeName));
+        
+        if (num) {
+            txMapCacheSize = num->unsigned32BitValue();
+            
+            if (txMapCacheSize && (txMapCacheSize < kTxMapCacheMin))
+                txMapCacheSize = kTxMapCacheMin;
+            else if (txMapCacheSize > kTxMapCacheMax)
+                txMapCacheSize = kTxMapCacheMax;
+        } else {
+            txMapCacheSize = kTxMapCacheDefault;
+        }
+        
+        /* Run our own FQ-CoDel scheduler in front of the tx ring. */
+        fqCoDel = OSDynamicCast(OSBoolean, params->getObject(kEnableFQCoDelName));
+        txFQMode = (fqCoDel) ? fqCoDel->getValue() : false;
+        
+        IOLog("FQ-CoDel %s.\n", txFQMode ? onName : offName);
+        
+        /* FQ-CoDel replaces service class priority. */
+        if (txFQMode)
+            txPriorityMode = false;
+        
+        /* Allow packet generator runs to be started from user space. */
+        generator = OSDynamicCast(OSBoolean, params->getObject(kEnablePktGenName));
+        pktGenEnabled = (generator) ? generator->getValue() : false;
+        
+        IOLog("Packet generator %s.\n", pktGenEnabled ? onName : offName);
+        
+        /* Packet split receive doesn't support AppleVTD. */
+        split = OSDynamicCast(OSBoolean, params->getObject(kRxPacketSplitName));
+        rxPSEnabled = (split) ? split->getValue() : false;
+        
+        if (rxPSEnabled && useAppleVTD) {
+            IOLog("Packet split receive not supported with AppleVTD.\n");
+            rxPSEnabled = false;
+        }
+        IOLog("Packet split receive %s.\n", rxPSEnabled ? onName : offName);
+        
+        /* Page flipping needs physical addresses and plain descriptors. */
+        flip = OSDynamicCast(OSBoolean, params->getObject(kRxPageFlipName));
+        rxFlipEnabled = (flip) ? flip->getValue() : false;
+        
+        if (rxFlipEnabled && (useAppleVTD || rxPSEnabled)) {
+            IOLog("Page flipping not supported with AppleVTD or packet split.\n");
+            rxFlipEnabled = false;
+        }
+        IOLog("Page flipping %s.\n", rxFlipEnabled ? onName : offName);
     } else {
         /* Use default values in case of missing config data. */
         enableCSO6 = false;
+        softTSO4 = false;
+        softTSO6 = false;
+        safeTSO4 = false;
+        safeTSO6 = false;
         enableWoM = false;
         enableWakeS5 = false;
         newIntrRate10 = 3000;
@@ -247,9 +450,32 @@ void IntelMausi::getParams()
         rxDelayTime10 = 0;
         rxDelayTime100 = 0;
         rxDelayTime1000 = 0;
+        txCopyBreak = kTxCopyBreakDefault;
+        txReportInterval = kTxReportIntervalDefault;
+        txHeadCompletion = false;
+        cachedRings = false;
+        numTxDesc = kNumDescDefault;
+        numRxDesc = kNumDescDefault;
+        txPriorityMode = false;
+        txByteLimitMode = false;
+        txFQMode = false;
+        txMapCacheSize = kTxMapCacheDefault;
+        pktGenEnabled = false;
+        rxPSEnabled = false;
+        rxFlipEnabled = false;
     }
+    /* Derive masks and sizes of the map arrays from the ring sizes. */
+    txDescMask = numTxDesc - 1;
+    numTxMemDesc = kNumTxMemDesc(numTxDesc);
+    txMemDescMask = numTxMemDesc - 1;
+    txWakeThreshold = kTxQueueWakeTreshhold(numTxDesc);
+    txBulkLimit = kTxBulkLimit(numTxDesc);
+    rxDescMask = numRxDesc - 1;
+    numRxMemDesc = kNumRxMemDesc(numRxDesc);
     
     DebugLog("rxAbsTime10=%u, rxAbsTime100=%u, rxAbsTime1000=%u, rxDelayTime10=%u, rxDelayTime100=%u, rxDelayTime1000=%u. \n", rxAbsTime10, rxAbsTime100, rxAbsTime1000, rxDelayTime10, rxDelayTime100, rxDelayTime1000);
+    DebugLog("txCopyBreak=%u, txReportInterval=%u.\n", txCopyBreak, txReportInterval);
+    IOLog("Using %u tx and %u rx descriptors.\n", numTxDesc, numRxDesc);
     
     if (versionString)
         IOLog("Version %s using max interrupt rates [%u; %u; %u]. Please don't support tonymacx86.com!\n", versionString->getCStringNoCopy(), newIntrRate10, newIntrRate100, newIntrRate1000);
@@ -307,6 +533,76 @@ error1:
     goto done;
 }
 
+bool IntelMausi::setupDriverStats()
+{
+    UInt32 i;
+    bool result = false;
+    
+    drvStatsDict = OSDictionary::withCapacity(kDrvStatCount);
+    
+    if (!drvStatsDict)
+        goto done;
+    
+    for (i = 0; i < kDrvStatCount; i++) {
+        drvStats[i] = 0;
+        drvStatsNum[i] = OSNumber::withNumber(0ULL, 64);
+        
+        if (!drvStatsNum[i])
+            goto error1;
+        
+        drvStatsDict->setObject(drvStatsNames[i], drvStatsNum[i]);
+        drvStatsNum[i]->release();
+    }
+    result = setProperty(kDriverStatsName, drvStatsDict);
+    
+    if (!result)
+        goto error1;
+    
+done:
+    return result;
+    
+error1:
+    IOLog("Error creating statistics dictionary.\n");
+    RELEASE(drvStatsDict);
+    
+    for (i = 0; i < kDrvStatCount; i++)
+        drvStatsNum[i] = NULL;
+    
+    goto done;
+}
+
+void IntelMausi::updateDriverStats()
+{
+    struct MausiRxPoolStats poolStats;
+    UInt32 i;
+    
+    if (drvStatsDict) {
+        drvStats[kDrvStatTxInflightBytes] = bqlInflight(&txByteLimit);
+        drvStats[kDrvStatTxByteLimit] = txByteLimit.limit;
+        
+        if (txFQ) {
+            drvStats[kDrvStatTxFQCoDelDrops] = txFQ->codelDrops;
+            drvStats[kDrvStatTxFQOverlimitDrops] = txFQ->overlimitDrops;
+            drvStats[kDrvStatTxFQBacklog] = txFQ->getPackets();
+        }
+        
+        if (rxPool) {
+            rxPool->getStats(&poolStats);
+            
+            drvStats[kDrvStatRxPoolMbufs] = poolStats.mbufDepth;
+            drvStats[kDrvStatRxPoolMbufLowWater] = poolStats.mbufLowWater;
+            drvStats[kDrvStatRxPoolMbufCapacity] = poolStats.mbufCapacity;
+            drvStats[kDrvStatRxPoolClusters] = poolStats.clustDepth;
+            drvStats[kDrvStatRxPoolClusterLowWater] = poolStats.clustLowWater;
+            drvStats[kDrvStatRxPoolClusterCapacity] = poolStats.clustCapacity;
+        }
+        
+        /* The numbers are owned by the dictionary in the registry. */
+        for (i = 0; i < kDrvStatCount; i++)
+            drvStatsNum[i]->setValue(drvStats[i]);
+    }
+}
+
 bool IntelMausi::initEventSources(IOService *provider)
 {
     IOReturn intrResult;
@@ -376,11 +672,12 @@ bool IntelMausi::setupRxResources()
     mbuf_t m;
     UInt64 offset = 0;
     UInt32 numSegs = 1;
+    UInt32 ringSize;
     UInt32 i;
     bool result = false;
         
     /* Alloc rx mbuf_t array. */
-    rxBufArrayMem = IOMallocZero(kRxBufArraySize);
+    rxBufArrayMem = IOMallocZero(kRxBufArraySize(numRxDesc));
     
     if (!rxBufArrayMem) {
         IOLog("Couldn't alloc receive buffer array.\n");
@@ -388,8 +685,19 @@ bool IntelMausi::setupRxResources()
     }
     rxBufArray = (intelRxBufferInfo *)rxBufArrayMem;
 
+    /* Packet split needs the header buffers too. */
+    if (rxPSEnabled) {
+        if (!rxPSSetupHdrBuffers())
+            goto error_rx_desc;
+        
+        /* Packet split descriptors are twice as large. */
+        ringSize = kRxPSDescSize(numRxDesc);
+    } else {
+        ringSize = kRxDescSize(numRxDesc);
+    }
+
     /* Create receiver descriptor array. */
-    rxBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous | kIOMapInhibitCache), kRxDescSize, 0xFFFFFFFFFFFFF000ULL);
+    rxBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous | (cachedRings ? 0 : kIOMapInhibitCache)), ringSize, 0xFFFFFFFFFFFFF000ULL);
     
     if (!rxBufDesc) {
         IOLog("Couldn't alloc rxBufDesc.\n");
@@ -401,6 +709,7 @@ bool IntelMausi::setupRxResources()
         goto error_rx_prep;
     }
     rxDescArray = (union e1000_rx_desc_extended *)rxBufDesc->getBytesNoCopy();
+    rxPSDescArray = (union e1000_rx_desc_packet_split *)rxDescArray;
     
     /* I don't know if it's really necessary but the documenation says so and Apple's drivers are also doing it this way. */
     rxDescDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1, mapper, NULL);
@@ -425,25 +734,47 @@ bool IntelMausi::setupRxResources()
     rxPhyAddr = seg.fIOVMAddr;
     
     /* Initialize rxDescArray. */
-    bzero((void *)rxDescArray, kRxDescSize);
+    bzero((void *)rxDescArray, ringSize);
     
-    for (i = 0; i < kNumRxDesc; i++) {
+    for (i = 0; i < numRxDesc; i++) {
         rxBufArray[i].mbuf = NULL;
         rxBufArray[i].phyAddr = 0;
     }
     rxCleanedCount = rxNextDescIndex = 0;
     rxMapNextIndex = 0;
 
-    rxPool = MausiRxPool::withCapacity(kRxPoolMbufCap, kRxPoolClstCap);
+    rxBufferSize = rxBufferSizeForMtu(mtu);
+    adapterData.rx_buffer_len = rxBufferSize;
+    rxPool = MausiRxPool::withCapacity(kRxPoolMbufCap, kRxPoolClstCap, rxBufferSize);
 
     if (!rxPool) {
         IOLog("Couldn't alloc receive buffer pool.\n");
         goto error_rx_pool;
     }
+    rxFlipMode = false;
+
+    if (rxFlipEnabled) {
+        rxPageArray = (intelRxPageInfo *)IOMallocZero(numRxDesc * sizeof(intelRxPageInfo));
+        rxPagePool = MausiPagePool::withCapacity(numRxDesc + kRxFlipSpares(numRxDesc));
+
+        if (!rxPageArray || !rxPagePool) {
+            IOLog("Couldn't alloc receive page pool.\n");
+            goto error_rx_buf;
+        }
+        /* Pages are only used for standard frames. */
+        rxFlipMode = ((rxBufferSize == kRxBufferSizeStd) && rxFlipBindPages());
+    }
 
     /* Alloc receive buffers. */
-    for (i = 0; i < kNumRxDesc; i++) {
-        m = rxPool->getPacket(kRxBufferSize, MBUF_WAITOK);
+    for (i = 0; i < numRxDesc; i++) {
+        if (rxFlipMode) {
+            /* Start with the first half of the page. */
+            rxBufArray[i].phyAddr = rxPageArray[i].page->phyAddr;
+            rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[i].phyAddr);
+            rxDescArray[i].read.reserved = 0;
+            continue;
+        }
+        m = rxPool->getPacket(rxBufferSize, MBUF_WAITOK);
         
         if (!m) {
             IOLog("Couldn't alloc receive buffer.\n");
@@ -479,13 +810,21 @@ done:
     return result;
 
 error_rx_buf:
-    for (i = 0; i < kNumRxDesc; i++) {
+    for (i = 0; i < numRxDesc; i++) {
         if (rxBufArray[i].mbuf) {
             mbuf_freem_list(rxBufArray[i].mbuf);
             rxBufArray[i].mbuf = NULL;
             rxBufArray[i].phyAddr = 0;
         }
     }
+    if (rxPageArray) {
+        if (rxPagePool)
+            rxFlipUnbindPages();
+
+        IOFree(rxPageArray, numRxDesc * sizeof(intelRxPageInfo));
+        rxPageArray = NULL;
+    }
+    RELEASE(rxPagePool);
 
 error_rx_mem:
     RELEASE(rxPool);
@@ -507,7 +846,8 @@ error_rx_prep:
     rxBufDesc = NULL;
 
 error_rx_desc:
-    IOFree(rxBufArrayMem, kRxBufArraySize);
+    rxPSFreeHdrBuffers();
+    IOFree(rxBufArrayMem, kRxBufArraySize(numRxDesc));
     rxBufArrayMem = NULL;
     rxBufArray = NULL;
     goto done;
@@ -521,7 +861,7 @@ void IntelMausi::freeRxResources()
         freeRxMap();
 
     if (rxBufArray) {
-        for (i = 0; i < kNumRxDesc; i++) {
+        for (i = 0; i < numRxDesc; i++) {
             if (rxBufArray[i].mbuf) {
                 mbuf_freem_list(rxBufArray[i].mbuf);
                 rxBufArray[i].mbuf = NULL;
@@ -529,6 +869,18 @@ void IntelMausi::freeRxResources()
         }
         rxBufArray = NULL;
     }
+    rxPSFreeHdrBuffers();
+
+    if (rxPageArray) {
+        if (rxPagePool)
+            rxFlipUnbindPages();
+
+        IOFree(rxPageArray, numRxDesc * sizeof(intelRxPageInfo));
+        rxPageArray = NULL;
+    }
+    /* Pages still held by the stack keep the pool alive. */
+    RELEASE(rxPagePool);
+    rxFlipMode = false;
     RELEASE(rxPool);
 
     if (rxDescDmaCmd) {
@@ -544,30 +896,243 @@ void IntelMausi::freeRxResources()
     }
     
     if (rxBufArrayMem) {
-        IOFree(rxBufArrayMem, kRxBufArraySize);
+        IOFree(rxBufArrayMem, kRxBufArraySize(numRxDesc));
         rxBufArrayMem = NULL;
     }
 }
 
-bool IntelMausi::setupTxResources()
+/*
+ * Allocate the header buffers for packet split receive. They are owned
+ * by the driver and mapped once, like the tx bounce buffers, as the
+ * headers are copied to a small mbuf on receive.
+ */
+bool IntelMausi::rxPSSetupHdrBuffers()
 {
     IODMACommand::Segment64 seg;
     UInt64 offset = 0;
     UInt32 numSegs = 1;
+    bool result = false;
+
+    rxHdrBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionIn | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous), kRxPSHdrArraySize(numRxDesc), 0xFFFFFFFFFFFFF000ULL);
+    
+    if (!rxHdrBufDesc) {
+        IOLog("Couldn't alloc rxHdrBufDesc.\n");
+        goto done;
+    }
+    if (rxHdrBufDesc->prepare() != kIOReturnSuccess) {
+        IOLog("rxHdrBufDesc->prepare() failed.\n");
+        goto error_prep;
+    }
+    rxHdrArray = (UInt8 *)rxHdrBufDesc->getBytesNoCopy();
+    
+    rxHdrDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1, mapper, NULL);
+    
+    if (!rxHdrDmaCmd) {
+        IOLog("Couldn't alloc rxHdrDmaCmd.\n");
+        goto error_dma;
+    }
+    if (rxHdrDmaCmd->setMemoryDescriptor(rxHdrBufDesc) != kIOReturnSuccess) {
+        IOLog("setMemoryDescriptor() failed.\n");
+        goto error_set;
+    }
+    if (rxHdrDmaCmd->gen64IOVMSegments(&offset, &seg, &numSegs) != kIOReturnSuccess) {
+        IOLog("gen64IOVMSegments() failed.\n");
+        goto error_seg;
+    }
+    rxHdrPhyAddr = seg.fIOVMAddr;
+    result = true;
+    
+done:
+    return result;
+    
+error_seg:
+    rxHdrDmaCmd->clearMemoryDescriptor();
+    
+error_set:
+    RELEASE(rxHdrDmaCmd);
+    
+error_dma:
+    rxHdrBufDesc->complete();
+    rxHdrArray = NULL;
+    
+error_prep:
+    rxHdrBufDesc->release();
+    rxHdrBufDesc = NULL;
+    goto done;
+}
+
+void IntelMausi::rxPSFreeHdrBuffers()
+{
+    if (rxHdrDmaCmd) {
+        rxHdrDmaCmd->clearMemoryDescriptor();
+        rxHdrDmaCmd->release();
+        rxHdrDmaCmd = NULL;
+    }
+    if (rxHdrBufDesc) {
+        rxHdrBufDesc->complete();
+        rxHdrBufDesc->release();
+        rxHdrBufDesc = NULL;
+        rxHdrArray = NULL;
+        rxHdrPhyAddr = 0;
+    }
+}
+
+/*
+ * Bind a page to each descriptor for page flipping. Fails in case there
+ * aren't enough free pages, which may happen when the stack still holds
+ * halves of pages from a previous flip mode period.
+ */
+bool IntelMausi::rxFlipBindPages()
+{
+    struct MausiRxPage *page;
+    UInt32 i;
+    bool result = false;
+    
+    for (i = 0; i < numRxDesc; i++) {
+        page = rxPagePool->getPage();
+        
+        if (!page) {
+            DebugLog("Not enough free pages.\n");
+            rxFlipUnbindPages();
+            goto done;
+        }
+        rxPageArray[i].page = page;
+        rxPageArray[i].offset = 0;
+    }
+    result = true;
+    
+done:
+    return result;
+}
+
+void IntelMausi::rxFlipUnbindPages()
+{
     UInt32 i;
+    
+    for (i = 0; i < numRxDesc; i++) {
+        if (rxPageArray[i].page) {
+            rxPagePool->putPage(rxPageArray[i].page);
+            rxPageArray[i].page = NULL;
+        }
+    }
+}
+
+/*
+ * With AppleVTD the buffers are always pages as the mappings cover
+ * whole pages.
+ */
+UInt32 IntelMausi::rxBufferSizeForMtu(UInt32 newMtu)
+{
+    return rxBufferSizeFor(newMtu, useAppleVTD);
+}
+
+/*
+ * Replace all receive buffers with buffers of the given size. Must be
+ * called with the receiver stopped. In case of an allocation failure the
+ * old buffers are kept, which still works as the buffer size programmed
+ * into the hardware always follows rxBufferSize.
+ */
+bool IntelMausi::rxResizeBuffers(UInt32 size)
+{
+    MausiRxPool *pool;
+    mbuf_t *newBufs;
+    UInt32 i;
+    bool flip = (rxPagePool && (size == kRxBufferSizeStd));
+    bool result = false;
+    
+    newBufs = (mbuf_t *)IOMallocZero(numRxDesc * sizeof(mbuf_t));
+    
+    if (!newBufs)
+        goto done;
+    
+    pool = MausiRxPool::withCapacity(kRxPoolMbufCap, kRxPoolClstCap, size);
+    
+    if (!pool)
+        goto error_pool;
+    
+    /*
+     * Standard frames are received into halves of pages. In case the
+     * stack still holds too many of them, use 2K clusters until the next
+     * resize rather than failing the MTU change.
+     */
+    if (flip && !rxFlipBindPages()) {
+        IOLog("Not enough free pages for page flipping, using clusters.\n");
+        flip = false;
+    }
+    if (!flip) {
+        for (i = 0; i < numRxDesc; i++) {
+            newBufs[i] = pool->getPacket(size, MBUF_WAITOK);
+            
+            if (!newBufs[i])
+                goto error_buf;
+        }
+    }
+    /* From here on nothing can fail. */
+    for (i = 0; i < numRxDesc; i++) {
+        if (rxBufArray[i].mbuf)
+            mbuf_freem_list(rxBufArray[i].mbuf);
+        
+        if (flip) {
+            rxBufArray[i].mbuf = NULL;
+            rxBufArray[i].phyAddr = rxPageArray[i].page->phyAddr;
+        } else {
+            rxBufArray[i].mbuf = newBufs[i];
+            rxBufArray[i].phyAddr = mbuf_data_to_physical(mbuf_datastart(newBufs[i]));
+        }
+    }
+    /* Pages of the old mode are released once the stack has freed them. */
+    if (rxFlipMode)
+        rxFlipUnbindPages();
+    
+    rxFlipMode = flip;
+    RELEASE(rxPool);
+    rxPool = pool;
+    rxBufferSize = size;
+    adapterData.rx_buffer_len = size;
+    
+    DebugLog("Receive buffer size %u.\n", size);
+    result = true;
+    
+free_array:
+    IOFree(newBufs, numRxDesc * sizeof(mbuf_t));
+    
+done:
+    return result;
+    
+error_buf:
+    for (i = 0; i < numRxDesc; i++) {
+        if (newBufs[i])
+            mbuf_freem_list(newBufs[i]);
+    }
+    
+error_pool:
+    RELEASE(pool);
+    goto free_array;
+}
+
+bool IntelMausi::setupTxResources()
+{
+    IODMACommand::Segment64 seg;
+    UInt64 offset = 0;
+    UInt32 numSegs = 1;
     bool result = false;
     
-    /* Alloc tx mbuf_t array. */
-    txBufArrayMem = IOMallocZero(kTxBufArraySize);
+    /* Alloc the queue of packets in flight. */
+    txInflightMem = IOMallocZero(kTxInflightSize(numTxDesc));
     
-    if (!txBufArrayMem) {
-        IOLog("Couldn't alloc transmit buffer array.\n");
+    if (!txInflightMem) {
+        IOLog("Couldn't alloc transmit queue.\n");
         goto done;
     }
-    txBufArray = (intelTxBufferInfo *)txBufArrayMem;
+    txInflight.mbuf = (mbuf_t *)txInflightMem;
+    txInflight.bytes = (UInt32 *)(txInflight.mbuf + numTxDesc);
+    txInflight.eopIndex = (UInt16 *)(txInflight.bytes + numTxDesc);
+    txInflight.numDescs = txInflight.eopIndex + numTxDesc;
+    txInflight.flags = txInflight.numDescs + numTxDesc;
+    txInflightHead = txInflightTail = 0;
 
     /* Create transmitter descriptor array. */
-    txBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous | kIOMapInhibitCache), kTxDescSize, 0xFFFFFFFFFFFFF000ULL);
+    txBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous | (cachedRings ? 0 : kIOMapInhibitCache)), kTxDescSize(numTxDesc), 0xFFFFFFFFFFFFF000ULL);
     
     if (!txBufDesc) {
         IOLog("Couldn't alloc txBufDesc.\n");
@@ -600,15 +1165,45 @@ bool IntelMausi::setupTxResources()
     txPhyAddr = seg.fIOVMAddr;
 
     /* Initialize txDescArray. */
-    bzero(txDescArray, kTxDescSize);
+    bzero(txDescArray, kTxDescSize(numTxDesc));
+    
+    /*
+     * Allocate the bounce buffers for small packets. They are mapped
+     * once so that copied packets don't need a mapping of their own.
+     */
+    txBounceBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionOut | kIOMemoryPhysicallyContiguous | kIOMemoryHostPhysicallyContiguous), kTxBounceSize(numTxDesc), 0xFFFFFFFFFFFFF000ULL);
+    
+    if (!txBounceBufDesc) {
+        IOLog("Couldn't alloc txBounceBufDesc.\n");
+        goto error_tx_seg;
+    }
+    if (txBounceBufDesc->prepare() != kIOReturnSuccess) {
+        IOLog("txBounceBufDesc->prepare() failed.\n");
+        goto error_bounce_prep;
+    }
+    txBounceArray = (UInt8 *)txBounceBufDesc->getBytesNoCopy();
+    
+    txBounceDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1, mapper, NULL);
     
-    for (i = 0; i < kNumTxDesc; i++) {
-        txBufArray[i].mbuf = NULL;
-        txBufArray[i].numDescs = 0;
-        txBufArray[i].pad = 0;
+    if (!txBounceDmaCmd) {
+        IOLog("Couldn't alloc txBounceDmaCmd.\n");
+        goto error_bounce_dma;
     }
+    if (txBounceDmaCmd->setMemoryDescriptor(txBounceBufDesc) != kIOReturnSuccess) {
+        IOLog("setMemoryDescriptor() failed.\n");
+        goto error_bounce_set;
+    }
+    offset = 0;
+    numSegs = 1;
+    
+    if (txBounceDmaCmd->gen64IOVMSegments(&offset, &seg, &numSegs) != kIOReturnSuccess) {
+        IOLog("gen64IOVMSegments() failed.\n");
+        goto error_bounce_seg;
+    }
+    txBouncePhyAddr = seg.fIOVMAddr;
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txNumFreeDesc = numTxDesc;
+    txLastContext.valid = false;
     
     if (useAppleVTD) {
         result = setupTxMap();
@@ -623,12 +1218,41 @@ bool IntelMausi::setupTxResources()
             goto error_tx_cursor;
         }
     }
+    if (txFQMode) {
+        txFQ = MausiFQCoDel::withParams(kFQCoDelFlows, kFQCoDelLimit, kFQCoDelQuantum, kFQCoDelTarget, kFQCoDelInterval);
+        
+        if (!txFQ) {
+            IOLog("Couldn't create FQ-CoDel scheduler.\n");
+            goto error_fq;
+        }
+    }
     result = true;
 
 done:
     return result;
     
+error_fq:
+    if (useAppleVTD)
+        freeTxMap();
+    else
+        RELEASE(txMbufCursor);
+    
 error_tx_cursor:
+    txBouncePhyAddr = 0;
+
+error_bounce_seg:
+    txBounceDmaCmd->clearMemoryDescriptor();
+
+error_bounce_set:
+    RELEASE(txBounceDmaCmd);
+
+error_bounce_dma:
+    txBounceBufDesc->complete();
+    txBounceArray = NULL;
+
+error_bounce_prep:
+    txBounceBufDesc->release();
+    txBounceBufDesc = NULL;
     txPhyAddr = 0;
     
 error_tx_seg:
@@ -646,18 +1270,31 @@ error_tx_prep:
     txBufDesc = NULL;
 
 error_tx_buf:
-    IOFree(txBufArrayMem, kTxBufArraySize);
-    txBufArrayMem = NULL;
-    txBufArray = NULL;
+    IOFree(txInflightMem, kTxInflightSize(numTxDesc));
+    txInflightMem = NULL;
 
     goto done;
 }
 
 void IntelMausi::freeTxResources()
 {
+    RELEASE(txFQ);
+    
     if (useAppleVTD)
         freeTxMap();
 
+    if (txBounceDmaCmd) {
+        txBounceDmaCmd->clearMemoryDescriptor();
+        txBounceDmaCmd->release();
+        txBounceDmaCmd = NULL;
+    }
+    if (txBounceBufDesc) {
+        txBounceBufDesc->complete();
+        txBounceBufDesc->release();
+        txBounceBufDesc = NULL;
+        txBounceArray = NULL;
+        txBouncePhyAddr = 0;
+    }
     if (txDescDmaCmd) {
         txDescDmaCmd->clearMemoryDescriptor();
         txDescDmaCmd->release();
@@ -670,10 +1307,9 @@ void IntelMausi::freeTxResources()
         txDescArray = NULL;
         txPhyAddr = 0;
     }
-    if (txBufArrayMem) {
-        IOFree(txBufArrayMem, kTxBufArraySize);
-        txBufArrayMem = NULL;
-        txBufArray = NULL;
+    if (txInflightMem) {
+        IOFree(txInflightMem, kTxInflightSize(numTxDesc));
+        txInflightMem = NULL;
     }
     RELEASE(txMbufCursor);
 }
@@ -686,18 +1322,20 @@ void IntelMausi::clearDescriptors()
     
     DebugLog("clearDescriptors() ===>\n");
     
-    /* First cleanup the tx descriptor ring. */
-    for (i = 0; i < kNumTxDesc; i++) {
-        m = txBufArray[i].mbuf;
+    /* First cleanup the packets in flight. */
+    for (i = txInflightHead; i != txInflightTail; i = (i + 1) & txDescMask) {
+        m = txInflight.mbuf[i];
         
         if (m) {
             mbuf_freem_list(m);
-            txBufArray[i].mbuf = NULL;
-            txBufArray[i].numDescs = 0;
+            txInflight.mbuf[i] = NULL;
         }
+        txInflight.flags[i] = 0;
     }
+    txInflightHead = txInflightTail = 0;
+    
     if (useAppleVTD) {
-        for (i = 0; i < kNumTxMemDesc; i++) {
+        for (i = 0; i < numTxMemDesc; i++) {
             md = txMapInfo->txMemIO[i];
             
             if (md && (md->getTag() == kIOMemoryActive)) {
@@ -706,22 +1344,49 @@ void IntelMausi::clearDescriptors()
             }
         }
         txMapInfo->txNextMem2Use = txMapInfo->txNextMem2Free = 0;
-        txMapInfo->txNumFreeMem = kNumTxMemDesc;
+        txMapInfo->txNumFreeMem = numTxMemDesc;
     }
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txNumFreeDesc = numTxDesc;
+    txLastContext.valid = false;
+    txUnreportedPkts = 0;
+    txBulkDescs = 0;
+    txStallDescs = 0;
+    bqlReset(&txByteLimit);
+    
+    /* Drop packets which haven't been posted yet. */
+    if (txPendingPkt) {
+        mbuf_freem_list(txPendingPkt);
+        txPendingPkt = NULL;
+        txGSO.nextSeg = 0;
+    }
+    if (txFQ)
+        txFQ->flush();
+    
+    /* A reset aborts a packet generator run. */
+    if (pktGen.active) {
+        IOLog("Packet generator run aborted.\n");
+        pktGen.active = false;
+        pktGen.injected = false;
+    }
+    if (txMapCache)
+        txMapCacheFlush();
     
     if (useAppleVTD) {
         rxMapNextIndex = 0;
-        rxMapBuffers(0, kNumRxMemDesc, false);
+        rxMapBuffers(0, numRxMemDesc, false);
     }
     /* On descriptor writeback the buffer addresses are overwritten so that
      * we must restore them in order to make sure that we leave the ring in
      * a usable state.
      */
-    for (i = 0; i < kNumRxDesc; i++) {
-        rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[i].phyAddr);
-        rxDescArray[i].read.reserved = 0;
+    if (rxPSEnabled) {
+        rxPSInitDescriptors();
+    } else {
+        for (i = 0; i < numRxDesc; i++) {
+            rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[i].phyAddr);
+            rxDescArray[i].read.reserved = 0;
+        }
     }
     rxCleanedCount = rxNextDescIndex = 0;
     rxMapNextIndex = 0;
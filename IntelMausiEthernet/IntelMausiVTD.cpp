@@ -26,6 +26,8 @@
 
 #define next_page(x) trunc_page(x + PAGE_SIZE)
 
+#define kTxMapCacheOptions  (kIOMemoryTypeVirtual | kIODirectionOut | kIOMemoryAsReference)
+
 #pragma mark --- initialisation methods for AppleVTD support ---
 
 bool IntelMausi::setupRxMap()
@@ -38,22 +40,24 @@ bool IntelMausi::setupRxMap()
     bool result = false;
 
     /* Alloc ixgbeRxBufferInfo. */
-    rxMapMem = IOMallocZero(kRxMapMemSize);
+    rxMapMem = IOMallocZero(kRxMapMemSize(numRxDesc));
     
     if (!rxMapMem) {
         IOLog("Couldn't alloc rx map.\n");
         goto done;
     }
     rxMapInfo = (intelRxMapInfo *)rxMapMem;
+    rxMapInfo->rxMemRange = (IOAddressRange *)(rxMapInfo + 1);
+    rxMapInfo->rxMemIO = (IOMemoryDescriptor **)(rxMapInfo->rxMemRange + numRxDesc);
     
     /* Setup Ranges for IOMemoryDescriptors. */
-    for (i = 0; i < kNumRxDesc; i++) {
+    for (i = 0; i < numRxDesc; i++) {
         rxMapInfo->rxMemRange[i].address = (IOVirtualAddress)mbuf_datastart(rxBufArray[i].mbuf);
         rxMapInfo->rxMemRange[i].length = PAGE_SIZE;
     }
 
     /* Alloc IOMemoryDescriptors. */
-    for (i = 0, idx = 0; i < kNumRxMemDesc; i++, idx += kRxMemBatchSize) {
+    for (i = 0, idx = 0; i < numRxMemDesc; i++, idx += kRxMemBatchSize) {
         md = IOMemoryDescriptor::withOptions(&rxMapInfo->rxMemRange[idx], kRxMemBatchSize, 0, kernel_task, (kIOMemoryTypeVirtual | kIODirectionIn | kIOMemoryAsReference), mapper);
         
         if (!md) {
@@ -89,7 +93,7 @@ error_prep:
 
 error_rx_desc:
     if (rxMapMem) {
-        for (i = 0; i < kNumRxMemDesc; i++) {
+        for (i = 0; i < numRxMemDesc; i++) {
             md = rxMapInfo->rxMemIO[i];
                             
             if (md) {
@@ -98,7 +102,7 @@ error_rx_desc:
             }
             rxMapInfo->rxMemIO[i] = NULL;
         }
-        IOFree(rxMapMem, kRxMapMemSize);
+        IOFree(rxMapMem, kRxMapMemSize(numRxDesc));
         rxMapMem = NULL;
     }
     goto done;
@@ -110,7 +114,7 @@ void IntelMausi::freeRxMap()
     UInt32 i;
 
     if (rxMapMem) {
-        for (i = 0; i < kNumRxMemDesc; i++) {
+        for (i = 0; i < numRxMemDesc; i++) {
             md = rxMapInfo->rxMemIO[i];
                             
             if (md) {
@@ -119,7 +123,7 @@ void IntelMausi::freeRxMap()
             }
             rxMapInfo->rxMemIO[i] = NULL;
         }
-        IOFree(rxMapMem, kRxMapMemSize);
+        IOFree(rxMapMem, kRxMapMemSize(numRxDesc));
         rxMapMem = NULL;
     }
 }
@@ -128,17 +132,23 @@ bool IntelMausi::setupTxMap()
 {
     bool result = false;
 
-    txMapMem = IOMallocZero(kTxMapMemSize);
+    txMapMem = IOMallocZero(kTxMapMemSize(numTxDesc));
     
     if (!txMapMem) {
         IOLog("Couldn't alloc memory for tx map.\n");
         goto done;
     }
     txMapInfo = (intelTxMapInfo *)txMapMem;
+    txMapInfo->txMemRange = (IOAddressRange *)(txMapInfo + 1);
+    txMapInfo->txMemIO = (IOMemoryDescriptor **)(txMapInfo->txMemRange + kNumTxRanges(numTxDesc));
     
     txMapInfo->txNextMem2Use = 0;
     txMapInfo->txNextMem2Free = 0;
-    txMapInfo->txNumFreeMem = kNumTxMemDesc;
+    txMapInfo->txNumFreeMem = numTxMemDesc;
+
+    /* Without the cache every packet is mapped on its own. */
+    if (txMapCacheSize && !setupTxMapCache())
+        IOLog("Couldn't alloc tx map cache.\n");
 
     result = true;
     
@@ -150,19 +160,160 @@ void IntelMausi::freeTxMap()
 {
     UInt32 i;
 
+    freeTxMapCache();
+
     if (txMapMem) {
-        for (i = 0; i < kNumTxMemDesc; i++) {
+        for (i = 0; i < numTxMemDesc; i++) {
             if (txMapInfo->txMemIO[i]) {
                 txMapInfo->txMemIO[i]->complete();
                 txMapInfo->txMemIO[i]->release();
                 txMapInfo->txMemIO[i] = NULL;
             }
         }
-        IOFree(txMapMem, kTxMapMemSize);
+        IOFree(txMapMem, kTxMapMemSize(numTxDesc));
         txMapMem = NULL;
     }
 }
 
+bool IntelMausi::setupTxMapCache()
+{
+    bool result = false;
+
+    txMapCacheMem = IOMallocZero(kTxMapCacheMemSize(numTxDesc, txMapCacheSize));
+
+    if (!txMapCacheMem)
+        goto done;
+
+    txMapCache = (intelTxMapCache *)txMapCacheMem;
+    txMapCache->entries = (intelTxMapCacheEntry *)(txMapCache + 1);
+    txMapCache->hash = (UInt16 *)(txMapCache->entries + txMapCacheSize);
+    txMapCache->memRefs = txMapCache->hash + kTxMapCacheBuckets;
+    txMapCache->numEntries = txMapCacheSize;
+
+    txMapCacheFlush();
+
+    IOLog("Tx map cache with %u pages.\n", txMapCacheSize);
+    result = true;
+
+done:
+    return result;
+}
+
+void IntelMausi::freeTxMapCache()
+{
+    UInt32 i;
+
+    if (txMapCacheMem) {
+        txMapCacheFlush();
+
+        for (i = 0; i < txMapCache->numEntries; i++)
+            RELEASE(txMapCache->entries[i].md);
+
+        IOFree(txMapCacheMem, kTxMapCacheMemSize(numTxDesc, txMapCacheSize));
+        txMapCacheMem = NULL;
+        txMapCache = NULL;
+    }
+}
+
+/*
+ * Unmap all cached pages and reset the cache to its initial state
+ * with all entries on the free list. The IOMemoryDescriptors are
+ * kept for reuse.
+ */
+void IntelMausi::txMapCacheFlush()
+{
+    intelTxMapCacheEntry *entry;
+    UInt32 i;
+
+    for (i = 0; i < txMapCache->numEntries; i++) {
+        entry = &txMapCache->entries[i];
+
+        if (entry->md && (entry->md->getTag() == kIOMemoryActive)) {
+            entry->md->complete();
+            entry->md->setTag(kIOMemoryInactive);
+        }
+    }
+    txMapCacheReset(txMapCache, numTxMemDesc, kTxMapCacheRefs);
+}
+
+/*
+ * Drop the page references of all packets which have been completed
+ * since the last call. As txUnmapPacket() runs on the workloop, the
+ * references are released on the output thread which owns the cache.
+ * Idle pages stay mapped until txMapCacheGet() needs their entry, so
+ * that the cache never holds more than txMapCacheSize pages.
+ */
+void IntelMausi::txMapCacheRelease()
+{
+    UInt16 *refs;
+    UInt16 end = txMapInfo->txNextMem2Free & txMemDescMask;
+    UInt16 i;
+
+    while (txMapCache->nextMem2Release != end) {
+        refs = &txMapCache->memRefs[txMapCache->nextMem2Release * kTxMapCacheRefs];
+
+        for (i = 1; i <= refs[0]; i++)
+            txMapCachePut(txMapCache, refs[i]);
+
+        refs[0] = 0;
+        ++(txMapCache->nextMem2Release) &= txMemDescMask;
+    }
+}
+
+/*
+ * Get a reference to a mapped page. In case the page isn't cached
+ * yet, an unused entry or the least recently used one is mapped.
+ * @page    Virtual address of the page.
+ * @phys    Physical address of the page.
+ * @result  Index of the cache entry or kTxMapCacheNone in case all
+ *          entries are in use or mapping failed.
+ */
+UInt16 IntelMausi::txMapCacheGet(IOVirtualAddress page, IOPhysicalAddress64 phys)
+{
+    intelTxMapCacheEntry *entry;
+    UInt16 index = kTxMapCacheNone;
+    bool unmap;
+    bool result;
+
+    switch (txMapCacheLookup(txMapCache, page, phys, &index, &unmap)) {
+        case kTxMapCacheHit:
+            drvStats[kDrvStatTxMapCacheHits]++;
+            goto done;
+
+        case kTxMapCacheFull:
+            index = kTxMapCacheNone;
+            goto done;
+    }
+    drvStats[kDrvStatTxMapCacheMisses]++;
+    entry = &txMapCache->entries[index];
+
+    if (unmap) {
+        entry->md->complete();
+        entry->md->setTag(kIOMemoryInactive);
+        drvStats[kDrvStatTxMapCacheEvictions]++;
+    }
+    if (entry->md) {
+        result = entry->md->initWithOptions(&entry->range, 1, 0, kernel_task, kTxMapCacheOptions, mapper);
+    } else {
+        entry->md = IOMemoryDescriptor::withOptions(&entry->range, 1, 0, kernel_task, kTxMapCacheOptions, mapper);
+        result = (entry->md != NULL);
+    }
+    if (!result || (entry->md->prepare() != kIOReturnSuccess)) {
+        DebugLog("Failed to map page for tx map cache.\n");
+        goto error_map;
+    }
+    entry->md->setTag(kIOMemoryActive);
+    txMapCacheInsert(txMapCache, index, entry->md->getPhysicalSegment(0, NULL));
+
+done:
+    return index;
+
+error_map:
+    txMapCacheFree(txMapCache, index);
+    index = kTxMapCacheNone;
+    goto done;
+}
+
 #pragma mark --- interrupt methods for AppleVTD support ---
 
 void IntelMausi::interruptOccurredVTD(OSObject *client, IOInterruptEventSource *src, int count)
@@ -179,7 +330,7 @@ void IntelMausi::interruptOccurredVTD(OSObject *client, IOInterruptEventSource *
         }
 
         if (icr & (E1000_ICR_RXQ0 | E1000_ICR_RXT0 | E1000_ICR_RXDMT0)) {
-            packets = rxInterruptVTD(netif, kNumRxDesc, NULL, NULL);
+            packets = rxInterruptVTD(netif, numRxDesc, NULL, NULL);
             etherStats->dot3RxExtraEntry.interrupts++;
 
             if (packets)
@@ -210,7 +361,9 @@ void IntelMausi::interruptOccurredVTD(OSObject *client, IOInterruptEventSource *
  * Map a tx packet for read DMA access by the NIC.
  * The packet is split up into physical contiguous segments
  * and an IOMemoryDescriptor is used to map all segments for
- * DMA access.
+ * DMA access. With the tx map cache, the pages of packets
+ * in mbuf clusters are taken from the cache instead and the
+ * IOMemoryDescriptor slot only records the references.
  */
 UInt32 IntelMausi::txMapPacket(mbuf_t packet,
                             IOPhysicalSegment *vector,
@@ -219,14 +372,18 @@ UInt32 IntelMausi::txMapPacket(mbuf_t packet,
     IOMemoryDescriptor *md = NULL;
     IOAddressRange *srcRange;
     IOAddressRange *dstRange;
+    UInt16 *refs;
     mbuf_t m;
     IOVirtualAddress d;
     IOByteCount offset;
+    IOPhysicalAddress64 phys;
     UInt64 len, l;
     UInt32 segIndex = 0;
     UInt32 i;
     UInt16 saveMem;
+    UInt16 entry;
     bool result = false;
+    bool clusters = true;
 
     if (packet && vector && maxSegs) {
         srcRange = txMapInfo->txSCRange;
@@ -238,6 +395,7 @@ UInt32 IntelMausi::txMapPacket(mbuf_t packet,
         if (mbuf_next(m) == 0) {
             d = (IOVirtualAddress)mbuf_data(m);
             len = mbuf_len(m);
+            clusters = (mbuf_flags(m) & MBUF_EXT);
             
             if ( trunc_page(d) == trunc_page(d + len - 1) ) {
                 srcRange[0].address = d;
@@ -248,6 +406,7 @@ UInt32 IntelMausi::txMapPacket(mbuf_t packet,
         }
         do {
             d = (IOVirtualAddress)mbuf_data(m);
+            clusters &= ((mbuf_flags(m) & MBUF_EXT) != 0);
             
             for (len = mbuf_len(m); len; d += l, len -= l) {
                 l = MIN(len, PAGE_SIZE);
@@ -270,6 +429,36 @@ map:
          * an IOMemoryDescriptor to map the packet.
          */
         if (txMapInfo->txNumFreeMem > 1) {
+            if (txMapCache && clusters) {
+                txMapCacheRelease();
+
+                refs = &txMapCache->memRefs[txMapInfo->txNextMem2Use * kTxMapCacheRefs];
+
+                for (i = 0; i < segIndex; i++) {
+                    phys = mbuf_data_to_physical((void *)srcRange[i].address);
+
+                    if (!phys)
+                        break;
+
+                    entry = txMapCacheGet(trunc_page(srcRange[i].address), trunc_page(phys));
+
+                    if (entry == kTxMapCacheNone)
+                        break;
+
+                    refs[i + 1] = entry;
+                    vector[i].location = txMapCache->entries[entry].iova + (srcRange[i].address & PAGE_MASK);
+                    vector[i].length = srcRange[i].length;
+                }
+                if (i == segIndex) {
+                    refs[0] = segIndex;
+                    OSAddAtomic16(-1, &txMapInfo->txNumFreeMem);
+                    ++(txMapInfo->txNextMem2Use) &= txMemDescMask;
+                    goto merge;
+                }
+                /* Fall back to mapping the packet on its own. */
+                while (i--)
+                    txMapCachePut(txMapCache, refs[i + 1]);
+            }
             dstRange = &txMapInfo->txMemRange[txNextDescIndex];
             
             for (i = 0; i < segIndex; i++) {
@@ -279,7 +468,7 @@ map:
             }
             OSAddAtomic16(-1, &txMapInfo->txNumFreeMem);
             saveMem = txMapInfo->txNextMem2Use++;
-            txMapInfo->txNextMem2Use &= kTxMemDescMask;
+            txMapInfo->txNextMem2Use &= txMemDescMask;
             md = txMapInfo->txMemIO[saveMem];
             
             if (md) {
@@ -315,6 +504,12 @@ map:
                 //DebugLog("Phy. Segment %u addr: %llx, len: %llu\n", i, vector[i].location, vector[i].length);
                 offset += PAGE_SIZE;
             }
+merge:
+            if (segIndex > 1) {
+                i = txMergeSegments(vector, segIndex, kTxMaxMergedSegSize);
+                drvStats[kDrvStatTxMergedSegments] += segIndex - i;
+                segIndex = i;
+            }
         }
     }
     
@@ -337,10 +532,13 @@ void IntelMausi::txUnmapPacket()
 {
     IOMemoryDescriptor *md = txMapInfo->txMemIO[txMapInfo->txNextMem2Free];
     
-    md->complete();
-    md->setTag(kIOMemoryInactive);
+    /* Packets mapped by the cache release their pages on the output thread. */
+    if (md && (md->getTag() == kIOMemoryActive)) {
+        md->complete();
+        md->setTag(kIOMemoryInactive);
+    }
     
-    ++(txMapInfo->txNextMem2Free) &= kTxMemDescMask;
+    ++(txMapInfo->txNextMem2Free) &= txMemDescMask;
     OSAddAtomic16(1, &txMapInfo->txNumFreeMem);
 }
 
@@ -412,7 +610,7 @@ UInt16 IntelMausi::rxMapBuffers(UInt16 index, UInt16 count, bool update)
         
 next_batch:
         rdt = index + kRxMemDescMask;
-        index = (index + kRxMemBatchSize) & kRxDescMask;
+        index = (index + kRxMemBatchSize) & rxDescMask;
         rxMapNextIndex = index;
 
         if (update) {
@@ -533,12 +731,16 @@ UInt32 IntelMausi::rxInterruptVTD(IONetworkInterface *interface, uint32_t maxCou
         if ((rxNextDescIndex & kRxMemDescMask) == kRxMemDescMask)
             rxCleanedCount++;
         
-        ++rxNextDescIndex &= kRxDescMask;
+        ++rxNextDescIndex &= rxDescMask;
         desc = &rxDescArray[rxNextDescIndex];
     }
     if (rxCleanedCount) {
         rxMapBuffers(rxMapNextIndex, rxCleanedCount, true);
         rxCleanedCount = 0;
     }
+    /* Use the remaining budget to top up the buffer pool. */
+    if (goodPkts < maxCount)
+        rxPool->refillNow(maxCount - goodPkts);
+    
     return goodPkts;
 }
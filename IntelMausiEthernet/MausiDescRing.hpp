@@ -0,0 +1,57 @@
+//
+//  MausiDescRing.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Index arithmetic of the descriptor rings. Ring sizes are powers of 2,
+//  so that indices wrap around by masking with the size minus 1. The
+//  functions are kept apart from the driver, so that wraparound can be
+//  tested outside of the kernel for every supported ring size.
+//
+
+#ifndef MausiDescRing_hpp
+#define MausiDescRing_hpp
+
+/* The number of descriptors must be a power of 2. */
+#define kNumDescDefault 512     /* Default number of Tx and Rx descriptors */
+#define kNumDescMin     256
+#define kNumDescMax     4096
+
+/*
+ * Check if size is a supported number of descriptors for a ring.
+ */
+static inline bool descRingSizeValid(UInt32 size)
+{
+    return ((size >= kNumDescMin) && (size <= kNumDescMax) && !(size & (size - 1)));
+}
+
+/*
+ * Get the number of descriptors from index from up to, but not including,
+ * index to. A distance of 0 means that the range is empty, so that a ring
+ * must never be filled completely.
+ */
+static inline UInt32 descDistance(UInt32 from, UInt32 to, UInt32 mask)
+{
+    return (to - from) & mask;
+}
+
+/*
+ * Check if index lies in the range from start up to, but not including, end.
+ */
+static inline bool descInRange(UInt32 index, UInt32 start, UInt32 end, UInt32 mask)
+{
+    return (descDistance(start, index, mask) < descDistance(start, end, mask));
+}
+
+/*
+ * Get the index in front of index, e.g. the rx tail which is kept one
+ * descriptor behind the next descriptor to be cleaned.
+ */
+static inline UInt32 descPrev(UInt32 index, UInt32 mask)
+{
+    return (index - 1) & mask;
+}
+
+#endif /* MausiDescRing_hpp */
@@ -0,0 +1,481 @@
+//
+//  MausiFQCoDel.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#include "MausiFQCoDel.hpp"
+
+OSDefineMetaClassAndStructors(MausiFQCoDel, OSObject);
+
+#define super OSObject
+
+#define kEtherTypeIPv4      0x0800
+#define kEtherTypeIPv6      0x86dd
+#define kEtherTypeVlan      0x8100
+
+#define kIPProtoTCP         6
+#define kIPProtoUDP         17
+
+static inline UInt16 getBE16(const UInt8 *p)
+{
+    return (UInt16)((p[0] << 8) | p[1]);
+}
+
+static inline UInt32 getWord(const UInt8 *p)
+{
+    return (((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3]);
+}
+
+static inline UInt32 hashMix(UInt32 h, UInt32 val)
+{
+    h ^= val;
+    h *= 0x9e3779b1;
+    h ^= h >> 15;
+
+    return h;
+}
+
+static UInt32 intSqrt(UInt32 n)
+{
+    UInt32 x = n;
+    UInt32 y = (x + 1) >> 1;
+
+    while (y < x) {
+        x = y;
+        y = (x + n / x) >> 1;
+    }
+    return x;
+}
+
+bool MausiFQCoDel::init()
+{
+    if (!super::init())
+        return false;
+
+    flows = NULL;
+    entries = NULL;
+    freeEntries = NULL;
+    newFlows.head = newFlows.tail = NULL;
+    oldFlows.head = oldFlows.tail = NULL;
+    numFlows = 0;
+    packets = 0;
+    codelDrops = 0;
+    overlimitDrops = 0;
+
+    return true;
+}
+
+void MausiFQCoDel::free()
+{
+    if (flows) {
+        flush();
+        IOFree(flows, numFlows * sizeof(struct MausiFQFlow));
+        flows = NULL;
+    }
+    if (entries) {
+        IOFree(entries, limit * sizeof(struct MausiFQPacket));
+        entries = NULL;
+    }
+    super::free();
+}
+
+bool MausiFQCoDel::initWithParams(UInt32 nFlows, UInt32 maxPkts, UInt32 quant,
+                                  UInt64 targetTime, UInt64 intervalTime)
+{
+    UInt32 i;
+    bool result = false;
+
+    if (!init())
+        goto done;
+
+    if ((nFlows == 0) || (maxPkts == 0) || (quant == 0))
+        goto done;
+
+    flows = (struct MausiFQFlow *)IOMallocZero(nFlows * sizeof(struct MausiFQFlow));
+
+    if (!flows)
+        goto done;
+
+    numFlows = nFlows;
+
+    entries = (struct MausiFQPacket *)IOMallocZero(maxPkts * sizeof(struct MausiFQPacket));
+
+    if (!entries)
+        goto done;
+
+    limit = maxPkts;
+
+    for (i = 0; i < limit; i++) {
+        entries[i].next = freeEntries;
+        freeEntries = &entries[i];
+    }
+    quantum = quant;
+    target = targetTime;
+    interval = intervalTime;
+    hashSeed = (UInt32)random();
+
+    result = true;
+
+done:
+    return result;
+}
+
+MausiFQCoDel *
+MausiFQCoDel::withParams(UInt32 numFlows, UInt32 limit, UInt32 quantum,
+                         UInt64 target, UInt64 interval)
+{
+    MausiFQCoDel *fq = new MausiFQCoDel;
+
+    if (fq && !fq->initWithParams(numFlows, limit, quantum,
+                                  target, interval)) {
+        fq->release();
+        fq = NULL;
+    }
+    return fq;
+}
+
+#pragma mark--- flow management ---
+
+void MausiFQCoDel::listAppend(struct MausiFQList *list, struct MausiFQFlow *flow)
+{
+    flow->next = NULL;
+
+    if (list->tail)
+        list->tail->next = flow;
+    else
+        list->head = flow;
+
+    list->tail = flow;
+}
+
+struct MausiFQFlow * MausiFQCoDel::listPop(struct MausiFQList *list)
+{
+    struct MausiFQFlow *flow = list->head;
+
+    if (flow) {
+        list->head = flow->next;
+
+        if (!list->head)
+            list->tail = NULL;
+
+        flow->next = NULL;
+    }
+    return flow;
+}
+
+/*
+ * Hash the 5-tuple of IPv4 and IPv6 packets. Everything else, as well
+ * as packets with headers not in the first mbuf, is hashed by its
+ * ethertype only.
+ */
+UInt32 MausiFQCoDel::flowHash(mbuf_t m)
+{
+    const UInt8 *p = (const UInt8 *)mbuf_data(m);
+    const UInt8 *ip;
+    size_t len = mbuf_len(m);
+    UInt32 l3 = ETHER_HDR_LEN;
+    UInt32 l4 = 0;
+    UInt32 h = hashSeed;
+    UInt16 etherType;
+    UInt8 proto = 0;
+
+    if (len < ETHER_HDR_LEN)
+        goto done;
+
+    etherType = getBE16(&p[l3 - 2]);
+
+    if ((etherType == kEtherTypeVlan) && (len >= (l3 + 4))) {
+        h = hashMix(h, getBE16(&p[l3]) & 0x0fff);
+        l3 += 4;
+        etherType = getBE16(&p[l3 - 2]);
+    }
+    h = hashMix(h, etherType);
+    ip = &p[l3];
+
+    if ((etherType == kEtherTypeIPv4) && (len >= (l3 + 20))) {
+        proto = ip[9];
+        h = hashMix(h, getWord(&ip[12]));
+        h = hashMix(h, getWord(&ip[16]));
+
+        /* Only the first fragment has the ports. */
+        if (!(getBE16(&ip[6]) & 0x1fff))
+            l4 = l3 + ((ip[0] & 0x0f) << 2);
+    } else if ((etherType == kEtherTypeIPv6) && (len >= (l3 + 40))) {
+        proto = ip[6];
+
+        for (UInt32 i = 8; i < 40; i += 4)
+            h = hashMix(h, getWord(&ip[i]));
+
+        l4 = l3 + 40;
+    }
+    h = hashMix(h, proto);
+
+    if (((proto == kIPProtoTCP) || (proto == kIPProtoUDP)) && l4 && (len >= (l4 + 4)))
+        h = hashMix(h, getWord(&p[l4]));
+
+done:
+    return h % numFlows;
+}
+
+struct MausiFQPacket * MausiFQCoDel::flowPop(struct MausiFQFlow *flow)
+{
+    struct MausiFQPacket *pkt = flow->head;
+
+    if (pkt) {
+        flow->head = pkt->next;
+
+        if (!flow->head)
+            flow->tail = NULL;
+
+        flow->backlog -= pkt->len;
+        packets--;
+    }
+    return pkt;
+}
+
+/*
+ * Return a packet's entry to the free list.
+ * @result  The packet's mbuf.
+ */
+mbuf_t MausiFQCoDel::entryFree(struct MausiFQPacket *pkt)
+{
+    mbuf_t m = pkt->m;
+
+    pkt->m = NULL;
+    pkt->next = freeEntries;
+    freeEntries = pkt;
+
+    return m;
+}
+
+/*
+ * Drop a batch of packets from the head of the longest queue like
+ * Linux' fq_codel_drop(): half of its backlog, but no more than
+ * kFQCoDelDropBatch packets. Only queues on the new or the old list
+ * can have a backlog, so that only the active flows are searched and
+ * the search is done once per batch instead of once per packet.
+ */
+void MausiFQCoDel::dropFromLongest()
+{
+    struct MausiFQFlow *fattest = NULL;
+    struct MausiFQFlow *flow;
+    struct MausiFQPacket *pkt;
+    UInt32 maxBacklog = 0;
+    UInt32 threshold;
+    UInt32 dropped = 0;
+    UInt32 count = 0;
+
+    for (flow = newFlows.head; flow; flow = flow->next) {
+        if (flow->backlog > maxBacklog) {
+            maxBacklog = flow->backlog;
+            fattest = flow;
+        }
+    }
+    for (flow = oldFlows.head; flow; flow = flow->next) {
+        if (flow->backlog > maxBacklog) {
+            maxBacklog = flow->backlog;
+            fattest = flow;
+        }
+    }
+    if (!fattest)
+        return;
+
+    threshold = maxBacklog >> 1;
+
+    while ((dropped < threshold) && (count < kFQCoDelDropBatch)) {
+        pkt = flowPop(fattest);
+
+        if (!pkt)
+            break;
+
+        dropped += pkt->len;
+        count++;
+        mbuf_freem(entryFree(pkt));
+    }
+    overlimitDrops += count;
+}
+
+void MausiFQCoDel::enqueue(mbuf_t m, UInt64 now)
+{
+    struct MausiFQFlow *flow = &flows[flowHash(m)];
+    struct MausiFQPacket *pkt;
+
+    /* Make room for the packet in case the limit has been reached. */
+    if (!freeEntries)
+        dropFromLongest();
+
+    pkt = freeEntries;
+    freeEntries = pkt->next;
+
+    mbuf_setnextpkt(m, NULL);
+    pkt->next = NULL;
+    pkt->m = m;
+    pkt->time = now;
+    pkt->len = (UInt32)mbuf_pkthdr_len(m);
+
+    if (flow->tail)
+        flow->tail->next = pkt;
+    else
+        flow->head = pkt;
+
+    flow->tail = pkt;
+    flow->backlog += pkt->len;
+    packets++;
+
+    if (!flow->listed) {
+        flow->deficit = quantum;
+        flow->listed = true;
+        listAppend(&newFlows, flow);
+    }
+}
+
+#pragma mark--- CoDel ---
+
+UInt64 MausiFQCoDel::controlLaw(UInt64 t, UInt32 count)
+{
+    return t + interval / intSqrt(count ? count : 1);
+}
+
+bool MausiFQCoDel::shouldDrop(struct MausiFQFlow *flow, struct MausiFQPacket *pkt, UInt64 now)
+{
+    bool result = false;
+
+    if (!pkt) {
+        flow->firstAboveTime = 0;
+        goto done;
+    }
+
+    /* Don't drop the last packet of a queue. */
+    if (((now - pkt->time) < target) || (flow->backlog <= quantum)) {
+        flow->firstAboveTime = 0;
+        goto done;
+    }
+    if (flow->firstAboveTime == 0)
+        flow->firstAboveTime = now + interval;
+    else if (now >= flow->firstAboveTime)
+        result = true;
+
+done:
+    return result;
+}
+
+struct MausiFQPacket * MausiFQCoDel::codelDequeue(struct MausiFQFlow *flow, UInt64 now)
+{
+    struct MausiFQPacket *pkt = flowPop(flow);
+    UInt32 delta;
+    bool drop;
+
+    if (!pkt) {
+        flow->dropping = false;
+        goto done;
+    }
+    drop = shouldDrop(flow, pkt, now);
+
+    if (flow->dropping) {
+        if (!drop) {
+            flow->dropping = false;
+        } else {
+            while (flow->dropping && (now >= flow->dropNext)) {
+                flow->count++;
+                mbuf_freem(entryFree(pkt));
+                codelDrops++;
+
+                pkt = flowPop(flow);
+
+                if (!shouldDrop(flow, pkt, now))
+                    flow->dropping = false;
+                else
+                    flow->dropNext = controlLaw(flow->dropNext, flow->count);
+            }
+        }
+    } else if (drop) {
+        mbuf_freem(entryFree(pkt));
+        codelDrops++;
+
+        pkt = flowPop(flow);
+        shouldDrop(flow, pkt, now);
+
+        flow->dropping = true;
+        delta = flow->count - flow->lastCount;
+
+        /* Resume at the previous drop rate if we left dropping state recently. */
+        if ((delta > 1) && ((now - flow->dropNext) < (16 * interval)))
+            flow->count = delta;
+        else
+            flow->count = 1;
+
+        flow->lastCount = flow->count;
+        flow->dropNext = controlLaw(now, flow->count);
+    }
+
+done:
+    return pkt;
+}
+
+#pragma mark--- scheduler ---
+
+mbuf_t MausiFQCoDel::dequeue(UInt64 now)
+{
+    struct MausiFQList *list;
+    struct MausiFQFlow *flow;
+    struct MausiFQPacket *pkt;
+    mbuf_t m = NULL;
+
+    while (true) {
+        list = &newFlows;
+
+        if (!list->head) {
+            list = &oldFlows;
+
+            if (!list->head)
+                break;
+        }
+        flow = list->head;
+
+        if (flow->deficit <= 0) {
+            flow->deficit += quantum;
+            listPop(list);
+            listAppend(&oldFlows, flow);
+            continue;
+        }
+        pkt = codelDequeue(flow, now);
+
+        if (!pkt) {
+            listPop(list);
+
+            /* Keep new flows around for one round to prevent starving old ones. */
+            if ((list == &newFlows) && oldFlows.head)
+                listAppend(&oldFlows, flow);
+            else
+                flow->listed = false;
+
+            continue;
+        }
+        flow->deficit -= (SInt32)pkt->len;
+        m = entryFree(pkt);
+        break;
+    }
+    return m;
+}
+
+void MausiFQCoDel::flush()
+{
+    struct MausiFQFlow *flow;
+    struct MausiFQPacket *pkt;
+    UInt32 i;
+
+    for (i = 0; i < numFlows; i++) {
+        flow = &flows[i];
+
+        while ((pkt = flowPop(flow)))
+            mbuf_freem(entryFree(pkt));
+
+        bzero(flow, sizeof(struct MausiFQFlow));
+    }
+    newFlows.head = newFlows.tail = NULL;
+    oldFlows.head = oldFlows.tail = NULL;
+    packets = 0;
+}
@@ -0,0 +1,120 @@
+//
+//  MausiFQCoDel.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Flow queueing with CoDel as described in RFC 8290. Packets are
+//  hashed into a fixed number of flow queues which are served with
+//  deficit round robin, new flows first. Each queue is managed by
+//  CoDel based on the time packets spent in the scheduler. The enqueue
+//  time is kept in an entry owned by the scheduler, so that the mbuf's
+//  own timestamp is left alone.
+//
+
+#ifndef MausiFQCoDel_hpp
+#define MausiFQCoDel_hpp
+
+#define kFQCoDelFlows       1024
+#define kFQCoDelLimit       1024        /* packets in all queues */
+#define kFQCoDelQuantum     1514        /* bytes per round */
+#define kFQCoDelTarget      5000000ULL  /* 5ms in ns */
+#define kFQCoDelInterval    100000000ULL    /* 100ms in ns */
+#define kFQCoDelDropBatch   64          /* packets dropped at once over the limit */
+
+/* Queue entry of a packet, one for each packet the limit allows. */
+struct MausiFQPacket {
+    struct MausiFQPacket *next;
+    mbuf_t m;
+    UInt64 time;                /* enqueue time in ns */
+    UInt32 len;
+};
+
+struct MausiFQFlow {
+    struct MausiFQFlow *next;   /* in the new or the old list */
+    struct MausiFQPacket *head;
+    struct MausiFQPacket *tail;
+    SInt32 deficit;
+    UInt32 backlog;             /* bytes */
+    UInt64 firstAboveTime;
+    UInt64 dropNext;
+    UInt32 count;
+    UInt32 lastCount;
+    bool dropping;
+    bool listed;
+};
+
+struct MausiFQList {
+    struct MausiFQFlow *head;
+    struct MausiFQFlow *tail;
+};
+
+class MausiFQCoDel : public OSObject
+{
+    OSDeclareDefaultStructors(MausiFQCoDel);
+
+public:
+    virtual bool init() APPLE_KEXT_OVERRIDE;
+
+    virtual void free() APPLE_KEXT_OVERRIDE;
+
+    virtual bool initWithParams(UInt32 numFlows, UInt32 limit, UInt32 quantum,
+                                UInt64 target, UInt64 interval);
+
+    static MausiFQCoDel * withParams(UInt32 numFlows, UInt32 limit, UInt32 quantum,
+                                     UInt64 target, UInt64 interval);
+
+    /*
+     * Add a packet to its flow's queue. In case the limit has been
+     * reached, a batch of packets is dropped from the head of the
+     * longest queue first.
+     * @m       The packet.
+     * @now     Current time in ns.
+     */
+    void enqueue(mbuf_t m, UInt64 now);
+
+    /*
+     * Get the next packet to send. Packets which CoDel decides to drop
+     * are freed.
+     * @now     Current time in ns.
+     * @result  The packet or NULL in case all queues are empty.
+     */
+    mbuf_t dequeue(UInt64 now);
+
+    /* Free all queued packets. */
+    void flush();
+
+    inline UInt32 getPackets() { return packets; };
+    inline UInt32 getSpace() { return (packets < limit) ? (limit - packets) : 0; };
+
+    UInt64 codelDrops;
+    UInt64 overlimitDrops;
+
+protected:
+    UInt32 flowHash(mbuf_t m);
+    struct MausiFQPacket * flowPop(struct MausiFQFlow *flow);
+    mbuf_t entryFree(struct MausiFQPacket *pkt);
+    bool shouldDrop(struct MausiFQFlow *flow, struct MausiFQPacket *pkt, UInt64 now);
+    struct MausiFQPacket * codelDequeue(struct MausiFQFlow *flow, UInt64 now);
+    UInt64 controlLaw(UInt64 t, UInt32 count);
+    void dropFromLongest();
+
+    static void listAppend(struct MausiFQList *list, struct MausiFQFlow *flow);
+    static struct MausiFQFlow * listPop(struct MausiFQList *list);
+
+    struct MausiFQFlow *flows;
+    struct MausiFQPacket *entries;
+    struct MausiFQPacket *freeEntries;
+    struct MausiFQList newFlows;
+    struct MausiFQList oldFlows;
+    UInt64 target;
+    UInt64 interval;
+    UInt32 numFlows;
+    UInt32 limit;
+    UInt32 quantum;
+    UInt32 packets;
+    UInt32 hashSeed;
+};
+
+#endif /* MausiFQCoDel_hpp */
@@ -0,0 +1,277 @@
+//
+//  MausiGSO.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#include "MausiGSO.hpp"
+
+#define kEtherTypeIPv4      0x0800
+#define kEtherTypeIPv6      0x86dd
+#define kEtherTypeVlan      0x8100
+
+#define kIPv4HdrMinLen      20
+#define kIPv6HdrLen         40
+#define kTCPHdrMinLen       20
+#define kIPProtoTCP         6
+
+#define kIPv6ExtHopByHop    0
+#define kIPv6ExtRouting     43
+#define kIPv6ExtFragment    44
+#define kIPv6ExtAuth        51
+#define kIPv6ExtDestOpts    60
+#define kIPv6MaxExtHdrs     8
+
+#define kIPv4LenOffset      2
+#define kIPv4IdOffset       4
+#define kIPv4FragOffset     6
+#define kIPv4ProtoOffset    9
+#define kIPv4CSumOffset     10
+#define kIPv4SrcOffset      12
+#define kIPv6LenOffset      4
+#define kIPv6NextOffset     6
+#define kIPv6SrcOffset      8
+#define kTCPSeqOffset       4
+#define kTCPDataOffset      12
+#define kTCPFlagsOffset     13
+#define kTCPCSumOffset      16
+
+#define kIPv4FragMask       0x3fff  /* MF flag and fragment offset */
+
+#define kTCPFlagFIN         0x01
+#define kTCPFlagPSH         0x08
+#define kTCPFlagCWR         0x80
+
+static inline bool isIPv6ExtHdr(UInt8 next)
+{
+    return ((next == kIPv6ExtHopByHop) || (next == kIPv6ExtRouting) ||
+            (next == kIPv6ExtFragment) || (next == kIPv6ExtAuth) ||
+            (next == kIPv6ExtDestOpts));
+}
+
+bool gsoParseOffsets(const UInt8 *hdr, UInt32 hdrBufLen, struct MausiHdrOffsets *offs)
+{
+    const UInt8 *ip;
+    const UInt8 *ext;
+    UInt32 l3, l4, len, i;
+    UInt16 etherType;
+    UInt8 next;
+    bool result = false;
+
+    if (hdrBufLen < ETHER_HDR_LEN)
+        goto done;
+
+    l3 = ETHER_HDR_LEN;
+    etherType = getBE16(&hdr[l3 - 2]);
+
+    /* VLAN tag in the payload. */
+    if (etherType == kEtherTypeVlan) {
+        l3 += 4;
+
+        if (hdrBufLen < l3)
+            goto done;
+
+        etherType = getBE16(&hdr[l3 - 2]);
+    }
+    ip = &hdr[l3];
+
+    if (etherType == kEtherTypeIPv4) {
+        if ((hdrBufLen < (l3 + kIPv4HdrMinLen)) || ((ip[0] >> 4) != 4))
+            goto done;
+
+        len = (ip[0] & 0x0f) << 2;
+
+        if ((len < kIPv4HdrMinLen) || (hdrBufLen < (l3 + len)))
+            goto done;
+
+        offs->type = kGSOTypeIPv4;
+        next = ip[kIPv4ProtoOffset];
+        l4 = l3 + len;
+    } else if (etherType == kEtherTypeIPv6) {
+        if ((hdrBufLen < (l3 + kIPv6HdrLen)) || ((ip[0] >> 4) != 6))
+            goto done;
+
+        offs->type = kGSOTypeIPv6;
+        next = ip[kIPv6NextOffset];
+        l4 = l3 + kIPv6HdrLen;
+
+        for (i = 0; isIPv6ExtHdr(next); i++) {
+            if ((i == kIPv6MaxExtHdrs) || (hdrBufLen < (l4 + 2)))
+                goto done;
+
+            ext = &hdr[l4];
+
+            if (next == kIPv6ExtFragment)
+                len = 8;
+            else if (next == kIPv6ExtAuth)
+                len = (ext[1] + 2) << 2;
+            else
+                len = (ext[1] + 1) << 3;
+
+            next = ext[0];
+            l4 += len;
+        }
+        if (hdrBufLen < l4)
+            goto done;
+    } else {
+        goto done;
+    }
+    offs->l3Offset = l3;
+    offs->l4Offset = l4;
+    offs->l4Proto = next;
+
+    result = true;
+
+done:
+    return result;
+}
+
+bool gsoParseHeader(const UInt8 *hdr, UInt32 hdrBufLen, UInt32 pktLen,
+                    UInt32 mss, struct MausiGSOInfo *info)
+{
+    const UInt8 *ip;
+    const UInt8 *tcp;
+    UInt32 l3, l4, len;
+    UInt16 etherType;
+    bool result = false;
+
+    if ((mss < kGSOMinMSS) || (mss > 0xffff) || (hdrBufLen < ETHER_HDR_LEN))
+        goto done;
+
+    l3 = ETHER_HDR_LEN;
+    etherType = getBE16(&hdr[l3 - 2]);
+
+    /* VLAN tag in the payload. */
+    if (etherType == kEtherTypeVlan) {
+        l3 += 4;
+
+        if (hdrBufLen < l3)
+            goto done;
+
+        etherType = getBE16(&hdr[l3 - 2]);
+    }
+    ip = &hdr[l3];
+
+    if (etherType == kEtherTypeIPv4) {
+        if ((hdrBufLen < (l3 + kIPv4HdrMinLen)) || ((ip[0] >> 4) != 4))
+            goto done;
+
+        len = (ip[0] & 0x0f) << 2;
+
+        if ((len < kIPv4HdrMinLen) || (ip[kIPv4ProtoOffset] != kIPProtoTCP))
+            goto done;
+
+        /* Fragments can't be segmented. */
+        if (getBE16(&ip[kIPv4FragOffset]) & kIPv4FragMask)
+            goto done;
+
+        info->type = kGSOTypeIPv4;
+        info->ipId = getBE16(&ip[kIPv4IdOffset]);
+        info->pseudoSum = sumWords(&ip[kIPv4SrcOffset], 8) + kIPProtoTCP;
+    } else if (etherType == kEtherTypeIPv6) {
+        if ((hdrBufLen < (l3 + kIPv6HdrLen)) || ((ip[0] >> 4) != 6))
+            goto done;
+
+        /* Extension headers aren't supported. */
+        if (ip[kIPv6NextOffset] != kIPProtoTCP)
+            goto done;
+
+        len = kIPv6HdrLen;
+
+        info->type = kGSOTypeIPv6;
+        info->ipId = 0;
+        info->pseudoSum = sumWords(&ip[kIPv6SrcOffset], 32) + kIPProtoTCP;
+    } else {
+        goto done;
+    }
+    l4 = l3 + len;
+
+    if (hdrBufLen < (l4 + kTCPHdrMinLen))
+        goto done;
+
+    tcp = &hdr[l4];
+    len = (tcp[kTCPDataOffset] >> 4) << 2;
+
+    if ((len < kTCPHdrMinLen) || ((l4 + len) > hdrBufLen) || ((l4 + len) > kGSOMaxHdrLen))
+        goto done;
+
+    if (pktLen <= (l4 + len))
+        goto done;
+
+    /* The segment count must fit into info->numSegs. */
+    if (((pktLen - (l4 + len) + mss - 1) / mss) > 0xffff)
+        goto done;
+
+    info->l3Offset = l3;
+    info->l4Offset = l4;
+    info->hdrLen = l4 + len;
+    info->mss = mss;
+    info->payloadLen = pktLen - info->hdrLen;
+    info->numSegs = (info->payloadLen + mss - 1) / mss;
+    info->tcpSeq = getBE32(&tcp[kTCPSeqOffset]);
+    info->tcpFlags = tcp[kTCPFlagsOffset];
+
+    result = true;
+
+done:
+    return result;
+}
+
+/*
+ * Build the headers for numSegs segments starting at segIndex. With
+ * tso set, the length fields are cleared and the pseudo header sum
+ * doesn't include the length, as the hardware inserts it for each
+ * segment.
+ */
+static UInt32 buildHeader(const struct MausiGSOInfo *info, const UInt8 *tmpl,
+                          UInt8 *hdr, UInt32 segIndex, UInt32 numSegs, bool tso)
+{
+    UInt8 *ip = &hdr[info->l3Offset];
+    UInt8 *tcp = &hdr[info->l4Offset];
+    UInt32 offset = segIndex * info->mss;
+    UInt32 len = info->payloadLen - offset;
+    UInt32 tcpLen;
+    UInt8 flags = info->tcpFlags;
+
+    if (len > (numSegs * info->mss))
+        len = numSegs * info->mss;
+
+    memcpy(hdr, tmpl, info->hdrLen);
+
+    tcpLen = (tso) ? 0 : (info->hdrLen - info->l4Offset + len);
+
+    if (info->type == kGSOTypeIPv4) {
+        putBE16(&ip[kIPv4LenOffset], (tso) ? 0 : (UInt16)(info->hdrLen - info->l3Offset + len));
+        putBE16(&ip[kIPv4IdOffset], (UInt16)(info->ipId + segIndex));
+        putBE16(&ip[kIPv4CSumOffset], 0);
+    } else {
+        putBE16(&ip[kIPv6LenOffset], (UInt16)tcpLen);
+    }
+    putBE32(&tcp[kTCPSeqOffset], info->tcpSeq + offset);
+
+    /* FIN and PSH belong to the last segment, CWR to the first one. */
+    if ((segIndex + numSegs) < info->numSegs)
+        flags &= ~(kTCPFlagFIN | kTCPFlagPSH);
+
+    if (segIndex > 0)
+        flags &= ~kTCPFlagCWR;
+
+    tcp[kTCPFlagsOffset] = flags;
+    putBE16(&tcp[kTCPCSumOffset], foldSum(info->pseudoSum + tcpLen));
+
+    return len;
+}
+
+UInt32 gsoSegmentHeader(const struct MausiGSOInfo *info, const UInt8 *tmpl,
+                        UInt8 *hdr, UInt32 segIndex)
+{
+    return buildHeader(info, tmpl, hdr, segIndex, 1, false);
+}
+
+UInt32 gsoChunkHeader(const struct MausiGSOInfo *info, const UInt8 *tmpl,
+                      UInt8 *hdr, UInt32 segIndex, UInt32 numSegs)
+{
+    return buildHeader(info, tmpl, hdr, segIndex, numSegs, true);
+}
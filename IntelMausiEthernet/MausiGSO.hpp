@@ -0,0 +1,174 @@
+//
+//  MausiGSO.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Software segmentation of TCP packets. The functions only work on
+//  a copy of the packet's headers, so that they don't depend on mbufs
+//  or the layout of the tx ring.
+//
+
+#ifndef MausiGSO_hpp
+#define MausiGSO_hpp
+
+/* Maximum size of all headers of a packet to be segmented. */
+#define kGSOMaxHdrLen   256
+
+/*
+ * Smaller segment sizes are rejected. They don't make sense and would
+ * let the number of segments overflow.
+ */
+#define kGSOMinMSS      64
+
+enum
+{
+    kGSOTypeNone = 0,
+    kGSOTypeIPv4,
+    kGSOTypeIPv6
+};
+
+struct MausiHdrOffsets {
+    UInt16 l3Offset;
+    UInt16 l4Offset;
+    UInt8 l4Proto;      /* after all IPv6 extension headers */
+    UInt8 type;
+};
+
+struct MausiGSOInfo {
+    UInt32 payloadLen;  /* TCP payload of the whole packet */
+    UInt32 tcpSeq;      /* sequence number of the first segment */
+    UInt32 pseudoSum;   /* unfolded pseudo header sum without length */
+    UInt16 mss;
+    UInt16 numSegs;
+    UInt16 l3Offset;
+    UInt16 l4Offset;
+    UInt16 hdrLen;      /* Ethernet, IP and TCP header */
+    UInt16 ipId;
+    UInt8 tcpFlags;
+    UInt8 type;
+};
+
+/*
+ * Access to big endian header fields and the ones' complement sum of
+ * a header in host order, which is folded to 16 bits by foldSum().
+ */
+static inline UInt16 getBE16(const UInt8 *p)
+{
+    return (UInt16)((p[0] << 8) | p[1]);
+}
+
+static inline UInt32 getBE32(const UInt8 *p)
+{
+    return (((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3]);
+}
+
+static inline void putBE16(UInt8 *p, UInt16 val)
+{
+    p[0] = (UInt8)(val >> 8);
+    p[1] = (UInt8)val;
+}
+
+static inline void putBE32(UInt8 *p, UInt32 val)
+{
+    p[0] = (UInt8)(val >> 24);
+    p[1] = (UInt8)(val >> 16);
+    p[2] = (UInt8)(val >> 8);
+    p[3] = (UInt8)val;
+}
+
+static inline UInt32 sumWords(const UInt8 *p, UInt32 len)
+{
+    UInt32 sum = 0;
+
+    for (; len > 1; len -= 2, p += 2)
+        sum += getBE16(p);
+
+    return sum;
+}
+
+static inline UInt16 foldSum(UInt32 sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return (UInt16)sum;
+}
+
+/*
+ * Same as sumWords() for the addresses of a pseudo header, but adds 32
+ * bit words in native byte order, which the ones' complement sum allows
+ * (RFC 1071), and converts the folded sum to host order at the end.
+ * @len     Multiple of 4, 8 for IPv4 and 32 for IPv6.
+ */
+static inline UInt32 gsoAddrSum(const UInt8 *p, UInt32 len)
+{
+    UInt64 sum = 0;
+    UInt32 word;
+    UInt16 folded;
+    UInt8 bytes[2];
+
+    for (; len >= 4; len -= 4, p += 4) {
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+    }
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    folded = foldSum((UInt32)(sum & 0xffffffff) + (UInt32)(sum >> 32));
+    memcpy(bytes, &folded, sizeof(bytes));
+
+    return getBE16(bytes);
+}
+
+/*
+ * Find the IP and transport headers of a packet. IPv4 options, IPv6
+ * extension headers and a VLAN tag in the payload are skipped.
+ * @hdr         Copy of the first bytes of the packet.
+ * @hdrBufLen   Number of valid bytes in hdr.
+ * @offs        The header offsets.
+ * @result      true in case the packet is IPv4 or IPv6 and all headers
+ *              in front of the transport header are within hdr.
+ */
+bool gsoParseOffsets(const UInt8 *hdr, UInt32 hdrBufLen, struct MausiHdrOffsets *offs);
+
+/*
+ * Parse the headers of a TCP packet and fill in the segmentation info.
+ * @hdr         Copy of the first bytes of the packet.
+ * @hdrBufLen   Number of valid bytes in hdr.
+ * @pktLen      Length of the whole packet.
+ * @mss         The maximum segment size requested by the stack, at
+ *              least kGSOMinMSS.
+ * @info        The segmentation info.
+ * @result      true in case the packet can be segmented.
+ */
+bool gsoParseHeader(const UInt8 *hdr, UInt32 hdrBufLen, UInt32 pktLen,
+                    UInt32 mss, struct MausiGSOInfo *info);
+
+/*
+ * Build the headers of a segment from the packet's headers. The IPv4
+ * header checksum is cleared and the TCP checksum is set to the pseudo
+ * header sum, as expected by the checksum offload engine.
+ * @info        The segmentation info.
+ * @tmpl        The original headers of the packet.
+ * @hdr         Buffer for the headers of the segment (info->hdrLen bytes).
+ * @segIndex    Index of the segment.
+ * @result      The payload length of the segment.
+ */
+UInt32 gsoSegmentHeader(const struct MausiGSOInfo *info, const UInt8 *tmpl,
+                        UInt8 *hdr, UInt32 segIndex);
+
+/*
+ * Build the headers of a chunk of segments which is handed to the
+ * hardware for TSO. IP length and the TCP checksum's length part are
+ * cleared as the hardware inserts them for each segment.
+ * @info        The segmentation info.
+ * @tmpl        The original headers of the packet.
+ * @hdr         Buffer for the headers of the chunk (info->hdrLen bytes).
+ * @segIndex    Index of the chunk's first segment.
+ * @numSegs     Number of segments in the chunk.
+ * @result      The payload length of the chunk.
+ */
+UInt32 gsoChunkHeader(const struct MausiGSOInfo *info, const UInt8 *tmpl,
+                      UInt8 *hdr, UInt32 segIndex, UInt32 numSegs);
+
+#endif /* MausiGSO_hpp */
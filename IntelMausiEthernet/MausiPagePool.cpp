@@ -0,0 +1,168 @@
+//
+//  MausiPagePool.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#include "MausiPagePool.hpp"
+
+OSDefineMetaClassAndStructors(MausiPagePool, OSObject);
+
+#define super OSObject
+
+bool MausiPagePool::init()
+{
+    if (!super::init())
+        return false;
+
+    pages = NULL;
+    numPages = 0;
+
+    return true;
+}
+
+/*
+ * As each half passed upstream retains the pool, all pages are back
+ * when the pool is freed.
+ */
+void MausiPagePool::free()
+{
+    struct MausiRxPage *page;
+    UInt32 i;
+
+    if (pages) {
+        for (i = 0; i < numPages; i++) {
+            page = &pages[i];
+
+            if (page->md) {
+                page->md->complete();
+                page->md->release();
+                page->md = NULL;
+            }
+        }
+        IOFree(pages, numPages * sizeof(struct MausiRxPage));
+        pages = NULL;
+    }
+    ringFree(&freeRing);
+    super::free();
+}
+
+bool MausiPagePool::initWithCapacity(UInt32 capacity)
+{
+    struct MausiRxPage *page;
+    IOBufferMemoryDescriptor *md;
+    UInt32 i;
+    bool result = false;
+
+    if (!init() || (capacity == 0))
+        goto done;
+
+    if (!ringInit(&freeRing, capacity))
+        goto done;
+
+    pages = (struct MausiRxPage *)IOMallocZero(capacity * sizeof(struct MausiRxPage));
+
+    if (!pages)
+        goto done;
+
+    numPages = capacity;
+
+    for (i = 0; i < numPages; i++) {
+        md = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionIn | kIOMemoryPhysicallyContiguous), PAGE_SIZE, 0xFFFFFFFFFFFFF000ULL);
+
+        if (!md)
+            goto done;
+
+        if (md->prepare() != kIOReturnSuccess) {
+            md->release();
+            goto done;
+        }
+        page = &pages[i];
+        page->md = md;
+        page->pool = this;
+        page->addr = (UInt8 *)md->getBytesNoCopy();
+        page->phyAddr = md->getPhysicalSegment(0, NULL, kIOMemoryMapperNone);
+        page->refCount = 0;
+        ringPush(&freeRing, page);
+    }
+    result = true;
+
+done:
+    return result;
+}
+
+MausiPagePool *
+MausiPagePool::withCapacity(UInt32 capacity)
+{
+    MausiPagePool *pool = new MausiPagePool;
+
+    if (pool && !pool->initWithCapacity(capacity)) {
+        pool->release();
+        pool = NULL;
+    }
+    return pool;
+}
+
+/*
+ * Get a free page. The caller owns the page and must return
+ * it with putPage().
+ */
+struct MausiRxPage * MausiPagePool::getPage()
+{
+    struct MausiRxPage *page = (struct MausiRxPage *)ringPop(&freeRing);
+
+    if (page)
+        page->refCount = 1;
+
+    return page;
+}
+
+/*
+ * Drop a reference to a page. The page goes back to the free list
+ * once the last half has been released by the stack.
+ */
+void MausiPagePool::putPage(struct MausiRxPage *page)
+{
+    /* The ring can hold all pages so that this can't fail. */
+    if (OSDecrementAtomic(&page->refCount) == 1)
+        ringPush(&freeRing, page);
+}
+
+/*
+ * Wrap one half of a page in an mbuf so that it can be passed
+ * upstream without copying. The caller must own the page.
+ */
+mbuf_t MausiPagePool::attachHalf(struct MausiRxPage *page,
+                                 UInt32 offset,
+                                 UInt32 len)
+{
+    mbuf_t m = NULL;
+
+    OSIncrementAtomic(&page->refCount);
+    retain();
+
+    if (mbuf_attachcluster(MBUF_DONTWAIT, MBUF_TYPE_DATA, &m, (caddr_t)(page->addr + offset), &halfFree, kPageHalfSize, (caddr_t)page) == 0) {
+        mbuf_setlen(m, len);
+        mbuf_pkthdr_setlen(m, len);
+    } else {
+        /* The caller's reference keeps the page from being freed. */
+        OSDecrementAtomic(&page->refCount);
+        release();
+        m = NULL;
+    }
+    return m;
+}
+
+/*
+ * Called by the stack when an mbuf with one of our halves is freed.
+ */
+void MausiPagePool::halfFree(caddr_t buf, u_int size, caddr_t arg)
+{
+    struct MausiRxPage *page = (struct MausiRxPage *)arg;
+    MausiPagePool *pool = page->pool;
+
+    pool->putPage(page);
+    pool->release();
+}
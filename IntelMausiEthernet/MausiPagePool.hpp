@@ -0,0 +1,65 @@
+//
+//  MausiPagePool.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#ifndef MausiPagePool_hpp
+#define MausiPagePool_hpp
+
+#include "MausiRing.hpp"
+
+/* Each page holds two receive buffers. */
+#define kPageHalfSize   (PAGE_SIZE / 2)
+
+class MausiPagePool;
+
+/*
+ * The owner of a page, i.e. the ring slot it is bound to, holds one
+ * reference and each half passed upstream holds another one. A page
+ * returns to the free list when the last reference is dropped.
+ */
+struct MausiRxPage {
+    MausiPagePool *pool;
+    IOBufferMemoryDescriptor *md;
+    UInt8 *addr;
+    IOPhysicalAddress64 phyAddr;
+    volatile SInt32 refCount;
+};
+
+class MausiPagePool : public OSObject
+{
+    OSDeclareDefaultStructors(MausiPagePool);
+
+public:
+    virtual bool init() APPLE_KEXT_OVERRIDE;
+
+    virtual void free() APPLE_KEXT_OVERRIDE;
+
+    virtual bool initWithCapacity(UInt32 capacity);
+
+    static MausiPagePool * withCapacity(UInt32 capacity);
+
+    struct MausiRxPage * getPage();
+
+    void putPage(struct MausiRxPage *page);
+
+    mbuf_t attachHalf(struct MausiRxPage *page,
+                      UInt32 offset,
+                      UInt32 len);
+
+    /* The other half of a page isn't upstream. */
+    inline bool canFlip(struct MausiRxPage *page) { return (page->refCount == 1); }
+
+protected:
+    static void halfFree(caddr_t buf, u_int size, caddr_t arg);
+
+    /* Free pages are returned from any thread. */
+    struct MausiRing freeRing;
+    struct MausiRxPage *pages;
+    UInt32 numPages;
+};
+
+#endif /* MausiPagePool_hpp */
@@ -0,0 +1,126 @@
+//
+//  MausiPktGen.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Bookkeeping of the packet generator. Packets are posted by the
+//  output thread while the tx interrupt and the watchdog timer reclaim
+//  them on the workloop, so that the counters shared by both sides are
+//  updated atomically and the end of a run is handed over with release
+//  and acquire semantics.
+//
+
+#ifndef MausiPktGen_hpp
+#define MausiPktGen_hpp
+
+#define kPktGenHdrLen       42  /* Ethernet, IPv4 and UDP */
+#define kPktGenMinSize      60
+#define kPktGenSizeDefault  60
+#define kPktGenCountDefault 1000000
+#define kPktGenCountMax     1000000000
+
+/*
+ * State of a packet generator run. Generated packets are fed into the
+ * descriptor build path of outputStart() instead of the packets from
+ * the network stack, so that the tx engine can be measured on its own.
+ */
+typedef struct intelPktGen {
+    UInt64 startTime;
+    volatile UInt64 bytes;
+    volatile UInt64 descs;
+    volatile UInt64 posted;
+    UInt64 completed;
+    UInt64 probeTime;       /* post time of the latency probe */
+    UInt64 latencySum;      /* ns */
+    UInt64 latencyMax;      /* ns */
+    UInt32 latencySamples;
+    UInt32 count;           /* packets to send */
+    UInt32 built;
+    UInt32 minSize;
+    UInt32 maxSize;
+    UInt16 vlanTag;
+    UInt16 probeSlot;       /* inflight entry of the latency probe */
+    UInt8 header[kPktGenHdrLen];
+    bool checksumOffload;
+    volatile bool probeActive;
+    bool injected;          /* txPendingPkt holds generated packets */
+    volatile bool allPosted;
+    volatile bool active;
+} intelPktGen;
+
+/*
+ * Account for a generated packet which has been posted. Called by the
+ * output thread.
+ * @result  true in case no latency probe is in flight, so that the
+ *          packet should become the next one with pktGenStartProbe().
+ */
+static inline bool pktGenPosted(intelPktGen *gen, UInt32 bytes, UInt32 numDescs)
+{
+    OSAddAtomic64(bytes, (volatile SInt64 *)&gen->bytes);
+    OSAddAtomic64(numDescs, (volatile SInt64 *)&gen->descs);
+    OSAddAtomic64(1, (volatile SInt64 *)&gen->posted);
+
+    return !__atomic_load_n(&gen->probeActive, __ATOMIC_ACQUIRE);
+}
+
+/* Publish the probe's slot and post time before the flag. */
+static inline void pktGenStartProbe(intelPktGen *gen, UInt16 slot, UInt64 time)
+{
+    gen->probeSlot = slot;
+    gen->probeTime = time;
+    __atomic_store_n(&gen->probeActive, true, __ATOMIC_RELEASE);
+}
+
+/* Check if a reclaimed slot holds the latency probe. */
+static inline bool pktGenIsProbe(intelPktGen *gen, UInt16 slot)
+{
+    return (__atomic_load_n(&gen->probeActive, __ATOMIC_ACQUIRE) && (slot == gen->probeSlot));
+}
+
+static inline void pktGenEndProbe(intelPktGen *gen)
+{
+    __atomic_store_n(&gen->probeActive, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called by the output thread once the last packet of the run has been
+ * posted. The release store makes the final counters visible to the
+ * workloop before the flag.
+ */
+static inline void pktGenSetAllPosted(intelPktGen *gen)
+{
+    __atomic_store_n(&gen->allPosted, true, __ATOMIC_RELEASE);
+}
+
+/* Check on the workloop if all packets of the run have been reclaimed. */
+static inline bool pktGenRunDone(intelPktGen *gen)
+{
+    if (!__atomic_load_n(&gen->allPosted, __ATOMIC_ACQUIRE))
+        return false;
+
+    return (gen->completed == __atomic_load_n(&gen->posted, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Get value per second. The quotient is split into its integer and its
+ * fractional part, so that value * NSEC_PER_SEC can't overflow, which
+ * would happen with more than 18GB sent. The remainder is scaled down
+ * in case even the fractional part would overflow, which costs some
+ * precision only for runs of more than 18 seconds.
+ * @value       Packets or bytes.
+ * @elapsedNs   Duration of the run in ns, at least 1.
+ */
+static inline UInt64 pktGenRate(UInt64 value, UInt64 elapsedNs)
+{
+    UInt64 rem = value % elapsedNs;
+    UInt32 shift = 0;
+
+    while ((rem >> shift) > (UINT64_MAX / NSEC_PER_SEC))
+        shift++;
+
+    return ((value / elapsedNs) * NSEC_PER_SEC + ((rem >> shift) * NSEC_PER_SEC) / (elapsedNs >> shift));
+}
+
+#endif /* MausiPktGen_hpp */
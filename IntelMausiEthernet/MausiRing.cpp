@@ -0,0 +1,107 @@
+//
+//  MausiRing.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#include "MausiRing.hpp"
+
+bool ringInit(struct MausiRing *ring, UInt32 capacity)
+{
+    UInt32 size = 1;
+    UInt32 i;
+    bool result = false;
+
+    if ((capacity == 0) || (capacity > 0x40000000))
+        goto done;
+
+    while (size < capacity)
+        size <<= 1;
+
+    ring->slots = (struct MausiRingSlot *)IOMallocZero(size * sizeof(struct MausiRingSlot));
+
+    if (!ring->slots)
+        goto done;
+
+    /* A slot is ready to be filled when its sequence number equals the tail. */
+    for (i = 0; i < size; i++)
+        ring->slots[i].seq = i;
+
+    ring->size = size;
+    ring->mask = size - 1;
+    ring->head = ring->tail = 0;
+
+    result = true;
+
+done:
+    return result;
+}
+
+void ringFree(struct MausiRing *ring)
+{
+    if (ring->slots) {
+        IOFree(ring->slots, ring->size * sizeof(struct MausiRingSlot));
+        ring->slots = NULL;
+    }
+    ring->size = ring->mask = 0;
+    ring->head = ring->tail = 0;
+}
+
+bool ringPush(struct MausiRing *ring, void *obj)
+{
+    struct MausiRingSlot *slot;
+    UInt32 pos = ringLoadPos(&ring->tail);
+    SInt32 diff;
+
+    while (true) {
+        slot = &ring->slots[pos & ring->mask];
+        diff = (SInt32)(ringLoadAcquire(&slot->seq) - pos);
+
+        if (diff == 0) {
+            /* The slot is empty. Claim it unless another producer was faster. */
+            if (OSCompareAndSwap(pos, pos + 1, &ring->tail))
+                break;
+        } else if (diff < 0) {
+            /* The slot still holds an entry from the previous lap. */
+            return false;
+        }
+        pos = ringLoadPos(&ring->tail);
+    }
+    slot->obj = obj;
+
+    /* The entry must be visible before the slot is handed to consumers. */
+    ringStoreRelease(&slot->seq, pos + 1);
+
+    return true;
+}
+
+void *ringPop(struct MausiRing *ring)
+{
+    struct MausiRingSlot *slot;
+    UInt32 pos = ringLoadPos(&ring->head);
+    SInt32 diff;
+    void *obj;
+
+    while (true) {
+        slot = &ring->slots[pos & ring->mask];
+        diff = (SInt32)(ringLoadAcquire(&slot->seq) - (pos + 1));
+
+        if (diff == 0) {
+            /* The slot is filled. Claim it unless another consumer was faster. */
+            if (OSCompareAndSwap(pos, pos + 1, &ring->head))
+                break;
+        } else if (diff < 0) {
+            /* The slot hasn't been filled in this lap yet. */
+            return NULL;
+        }
+        pos = ringLoadPos(&ring->head);
+    }
+    obj = slot->obj;
+
+    /* Hand the slot back to producers for the next lap. */
+    ringStoreRelease(&slot->seq, pos + ring->mask + 1);
+
+    return obj;
+}
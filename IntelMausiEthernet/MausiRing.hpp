@@ -0,0 +1,97 @@
+//
+//  MausiRing.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Bounded lock-free ring of pointers which can be used by multiple
+//  producers and consumers at the same time. Each slot has a sequence
+//  number telling whether it's ready to be filled or emptied in the
+//  current lap, so that producers and consumers only have to agree
+//  on their position in the ring with a compare-and-swap.
+//
+
+#ifndef MausiRing_hpp
+#define MausiRing_hpp
+
+#define kRingCacheLine  64
+
+struct MausiRingSlot {
+    volatile UInt32 seq;
+    void *obj;
+};
+
+struct MausiRing {
+    struct MausiRingSlot *slots;
+    UInt32 size;        /* power of 2 */
+    UInt32 mask;
+    UInt8 pad0[kRingCacheLine];
+    volatile UInt32 head;   /* next slot to empty */
+    UInt8 pad1[kRingCacheLine];
+    volatile UInt32 tail;   /* next slot to fill */
+    UInt8 pad2[kRingCacheLine];
+};
+
+/*
+ * Allocate the slots of a ring.
+ * @ring        The ring.
+ * @capacity    Minimum number of entries, rounded up to a power of 2.
+ * @result      true on success.
+ */
+bool ringInit(struct MausiRing *ring, UInt32 capacity);
+
+/*
+ * Free the slots of a ring. The ring must be empty or its entries
+ * must have been released by the caller.
+ */
+void ringFree(struct MausiRing *ring);
+
+/*
+ * Add an entry to the ring.
+ * @result      false in case the ring is full.
+ */
+bool ringPush(struct MausiRing *ring, void *obj);
+
+/*
+ * Remove the oldest entry from the ring.
+ * @result      The entry or NULL in case the ring is empty.
+ */
+void *ringPop(struct MausiRing *ring);
+
+/*
+ * A slot's sequence number hands the entry over between producers and
+ * consumers, so that it's read with acquire and written with release
+ * semantics. The positions are only claimed with OSCompareAndSwap().
+ */
+static inline UInt32 ringLoadAcquire(volatile UInt32 *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ringStoreRelease(volatile UInt32 *p, UInt32 val)
+{
+    __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+
+static inline UInt32 ringLoadPos(volatile UInt32 *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+/*
+ * Number of entries in the ring. It's only a snapshot while other
+ * threads are using the ring. The head never passes the tail, so that
+ * loading the head first keeps the difference from going negative. As
+ * the tail may have moved on by more than a lap in the meantime, the
+ * result is clamped to the size of the ring.
+ */
+static inline UInt32 ringCount(struct MausiRing *ring)
+{
+    UInt32 head = ringLoadAcquire(&ring->head);
+    UInt32 count = ringLoadPos(&ring->tail) - head;
+
+    return (count < ring->size) ? count : ring->size;
+}
+
+#endif /* MausiRing_hpp */
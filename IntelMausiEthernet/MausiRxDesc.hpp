@@ -0,0 +1,144 @@
+//
+//  MausiRxDesc.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Decoding of packet split rx write-back descriptors and rearming of
+//  the descriptors, and the choice of the receive buffer size. Like
+//  MausiTxDesc.hpp, the functions only depend on the descriptor and
+//  register layout, so that the decisions of rxInterruptPS() and the
+//  buffer sizes can be tested with synthetic descriptors outside of
+//  the kernel.
+//
+
+#ifndef MausiRxDesc_hpp
+#define MausiRxDesc_hpp
+
+/*
+ * Receive buffer sizes. Standard frames fit into a 2K cluster while jumbo
+ * frames use a page per descriptor. Larger buffers would span multiple
+ * pages, which aren't guaranteed to be physically contiguous.
+ */
+#define kRxBufferSize   PAGE_SIZE
+#define kRxBufferSizeStd    2048
+
+/* What rxInterruptPS() does with a packet. */
+enum
+{
+    kRxPSDrop = 0,  /* receive error, spans descriptors or bad lengths */
+    kRxPSWhole,     /* headers not split off, the packet is in the page */
+    kRxPSSplit      /* headers in the header buffer, payload in the page */
+};
+
+/* The fields of a packet split write-back. */
+struct MausiRxPSInfo {
+    UInt32 status;
+    UInt16 hdrSize;
+    UInt16 bufSize;
+    UInt16 vlanTag;
+};
+
+/*
+ * Get the lengths and the VLAN tag of a completed descriptor. Must be
+ * called after a read barrier following the status read.
+ * @desc    The descriptor.
+ * @status  Status and errors, already read and swapped.
+ * @info    Returns the write-back fields.
+ */
+static inline void rxPSReadWriteBack(const union e1000_rx_desc_packet_split *desc, UInt32 status,
+                                     struct MausiRxPSInfo *info)
+{
+    info->status = status;
+    info->hdrSize = OSSwapLittleToHostInt16(desc->wb.middle.length0);
+    info->bufSize = OSSwapLittleToHostInt16(desc->wb.upper.length[0]);
+    info->vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.middle.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
+}
+
+/*
+ * Decide how to pass a packet upstream. The lengths are checked
+ * against the buffers, so that a bad write-back can't make the driver
+ * copy beyond the header buffer or pass on more than the page holds.
+ * @info        The write-back fields.
+ * @hdrBufSize  Size of a header buffer.
+ * @bufSize     Size of a payload buffer.
+ * @result      kRxPSDrop, kRxPSWhole or kRxPSSplit.
+ */
+static inline UInt32 rxPSClassify(const struct MausiRxPSInfo *info, UInt32 hdrBufSize, UInt32 bufSize)
+{
+    if ((info->status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) || !(info->status & E1000_RXD_STAT_EOP))
+        return kRxPSDrop;
+
+    if ((info->hdrSize > hdrBufSize) || (info->bufSize > bufSize) || ((info->hdrSize + info->bufSize) == 0))
+        return kRxPSDrop;
+
+    return (info->hdrSize) ? kRxPSSplit : kRxPSWhole;
+}
+
+/*
+ * Check if the payload of a split packet is copied behind the headers,
+ * so that the page stays in place.
+ * @hdrSpace    Space of the mbuf which holds the headers.
+ */
+static inline bool rxPSCopyPayload(const struct MausiRxPSInfo *info, UInt32 copyBreak, UInt32 hdrSpace)
+{
+    return ((info->bufSize <= copyBreak) && ((info->hdrSize + info->bufSize) <= hdrSpace));
+}
+
+/*
+ * Hand a descriptor back to the hardware with a header buffer and a
+ * single payload buffer. The unused buffers are marked as such.
+ */
+static inline void rxPSSetDesc(union e1000_rx_desc_packet_split *desc, IOPhysicalAddress64 hdrAddr,
+                               IOPhysicalAddress64 bufAddr)
+{
+    desc->read.buffer_addr[0] = OSSwapHostToLittleInt64(hdrAddr);
+    desc->read.buffer_addr[1] = OSSwapHostToLittleInt64(bufAddr);
+    desc->read.buffer_addr[2] = ~0ULL;
+    desc->read.buffer_addr[3] = ~0ULL;
+}
+
+/*
+ * Standard frames fit into a 2K buffer. Jumbo frames get a page per
+ * descriptor so that they need less descriptors.
+ * @mtu         The MTU.
+ * @pagesOnly   Use pages for all frames, e.g. with AppleVTD, whose
+ *              mappings cover whole pages.
+ */
+static inline UInt32 rxBufferSizeFor(UInt32 mtu, bool pagesOnly)
+{
+    return ((mtu <= ETH_DATA_LEN) && !pagesOnly) ? kRxBufferSizeStd : kRxBufferSize;
+}
+
+/*
+ * Get the RCTL bits which make the hardware use buffers of the given
+ * size. Sizes above 2048 need the buffer size extension.
+ */
+static inline UInt32 rxCtrlBufferSize(UInt32 size)
+{
+    switch (size) {
+        case 256:
+            return E1000_RCTL_SZ_256;
+            
+        case 512:
+            return E1000_RCTL_SZ_512;
+            
+        case 1024:
+            return E1000_RCTL_SZ_1024;
+            
+        case 4096:
+            return (E1000_RCTL_SZ_4096 | E1000_RCTL_BSEX);
+            
+        case 8192:
+            return (E1000_RCTL_SZ_8192 | E1000_RCTL_BSEX);
+            
+        case 16384:
+            return (E1000_RCTL_SZ_16384 | E1000_RCTL_BSEX);
+            
+        default:
+            return E1000_RCTL_SZ_2048;
+    }
+}
+
+#endif /* MausiRxDesc_hpp */
@@ -12,6 +12,31 @@ OSDefineMetaClassAndStructors(MausiRxPool, OSObject);
 
 #define super OSObject
 
+/* Lower a low-water mark to count, which may race with its reset. */
+static inline void poolLowerMark(volatile UInt32 *mark, UInt32 count)
+{
+    UInt32 old;
+    
+    do {
+        old = *mark;
+        
+        if (count >= old)
+            break;
+    } while (!OSCompareAndSwap(old, count, mark));
+}
+
+/* Replace a counter's value atomically and return the previous one. */
+static inline UInt32 poolSwapCounter(volatile UInt32 *counter, UInt32 value)
+{
+    UInt32 old;
+    
+    do {
+        old = *counter;
+    } while (!OSCompareAndSwap(old, value, counter));
+    
+    return old;
+}
+
 bool MausiRxPool::init()
 {
     return true;
@@ -25,113 +50,77 @@ void MausiRxPool::free()
         thread_call_free(refillCE);
         refillCE = NULL;
     }
-    if (cPktHead) {
-        mbuf_freem_list(cPktHead);
-        cPktHead = cPktTail = NULL;
-        cPktNum = 0;
+    if (cRing.slots) {
+        flushRing(&cRing);
+        ringFree(&cRing);
     }
-    if (mPktHead) {
-        mbuf_freem_list(mPktHead);
-        mPktHead = mPktTail = NULL;
-        mPktNum = 0;
+    if (mRing.slots) {
+        flushRing(&mRing);
+        ringFree(&mRing);
     }
     super::free();
 }
 
-bool MausiRxPool::initWithCapacity(UInt32 mbufCapacity,
-                                     UInt32 clustCapacity)
+void MausiRxPool::flushRing(struct MausiRing *ring)
 {
     mbuf_t m;
-    void *data;
-    UInt32 i;
-    errno_t err;
-    unsigned int chunks;
+    
+    while ((m = (mbuf_t)ringPop(ring)) != NULL)
+        mbuf_freem(m);
+}
+
+bool MausiRxPool::initWithCapacity(UInt32 mbufCapacity,
+                                     UInt32 clustCapacity,
+                                     UInt32 clustSize)
+{
     bool result = false;
     
-    if ((mbufCapacity > 0) && (clustCapacity > 0)) {
-        cPktHead = cPktTail = NULL;
-        mPktHead = mPktTail = NULL;
-        cCapacity = clustCapacity;
+    if ((mbufCapacity > 0) && (clustCapacity > 0) && (clustSize <= PAGE_SIZE)) {
+        cCapacity = cMinCapacity = clustCapacity;
+        cSize = clustSize;
         cRefillTresh = cCapacity - (cCapacity >> 1);
-        mCapacity = mbufCapacity;
+        mCapacity = mMinCapacity = mbufCapacity;
         mRefillTresh = mCapacity - (mCapacity >> 1);
-        cPktNum = 0;
-        mPktNum = 0;
         maxCopySize = mbuf_get_mhlen();
-        refillScheduled = false;
+        refillScheduled = 0;
+        cTaken = cEmpty = mTaken = mEmpty = 0;
 
         nanoseconds_to_absolutetime(kRefillDelayTime, &refillDelay);
 
+        /* Make room for the largest capacity right away. */
+        if (!ringInit(&mRing, mCapacity * kPoolMaxScale) || !ringInit(&cRing, cCapacity * kPoolMaxScale))
+            goto done;
+
         refillCE = thread_call_allocate_with_options((thread_call_func_t) &refillThread, (void *) this, THREAD_CALL_PRIORITY_KERNEL, 0);
 
         if (!refillCE) {
             goto done;
         }
-        for (i = 0; i < mbufCapacity; i++) {
-            chunks = 1;
-            err = mbuf_allocpacket(MBUF_WAITOK, maxCopySize, &chunks, &m);
-
-            if (err)
-                goto fail_mbuf;
-
-            if (mPktHead) {
-                mbuf_setnextpkt(mPktTail, m);
-                mPktTail = m;
-                mPktNum++;
-            } else {
-                mPktHead = mPktTail = m;
-                mPktNum = 1;
-            }
-            data = mbuf_datastart(m);
-            mbuf_setdata(m, data, 0);
-        }
-        for (i = 0; i < clustCapacity; i++) {
-            chunks = 1;
-            err = mbuf_allocpacket(MBUF_WAITOK, PAGE_SIZE, &chunks, &m);
-
-            if (err)
-                goto fail_cluster;
+        /* Fill both rings before the pool is used. */
+        refillScheduled = 1;
+        refillPool(MBUF_WAITOK);
+        
+        if ((ringCount(&mRing) < mCapacity) || (ringCount(&cRing) < cCapacity))
+            goto done;
 
-            if (cPktHead) {
-                mbuf_setnextpkt(cPktTail, m);
-                cPktTail = m;
-                cPktNum++;
-            } else {
-                cPktHead = cPktTail = m;
-                cPktNum = 1;
-            }
-            data = mbuf_datastart(m);
-            mbuf_setdata(m, data, 0);
-        }
+        mLowWater = mCapacity;
+        cLowWater = cCapacity;
         result = true;
     }
 done:
     return result;
-    
-fail_cluster:
-    if (cPktHead) {
-        mbuf_freem_list(cPktHead);
-        cPktHead = cPktTail = NULL;
-        cPktNum = 0;
-    }
-
-fail_mbuf:
-    if (mPktHead) {
-        mbuf_freem_list(mPktHead);
-        mPktHead = mPktTail = NULL;
-        mPktNum = 0;
-    }
-    goto done;
 }
 
 MausiRxPool *
 MausiRxPool::withCapacity(UInt32 mbufCapacity,
-                              UInt32 clustCapacity)
+                              UInt32 clustCapacity,
+                              UInt32 clustSize)
 {
     MausiRxPool *pool = new MausiRxPool;
     
     if (pool && !pool->initWithCapacity(mbufCapacity,
-                                        clustCapacity)) {
+                                        clustCapacity,
+                                        clustSize)) {
         pool->release();
         pool = NULL;
     }
@@ -143,26 +132,30 @@ mbuf_t MausiRxPool::getPacket(UInt32 size, mbuf_how_t how)
     mbuf_t m = NULL;
     void * data;
     errno_t err;
+    UInt32 count;
     unsigned int chunks = 1;
 
     if (size > maxCopySize) {
-        err = mbuf_allocpacket(how, PAGE_SIZE, &chunks, &m);
+        err = mbuf_allocpacket(how, cSize, &chunks, &m);
         
         if (!err) {
             data = mbuf_datastart(m);
             mbuf_setdata(m, data, 0);
             
-        } else if (cPktNum > 1) {
-            OSDecrementAtomic(&cPktNum);
+        } else {
+            m = (mbuf_t)ringPop(&cRing);
+            count = ringCount(&cRing);
             
-            m = cPktHead;
-            cPktHead = mbuf_nextpkt(cPktHead);
-            mbuf_setnextpkt(m, NULL);
+            if (m)
+                OSIncrementAtomic((volatile SInt32 *)&cTaken);
+            else
+                OSIncrementAtomic((volatile SInt32 *)&cEmpty);
             
-            if ((cPktNum < cRefillTresh) && !refillScheduled) {
-                refillScheduled = true;
-                thread_call_enter_delayed(refillCE, refillDelay);
-            }
+            poolLowerMark(&cLowWater, count);
+            
+            /* Refill from the thread call once the refill threshold is hit. */
+            if (count < cRefillTresh)
+                scheduleRefill();
         }
     } else {
         err = mbuf_allocpacket(how, maxCopySize, &chunks, &m);
@@ -171,67 +164,194 @@ mbuf_t MausiRxPool::getPacket(UInt32 size, mbuf_how_t how)
             data = mbuf_datastart(m);
             mbuf_setdata(m, data, 0);
             
-        } else if (mPktNum > 1) {
-            OSDecrementAtomic(&mPktNum);
+        } else {
+            m = (mbuf_t)ringPop(&mRing);
+            count = ringCount(&mRing);
             
-            m = mPktHead;
-            mPktHead = mbuf_nextpkt(mPktHead);
-            mbuf_setnextpkt(m, NULL);
+            if (m)
+                OSIncrementAtomic((volatile SInt32 *)&mTaken);
+            else
+                OSIncrementAtomic((volatile SInt32 *)&mEmpty);
             
-            if ((mPktNum < mRefillTresh) && !refillScheduled) {
-                refillScheduled = true;
-                thread_call_enter_delayed(refillCE, refillDelay);
-            }
+            poolLowerMark(&mLowWater, count);
+            
+            /* Refill from the thread call once the refill threshold is hit. */
+            if (count < mRefillTresh)
+                scheduleRefill();
         }
     }
     return m;
 }
 
-void MausiRxPool::refillPool()
+void MausiRxPool::scheduleRefill()
+{
+    if (OSCompareAndSwap(0, 1, &refillScheduled))
+        thread_call_enter_delayed(refillCE, refillDelay);
+}
+
+/*
+ * Allocate buffers until the ring holds capacity entries or the
+ * budget is used up. Returns the number of buffers added.
+ */
+UInt32 MausiRxPool::fillRing(struct MausiRing *ring,
+                             UInt32 capacity,
+                             UInt32 size,
+                             UInt32 budget,
+                             mbuf_how_t how)
 {
     mbuf_t m;
     void * data;
     errno_t err;
     unsigned int chunks;
+    UInt32 added = 0;
     
-    while (mPktNum < mCapacity) {
+    while ((ringCount(ring) < capacity) && (added < budget)) {
         chunks = 1;
-        err = mbuf_allocpacket(MBUF_DONTWAIT, maxCopySize, &chunks, &m);
-
-        if (!err) {
-            data = mbuf_datastart(m);
-            mbuf_setdata(m, data, 0);
-            
-            mbuf_setnextpkt(mPktTail, m);
-            mPktTail = m;
-            OSIncrementAtomic(&mPktNum);
-        } else {
-            goto done;
-        }
-    }
-    while (cPktNum < cCapacity) {
-        chunks = 1;
-        err = mbuf_allocpacket(MBUF_DONTWAIT, PAGE_SIZE, &chunks, &m);
+        err = mbuf_allocpacket(how, size, &chunks, &m);
         
-        if (!err) {
-            data = mbuf_datastart(m);
-            mbuf_setdata(m, data, 0);
-
-            mbuf_setnextpkt(cPktTail, m);
-            cPktTail = m;
-            OSIncrementAtomic(&cPktNum);
-        } else {
-            goto done;
+        if (err)
+            break;
+        
+        data = mbuf_datastart(m);
+        mbuf_setdata(m, data, 0);
+        
+        if (!ringPush(ring, m)) {
+            mbuf_freem(m);
+            break;
         }
+        added++;
     }
+    return added;
+}
 
+void MausiRxPool::refillPool(mbuf_how_t how)
+{
+    mbuf_t m;
+    
+    fillRing(&mRing, mCapacity, maxCopySize, mCapacity, how);
+    fillRing(&cRing, cCapacity, cSize, cCapacity, how);
+    
+    /* Release buffers exceeding a capacity which has shrunk. */
+    while ((ringCount(&mRing) > mCapacity) && (m = (mbuf_t)ringPop(&mRing)))
+        mbuf_freem(m);
+    
+    while ((ringCount(&cRing) > cCapacity) && (m = (mbuf_t)ringPop(&cRing)))
+        mbuf_freem(m);
+    
+    OSMemoryBarrier();
+    refillScheduled = 0;
+}
+
+/*
+ * Top up the pool from the receive path with the budget a cleaner has
+ * left, so that a reserve which has dropped below its refill threshold
+ * doesn't depend on the refill thread alone. As long as both reserves
+ * are above their thresholds, which is the common case, nothing is
+ * allocated. The ring which is emptier relative to its capacity is
+ * refilled first.
+ */
+UInt32 MausiRxPool::refillNow(UInt32 budget)
+{
+    UInt32 mDepth = ringCount(&mRing);
+    UInt32 cDepth = ringCount(&cRing);
+    bool mLow = (mDepth < mRefillTresh);
+    bool cLow = (cDepth < cRefillTresh);
+    UInt32 added = 0;
+    
+    if (!mLow && !cLow)
+        goto done;
+    
+    if (budget > kPoolRefillBudget)
+        budget = kPoolRefillBudget;
+    
+    if ((mDepth * cCapacity) < (cDepth * mCapacity)) {
+        if (mLow)
+            added = fillRing(&mRing, mCapacity, maxCopySize, budget, MBUF_DONTWAIT);
+        
+        if (cLow)
+            added += fillRing(&cRing, cCapacity, cSize, budget - added, MBUF_DONTWAIT);
+    } else {
+        if (cLow)
+            added = fillRing(&cRing, cCapacity, cSize, budget, MBUF_DONTWAIT);
+        
+        if (mLow)
+            added += fillRing(&mRing, mCapacity, maxCopySize, budget - added, MBUF_DONTWAIT);
+    }
+    
 done:
-    refillScheduled = false;
+    return added;
+}
+
+/*
+ * Size a reserve after its demand in the last period: it should hold
+ * twice the number of buffers taken from it and double in case it ran
+ * empty. When the demand has gone, it shrinks by 1/8 per period down to
+ * its initial capacity.
+ */
+UInt32 MausiRxPool::adaptCapacity(UInt32 capacity,
+                                  UInt32 minCapacity,
+                                  UInt32 taken,
+                                  UInt32 empty)
+{
+    UInt32 maxCapacity = minCapacity * kPoolMaxScale;
+    UInt32 target = taken << 1;
+    
+    if (empty && (target < (capacity << 1)))
+        target = capacity << 1;
+    
+    if (target < minCapacity)
+        target = minCapacity;
+    
+    if (target > capacity)
+        capacity = target;
+    else
+        capacity -= (capacity - target) >> 3;
+    
+    if (capacity > maxCapacity)
+        capacity = maxCapacity;
+    
+    return capacity;
+}
+
+/*
+ * Must be called periodically on the workloop. Adapts the capacities
+ * to the demand since the last call.
+ */
+void MausiRxPool::updateCapacity()
+{
+    UInt32 taken, empty;
+    
+    taken = poolSwapCounter(&mTaken, 0);
+    empty = poolSwapCounter(&mEmpty, 0);
+    mCapacity = adaptCapacity(mCapacity, mMinCapacity, taken, empty);
+    mRefillTresh = mCapacity - (mCapacity >> 1);
+    
+    taken = poolSwapCounter(&cTaken, 0);
+    empty = poolSwapCounter(&cEmpty, 0);
+    cCapacity = adaptCapacity(cCapacity, cMinCapacity, taken, empty);
+    cRefillTresh = cCapacity - (cCapacity >> 1);
+    
+    if ((ringCount(&mRing) != mCapacity) || (ringCount(&cRing) != cCapacity))
+        scheduleRefill();
+}
+
+/*
+ * Report depth, capacity and low-water mark of both reserves. The
+ * low-water marks are reset to the current depth.
+ */
+void MausiRxPool::getStats(struct MausiRxPoolStats *stats)
+{
+    stats->mbufDepth = ringCount(&mRing);
+    stats->mbufLowWater = poolSwapCounter(&mLowWater, stats->mbufDepth);
+    stats->mbufCapacity = mCapacity;
+    stats->clustDepth = ringCount(&cRing);
+    stats->clustLowWater = poolSwapCounter(&cLowWater, stats->clustDepth);
+    stats->clustCapacity = cCapacity;
 }
 
 void MausiRxPool::refillThread(thread_call_param_t param0)
 {
-    ((MausiRxPool *) param0)->refillPool();
+    ((MausiRxPool *) param0)->refillPool(MBUF_DONTWAIT);
 }
 
 /*
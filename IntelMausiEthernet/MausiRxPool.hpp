@@ -9,8 +9,25 @@
 #ifndef MausiRxPool_hpp
 #define MausiRxPool_hpp
 
+#include "MausiRing.hpp"
+
 #define kRefillDelayTime  5000UL
 
+/* The capacities may grow up to this multiple of their initial value. */
+#define kPoolMaxScale   4
+
+/* Maximum number of buffers allocated by refillNow() in one call. */
+#define kPoolRefillBudget   16
+
+struct MausiRxPoolStats {
+    UInt32 mbufDepth;
+    UInt32 mbufLowWater;
+    UInt32 mbufCapacity;
+    UInt32 clustDepth;
+    UInt32 clustLowWater;
+    UInt32 clustCapacity;
+};
+
 class MausiRxPool : public OSObject
 {
     OSDeclareDefaultStructors(MausiRxPool);
@@ -21,10 +38,12 @@ public:
     virtual void free() APPLE_KEXT_OVERRIDE;
     
     virtual bool initWithCapacity(UInt32 mbufCapacity,
-                                  UInt32 clustCapacity);
+                                  UInt32 clustCapacity,
+                                  UInt32 clustSize);
 
     static MausiRxPool * withCapacity(UInt32 mbufCapacity,
-                                        UInt32 clustCapacity);
+                                        UInt32 clustCapacity,
+                                        UInt32 clustSize);
 
     virtual mbuf_t getPacket(UInt32 size, mbuf_how_t how);
 
@@ -33,25 +52,61 @@ public:
                                UInt32 len,
                                bool * replaced);
     
+    UInt32 refillNow(UInt32 budget);
+
+    void updateCapacity();
+
+    void getStats(struct MausiRxPoolStats *stats);
+
 protected:
-    void refillPool();
+    void refillPool(mbuf_how_t how);
+
+    UInt32 fillRing(struct MausiRing *ring,
+                    UInt32 capacity,
+                    UInt32 size,
+                    UInt32 budget,
+                    mbuf_how_t how);
+
+    UInt32 adaptCapacity(UInt32 capacity,
+                         UInt32 minCapacity,
+                         UInt32 taken,
+                         UInt32 empty);
+
+    void scheduleRefill();
+
+    void flushRing(struct MausiRing *ring);
 
     static void refillThread(thread_call_param_t param0);
 
+    /*
+     * The rings are filled by the refill thread and refillNow() while
+     * getPacket() empties them on the workloop.
+     */
+    struct MausiRing cRing;
+    struct MausiRing mRing;
     thread_call_t refillCE;
     UInt64 refillDelay;
-    mbuf_t cPktHead;
-    mbuf_t cPktTail;
-    mbuf_t mPktHead;
-    mbuf_t mPktTail;
     UInt32 cCapacity;
+    UInt32 cMinCapacity;
+    UInt32 cSize;
     UInt32 cRefillTresh;
-    SInt32 cPktNum;
     UInt32 mCapacity;
+    UInt32 mMinCapacity;
     UInt32 mRefillTresh;
-    SInt32 mPktNum;
     UInt32 maxCopySize;
-    bool refillScheduled;
+
+    /*
+     * Demand in the current period. The counters are updated by the
+     * workloop and the poller and reset by the timer, so they are
+     * only accessed atomically.
+     */
+    volatile UInt32 cTaken;
+    volatile UInt32 cEmpty;
+    volatile UInt32 cLowWater;
+    volatile UInt32 mTaken;
+    volatile UInt32 mEmpty;
+    volatile UInt32 mLowWater;
+    volatile UInt32 refillScheduled;
 };
 
 #endif /* MausiRxPool_hpp */
@@ -0,0 +1,289 @@
+//
+//  MausiTxDesc.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Building of tx data and context descriptors. The functions only
+//  depend on the layout of the legacy/extended descriptors, so that the
+//  hot part of outputStart() can be measured and tested outside of the
+//  kernel.
+//
+
+#ifndef MausiTxDesc_hpp
+#define MausiTxDesc_hpp
+
+/* Checksum options in the upper dword of a data descriptor. */
+#define E1000_TXD_OPTS_IXSM     0x00000100
+#define E1000_TXD_OPTS_TXSM     0x00000200
+
+/*
+ * Fill in a tx data descriptor using two 64 bit stores instead of
+ * three separate field writes.
+ */
+static inline void txSetDataDesc(struct e1000_data_desc *desc, UInt64 addr, UInt32 lower, UInt32 upper)
+{
+    volatile UInt64 *p = (volatile UInt64 *)desc;
+
+    p[0] = OSSwapHostToLittleInt64(addr);
+    p[1] = OSSwapHostToLittleInt64(((UInt64)upper << 32) | lower);
+}
+
+/*
+ * Fill in the data descriptors of a packet, one for each physical segment.
+ * @ring        The tx descriptor ring.
+ * @mask        Number of descriptors in the ring minus 1.
+ * @index       Index of the packet's first data descriptor.
+ * @segs        The packet's physical segments.
+ * @numSegs     Number of segments, at least 1.
+ * @cmd         Command bits of all descriptors.
+ * @firstCmd    Additional command bits of the first descriptor.
+ * @lastCmd     Additional command bits of the last descriptor.
+ * @word2       Upper dword of all descriptors (options and VLAN tag).
+ * @result      Index of the descriptor following the packet.
+ */
+static inline UInt32 txFillDataDescs(struct e1000_data_desc *ring, UInt32 mask, UInt32 index,
+                                     const IOPhysicalSegment *segs, UInt32 numSegs, UInt32 cmd,
+                                     UInt32 firstCmd, UInt32 lastCmd, UInt32 word2)
+{
+    UInt32 lastSeg = numSegs - 1;
+    UInt32 word1;
+    UInt32 i;
+
+    for (i = 0; i < numSegs; i++) {
+        word1 = (cmd | ((UInt32)segs[i].length & 0x000fffff));
+
+        /* A packet may consist of a single segment only. */
+        if (i == 0)
+            word1 |= firstCmd;
+
+        if (i == lastSeg)
+            word1 |= lastCmd;
+
+        txSetDataDesc(&ring[index], segs[i].location, word1, word2);
+
+        ++index &= mask;
+    }
+    return index;
+}
+
+/* Limits of a TSO chunk in safe TSO mode. */
+#define kSafeTSOMaxPayload  32768   /* payload bytes per TSO context */
+#define kSafeTSOMaxDescs    16      /* data descriptors per chunk */
+#define kSafeTSOMaxPerDesc  4096    /* bytes per data descriptor */
+
+/*
+ * Get the number of descriptors needed for len bytes of payload starting
+ * at offset in physical segment i, with at most maxLen bytes per descriptor.
+ */
+static inline UInt32 txCountDescs(const IOPhysicalSegment *segs, UInt32 i, UInt32 offset, UInt32 len, UInt32 maxLen)
+{
+    UInt32 numDescs = 0;
+    UInt32 l;
+
+    while (len) {
+        l = min(len, (UInt32)segs[i].length - offset);
+        numDescs += (l + maxLen - 1) / maxLen;
+        len -= l;
+        offset += l;
+
+        if (offset == segs[i].length) {
+            offset = 0;
+            i++;
+        }
+    }
+    return numDescs;
+}
+
+/*
+ * Get the number of descriptors a segment of a TSO packet needs at most:
+ * a header descriptor, a context descriptor in safe TSO mode and one
+ * payload descriptor per started kSafeTSOMaxPerDesc bytes. Boundaries
+ * between physical segments aren't included. They may add one more
+ * descriptor each and have to be covered by a reserve for the packet.
+ */
+static inline UInt32 txSegmentDescs(UInt32 mss)
+{
+    return 3 + mss / kSafeTSOMaxPerDesc;
+}
+
+/*
+ * Get the number of segments of a TSO packet which are sure to fit into
+ * numFree descriptors while keeping reserve descriptors free.
+ */
+static inline UInt32 txSegmentsThatFit(UInt32 numFree, UInt32 reserve, UInt32 mss)
+{
+    return (numFree > reserve) ? ((numFree - reserve) / txSegmentDescs(mss)) : 0;
+}
+
+/*
+ * Check if len bytes of payload starting at offset in physical segment i
+ * can be handed to the TSO engine in safe TSO mode. Together with its
+ * header descriptor the chunk must stay within kSafeTSOMaxDescs.
+ */
+static inline bool txSafeTSOFits(const IOPhysicalSegment *segs, UInt32 i, UInt32 offset, UInt32 len)
+{
+    return ((len <= kSafeTSOMaxPayload) &&
+            (txCountDescs(segs, i, offset, len, kSafeTSOMaxPerDesc) < kSafeTSOMaxDescs));
+}
+
+/*
+ * Get the number of segments of a safe TSO chunk.
+ * @segs        The packet's physical segments.
+ * @i           Physical segment of the chunk's first payload byte.
+ * @offset      Offset of the chunk's first payload byte in segment i.
+ * @mss         The segment size.
+ * @payloadLen  Payload left in the packet starting with the chunk.
+ * @maxSegs     Number of segments which may be added to the chunk.
+ * @result      Number of segments, at least 1. A single segment doesn't
+ *              always fit, which has to be checked with txSafeTSOFits().
+ */
+static inline UInt32 txSafeTSOChunkSegs(const IOPhysicalSegment *segs, UInt32 i, UInt32 offset,
+                                        UInt32 mss, UInt32 payloadLen, UInt32 maxSegs)
+{
+    UInt32 numSegs;
+
+    for (numSegs = 1; numSegs < maxSegs; numSegs++) {
+        if (!txSafeTSOFits(segs, i, offset, min((numSegs + 1) * mss, payloadLen)))
+            break;
+    }
+    return numSegs;
+}
+
+/*
+ * Merge segments whose addresses are contiguous in IOVA space, which
+ * is the case for data crossing page boundaries as all pages of an
+ * IOMemoryDescriptor are mapped in one go. A contiguous run is split
+ * into as few descriptors of up to maxLen bytes as possible.
+ * @vector  The segments.
+ * @count   Number of segments.
+ * @maxLen  Maximum length of a merged segment, at least the length
+ *          of each segment.
+ * @result  Number of segments after merging.
+ */
+static inline UInt32 txMergeSegments(IOPhysicalSegment *vector, UInt32 count, UInt32 maxLen)
+{
+    IOPhysicalAddress64 addr;
+    UInt64 len, l;
+    UInt32 in, out;
+
+    for (in = 0, out = 0; in < count; ) {
+        addr = vector[in].location;
+        len = vector[in].length;
+
+        for (in++; (in < count) && (vector[in].location == (addr + len)); in++)
+            len += vector[in].length;
+
+        /* There are never more pieces than the run had segments. */
+        for (; len; addr += l, len -= l, out++) {
+            l = min(len, (UInt64)maxLen);
+            vector[out].location = addr;
+            vector[out].length = l;
+        }
+    }
+    return out;
+}
+
+/*
+ * Take the next payload slice of a TSO unit, which ends at a boundary of
+ * the physical segments and is at most kSafeTSOMaxPerDesc bytes long.
+ * @segs        The packet's physical segments.
+ * @i           Current physical segment, advanced past the slice.
+ * @offset      Offset in segment i, advanced past the slice.
+ * @len         Payload left in the unit.
+ * @addr        Address of the slice.
+ * @result      Length of the slice.
+ */
+static inline UInt32 txNextPayloadSlice(const IOPhysicalSegment *segs, UInt32 *i, UInt32 *offset,
+                                        UInt32 len, IOPhysicalAddress64 *addr)
+{
+    len = min(len, (UInt32)segs[*i].length - *offset);
+    len = min(len, (UInt32)kSafeTSOMaxPerDesc);
+    *addr = segs[*i].location + *offset;
+    *offset += len;
+
+    if (*offset == segs[*i].length) {
+        *offset = 0;
+        (*i)++;
+    }
+    return len;
+}
+
+/*
+ * The last context written to the tx ring. As the hardware keeps
+ * the context until a new one is loaded, packets with the same
+ * offload parameters don't need a context descriptor of their own.
+ */
+struct MausiTxContext {
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    UInt32 cmdLength;
+    UInt32 mss;
+    bool valid;
+};
+
+/*
+ * Check if the loaded context matches the one a packet needs.
+ */
+static inline bool txContextMatches(const struct MausiTxContext *ctx, UInt32 ipConfig,
+                                    UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss)
+{
+    return (ctx->valid && (ctx->ipConfig == ipConfig) && (ctx->tcpConfig == tcpConfig) &&
+            (ctx->cmdLength == cmdLength) && (ctx->mss == mss));
+}
+
+/*
+ * Write a context descriptor and remember it as the loaded context.
+ * It has the same layout as a data descriptor: ip_config, tcp_config,
+ * cmd_and_length and tcp_seg_setup.
+ */
+static inline void txSetContextDesc(struct e1000_data_desc *desc, struct MausiTxContext *ctx,
+                                    UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLength, UInt32 mss)
+{
+    txSetDataDesc(desc, (((UInt64)tcpConfig << 32) | ipConfig), cmdLength, mss);
+
+    ctx->ipConfig = ipConfig;
+    ctx->tcpConfig = tcpConfig;
+    ctx->cmdLength = cmdLength;
+    ctx->mss = mss;
+    ctx->valid = true;
+}
+
+/*
+ * Get the checksum offload context of a packet from its header offsets.
+ * @ipv6        IPv6 packet, IPv4 otherwise.
+ * @tcp         TCP checksum requested.
+ * @udp         UDP checksum requested. Without TCP and UDP only the
+ *              IPv4 header checksum is inserted.
+ * @l3Offset    Offset of the IP header.
+ * @l4Offset    Offset of the transport header.
+ * @stuff       Offset of the checksum field in the transport header.
+ * @ipConfig    ip_config of the context.
+ * @tcpConfig   tcp_config of the context.
+ * @cmdLength   cmd_and_length of the context.
+ * @word2       Checksum options of the data descriptors.
+ */
+static inline void txChecksumContext(bool ipv6, bool tcp, bool udp, UInt32 l3Offset, UInt32 l4Offset,
+                                     UInt32 stuff, UInt32 *ipConfig, UInt32 *tcpConfig,
+                                     UInt32 *cmdLength, UInt32 *word2)
+{
+    if (ipv6) {
+        *ipConfig = l3Offset;
+        *cmdLength = E1000_TXD_CMD_DEXT;
+        *word2 = E1000_TXD_OPTS_TXSM;
+    } else {
+        *ipConfig = (((l4Offset - 1) << 16) | ((l3Offset + offsetof(struct ip, ip_sum)) << 8) | l3Offset);
+        *cmdLength = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
+        *word2 = E1000_TXD_OPTS_IXSM;
+
+        if (tcp || udp)
+            *word2 |= E1000_TXD_OPTS_TXSM;
+    }
+    if (tcp)
+        *cmdLength |= E1000_TXD_CMD_TCP;
+
+    *tcpConfig = (tcp || udp) ? (((l4Offset + stuff) << 8) | l4Offset) : 0;
+}
+
+#endif /* MausiTxDesc_hpp */
@@ -0,0 +1,238 @@
+//
+//  MausiTxMapCache.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Bookkeeping of the tx map cache for AppleVTD. The functions decide
+//  which page an entry holds while the driver maps and unmaps the
+//  entries' IOMemoryDescriptors, so that the cache's policy can be
+//  tested with a mock mapper outside of the kernel.
+//
+
+#ifndef MausiTxMapCache_hpp
+#define MausiTxMapCache_hpp
+
+#define kTxMapCacheBuckets  1024
+#define kTxMapCacheNone     0xffff
+
+/* Results of txMapCacheLookup(). */
+enum
+{
+    kTxMapCacheHit = 0,
+    kTxMapCacheMiss,
+    kTxMapCacheFull
+};
+
+/*
+ * A cluster page which stays mapped for tx DMA. Entries are linked by
+ * index in a hash chain and, once they are idle, in the LRU list. Idle
+ * pages stay mapped until their entry is needed for another page. The
+ * physical page is checked on every lookup, so that a virtual page
+ * which has been remapped in the meantime is never used.
+ */
+typedef struct intelTxMapCacheEntry {
+    IOMemoryDescriptor *md;
+    IOAddressRange range;
+    IOPhysicalAddress64 phys;
+    IOPhysicalAddress64 iova;
+    UInt16 hashNext;
+    UInt16 lruPrev;
+    UInt16 lruNext;
+    UInt16 refCount;
+} intelTxMapCacheEntry;
+
+typedef struct intelTxMapCache {
+    intelTxMapCacheEntry *entries;
+    UInt16 *hash;
+    UInt16 *memRefs;
+    UInt32 numEntries;
+    UInt16 freeHead;
+    UInt16 lruHead;
+    UInt16 lruTail;
+    UInt16 nextMem2Release;
+} intelTxMapCache;
+
+static inline UInt32 txMapCacheBucket(IOVirtualAddress page)
+{
+    return (UInt32)(page >> PAGE_SHIFT) & (kTxMapCacheBuckets - 1);
+}
+
+static inline void txMapCacheLRURemove(intelTxMapCache *cache, UInt16 index)
+{
+    intelTxMapCacheEntry *entry = &cache->entries[index];
+
+    if (entry->lruPrev != kTxMapCacheNone)
+        cache->entries[entry->lruPrev].lruNext = entry->lruNext;
+    else
+        cache->lruHead = entry->lruNext;
+
+    if (entry->lruNext != kTxMapCacheNone)
+        cache->entries[entry->lruNext].lruPrev = entry->lruPrev;
+    else
+        cache->lruTail = entry->lruPrev;
+
+    entry->lruPrev = entry->lruNext = kTxMapCacheNone;
+}
+
+static inline void txMapCacheLRUAppend(intelTxMapCache *cache, UInt16 index)
+{
+    intelTxMapCacheEntry *entry = &cache->entries[index];
+
+    entry->lruNext = kTxMapCacheNone;
+    entry->lruPrev = cache->lruTail;
+
+    if (cache->lruTail != kTxMapCacheNone)
+        cache->entries[cache->lruTail].lruNext = index;
+    else
+        cache->lruHead = index;
+
+    cache->lruTail = index;
+}
+
+static inline void txMapCacheHashRemove(intelTxMapCache *cache, UInt16 index)
+{
+    UInt16 *link = &cache->hash[txMapCacheBucket(cache->entries[index].range.address)];
+
+    while (*link != kTxMapCacheNone) {
+        if (*link == index) {
+            *link = cache->entries[index].hashNext;
+            break;
+        }
+        link = &cache->entries[*link].hashNext;
+    }
+}
+
+/*
+ * Reset the cache to its initial state with all entries on the free
+ * list. The caller unmaps the pages first.
+ * @cache   The cache.
+ * @numMem  Number of IOMemoryDescriptor slots with page references.
+ * @refs    Size of a slot's references including their number.
+ */
+static inline void txMapCacheReset(intelTxMapCache *cache, UInt32 numMem, UInt32 refs)
+{
+    intelTxMapCacheEntry *entry;
+    UInt32 i;
+
+    for (i = 0; i < cache->numEntries; i++) {
+        entry = &cache->entries[i];
+
+        entry->hashNext = (i + 1 < cache->numEntries) ? (i + 1) : kTxMapCacheNone;
+        entry->lruPrev = entry->lruNext = kTxMapCacheNone;
+        entry->refCount = 0;
+    }
+    for (i = 0; i < kTxMapCacheBuckets; i++)
+        cache->hash[i] = kTxMapCacheNone;
+
+    for (i = 0; i < numMem; i++)
+        cache->memRefs[i * refs] = 0;
+
+    cache->freeHead = 0;
+    cache->lruHead = cache->lruTail = kTxMapCacheNone;
+    cache->nextMem2Release = 0;
+}
+
+/*
+ * Drop a packet's reference to a cached page. Pages which are no
+ * longer in use become candidates for eviction but stay mapped.
+ */
+static inline void txMapCachePut(intelTxMapCache *cache, UInt16 index)
+{
+    if (--cache->entries[index].refCount == 0)
+        txMapCacheLRUAppend(cache, index);
+}
+
+/*
+ * Look up a page and take a reference to it. In case the page isn't
+ * cached yet, an entry from the free list or the least recently used
+ * idle one is assigned to it, which the caller has to map and pass to
+ * txMapCacheInsert() or txMapCacheFree().
+ * @cache   The cache.
+ * @page    Virtual address of the page.
+ * @phys    Physical address of the page.
+ * @index   Returns the index of the entry.
+ * @unmap   Returns true on a miss if the entry still maps another page,
+ *          which has to be unmapped first.
+ * @result  kTxMapCacheHit, kTxMapCacheMiss or kTxMapCacheFull in case
+ *          all entries are in use.
+ */
+static inline UInt32 txMapCacheLookup(intelTxMapCache *cache, IOVirtualAddress page, IOPhysicalAddress64 phys,
+                                      UInt16 *index, bool *unmap)
+{
+    intelTxMapCacheEntry *entry;
+    UInt16 i;
+
+    *unmap = false;
+
+    for (i = cache->hash[txMapCacheBucket(page)]; i != kTxMapCacheNone; i = entry->hashNext) {
+        entry = &cache->entries[i];
+
+        if (entry->range.address == page) {
+            if (entry->phys == phys) {
+                if (entry->refCount++ == 0)
+                    txMapCacheLRURemove(cache, i);
+
+                *index = i;
+                return kTxMapCacheHit;
+            }
+            /* The virtual page has been remapped. */
+            if (entry->refCount)
+                return kTxMapCacheFull;
+
+            txMapCacheLRURemove(cache, i);
+            txMapCacheHashRemove(cache, i);
+            *unmap = true;
+            goto assign;
+        }
+    }
+    if (cache->freeHead != kTxMapCacheNone) {
+        i = cache->freeHead;
+        entry = &cache->entries[i];
+        cache->freeHead = entry->hashNext;
+    } else if (cache->lruHead != kTxMapCacheNone) {
+        i = cache->lruHead;
+        entry = &cache->entries[i];
+
+        txMapCacheLRURemove(cache, i);
+        txMapCacheHashRemove(cache, i);
+        *unmap = true;
+    } else {
+        return kTxMapCacheFull;
+    }
+
+assign:
+    entry->range.address = page;
+    entry->range.length = PAGE_SIZE;
+    entry->phys = phys;
+    *index = i;
+
+    return kTxMapCacheMiss;
+}
+
+/*
+ * Add a newly mapped entry with a reference to the hash table.
+ * @cache   The cache.
+ * @index   Entry returned by txMapCacheLookup().
+ * @iova    I/O virtual address of the page.
+ */
+static inline void txMapCacheInsert(intelTxMapCache *cache, UInt16 index, IOPhysicalAddress64 iova)
+{
+    intelTxMapCacheEntry *entry = &cache->entries[index];
+    UInt32 bucket = txMapCacheBucket(entry->range.address);
+
+    entry->iova = iova;
+    entry->refCount = 1;
+    entry->hashNext = cache->hash[bucket];
+    cache->hash[bucket] = index;
+}
+
+/* Return an unmapped entry to the free list. */
+static inline void txMapCacheFree(intelTxMapCache *cache, UInt16 index)
+{
+    cache->entries[index].hashNext = cache->freeHead;
+    cache->freeHead = index;
+}
+
+#endif /* MausiTxMapCache_hpp */
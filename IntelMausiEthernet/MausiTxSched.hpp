@@ -0,0 +1,184 @@
+//
+//  MausiTxSched.hpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Decisions of the tx path about which packets may be posted to the
+//  ring and when. They only depend on counters kept by the driver, so
+//  that they can be simulated outside of the kernel.
+//
+
+#ifndef MausiTxSched_hpp
+#define MausiTxSched_hpp
+
+/*
+ * Descriptors which always stay free and the minimum number a packet
+ * needs (context and data descriptor).
+ */
+#define kTxDescReserve  2
+#define kTxMinPktDescs  2
+
+/* Treshhold value to wake a stalled queue */
+#define kTxQueueWakeTreshhold(n) ((n) / 8)
+
+/*
+ * Check if a packet which needs at most numDescs descriptors may be
+ * posted, keeping kTxDescReserve descriptors free.
+ */
+static inline bool txPacketFits(SInt32 numFree, UInt32 numDescs)
+{
+    return (numFree >= (SInt32)(numDescs + kTxDescReserve));
+}
+
+/*
+ * Check if a queue stalled on stallDescs free descriptors may be woken
+ * up. Waiting for more than threshold free descriptors keeps it from
+ * stalling again right away.
+ */
+static inline bool txQueueWakes(SInt32 numFree, SInt32 threshold, UInt32 stallDescs)
+{
+    return (numFree > threshold) && (numFree >= (SInt32)stallDescs);
+}
+
+/*
+ * Service classes served by outputStart() in priority mode and the
+ * number of descriptors bulk traffic may use with n descriptors.
+ */
+#define kTxNumServiceClasses    10
+#define kTxNumPriorityClasses   3
+#define kTxBulkLimit(n)         ((n) / 4)
+
+/*
+ * Get the number of packets which may be dequeued from the service
+ * class at position i of the priority order. Latency sensitive classes
+ * may use the whole ring while all other classes share bulkLimit
+ * descriptors. As a packet's size isn't known before it's dequeued,
+ * the remaining share is divided by the minimum number of descriptors
+ * per packet, so that a batch can't overshoot the share by itself.
+ * @i           Position of the class in the priority order.
+ * @bulkDescs   Descriptors in use or reserved by bulk packets.
+ * @bulkLimit   Descriptors bulk packets may use.
+ * @maxCount    Maximum number of packets to dequeue.
+ * @result      Number of packets to dequeue, 0 if the class has to wait.
+ */
+static inline UInt32 txClassQuota(UInt32 i, SInt32 bulkDescs, UInt32 bulkLimit, UInt32 maxCount)
+{
+    if (i < kTxNumPriorityClasses)
+        return maxCount;
+
+    if (bulkDescs >= (SInt32)bulkLimit)
+        return 0;
+
+    return min(maxCount, (bulkLimit - bulkDescs) / kTxMinPktDescs);
+}
+
+/*
+ * Initial and maximum tx byte limits in milliseconds of transmit
+ * time at the current link speed.
+ */
+#define kTxByteLimitInitMS  1
+#define kTxByteLimitMaxMS   10
+
+/*
+ * State of the tx byte limit. The output thread posts bytes and checks
+ * the limit while txInterrupt() completes bytes and adapts it.
+ */
+struct MausiByteLimit {
+    UInt64 posted;
+    UInt64 completed;
+    UInt32 limit;
+    UInt32 min;
+    UInt32 max;
+    UInt32 maxInflight;
+    bool hit;
+};
+
+static inline UInt32 bqlInflight(const struct MausiByteLimit *bl)
+{
+    return (UInt32)(bl->posted - bl->completed);
+}
+
+/*
+ * Set the bounds of the byte limit for a new link speed and restart
+ * with an initial limit worth kTxByteLimitInitMS of transmit time.
+ * @bl          The byte limit.
+ * @speed       Link speed in Mbit/s.
+ * @frameLen    Maximum frame size, the limit is never below two frames.
+ */
+static inline void bqlSetup(struct MausiByteLimit *bl, UInt32 speed, UInt32 frameLen)
+{
+    UInt32 bytesPerMS = speed * 125;
+    
+    bl->min = 2 * frameLen;
+    bl->max = max(bytesPerMS * kTxByteLimitMaxMS, bl->min);
+    bl->limit = max(bytesPerMS * kTxByteLimitInitMS, bl->min);
+    bl->hit = false;
+    bl->maxInflight = 0;
+}
+
+/* Forget the bytes in flight after the ring has been reset. */
+static inline void bqlReset(struct MausiByteLimit *bl)
+{
+    bl->posted = bl->completed = 0;
+}
+
+static inline void bqlPosted(struct MausiByteLimit *bl, UInt32 bytes)
+{
+    bl->posted += bytes;
+    
+    if (bqlInflight(bl) > bl->maxInflight)
+        bl->maxInflight = bqlInflight(bl);
+}
+
+static inline void bqlCompleted(struct MausiByteLimit *bl, UInt32 bytes)
+{
+    bl->completed += bytes;
+}
+
+/*
+ * Check if the bytes in flight have reached the byte limit. The limit
+ * is checked before a packet is posted, so that it may be exceeded by
+ * the size of a single packet.
+ * @bl          The byte limit.
+ * @stalls      Incremented only when a stall episode starts, rather
+ *              than for each of the output thread's checks.
+ * @result      true if no more packets may be posted.
+ */
+static inline bool bqlReached(struct MausiByteLimit *bl, UInt64 *stalls)
+{
+    if (bqlInflight(bl) < bl->limit)
+        return false;
+    
+    if (!bl->hit) {
+        bl->hit = true;
+        (*stalls)++;
+    }
+    return true;
+}
+
+/*
+ * Adapt the byte limit in the spirit of Linux' dynamic queue limits.
+ * When the ring has run empty while packets were held back, the limit
+ * was too low and is increased. Once per timer period the limit is
+ * lowered towards the maximum number of bytes in flight if it hasn't
+ * been reached during the period.
+ * @bl          The byte limit.
+ * @timer       true when called from the timer, false after completions.
+ */
+static inline void bqlUpdate(struct MausiByteLimit *bl, bool timer)
+{
+    if (timer) {
+        if (!bl->hit && (bl->maxInflight < bl->limit))
+            bl->limit = max((bl->limit + bl->maxInflight) / 2, bl->min);
+        
+        bl->hit = false;
+        bl->maxInflight = 0;
+    } else if (bl->hit && (bl->posted == bl->completed)) {
+        bl->limit = min(bl->limit + bl->limit / 2, bl->max);
+        bl->hit = false;
+    }
+}
+
+#endif /* MausiTxSched_hpp */
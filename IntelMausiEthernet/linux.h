@@ -216,6 +216,14 @@ _OSReadInt8((base), (byteOffset))
 
 #define wmb() OSSynchronizeIO()
 
+/*
+ * Ordering of accesses to descriptor rings in coherent memory. On x86
+ * stores and loads aren't reordered with each other by the CPU so that
+ * it's sufficient to stop the compiler from doing so.
+ */
+#define dma_wmb() __asm__ __volatile__("" : : : "memory")
+#define dma_rmb() __asm__ __volatile__("" : : : "memory")
+
 #define __er16flash(hw, reg) \
 OSReadLittleInt16((hw->flash_address), (reg))
 
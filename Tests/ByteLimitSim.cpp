@@ -0,0 +1,143 @@
+//
+//  ByteLimitSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates a saturated bulk flow through the tx ring with and without
+//  the dynamic byte limit at 10, 100 and 1000 Mbit/s. The driver's
+//  bqlReached(), bqlPosted(), bqlCompleted() and bqlUpdate() decide
+//  when outputStart() stops posting. A packet queued by the stack has
+//  to wait for the bytes in the ring before it's sent, so the time
+//  packets spend in the ring is reported as latency, next to the link
+//  utilization as throughput.
+//
+
+#include "MausiTxSched.hpp"
+#include "HostTest.h"
+#include "TxLinkSim.h"
+
+#define kNsPerMs        1000000.0
+#define kSimTime        (10000 * kNsPerMs)
+#define kWarmup         (2000 * kNsPerMs)
+#define kIrqInterval    50000.0
+#define kTimerPeriod    1000.0  /* kTimeoutMS */
+
+/* As in IntelMausiEthernet.h. */
+#define kRingSize       512
+#define kTxBatchSize    32
+
+#define kPktSize        1514
+#define kPktDescs       2
+#define kFrameLen       1518
+
+struct SimResult {
+    double ringP50;
+    double ringP99;
+    double utilization;
+    UInt32 limit;
+    UInt64 stalls;
+};
+
+static SimResult simulate(double mbps, bool byteLimits)
+{
+    TxLinkSim link(kRingSize, mbps, kIrqInterval);
+    struct MausiByteLimit bl = {};
+    std::vector<SimPacket> done;
+    std::vector<double> ringDelay;
+    SimPacket pkt = {};
+    double nextTimer = kTimerPeriod * kNsPerMs;
+    double now = 0.0;
+    double busyStart = 0.0;
+    UInt64 stalls = 0;
+    UInt32 budget, i;
+    SimResult res;
+
+    bqlSetup(&bl, (UInt32)mbps, kFrameLen);
+    pkt.bytes = kPktSize;
+    pkt.descs = kPktDescs;
+
+    while (now < kSimTime) {
+        if (now >= nextTimer) {
+            if (byteLimits)
+                bqlUpdate(&bl, true);
+
+            nextTimer += kTimerPeriod * kNsPerMs;
+        }
+
+        /* txInterrupt() */
+        done.clear();
+        link.reclaim(now, &done);
+
+        for (i = 0; i < done.size(); i++) {
+            bqlCompleted(&bl, done[i].bytes);
+
+            if (done[i].posted >= kWarmup)
+                ringDelay.push_back((done[i].start - done[i].posted) / kNsPerMs);
+        }
+        if (byteLimits)
+            bqlUpdate(&bl, false);
+
+        if ((busyStart == 0.0) && (now >= kWarmup))
+            busyStart = link.busy(now);
+
+        /* outputStart(), the stack always has packets queued. */
+        while (link.numFree >= (kTxMinPktDescs + kTxDescReserve)) {
+            if (byteLimits && bqlReached(&bl, &stalls))
+                break;
+
+            budget = std::min(link.numFree / kTxMinPktDescs, (UInt32)kTxBatchSize);
+
+            for (; budget && (link.numFree >= (pkt.descs + kTxDescReserve)); budget--) {
+                if (byteLimits && bqlReached(&bl, &stalls))
+                    break;
+
+                pkt.arrival = now;
+                link.post(pkt, now);
+                bqlPosted(&bl, pkt.bytes);
+            }
+            if (budget)
+                break;
+        }
+        now = std::min(nextTimer, link.nextReclaim());
+    }
+    res.ringP50 = simQuantile(ringDelay, 0.5);
+    res.ringP99 = simQuantile(ringDelay, 0.99);
+    res.utilization = (link.busy(now) - busyStart) / (now - kWarmup);
+    res.limit = byteLimits ? bl.limit : kRingSize / kPktDescs * kPktSize;
+    res.stalls = stalls;
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    static const double speeds[] = { 10.0, 100.0, 1000.0 };
+    SimResult off, on;
+    double limitTime;
+    UInt32 s;
+
+    printf("%-6s %-6s %10s %10s %8s %8s %8s\n", "Mbit/s", "limits", "ring p50", "ring p99",
+           "util", "limit", "stalls");
+
+    for (s = 0; s < (sizeof(speeds) / sizeof(speeds[0])); s++) {
+        off = simulate(speeds[s], false);
+        on = simulate(speeds[s], true);
+
+        printf("%-6.0f %-6s %10.3f %10.3f %8.3f %8u %8s\n", speeds[s], "off", off.ringP50, off.ringP99,
+               off.utilization, off.limit, "-");
+        printf("%-6.0f %-6s %10.3f %10.3f %8.3f %8u %8llu\n", speeds[s], "on", on.ringP50, on.ringP99,
+               on.utilization, on.limit, (unsigned long long)on.stalls);
+
+        /* The ring holds at most the limit plus one packet. */
+        limitTime = (on.limit + kPktSize) * (kPktSize + kSimWireOverhead) / kPktSize * 8000.0 / speeds[s] / kNsPerMs;
+
+        CHECK(on.ringP99 <= (limitTime + kIrqInterval / kNsPerMs), "ring delay %.3f ms, limit %.3f ms",
+              on.ringP99, limitTime);
+        CHECK(on.ringP99 < (off.ringP99 / 2), "byte limits don't lower the ring delay");
+        CHECK(on.utilization > 0.98, "link utilization %.3f with byte limits", on.utilization);
+        CHECK(off.utilization > 0.98, "link utilization %.3f without byte limits", off.utilization);
+    }
+    return testResult("ByteLimitSim");
+}
@@ -0,0 +1,206 @@
+//
+//  DescRingTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Checks the ring size validation and the wraparound of the tx and rx
+//  rings for every supported ring size. The tx ring is filled with
+//  packets of 1 to kMaxSegs + 1 descriptors by txFillDataDescs() and
+//  reclaimed the way txReclaimPackets() and txInterrupt() do it, while
+//  a model of the hardware advances the head pointer by random steps,
+//  sometimes reporting bogus values. The rx ring is cleaned and its tail
+//  advanced like in rxInterrupt(). Each ring wraps around many times.
+//
+
+#include <stddef.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+#include "MausiDescRing.hpp"
+#include "HostTest.h"
+
+/* As in IntelMausiEthernet.h. */
+#define kMaxSegs        32
+#define kTxDescReserve  2
+
+/* As E1000_RX_BUFFER_WRITE in e1000.h. */
+#define kRxBufferWrite  16
+
+#define kNumWraps       64
+
+static void testSizes()
+{
+    UInt32 size;
+    bool expected;
+
+    for (size = 0; size <= (2 * kNumDescMax); size++) {
+        expected = ((size == 256) || (size == 512) || (size == 1024) || (size == 2048) || (size == 4096));
+        CHECK(descRingSizeValid(size) == expected, "ring size %u %s", size, expected ? "rejected" : "accepted");
+    }
+    CHECK(descRingSizeValid(kNumDescDefault), "default ring size rejected");
+    CHECK(!descRingSizeValid(0xffffffff), "ring size 0xffffffff accepted");
+}
+
+struct TxPacket {
+    UInt32 eopIndex;
+    UInt32 numDescs;
+    UInt64 firstSeq;
+};
+
+static void testTxRing(UInt32 size)
+{
+    struct e1000_data_desc *ring = new struct e1000_data_desc[size];
+    struct TxPacket *inflight = new struct TxPacket[size];
+    IOPhysicalSegment segs[kMaxSegs + 1];
+    UInt32 mask = size - 1;
+    UInt32 numFree = size;
+    UInt32 next = 0;
+    UInt32 dirty = 0;
+    UInt32 hwHead = 0;
+    UInt32 inflightHead = 0;
+    UInt32 inflightTail = 0;
+    UInt64 postSeq = 0;
+    UInt64 hwSeq = 0;
+    UInt64 reclaimSeq = 0;
+    UInt32 head, numDescs, steps, i;
+    bool bogus;
+
+    memset(ring, 0, size * sizeof(struct e1000_data_desc));
+
+    while (reclaimSeq < ((UInt64)kNumWraps * size)) {
+        /* Post packets while they fit, keeping the reserve free. */
+        for (;;) {
+            numDescs = testRandomRange(1, kMaxSegs + 1);
+
+            if ((numDescs + kTxDescReserve) > numFree)
+                break;
+
+            for (i = 0; i < numDescs; i++) {
+                segs[i].location = postSeq + i;
+                segs[i].length = 64;
+            }
+            inflight[inflightTail].eopIndex = (next + numDescs - 1) & mask;
+            inflight[inflightTail].numDescs = numDescs;
+            inflight[inflightTail].firstSeq = postSeq;
+            inflightTail = (inflightTail + 1) & mask;
+
+            CHECK(inflightTail != inflightHead, "queue of packets in flight overflows");
+
+            next = txFillDataDescs(ring, mask, next, segs, numDescs, E1000_TXD_DTYP_D, 0, E1000_TXD_CMD_EOP, 0);
+            postSeq += numDescs;
+            numFree -= numDescs;
+
+            CHECK(descDistance(dirty, next, mask) == (size - numFree), "%u descriptors in use, distance %u",
+                  size - numFree, descDistance(dirty, next, mask));
+
+            if (testRandom() & 1)
+                break;
+        }
+        /* The hardware fetches descriptors in order up to the tail. */
+        steps = testRandomRange(0, descDistance(hwHead, next, mask));
+
+        for (i = 0; i < steps; i++) {
+            CHECK(ring[hwHead].buffer_addr == hwSeq, "descriptor %u holds %llu instead of %llu", hwHead,
+                  (unsigned long long)ring[hwHead].buffer_addr, (unsigned long long)hwSeq);
+            hwHead = (hwHead + 1) & mask;
+            hwSeq++;
+        }
+        /* A bogus head, e.g. after a surprise removal, must be ignored. */
+        bogus = ((testRandom() % 8) == 0);
+        head = bogus ? (testRandom() & mask) : hwHead;
+
+        if (descDistance(dirty, head, mask) > descDistance(dirty, next, mask)) {
+            CHECK(bogus, "valid head %u rejected, dirty %u, tail %u", head, dirty, next);
+            continue;
+        }
+        if (bogus)
+            head = hwHead;
+
+        /* Reclaim the completed packets. */
+        while (inflightHead != inflightTail) {
+            struct TxPacket *pkt = &inflight[inflightHead];
+
+            if (!descInRange(pkt->eopIndex, dirty, head, mask))
+                break;
+
+            CHECK(pkt->firstSeq == reclaimSeq, "packet reclaimed out of order");
+            CHECK((pkt->firstSeq + pkt->numDescs) <= hwSeq, "packet reclaimed before it has been sent");
+
+            reclaimSeq += pkt->numDescs;
+            numFree += pkt->numDescs;
+            dirty = (pkt->eopIndex + 1) & mask;
+            inflightHead = (inflightHead + 1) & mask;
+        }
+        CHECK(numFree <= size, "%u free descriptors", numFree);
+    }
+    delete[] ring;
+    delete[] inflight;
+}
+
+/*
+ * The hardware may fill the descriptors from its head up to, but not
+ * including, the tail. The driver cleans them in order and moves the
+ * tail to the descriptor in front of the next one to be cleaned.
+ */
+static void testRxRing(UInt32 size)
+{
+    UInt64 *ring = new UInt64[size];
+    UInt32 mask = size - 1;
+    UInt32 tail = size - 1;
+    UInt32 hwHead = 0;
+    UInt32 next = 0;
+    UInt32 cleaned = 0;
+    UInt64 hwSeq = 1;
+    UInt64 rxSeq = 1;
+    UInt32 steps, i;
+
+    memset(ring, 0, size * sizeof(UInt64));
+
+    while (rxSeq < ((UInt64)kNumWraps * size)) {
+        steps = testRandomRange(0, descDistance(hwHead, tail, mask));
+
+        for (i = 0; i < steps; i++) {
+            CHECK(ring[hwHead] == 0, "descriptor %u overwritten before it has been cleaned", hwHead);
+            ring[hwHead] = hwSeq++;
+            hwHead = (hwHead + 1) & mask;
+        }
+        for (i = testRandomRange(1, size); i && ring[next]; i--) {
+            CHECK(ring[next] == rxSeq, "received %llu instead of %llu",
+                  (unsigned long long)ring[next], (unsigned long long)rxSeq);
+            ring[next] = 0;
+            rxSeq++;
+            next = (next + 1) & mask;
+            cleaned++;
+        }
+        if (cleaned >= kRxBufferWrite) {
+            tail = descPrev(next, mask);
+            cleaned = 0;
+        }
+    }
+    /* Once everything has been cleaned, all but one descriptor are free. */
+    while (ring[next]) {
+        ring[next] = 0;
+        next = (next + 1) & mask;
+    }
+    tail = descPrev(next, mask);
+    CHECK(descDistance(hwHead, tail, mask) == (size - 1), "%u descriptors free after cleaning",
+          descDistance(hwHead, tail, mask));
+
+    delete[] ring;
+}
+
+int main(int argc, char *argv[])
+{
+    UInt32 size;
+
+    testSizes();
+
+    for (size = kNumDescMin; size <= kNumDescMax; size <<= 1) {
+        testTxRing(size);
+        testRxRing(size);
+    }
+    return testResult("DescRingTest");
+}
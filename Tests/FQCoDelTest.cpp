@@ -0,0 +1,390 @@
+//
+//  FQCoDelTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Deterministic harness for the FQ-CoDel scheduler. It replays bulk
+//  TCP flows and sparse interactive flows over a 100 Mbit/s link in
+//  simulated time and checks the queueing delay of both kinds of flows,
+//  the link utilization and the fairness between the bulk flows. The
+//  same traffic is sent through a plain FIFO of kTransmitQueueCapacity
+//  packets for comparison. The bulk flows follow a simple Reno model:
+//  the window grows by one packet per round trip and is halved at most
+//  once per round trip when a packet is dropped.
+//
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "MausiFQCoDel.hpp"
+#include "HostTest.h"
+
+#define kNsPerSec           1000000000ULL
+#define kNsPerMs            1000000ULL
+#define kNsPerByte          80          /* 100 Mbit/s */
+#define kWireOverhead       24          /* preamble, FCS and inter frame gap */
+#define kRoundTrip          (20 * kNsPerMs)
+#define kSimTime            (30 * kNsPerSec)
+#define kWarmup             (5 * kNsPerSec)
+#define kNumBulk            4
+#define kNumInteractive     2
+#define kBulkSize           1514
+#define kInteractiveSize    128
+#define kInteractivePeriod  (10 * kNsPerMs)
+#define kFIFOLimit          1000        /* kTransmitQueueCapacity */
+
+#define kTestDelivered      1
+
+/* Exposes the flow hash, so that the harness can avoid collisions. */
+class TestFQ : public MausiFQCoDel
+{
+public:
+    using MausiFQCoDel::flowHash;
+};
+
+/* The queue under test, FQ-CoDel or a plain FIFO. */
+class TestQueue
+{
+public:
+    TestQueue(TestFQ *q) : fq(q) {}
+
+    void enqueue(mbuf_t m, UInt64 now)
+    {
+        if (fq) {
+            fq->enqueue(m, now);
+        } else if (fifo.size() < kFIFOLimit) {
+            fifo.push_back(m);
+        } else {
+            mbuf_freem(m);
+        }
+    }
+
+    mbuf_t dequeue(UInt64 now)
+    {
+        mbuf_t m = NULL;
+
+        if (fq) {
+            m = fq->dequeue(now);
+        } else if (!fifo.empty()) {
+            m = fifo.front();
+            fifo.pop_front();
+        }
+        return m;
+    }
+
+    void flush()
+    {
+        if (fq) {
+            fq->flush();
+        } else {
+            for (size_t i = 0; i < fifo.size(); i++)
+                mbuf_freem(fifo[i]);
+
+            fifo.clear();
+        }
+    }
+
+private:
+    TestFQ *fq;
+    std::deque<mbuf_t> fifo;
+};
+
+struct Flow {
+    bool bulk;
+    UInt8 hdr[54];
+    double cwnd;
+    UInt32 inflight;
+    UInt64 lastReduce;
+    UInt64 nextSend;
+    UInt64 bytes;
+    UInt64 drops;
+    std::deque<UInt64> acks;
+    std::vector<UInt64> sojourn;
+};
+
+struct Result {
+    double bulkMedian;
+    double bulkP99;
+    double interactiveP99;
+    double interactiveMax;
+    double utilization;
+    double fairness;
+    UInt64 drops;
+};
+
+static std::vector<Flow> flows;
+static UInt64 simTime;
+
+static void buildHeader(UInt8 *hdr, UInt32 index, bool bulk)
+{
+    memset(hdr, 0, 54);
+    hdr[12] = 0x08;                 /* IPv4 */
+    hdr[14] = 0x45;
+    hdr[23] = bulk ? 6 : 17;        /* TCP or UDP */
+    hdr[26] = 10;                   /* 10.0.0.1 -> 10.0.1.x */
+    hdr[29] = 1;
+    hdr[30] = 10;
+    hdr[32] = 1;
+    hdr[33] = (UInt8)index;
+    hdr[34] = 0xc0;                 /* source port */
+    hdr[35] = (UInt8)(0x10 + index);
+    hdr[36] = 0x01;                 /* destination port */
+    hdr[37] = 0xbb;
+}
+
+/* Packets freed without having been sent are drops. */
+static void freeHook(mbuf_t m)
+{
+    Flow *flow;
+
+    if (m->testData[1] & kTestDelivered)
+        return;
+
+    flow = &flows[m->testData[0]];
+    flow->drops++;
+
+    if (flow->bulk) {
+        flow->inflight--;
+
+        if ((simTime - flow->lastReduce) > kRoundTrip) {
+            flow->cwnd = std::max(flow->cwnd / 2, 2.0);
+            flow->lastReduce = simTime;
+        }
+    }
+}
+
+static void send(TestQueue *q, UInt32 index, UInt64 now)
+{
+    Flow *flow = &flows[index];
+    mbuf_t m = hostMbufAlloc(flow->hdr, sizeof(flow->hdr), flow->bulk ? kBulkSize : kInteractiveSize);
+
+    m->testData[0] = index;
+    m->testData[1] = now << 1;
+    q->enqueue(m, now);
+}
+
+static double percentile(std::vector<UInt64> &v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))] / (double)kNsPerMs;
+}
+
+static void runSimulation(TestFQ *fq, Result *res)
+{
+    TestQueue q(fq);
+    std::vector<UInt64> bulkSojourn;
+    std::vector<UInt64> interactiveSojourn;
+    UInt64 linkFree = 0;
+    UInt64 busyTime = 0;
+    UInt64 next, sojourn;
+    double sum = 0, sumSq = 0, rate;
+    UInt32 i;
+    mbuf_t m;
+
+    flows.assign(kNumBulk + kNumInteractive, Flow());
+
+    for (i = 0; i < flows.size(); i++) {
+        flows[i].bulk = (i < kNumBulk);
+        flows[i].cwnd = 2;
+        flows[i].nextSend = i * kNsPerMs;
+        buildHeader(flows[i].hdr, i, flows[i].bulk);
+    }
+    res->drops = 0;
+    hostMbufFreeHook = freeHook;
+
+    for (simTime = 0; simTime < kSimTime; simTime = next) {
+        next = kSimTime;
+
+        for (i = 0; i < flows.size(); i++) {
+            Flow *flow = &flows[i];
+
+            if (flow->bulk) {
+                while (!flow->acks.empty() && (flow->acks.front() <= simTime)) {
+                    flow->acks.pop_front();
+                    flow->inflight--;
+                    flow->cwnd += 1 / flow->cwnd;
+                }
+                while (flow->inflight < (UInt32)flow->cwnd) {
+                    flow->inflight++;
+                    send(&q, i, simTime);
+                }
+                if (!flow->acks.empty())
+                    next = std::min(next, flow->acks.front());
+            } else {
+                if (flow->nextSend <= simTime) {
+                    send(&q, i, simTime);
+                    flow->nextSend += kInteractivePeriod;
+                }
+                next = std::min(next, flow->nextSend);
+            }
+        }
+        if (linkFree <= simTime) {
+            m = q.dequeue(simTime);
+
+            if (m) {
+                Flow *flow = &flows[m->testData[0]];
+
+                sojourn = simTime - (m->testData[1] >> 1);
+                linkFree = simTime + (m->pktLen + kWireOverhead) * kNsPerByte;
+
+                if (simTime >= kWarmup) {
+                    flow->bytes += m->pktLen;
+                    busyTime += linkFree - simTime;
+
+                    if (flow->bulk)
+                        bulkSojourn.push_back(sojourn);
+                    else
+                        interactiveSojourn.push_back(sojourn);
+                }
+                if (flow->bulk)
+                    flow->acks.push_back(linkFree + kRoundTrip);
+
+                m->testData[1] |= kTestDelivered;
+                mbuf_freem(m);
+            }
+        }
+        if (linkFree > simTime)
+            next = std::min(next, linkFree);
+    }
+    q.flush();
+    hostMbufFreeHook = NULL;
+
+    for (i = 0; i < kNumBulk; i++) {
+        rate = flows[i].bytes;
+        sum += rate;
+        sumSq += rate * rate;
+    }
+    for (i = 0; i < flows.size(); i++)
+        res->drops += flows[i].drops;
+
+    res->bulkMedian = percentile(bulkSojourn, 0.5);
+    res->bulkP99 = percentile(bulkSojourn, 0.99);
+    res->interactiveP99 = percentile(interactiveSojourn, 0.99);
+    res->interactiveMax = percentile(interactiveSojourn, 1.0);
+    res->utilization = busyTime / (double)(kSimTime - kWarmup);
+    res->fairness = (sum * sum) / (kNumBulk * sumSq);
+}
+
+static void printResult(const char *name, const Result *res)
+{
+    printf("%-10s %10.2f %10.2f %12.2f %12.2f %8.3f %8.3f %8llu\n", name,
+           res->bulkMedian, res->bulkP99, res->interactiveP99, res->interactiveMax,
+           res->utilization, res->fairness, (unsigned long long)res->drops);
+}
+
+static TestFQ *createFQ(UInt32 limit)
+{
+    TestFQ *fq = new TestFQ;
+
+    if (!fq->initWithParams(kFQCoDelFlows, limit, kFQCoDelQuantum, kFQCoDelTarget, kFQCoDelInterval)) {
+        fq->release();
+        fq = NULL;
+    }
+    return fq;
+}
+
+/*
+ * A full queue drops half of the longest queue's backlog, but no more
+ * than kFQCoDelDropBatch packets, before the new packet is queued.
+ */
+static void testOverlimit()
+{
+    UInt8 hdrA[54], hdrB[54];
+    TestFQ *fq = createFQ(128);
+    UInt32 i;
+
+    buildHeader(hdrA, 1, true);
+    buildHeader(hdrB, 2, false);
+
+    for (i = 0; i < 128; i++)
+        fq->enqueue(hostMbufAlloc(hdrA, sizeof(hdrA), kBulkSize), 0);
+
+    CHECK(fq->getSpace() == 0, "queue not full");
+    CHECK(fq->overlimitDrops == 0, "drops before the limit");
+
+    fq->enqueue(hostMbufAlloc(hdrB, sizeof(hdrB), kInteractiveSize), 0);
+
+    CHECK(fq->overlimitDrops == kFQCoDelDropBatch, "%llu overlimit drops instead of %u",
+          (unsigned long long)fq->overlimitDrops, kFQCoDelDropBatch);
+    CHECK(fq->getPackets() == (128 - kFQCoDelDropBatch + 1), "%u packets queued", fq->getPackets());
+
+    /*
+     * The long flow has used up its quantum after one packet, so the
+     * sparse flow is served next.
+     */
+    mbuf_t m = fq->dequeue(0);
+
+    CHECK(m && (mbuf_pkthdr_len(m) == kBulkSize), "long flow not served first");
+
+    if (m)
+        mbuf_freem(m);
+
+    m = fq->dequeue(0);
+
+    CHECK(m && (mbuf_pkthdr_len(m) == kInteractiveSize), "sparse flow not served second");
+
+    if (m)
+        mbuf_freem(m);
+
+    fq->release();
+}
+
+int main(int argc, char *argv[])
+{
+    Result fqRes, fifoRes;
+    UInt8 hdr[54];
+    TestFQ *fq;
+    UInt32 i, j;
+
+    /* The hash seed comes from random(). */
+    srandom(1);
+    fq = createFQ(kFQCoDelLimit);
+
+    if (!fq)
+        return 1;
+
+    for (i = 0; i < (kNumBulk + kNumInteractive); i++) {
+        for (j = 0; j < i; j++) {
+            UInt8 other[54];
+
+            buildHeader(hdr, i, (i < kNumBulk));
+            buildHeader(other, j, (j < kNumBulk));
+
+            mbuf_t a = hostMbufAlloc(hdr, sizeof(hdr), 60);
+            mbuf_t b = hostMbufAlloc(other, sizeof(other), 60);
+
+            CHECK(fq->flowHash(a) != fq->flowHash(b), "flows %u and %u collide", i, j);
+            mbuf_freem(a);
+            mbuf_freem(b);
+        }
+    }
+    runSimulation(fq, &fqRes);
+    fq->release();
+
+    runSimulation(NULL, &fifoRes);
+
+    printf("%-10s %10s %10s %12s %12s %8s %8s %8s\n", "queue", "bulk p50", "bulk p99",
+           "interact p99", "interact max", "util", "fair", "drops");
+    printResult("fq-codel", &fqRes);
+    printResult("fifo", &fifoRes);
+
+    CHECK(fqRes.interactiveP99 < 1.0, "interactive p99 delay %.2f ms", fqRes.interactiveP99);
+    CHECK(fqRes.bulkMedian < (2 * kFQCoDelTarget / (double)kNsPerMs), "bulk median delay %.2f ms", fqRes.bulkMedian);
+    CHECK(fqRes.bulkP99 < 50.0, "bulk p99 delay %.2f ms", fqRes.bulkP99);
+    CHECK(fqRes.utilization > 0.9, "link utilization %.3f", fqRes.utilization);
+    CHECK(fqRes.fairness > 0.95, "bulk fairness %.3f", fqRes.fairness);
+    CHECK(fifoRes.interactiveP99 > (10 * fqRes.interactiveP99), "FIFO doesn't show the expected delay");
+
+    testOverlimit();
+
+    CHECK(hostMbufsAllocated == hostMbufsFreed, "%llu packets leaked",
+          (unsigned long long)(hostMbufsAllocated - hostMbufsFreed));
+
+    return testResult("FQCoDelTest");
+}
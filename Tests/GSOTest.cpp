@@ -0,0 +1,445 @@
+//
+//  GSOTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Checks the software segmenter against a reference implementation
+//  which follows the rules of Linux' tcp_gso_segment(): each segment
+//  gets its own IP length and ID, the sequence number advances by the
+//  MSS, FIN and PSH are only kept in the last segment and CWR only in
+//  the first one. The segments built from the driver's headers are
+//  completed by emulating the checksum offload engine and must match
+//  the reference segments byte for byte. Chunks built for safe TSO are
+//  split the same way by emulating the hardware's TSO engine.
+//
+
+#include <vector>
+
+#include "MausiGSO.hpp"
+#include "HostTest.h"
+
+typedef std::vector<UInt8> Packet;
+
+#define kTypeIPv4   0x0800
+#define kTypeIPv6   0x86dd
+#define kTypeVlan   0x8100
+
+#define kFlagFIN    0x01
+#define kFlagPSH    0x08
+#define kFlagACK    0x10
+#define kFlagCWR    0x80
+
+/* Layout of a test packet. */
+struct PacketSpec {
+    UInt16 type;
+    bool vlan;
+    UInt32 ipOptLen;
+    UInt32 tcpOptLen;
+    UInt8 flags;
+    UInt32 payloadLen;
+};
+
+struct Layout {
+    UInt32 l3;
+    UInt32 l4;
+    UInt32 hdrLen;
+};
+
+static UInt32 seed = 12345;
+
+static UInt8 nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return (UInt8)(seed >> 16);
+}
+
+static inline void put16(UInt8 *p, UInt16 v)
+{
+    p[0] = (UInt8)(v >> 8);
+    p[1] = (UInt8)v;
+}
+
+static inline void put32(UInt8 *p, UInt32 v)
+{
+    put16(p, (UInt16)(v >> 16));
+    put16(p + 2, (UInt16)v);
+}
+
+static inline UInt16 get16(const UInt8 *p)
+{
+    return (UInt16)((p[0] << 8) | p[1]);
+}
+
+static inline UInt32 get32(const UInt8 *p)
+{
+    return (((UInt32)get16(p) << 16) | get16(p + 2));
+}
+
+/* Ones' complement sum of a buffer, odd lengths are padded with zero. */
+static UInt32 sum(const UInt8 *p, UInt32 len, UInt32 acc)
+{
+    UInt32 i;
+
+    for (i = 0; (i + 1) < len; i += 2)
+        acc += get16(&p[i]);
+
+    if (len & 1)
+        acc += (UInt32)p[len - 1] << 8;
+
+    return acc;
+}
+
+static UInt16 fold(UInt32 acc)
+{
+    while (acc >> 16)
+        acc = (acc & 0xffff) + (acc >> 16);
+
+    return (UInt16)acc;
+}
+
+static Layout layoutOf(const PacketSpec &spec)
+{
+    Layout l;
+
+    l.l3 = 14 + (spec.vlan ? 4 : 0);
+    l.l4 = l.l3 + ((spec.type == kTypeIPv4) ? (20 + spec.ipOptLen) : 40);
+    l.hdrLen = l.l4 + 20 + spec.tcpOptLen;
+
+    return l;
+}
+
+/* Full TCP checksum of a complete segment. */
+static UInt16 tcpChecksum(const Packet &pkt, const Layout &l, bool ipv4)
+{
+    UInt32 tcpLen = (UInt32)pkt.size() - l.l4;
+    UInt32 acc;
+
+    if (ipv4)
+        acc = sum(&pkt[l.l3 + 12], 8, 0);
+    else
+        acc = sum(&pkt[l.l3 + 8], 32, 0);
+
+    acc += 6 + tcpLen;
+    acc = sum(&pkt[l.l4], tcpLen, acc);
+
+    return (UInt16)~fold(acc);
+}
+
+static void fillIPv4Checksum(Packet &pkt, const Layout &l)
+{
+    put16(&pkt[l.l3 + 10], 0);
+    put16(&pkt[l.l3 + 10], (UInt16)~fold(sum(&pkt[l.l3], l.l4 - l.l3, 0)));
+}
+
+/* Build a valid packet with all checksums filled in. */
+static Packet buildPacket(const PacketSpec &spec, UInt32 seq, UInt16 ipId)
+{
+    Layout l = layoutOf(spec);
+    Packet pkt(l.hdrLen + spec.payloadLen);
+    UInt8 *ip = &pkt[l.l3];
+    UInt8 *tcp = &pkt[l.l4];
+    UInt32 i;
+
+    for (i = 0; i < 12; i++)
+        pkt[i] = nextRandom();
+
+    if (spec.vlan) {
+        put16(&pkt[12], kTypeVlan);
+        put16(&pkt[14], 0x0123);
+    }
+    put16(&pkt[l.l3 - 2], spec.type);
+
+    if (spec.type == kTypeIPv4) {
+        ip[0] = 0x40 | ((20 + spec.ipOptLen) >> 2);
+        put16(&ip[2], (UInt16)(pkt.size() - l.l3));
+        put16(&ip[4], ipId);
+        put16(&ip[6], 0x4000);  /* DF */
+        ip[8] = 64;
+        ip[9] = 6;
+
+        for (i = 12; i < (l.l4 - l.l3); i++)
+            ip[i] = nextRandom();
+
+        /* NOPs as options. */
+        for (i = 20; i < (l.l4 - l.l3); i++)
+            ip[i] = 1;
+    } else {
+        ip[0] = 0x60;
+        put16(&ip[4], (UInt16)(pkt.size() - l.l4));
+        ip[6] = 6;
+        ip[7] = 64;
+
+        for (i = 8; i < 40; i++)
+            ip[i] = nextRandom();
+    }
+    put16(&tcp[0], 0xc000 | nextRandom());
+    put16(&tcp[2], 443);
+    put32(&tcp[4], seq);
+    put32(&tcp[8], 0x01020304);
+    tcp[12] = (UInt8)(((20 + spec.tcpOptLen) >> 2) << 4);
+    tcp[13] = spec.flags;
+    put16(&tcp[14], 0xffff);
+
+    for (i = 20; i < (l.hdrLen - l.l4); i++)
+        tcp[i] = 1;
+
+    for (i = l.hdrLen; i < pkt.size(); i++)
+        pkt[i] = nextRandom();
+
+    if (spec.type == kTypeIPv4)
+        fillIPv4Checksum(pkt, l);
+
+    put16(&tcp[16], tcpChecksum(pkt, l, (spec.type == kTypeIPv4)));
+
+    return pkt;
+}
+
+/* Reference segmentation following the rules of tcp_gso_segment(). */
+static std::vector<Packet> referenceSegments(const Packet &pkt, const PacketSpec &spec, UInt32 mss)
+{
+    std::vector<Packet> segs;
+    Layout l = layoutOf(spec);
+    bool ipv4 = (spec.type == kTypeIPv4);
+    UInt32 seq = get32(&pkt[l.l4 + 4]);
+    UInt16 ipId = ipv4 ? get16(&pkt[l.l3 + 4]) : 0;
+    UInt32 offset, len, n;
+
+    for (offset = 0, n = 0; offset < spec.payloadLen; offset += mss, n++) {
+        len = min(mss, spec.payloadLen - offset);
+
+        Packet seg(pkt.begin(), pkt.begin() + l.hdrLen);
+        seg.insert(seg.end(), pkt.begin() + l.hdrLen + offset, pkt.begin() + l.hdrLen + offset + len);
+
+        if (ipv4) {
+            put16(&seg[l.l3 + 2], (UInt16)(seg.size() - l.l3));
+            put16(&seg[l.l3 + 4], (UInt16)(ipId + n));
+            fillIPv4Checksum(seg, l);
+        } else {
+            put16(&seg[l.l3 + 4], (UInt16)(seg.size() - l.l4));
+        }
+        put32(&seg[l.l4 + 4], seq + offset);
+
+        if ((offset + len) < spec.payloadLen)
+            seg[l.l4 + 13] &= ~(kFlagFIN | kFlagPSH);
+
+        if (n > 0)
+            seg[l.l4 + 13] &= ~kFlagCWR;
+
+        put16(&seg[l.l4 + 16], 0);
+        put16(&seg[l.l4 + 16], tcpChecksum(seg, l, ipv4));
+        segs.push_back(seg);
+    }
+    return segs;
+}
+
+/*
+ * Emulate the checksum offload engine: the IPv4 checksum is computed
+ * from scratch and the TCP checksum field holds the pseudo header sum.
+ */
+static void offloadChecksums(Packet &seg, const Layout &l, bool ipv4)
+{
+    UInt32 acc;
+
+    if (ipv4) {
+        CHECK(get16(&seg[l.l3 + 10]) == 0, "IPv4 checksum not cleared");
+        fillIPv4Checksum(seg, l);
+    }
+    acc = sum(&seg[l.l4], (UInt32)seg.size() - l.l4, 0);
+    put16(&seg[l.l4 + 16], (UInt16)~fold(acc));
+}
+
+/*
+ * Emulate the TSO engine: it inserts the length fields, increments the
+ * IPv4 ID, advances the sequence number and adds the TCP length to the
+ * pseudo header sum of each segment. FIN and PSH are only kept in the
+ * last segment of the chunk and CWR only in the first one.
+ */
+static std::vector<Packet> tsoSegments(const UInt8 *hdr, const UInt8 *payload, UInt32 chunkLen,
+                                       const Layout &l, bool ipv4, UInt32 mss)
+{
+    std::vector<Packet> segs;
+    UInt32 seq = get32(&hdr[l.l4 + 4]);
+    UInt16 ipId = ipv4 ? get16(&hdr[l.l3 + 4]) : 0;
+    UInt16 pseudo = get16(&hdr[l.l4 + 16]);
+    UInt32 offset, len, n, tcpLen;
+
+    for (offset = 0, n = 0; offset < chunkLen; offset += mss, n++) {
+        len = min(mss, chunkLen - offset);
+
+        Packet seg(hdr, hdr + l.hdrLen);
+        seg.insert(seg.end(), payload + offset, payload + offset + len);
+        tcpLen = (UInt32)seg.size() - l.l4;
+
+        if (ipv4) {
+            put16(&seg[l.l3 + 2], (UInt16)(seg.size() - l.l3));
+            put16(&seg[l.l3 + 4], (UInt16)(ipId + n));
+        } else {
+            put16(&seg[l.l3 + 4], (UInt16)tcpLen);
+        }
+        put32(&seg[l.l4 + 4], seq + offset);
+
+        if ((offset + len) < chunkLen)
+            seg[l.l4 + 13] &= ~(kFlagFIN | kFlagPSH);
+
+        if (n > 0)
+            seg[l.l4 + 13] &= ~kFlagCWR;
+
+        put16(&seg[l.l4 + 16], fold(pseudo + tcpLen));
+        offloadChecksums(seg, l, ipv4);
+        segs.push_back(seg);
+    }
+    return segs;
+}
+
+static void compareSegments(const std::vector<Packet> &ref, const std::vector<Packet> &got,
+                            const char *what, const PacketSpec &spec, UInt32 mss)
+{
+    size_t i;
+
+    CHECK(ref.size() == got.size(), "%s: %zu segments instead of %zu (type 0x%04x, payload %u, mss %u)",
+          what, got.size(), ref.size(), spec.type, spec.payloadLen, mss);
+
+    for (i = 0; (i < ref.size()) && (i < got.size()); i++) {
+        CHECK(ref[i] == got[i], "%s: segment %zu differs (type 0x%04x, vlan %d, payload %u, mss %u, flags 0x%02x)",
+              what, i, spec.type, spec.vlan, spec.payloadLen, mss, spec.flags);
+    }
+}
+
+static void testSegmentation(const PacketSpec &spec, UInt32 mss)
+{
+    struct MausiGSOInfo info;
+    UInt8 hdr[kGSOMaxHdrLen];
+    Layout l = layoutOf(spec);
+    bool ipv4 = (spec.type == kTypeIPv4);
+    Packet pkt = buildPacket(spec, 0xfffff000, 0xfff0);
+    std::vector<Packet> ref = referenceSegments(pkt, spec, mss);
+    std::vector<Packet> got;
+    UInt32 hdrBufLen = min((UInt32)pkt.size(), (UInt32)kGSOMaxHdrLen);
+    static const UInt32 chunks[] = { 1, 3, 45 };
+    UInt32 seg, len, offset, chunk, c;
+
+    if (!gsoParseHeader(&pkt[0], hdrBufLen, (UInt32)pkt.size(), mss, &info)) {
+        CHECK(false, "gsoParseHeader() failed (type 0x%04x, payload %u, mss %u)", spec.type, spec.payloadLen, mss);
+        return;
+    }
+    CHECK(info.hdrLen == l.hdrLen, "hdrLen %u instead of %u", info.hdrLen, l.hdrLen);
+    CHECK(info.l3Offset == l.l3, "l3Offset %u instead of %u", info.l3Offset, l.l3);
+    CHECK(info.l4Offset == l.l4, "l4Offset %u instead of %u", info.l4Offset, l.l4);
+    CHECK(info.numSegs == ref.size(), "numSegs %u instead of %zu", info.numSegs, ref.size());
+
+    /* Software segmentation with checksum offload. */
+    for (seg = 0, offset = 0; seg < info.numSegs; seg++, offset += len) {
+        len = gsoSegmentHeader(&info, &pkt[0], hdr, seg);
+
+        Packet p(hdr, hdr + info.hdrLen);
+        p.insert(p.end(), pkt.begin() + l.hdrLen + offset, pkt.begin() + l.hdrLen + offset + len);
+        offloadChecksums(p, l, ipv4);
+        got.push_back(p);
+    }
+    compareSegments(ref, got, "segment", spec, mss);
+
+    /* Safe TSO with chunks of 1, 3 and 45 segments. */
+    for (c = 0; c < (sizeof(chunks) / sizeof(chunks[0])); c++) {
+        chunk = chunks[c];
+        got.clear();
+
+        for (seg = 0, offset = 0; seg < info.numSegs; seg += chunk, offset += len) {
+            len = gsoChunkHeader(&info, &pkt[0], hdr, seg, min(chunk, info.numSegs - seg));
+
+            if (ipv4)
+                CHECK(get16(&hdr[l.l3 + 2]) == 0, "IPv4 length of chunk not cleared");
+            else
+                CHECK(get16(&hdr[l.l3 + 4]) == 0, "IPv6 length of chunk not cleared");
+
+            std::vector<Packet> tso = tsoSegments(hdr, &pkt[l.hdrLen + offset], len, l, ipv4, mss);
+            got.insert(got.end(), tso.begin(), tso.end());
+        }
+        compareSegments(ref, got, "chunk", spec, mss);
+    }
+}
+
+static void testRejects()
+{
+    struct MausiGSOInfo info;
+    PacketSpec spec = { kTypeIPv4, false, 0, 0, kFlagACK, 3000 };
+    Packet pkt = buildPacket(spec, 1, 1);
+    Packet frag = pkt;
+    Packet udp = pkt;
+    UInt32 len = (UInt32)pkt.size();
+
+    CHECK(gsoParseHeader(&pkt[0], 54, len, kGSOMinMSS, &info), "MSS of kGSOMinMSS rejected");
+    CHECK(!gsoParseHeader(&pkt[0], 54, len, kGSOMinMSS - 1, &info), "MSS below kGSOMinMSS accepted");
+    CHECK(!gsoParseHeader(&pkt[0], 54, len, 0, &info), "MSS of 0 accepted");
+    CHECK(!gsoParseHeader(&pkt[0], 53, len, 1448, &info), "truncated header accepted");
+    CHECK(!gsoParseHeader(&pkt[0], 54, 54, 1448, &info), "packet without payload accepted");
+
+    put16(&frag[14 + 6], 0x2000);
+    CHECK(!gsoParseHeader(&frag[0], 54, len, 1448, &info), "fragment accepted");
+
+    udp[14 + 9] = 17;
+    CHECK(!gsoParseHeader(&udp[0], 54, len, 1448, &info), "UDP accepted");
+}
+
+static void testOffsets()
+{
+    struct MausiHdrOffsets offs;
+    PacketSpec spec = { kTypeIPv6, true, 0, 0, kFlagACK, 100 };
+    Packet pkt = buildPacket(spec, 1, 0);
+    Packet ext;
+    UInt32 l3 = 18;
+
+    CHECK(gsoParseOffsets(&pkt[0], (UInt32)pkt.size(), &offs), "gsoParseOffsets() failed");
+    CHECK((offs.l3Offset == l3) && (offs.l4Offset == (l3 + 40)) && (offs.l4Proto == 6) &&
+          (offs.type == kGSOTypeIPv6), "wrong offsets for IPv6 with VLAN");
+
+    /* Insert a hop-by-hop and a destination options header. */
+    ext.assign(pkt.begin(), pkt.begin() + l3 + 40);
+    ext[l3 + 6] = 0;
+    ext.push_back(60);
+    ext.push_back(0);
+    ext.insert(ext.end(), 6, 0);
+    ext.push_back(6);
+    ext.push_back(1);
+    ext.insert(ext.end(), 14, 0);
+    ext.insert(ext.end(), pkt.begin() + l3 + 40, pkt.end());
+
+    CHECK(gsoParseOffsets(&ext[0], (UInt32)ext.size(), &offs), "gsoParseOffsets() failed with extension headers");
+    CHECK((offs.l4Offset == (l3 + 40 + 8 + 16)) && (offs.l4Proto == 6),
+          "wrong transport offset with extension headers: %u", offs.l4Offset);
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 msses[] = { 64, 536, 1448, 8960 };
+    static const UInt32 payloads[] = { 1, 63, 64, 65, 535, 536, 537, 1448, 14487, 65000 };
+    static const UInt8 flags[] = { kFlagACK, (kFlagACK | kFlagPSH | kFlagFIN), (kFlagACK | kFlagCWR | kFlagPSH) };
+    PacketSpec spec;
+    UInt32 t, v, o, f, p, m;
+
+    for (t = 0; t < 2; t++) {
+        for (v = 0; v < 2; v++) {
+            for (o = 0; o < 2; o++) {
+                for (f = 0; f < (sizeof(flags) / sizeof(flags[0])); f++) {
+                    for (p = 0; p < (sizeof(payloads) / sizeof(payloads[0])); p++) {
+                        for (m = 0; m < (sizeof(msses) / sizeof(msses[0])); m++) {
+                            spec.type = (t == 0) ? kTypeIPv4 : kTypeIPv6;
+                            spec.vlan = (v != 0);
+                            spec.ipOptLen = (t == 0) ? (o * 12) : 0;
+                            spec.tcpOptLen = o * 12;
+                            spec.flags = flags[f];
+                            spec.payloadLen = payloads[p];
+
+                            testSegmentation(spec, msses[m]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    testRejects();
+    testOffsets();
+
+    return testResult("GSOTest");
+}
@@ -0,0 +1,401 @@
+//
+//  HdrOffsetTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Fuzzes gsoParseOffsets() with valid, truncated, mutated and random
+//  headers. Every header is copied into a buffer of exactly hdrBufLen
+//  bytes, so that AddressSanitizer catches any read beyond it, and the
+//  result must match a straightforward reference parser. The second
+//  part sends packets of all layouts through the checksum offload
+//  engine, once with contexts built from the fixed offsets the driver
+//  used to assume and once with the parsed offsets, and reports which
+//  layouts leave with bad checksums or an overwritten payload.
+//
+
+#include <stddef.h>
+#include <string.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiGSO.hpp"
+#include "MausiTxDesc.hpp"
+#include "HostTest.h"
+#include "TestPacket.h"
+
+#define kNumValid       50000
+#define kNumMutated     400000
+#define kNumRandom      200000
+#define kNumPerLayout   2000
+
+/* As in IntelMausiEthernet.h. */
+#define kMinL4HdrOffsetV4   34
+#define kMinL4HdrOffsetV6   54
+
+/* Reference parser, written from RFC 791, RFC 8200 and RFC 4302. */
+static bool refIsExtHdr(UInt8 next)
+{
+    switch (next) {
+        case 0:     /* hop-by-hop options */
+        case 43:    /* routing */
+        case 44:    /* fragment */
+        case 51:    /* authentication */
+        case 60:    /* destination options */
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static bool refParse(const UInt8 *p, UInt32 len, struct MausiHdrOffsets *offs)
+{
+    UInt32 l3 = 14, l4, hdrs = 0;
+    UInt16 type;
+    UInt8 next;
+
+    if (len < 14)
+        return false;
+
+    type = (p[12] << 8) | p[13];
+
+    if (type == kTypeVlan) {
+        if (len < 18)
+            return false;
+
+        type = (p[16] << 8) | p[17];
+        l3 = 18;
+    }
+    if (type == kTypeIPv4) {
+        if ((len < l3 + 20) || ((p[l3] & 0xf0) != 0x40) || ((p[l3] & 0x0f) < 5))
+            return false;
+
+        l4 = l3 + (p[l3] & 0x0f) * 4;
+        next = p[l3 + 9];
+
+        if (len < l4)
+            return false;
+
+        offs->type = kGSOTypeIPv4;
+    } else if (type == kTypeIPv6) {
+        if ((len < l3 + 40) || ((p[l3] & 0xf0) != 0x60))
+            return false;
+
+        l4 = l3 + 40;
+        next = p[l3 + 6];
+
+        while (refIsExtHdr(next)) {
+            if ((++hdrs > 8) || (len < l4 + 2))
+                return false;
+
+            if (next == 44) {
+                next = p[l4];
+                l4 += 8;
+            } else if (next == 51) {
+                next = p[l4];
+                l4 += 4 * (p[l4 + 1] + 2);
+            } else {
+                next = p[l4];
+                l4 += 8 * (p[l4 + 1] + 1);
+            }
+        }
+        if (len < l4)
+            return false;
+
+        offs->type = kGSOTypeIPv6;
+    } else {
+        return false;
+    }
+    offs->l3Offset = l3;
+    offs->l4Offset = l4;
+    offs->l4Proto = next;
+
+    return true;
+}
+
+/* Parse an exact copy of the first len bytes and compare with the reference. */
+static bool checkParse(const UInt8 *hdr, UInt32 len, struct MausiHdrOffsets *offs)
+{
+    UInt8 *copy = new UInt8[len ? len : 1];
+    struct MausiHdrOffsets ref = {};
+    bool result, expected;
+
+    memcpy(copy, hdr, len);
+    memset(offs, 0, sizeof(*offs));
+
+    result = gsoParseOffsets(copy, len, offs);
+    expected = refParse(copy, len, &ref);
+    delete[] copy;
+
+    CHECK(result == expected, "%u bytes: parsed %d, expected %d", len, result, expected);
+
+    if (result && expected) {
+        CHECK(offs->l3Offset == ref.l3Offset, "l3 offset %u, expected %u", offs->l3Offset, ref.l3Offset);
+        CHECK(offs->l4Offset == ref.l4Offset, "l4 offset %u, expected %u", offs->l4Offset, ref.l4Offset);
+        CHECK(offs->l4Proto == ref.l4Proto, "protocol %u, expected %u", offs->l4Proto, ref.l4Proto);
+        CHECK(offs->type == ref.type, "type %u, expected %u", offs->type, ref.type);
+        CHECK(offs->l4Offset <= len, "l4 offset %u beyond %u bytes", offs->l4Offset, len);
+    }
+    return result;
+}
+
+static TestPacketSpec randomSpec()
+{
+    TestPacketSpec spec;
+
+    spec.type = (testRandom() & 1) ? kTypeIPv6 : kTypeIPv4;
+    spec.proto = (testRandom() & 1) ? kProtoUDP : kProtoTCP;
+    spec.vlan = ((testRandom() % 4) == 0);
+    spec.payloadLen = testRandomRange(0, 64);
+
+    if (testRandom() & 1)
+        spec.optLen = 0;
+    else if (spec.type == kTypeIPv4)
+        spec.optLen = 4 * testRandomRange(1, 10);
+    else
+        spec.optLen = 8 * testRandomRange(2, 8);
+
+    return spec;
+}
+
+/* Valid packets parse to their layout iff the headers up to l4 are present. */
+static void fuzzValid()
+{
+    struct MausiHdrOffsets offs;
+    TestPacketSpec spec;
+    TestLayout l;
+    Packet pkt;
+    UInt32 n, len;
+    bool result;
+
+    for (n = 0; n < kNumValid; n++) {
+        spec = randomSpec();
+        l = testLayoutOf(spec);
+        pkt = testBuildPacket(spec, true);
+        len = (n & 1) ? (UInt32)pkt.size() : testRandomRange(0, (UInt32)pkt.size());
+
+        result = checkParse(&pkt[0], len, &offs);
+        CHECK(result == (len >= l.l4), "valid packet with %u of %u header bytes: %d", len, l.l4, result);
+
+        if (result) {
+            CHECK((offs.l3Offset == l.l3) && (offs.l4Offset == l.l4), "offsets %u/%u, expected %u/%u",
+                  offs.l3Offset, offs.l4Offset, l.l3, l.l4);
+            CHECK(offs.l4Proto == spec.proto, "protocol %u, expected %u", offs.l4Proto, spec.proto);
+        }
+    }
+}
+
+/*
+ * Corrupt a few bytes of the headers of valid packets. Ethertypes,
+ * version nibbles, header lengths and next header fields are hit more
+ * often than the rest, because that's where the parser takes branches.
+ */
+static void fuzzMutated(UInt32 *accepted)
+{
+    static const UInt32 hot[] = { 12, 13, 16, 17, 18, 20, 24, 27, 58, 59, 62, 63, 66, 67 };
+    static const UInt8 protos[] = { 0, 43, 44, 51, 60, 6, 17 };
+    struct MausiHdrOffsets offs;
+    TestPacketSpec spec;
+    Packet pkt;
+    UInt32 n, i, pos, len;
+
+    for (n = 0; n < kNumMutated; n++) {
+        spec = randomSpec();
+        pkt = testBuildPacket(spec, true);
+
+        for (i = testRandomRange(1, 4); i; i--) {
+            if (testRandom() & 1)
+                pos = hot[testRandom() % (sizeof(hot) / sizeof(hot[0]))];
+            else
+                pos = testRandomRange(0, 127);
+
+            if (pos >= pkt.size())
+                continue;
+
+            /* Ext header types and length bytes are worth trying. */
+            switch (testRandom() % 4) {
+                case 0:
+                    pkt[pos] = (UInt8)testRandom();
+                    break;
+
+                case 1:
+                    pkt[pos] = (testRandom() & 1) ? 0xff : 0x00;
+                    break;
+
+                case 2:
+                    pkt[pos] ^= 1 << (testRandom() % 8);
+                    break;
+
+                default:
+                    pkt[pos] = protos[testRandom() % sizeof(protos)];
+                    break;
+            }
+        }
+        len = (testRandom() & 1) ? (UInt32)pkt.size() : testRandomRange(0, (UInt32)pkt.size());
+
+        if (checkParse(&pkt[0], len, &offs))
+            (*accepted)++;
+    }
+}
+
+/* Random bytes behind an IPv4, IPv6 or VLAN ethertype. */
+static void fuzzRandom()
+{
+    static const UInt16 types[] = { kTypeIPv4, kTypeIPv6, kTypeVlan, 0x0806 };
+    struct MausiHdrOffsets offs;
+    UInt8 buf[512];
+    UInt32 n, i, len;
+
+    for (n = 0; n < kNumRandom; n++) {
+        len = testRandomRange(0, sizeof(buf));
+
+        for (i = 0; i < sizeof(buf); i++)
+            buf[i] = (UInt8)testRandom();
+
+        putBE16(&buf[12], types[testRandom() % 4]);
+
+        if (testRandom() & 1)
+            putBE16(&buf[16], types[testRandom() % 2]);
+
+        /* Usually let the version match the ethertype. */
+        if (testRandom() % 4) {
+            buf[14] = (buf[14] & 0x0f) | ((buf[13] == 0xdd) ? 0x60 : 0x40);
+            buf[18] = (buf[18] & 0x0f) | ((buf[17] == 0xdd) ? 0x60 : 0x40);
+        }
+        checkParse(buf, len, &offs);
+    }
+}
+
+/* Packet layouts of the checksum matrix. */
+static const struct {
+    const char *name;
+    UInt16 type;
+    bool vlan;
+    UInt32 optLen;
+} layouts[] = {
+    { "IPv4",                   kTypeIPv4, false, 0 },
+    { "IPv4 VLAN",              kTypeIPv4, true,  0 },
+    { "IPv4 options 12",        kTypeIPv4, false, 12 },
+    { "IPv4 options 40",        kTypeIPv4, false, 40 },
+    { "IPv4 VLAN options 12",   kTypeIPv4, true,  12 },
+    { "IPv6",                   kTypeIPv6, false, 0 },
+    { "IPv6 VLAN",              kTypeIPv6, true,  0 },
+    { "IPv6 ext 24",            kTypeIPv6, false, 24 },
+    { "IPv6 VLAN ext 24",       kTypeIPv6, true,  24 },
+};
+
+#define kNumLayouts (sizeof(layouts) / sizeof(layouts[0]))
+
+struct MatrixCell {
+    UInt32 badCsum;
+    UInt32 overwritten;
+};
+
+/*
+ * Offload a packet with a context built from the given offsets and
+ * check the result. Bytes other than the checksum fields must be left
+ * unchanged by the engine.
+ */
+static void offloadPacket(const TestPacketSpec &spec, bool parsed, MatrixCell *cell)
+{
+    TestLayout l = testLayoutOf(spec);
+    Packet pkt = testBuildPacket(spec, true);
+    Packet orig = pkt;
+    struct MausiHdrOffsets offs;
+    TestOffloadCtx ctx;
+    UInt32 l3, l4, cmdLength, word2, i;
+    bool ipv6 = (spec.type == kTypeIPv6);
+    bool tcp = (spec.proto == kProtoTCP);
+    bool valid;
+
+    if (parsed) {
+        CHECK(gsoParseOffsets(&pkt[0], (UInt32)pkt.size(), &offs), "%s packet not parsed", ipv6 ? "IPv6" : "IPv4");
+        l3 = offs.l3Offset;
+        l4 = offs.l4Offset;
+    } else {
+        l3 = ETHER_HDR_LEN;
+        l4 = ipv6 ? kMinL4HdrOffsetV6 : kMinL4HdrOffsetV4;
+    }
+    txChecksumContext(ipv6, tcp, !tcp, l3, l4, (tcp ? 16 : 6), &ctx.ipConfig, &ctx.tcpConfig, &cmdLength, &word2);
+    ctx.valid = true;
+
+    valid = testOffloadEngine(pkt, ctx, (word2 >> 8) & 0xff) && testL4ChecksumValid(pkt, spec, l);
+
+    if (!ipv6)
+        valid = valid && testIPv4ChecksumValid(pkt, l);
+
+    if (!valid)
+        cell->badCsum++;
+
+    for (i = 0; i < pkt.size(); i++) {
+        if ((i == l.csum) || (i == l.csum + 1) || (!ipv6 && ((i == l.l3 + 10) || (i == l.l3 + 11))))
+            continue;
+
+        if (pkt[i] != orig[i]) {
+            cell->overwritten++;
+            break;
+        }
+    }
+}
+
+static void checksumMatrix()
+{
+    MatrixCell cells[kNumLayouts][2][2] = {};
+    TestPacketSpec spec;
+    UInt32 i, p, parsed, n;
+
+    printf("%-22s %-5s %14s %14s %14s %14s\n", "layout", "proto", "fixed bad", "fixed overw.",
+           "parsed bad", "parsed overw.");
+
+    for (i = 0; i < kNumLayouts; i++) {
+        for (p = 0; p < 2; p++) {
+            spec.type = layouts[i].type;
+            spec.vlan = layouts[i].vlan;
+            spec.optLen = layouts[i].optLen;
+            spec.proto = p ? kProtoUDP : kProtoTCP;
+
+            for (parsed = 0; parsed < 2; parsed++) {
+                for (n = 0; n < kNumPerLayout; n++) {
+                    spec.payloadLen = testRandomRange(0, 1400);
+                    offloadPacket(spec, parsed, &cells[i][p][parsed]);
+                }
+            }
+            MatrixCell &fixed = cells[i][p][0];
+            MatrixCell &parsedCell = cells[i][p][1];
+
+            printf("%-22s %-5s %13.1f%% %13.1f%% %13.1f%% %13.1f%%\n", layouts[i].name, p ? "UDP" : "TCP",
+                   100.0 * fixed.badCsum / kNumPerLayout, 100.0 * fixed.overwritten / kNumPerLayout,
+                   100.0 * parsedCell.badCsum / kNumPerLayout, 100.0 * parsedCell.overwritten / kNumPerLayout);
+
+            CHECK((parsedCell.badCsum == 0) && (parsedCell.overwritten == 0), "%s %s: parsed offsets failed",
+                  layouts[i].name, p ? "UDP" : "TCP");
+
+            /* The fixed offsets are only right for the plain layouts. */
+            if (!layouts[i].vlan && !layouts[i].optLen)
+                CHECK((fixed.badCsum == 0) && (fixed.overwritten == 0), "%s %s: fixed offsets failed",
+                      layouts[i].name, p ? "UDP" : "TCP");
+            else
+                CHECK(fixed.badCsum > (kNumPerLayout * 99 / 100), "%s %s: fixed offsets only broke %u packets",
+                      layouts[i].name, p ? "UDP" : "TCP", fixed.badCsum);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UInt32 accepted = 0;
+
+    testSeed = 1;
+
+    fuzzValid();
+    fuzzMutated(&accepted);
+    fuzzRandom();
+
+    printf("fuzzed %u headers, %u mutated ones accepted\n", kNumValid + kNumMutated + kNumRandom, accepted);
+
+    checksumMatrix();
+
+    return testResult("HdrOffsetTest");
+}
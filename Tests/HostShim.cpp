@@ -0,0 +1,175 @@
+//
+//  HostShim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+
+#include <errno.h>
+
+void (*hostMbufFreeHook)(mbuf_t m) = NULL;
+bool (*hostMbufAllocHook)(mbuf_how_t how, size_t size) = NULL;
+UInt64 hostAbsoluteTime = 0;
+
+struct HostThreadCall {
+    struct HostThreadCall *next;
+    thread_call_func_t func;
+    thread_call_param_t param;
+    UInt64 deadline;
+    bool pending;
+};
+
+static struct HostThreadCall *hostThreadCalls = NULL;
+UInt64 hostMbufsAllocated = 0;
+UInt64 hostMbufsFreed = 0;
+
+mbuf_t hostMbufAlloc(const void *hdr, size_t hdrLen, size_t pktLen)
+{
+    mbuf_t m = (mbuf_t)calloc(1, sizeof(struct HostMbuf));
+
+    if (m) {
+        m->data = (UInt8 *)malloc(hdrLen ? hdrLen : 1);
+
+        if (!m->data) {
+            ::free(m);
+            return NULL;
+        }
+        memcpy(m->data, hdr, hdrLen);
+        m->len = hdrLen;
+        m->pktLen = pktLen;
+        hostMbufsAllocated++;
+    }
+    return m;
+}
+
+errno_t mbuf_allocpacket(mbuf_how_t how, size_t size, unsigned int *chunks, mbuf_t *m)
+{
+    if (hostMbufAllocHook && !hostMbufAllocHook(how, size))
+        return ENOBUFS;
+
+    mbuf_t n = (mbuf_t)calloc(1, sizeof(struct HostMbuf));
+
+    if (!n)
+        return ENOMEM;
+
+    n->data = (UInt8 *)malloc(size);
+
+    if (!n->data) {
+        ::free(n);
+        return ENOMEM;
+    }
+    hostMbufsAllocated++;
+    *chunks = 1;
+    *m = n;
+
+    return 0;
+}
+
+/* The mbuf gets a reference to an external buffer, which isn't copied. */
+int mbuf_attachcluster(int how, int type, mbuf_t *m, caddr_t buf, void (*extFree)(caddr_t, u_int, caddr_t),
+                       size_t size, caddr_t arg)
+{
+    mbuf_t n = (mbuf_t)calloc(1, sizeof(struct HostMbuf));
+
+    if (!n)
+        return ENOMEM;
+
+    n->data = (UInt8 *)buf;
+    n->extFree = extFree;
+    n->extArg = arg;
+    n->extSize = (u_int)size;
+    hostMbufsAllocated++;
+    *m = n;
+
+    return 0;
+}
+
+void mbuf_freem(mbuf_t m)
+{
+    if (hostMbufFreeHook)
+        hostMbufFreeHook(m);
+
+    hostMbufsFreed++;
+
+    if (m->extFree)
+        m->extFree((caddr_t)m->data, m->extSize, m->extArg);
+    else
+        ::free(m->data);
+
+    ::free(m);
+}
+
+void mbuf_freem_list(mbuf_t m)
+{
+    mbuf_t next;
+
+    for (; m; m = next) {
+        next = m->nextpkt;
+        mbuf_freem(m);
+    }
+}
+
+thread_call_t thread_call_allocate_with_options(thread_call_func_t func, thread_call_param_t param, int priority,
+                                                int options)
+{
+    struct HostThreadCall *call = (struct HostThreadCall *)calloc(1, sizeof(struct HostThreadCall));
+
+    if (call) {
+        call->func = func;
+        call->param = param;
+        call->next = hostThreadCalls;
+        hostThreadCalls = call;
+    }
+    return call;
+}
+
+bool thread_call_enter_delayed(thread_call_t call, UInt64 deadline)
+{
+    bool wasPending = call->pending;
+
+    call->deadline = deadline;
+    call->pending = true;
+
+    return wasPending;
+}
+
+bool thread_call_cancel(thread_call_t call)
+{
+    bool wasPending = call->pending;
+
+    call->pending = false;
+
+    return wasPending;
+}
+
+bool thread_call_free(thread_call_t call)
+{
+    struct HostThreadCall **p;
+
+    for (p = &hostThreadCalls; *p; p = &(*p)->next) {
+        if (*p == call) {
+            *p = call->next;
+            break;
+        }
+    }
+    ::free(call);
+
+    return true;
+}
+
+/* Run the thread calls whose deadline has passed. Returns their number. */
+UInt32 hostRunThreadCalls()
+{
+    struct HostThreadCall *call;
+    UInt32 count = 0;
+
+    for (call = hostThreadCalls; call; call = call->next) {
+        if (call->pending && (call->deadline <= hostAbsoluteTime)) {
+            call->pending = false;
+            call->func(call->param, NULL);
+            count++;
+        }
+    }
+    return count;
+}
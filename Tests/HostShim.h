@@ -0,0 +1,301 @@
+//
+//  HostShim.h
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Minimal replacements for the kernel types and functions used by the
+//  driver's platform-neutral sources, so that they can be built and
+//  tested on the host. It's included in front of every source file by
+//  the Makefile, like the prefix header in the kext's build.
+//
+
+#ifndef HostShim_h
+#define HostShim_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+typedef uint8_t UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef uint64_t UInt64;
+typedef int8_t SInt8;
+typedef int16_t SInt16;
+typedef int32_t SInt32;
+typedef int64_t SInt64;
+typedef UInt64 IOPhysicalAddress64;
+typedef uintptr_t IOVirtualAddress;
+typedef UInt64 IOByteCount;
+typedef int IOReturn;
+
+#define kIOReturnSuccess    0
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE       4096
+#endif
+#define PAGE_SHIFT      12
+
+#define ETHER_HDR_LEN   14
+
+#define NSEC_PER_SEC    1000000000ull
+
+#define APPLE_KEXT_OVERRIDE override
+
+#define IOLog(args...)  printf(args)
+
+/* The host is little endian like the hardware. */
+#define OSSwapHostToLittleInt64(x)  ((UInt64)(x))
+#define OSSwapHostToLittleInt32(x)  ((UInt32)(x))
+#define OSSwapLittleToHostInt32(x)  ((UInt32)(x))
+#define OSSwapLittleToHostInt16(x)  ((UInt16)(x))
+
+template <typename T> static inline T min(T a, T b) { return (a < b) ? a : b; }
+template <typename T> static inline T max(T a, T b) { return (a > b) ? a : b; }
+
+/*
+ * libkern atomics. Like on macOS, they are full barriers and the
+ * arithmetic ones return the previous value.
+ */
+static inline bool OSCompareAndSwap(UInt32 oldValue, UInt32 newValue, volatile UInt32 *address)
+{
+    return __atomic_compare_exchange_n(address, &oldValue, newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline SInt32 OSAddAtomic(SInt32 amount, volatile SInt32 *address)
+{
+    return __atomic_fetch_add(address, amount, __ATOMIC_SEQ_CST);
+}
+
+static inline SInt64 OSAddAtomic64(SInt64 amount, volatile SInt64 *address)
+{
+    return __atomic_fetch_add(address, amount, __ATOMIC_SEQ_CST);
+}
+
+static inline SInt32 OSIncrementAtomic(volatile SInt32 *address)
+{
+    return OSAddAtomic(1, address);
+}
+
+static inline SInt32 OSDecrementAtomic(volatile SInt32 *address)
+{
+    return OSAddAtomic(-1, address);
+}
+
+static inline void OSMemoryBarrier()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void *IOMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+static inline void *IOMallocZero(size_t size)
+{
+    return calloc(1, size);
+}
+
+static inline void IOFree(void *p, size_t size)
+{
+    free(p);
+}
+
+/*
+ * Reference counted base class. free() is where the object is deleted,
+ * so that subclasses end their free() with super::free() like in the
+ * kernel.
+ */
+class OSObject {
+public:
+    OSObject() : refCount(1) {}
+    virtual ~OSObject() {}
+    virtual bool init() { return true; }
+    virtual void free() { delete this; }
+    void retain() { refCount++; }
+    void release() { if (--refCount == 0) free(); }
+
+private:
+    int refCount;
+};
+
+#define OSDeclareDefaultStructors(className) \
+    public: className() {} virtual ~className() {}
+#define OSDefineMetaClassAndStructors(className, superclassName)
+
+/*
+ * Packets only have a single buffer which holds the headers. The
+ * packet length may be larger, so that tests don't have to allocate
+ * the payload. testData is for the tests' own bookkeeping. External
+ * buffers are handed back to their owner with extFree.
+ */
+struct HostMbuf {
+    struct HostMbuf *nextpkt;
+    UInt8 *data;
+    size_t len;
+    size_t pktLen;
+    UInt64 testData[2];
+    void (*extFree)(caddr_t buf, u_int size, caddr_t arg);
+    caddr_t extArg;
+    u_int extSize;
+};
+
+typedef struct HostMbuf *mbuf_t;
+
+typedef int errno_t;
+typedef int mbuf_how_t;
+
+#define MBUF_WAITOK     0
+#define MBUF_DONTWAIT   1
+#define MBUF_TYPE_DATA  1
+
+/* Room in a small mbuf with a packet header, roughly as on macOS. */
+#define kHostMHLEN      200
+
+mbuf_t hostMbufAlloc(const void *hdr, size_t hdrLen, size_t pktLen);
+
+/* Decides if mbuf_allocpacket() succeeds, if set. */
+extern bool (*hostMbufAllocHook)(mbuf_how_t how, size_t size);
+
+errno_t mbuf_allocpacket(mbuf_how_t how, size_t size, unsigned int *chunks, mbuf_t *m);
+
+/* Called for every packet before it's freed, if set. */
+extern void (*hostMbufFreeHook)(mbuf_t m);
+extern UInt64 hostMbufsAllocated;
+extern UInt64 hostMbufsFreed;
+
+static inline void *mbuf_data(mbuf_t m) { return m->data; }
+static inline size_t mbuf_len(mbuf_t m) { return m->len; }
+static inline size_t mbuf_pkthdr_len(mbuf_t m) { return m->pktLen; }
+static inline mbuf_t mbuf_nextpkt(mbuf_t m) { return m->nextpkt; }
+static inline void mbuf_setnextpkt(mbuf_t m, mbuf_t next) { m->nextpkt = next; }
+static inline void mbuf_setlen(mbuf_t m, size_t len) { m->len = len; }
+static inline void mbuf_pkthdr_setlen(mbuf_t m, size_t len) { m->pktLen = len; }
+static inline void *mbuf_datastart(mbuf_t m) { return m->data; }
+static inline errno_t mbuf_setdata(mbuf_t m, void *data, size_t len) { m->data = (UInt8 *)data; m->len = len; return 0; }
+static inline size_t mbuf_get_mhlen() { return kHostMHLEN; }
+static inline errno_t mbuf_copy_pkthdr(mbuf_t dest, mbuf_t src) { dest->pktLen = src->pktLen; return 0; }
+static inline void mbuf_pkthdr_setheader(mbuf_t m, void *header) {}
+
+int mbuf_attachcluster(int how, int type, mbuf_t *m, caddr_t buf, void (*extFree)(caddr_t, u_int, caddr_t),
+                       size_t size, caddr_t arg);
+
+void mbuf_freem(mbuf_t m);
+void mbuf_freem_list(mbuf_t m);
+
+/* Layout of the tx data descriptor, see hw.h. */
+struct e1000_data_desc {
+    UInt64 buffer_addr;
+    UInt32 lower;
+    UInt32 upper;
+};
+
+/* Layout of the packet split rx descriptor, see hw.h. */
+union e1000_rx_desc_packet_split {
+    struct {
+        UInt64 buffer_addr[4];
+    } read;
+    struct {
+        struct {
+            UInt32 mrq;
+            union {
+                UInt32 rss;
+                struct {
+                    UInt16 ip_id;
+                    UInt16 csum;
+                } csum_ip;
+            } hi_dword;
+        } lower;
+        struct {
+            UInt32 status_error;
+            UInt16 length0;
+            UInt16 vlan;
+        } middle;
+        struct {
+            UInt16 header_status;
+            UInt16 length[3];
+        } upper;
+        UInt64 reserved;
+    } wb;
+};
+
+struct IOPhysicalSegment {
+    IOPhysicalAddress64 location;
+    UInt64 length;
+};
+
+struct IOAddressRange {
+    IOVirtualAddress address;
+    IOByteCount length;
+};
+
+/*
+ * Thread calls only run from hostRunThreadCalls(), once the absolute
+ * time, which the tests advance in ns, has reached their deadline.
+ */
+typedef void *thread_call_param_t;
+typedef void (*thread_call_func_t)(thread_call_param_t param0, thread_call_param_t param1);
+typedef struct HostThreadCall *thread_call_t;
+
+#define THREAD_CALL_PRIORITY_KERNEL 2
+
+extern UInt64 hostAbsoluteTime;
+
+thread_call_t thread_call_allocate_with_options(thread_call_func_t func, thread_call_param_t param, int priority,
+                                                int options);
+bool thread_call_enter_delayed(thread_call_t call, UInt64 deadline);
+bool thread_call_cancel(thread_call_t call);
+bool thread_call_free(thread_call_t call);
+UInt32 hostRunThreadCalls();
+
+static inline void nanoseconds_to_absolutetime(UInt64 ns, UInt64 *result) { *result = ns; }
+static inline void IOSleep(unsigned int ms) {}
+
+/* Only referenced by pointer, tests use their own mapper. */
+class IOMemoryDescriptor;
+
+#define kernel_task     NULL
+
+enum {
+    kIODirectionIn = 0x1,
+    kIOMemoryPhysicallyContiguous = 0x10,
+    kIOMemoryHostPhysicallyContiguous = 0x20,
+    kIOMemoryMapperNone = 0x800
+};
+
+/* Page aligned host memory whose physical address is its address. */
+class IOBufferMemoryDescriptor : public OSObject {
+public:
+    static IOBufferMemoryDescriptor * inTaskWithPhysicalMask(void *task, UInt32 options, UInt64 capacity,
+                                                             UInt64 mask)
+    {
+        IOBufferMemoryDescriptor *md = new IOBufferMemoryDescriptor;
+
+        md->bytes = aligned_alloc(PAGE_SIZE, (capacity + PAGE_SIZE - 1) & ~(UInt64)(PAGE_SIZE - 1));
+
+        if (!md->bytes) {
+            md->release();
+            md = NULL;
+        }
+        return md;
+    }
+    IOReturn prepare() { return kIOReturnSuccess; }
+    IOReturn complete() { return kIOReturnSuccess; }
+    void * getBytesNoCopy() { return bytes; }
+    IOPhysicalAddress64 getPhysicalSegment(UInt64 offset, UInt64 *length, UInt32 options)
+    {
+        return (IOPhysicalAddress64)(uintptr_t)bytes + offset;
+    }
+    virtual void free() APPLE_KEXT_OVERRIDE { ::free(bytes); OSObject::free(); }
+
+private:
+    void *bytes = NULL;
+};
+
+#endif /* HostShim_h */
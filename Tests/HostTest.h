@@ -0,0 +1,52 @@
+//
+//  HostTest.h
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Check macro and deterministic random numbers shared by the host
+//  tests. Each test is a program of its own, so that the counters can
+//  live in the header.
+//
+
+#ifndef HostTest_h
+#define HostTest_h
+
+static UInt32 numChecks;
+static UInt32 numFailures;
+static UInt32 testSeed = 12345;
+
+#define CHECK(cond, args...)                            \
+    do {                                                \
+        numChecks++;                                    \
+        if (!(cond)) {                                  \
+            numFailures++;                              \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(args);                               \
+            printf("\n");                               \
+        }                                               \
+    } while (0)
+
+/* Linear congruential generator, good enough to vary test inputs. */
+static inline UInt32 testRandom()
+{
+    testSeed = testSeed * 1103515245 + 12345;
+    return (testSeed >> 8);
+}
+
+/* Random number in [lo, hi]. */
+static inline UInt32 testRandomRange(UInt32 lo, UInt32 hi)
+{
+    return lo + (testRandom() % (hi - lo + 1));
+}
+
+/* Print the summary line and get the exit code. */
+static inline int testResult(const char *name)
+{
+    printf("%s: %u checks, %u failures\n", name, numChecks, numFailures);
+
+    return (numFailures == 0) ? 0 : 1;
+}
+
+#endif /* HostTest_h */
@@ -0,0 +1,257 @@
+//
+//  PktGenTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Runs the packet generator's bookkeeping with the threads of the
+//  driver against a mocked register window and ring consumer. It's
+//  built with ThreadSanitizer. An output thread posts the generated
+//  packets and writes the tail register, a hardware thread consumes the
+//  descriptors and writes back their status and an interrupt thread
+//  reclaims the packets and checks for the end of the run, which must
+//  be detected exactly once, after the last packet, with the totals the
+//  output thread posted. pktGenRate() is checked against 128 bit math
+//  for runs up to kPktGenCountMax packets of jumbo frames.
+//
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "MausiPktGen.hpp"
+#include "HostTest.h"
+
+#define kRingSize       256
+#define kRingMask       (kRingSize - 1)
+#define kNumRuns        20
+#define kRunPackets     50000
+#define kNumRates       1000000
+
+#define kStatusDD       0x01
+
+/* The registers of the tx queue which matter here. */
+struct MockRegs {
+    volatile UInt32 tdh;
+    volatile UInt32 tdt;
+};
+
+struct MockDesc {
+    UInt32 length;
+    volatile UInt32 status;
+};
+
+/* Packets in flight, like txInflight. */
+struct Inflight {
+    UInt32 bytes[kRingSize];
+    UInt16 eopIndex[kRingSize];
+    UInt16 numDescs[kRingSize];
+};
+
+struct Run {
+    intelPktGen gen;
+    struct MockRegs regs;
+    struct MockDesc ring[kRingSize];
+    struct Inflight inflight;
+    volatile UInt32 dirtyIndex;     /* written by the interrupt thread */
+    volatile bool stop;
+    UInt64 sentBytes;               /* totals of the output thread */
+    UInt64 sentDescs;
+    UInt32 doneCount;
+    UInt32 earlyDone;
+    UInt32 probes;
+};
+
+static void *outputThread(void *p)
+{
+    struct Run *run = (struct Run *)p;
+    UInt32 seed = run->gen.count;
+    UInt32 next = 0, tail = 0;
+    UInt32 numDescs, bytes, used, i;
+
+    for (run->gen.built = 0; run->gen.built < run->gen.count; run->gen.built++) {
+        seed = seed * 1103515245 + 12345;
+        bytes = kPktGenMinSize + ((seed >> 8) % 1455);
+        numDescs = 1 + ((seed >> 20) % 3);
+
+        /* Wait for free descriptors like a stalled queue. */
+        do {
+            used = (next - __atomic_load_n(&run->dirtyIndex, __ATOMIC_ACQUIRE)) & kRingMask;
+
+            if ((used + numDescs) < kRingSize)
+                break;
+
+            sched_yield();
+        } while (true);
+
+        for (i = 0; i < numDescs; i++) {
+            run->ring[next].length = bytes;
+            next = (next + 1) & kRingMask;
+        }
+        run->inflight.bytes[tail] = bytes;
+        run->inflight.eopIndex[tail] = (next - 1) & kRingMask;
+        run->inflight.numDescs[tail] = numDescs;
+
+        /* txFinishPacket() */
+        if (pktGenPosted(&run->gen, bytes, numDescs))
+            pktGenStartProbe(&run->gen, tail, run->gen.built);
+
+        tail = (tail + 1) & kRingMask;
+        run->sentBytes += bytes;
+        run->sentDescs += numDescs;
+
+        /* The tail update makes the descriptors visible to the hardware. */
+        __atomic_store_n(&run->regs.tdt, next, __ATOMIC_RELEASE);
+    }
+    /* pktGenDequeue() finds nothing more to send. */
+    pktGenSetAllPosted(&run->gen);
+
+    return NULL;
+}
+
+static void *hardwareThread(void *p)
+{
+    struct Run *run = (struct Run *)p;
+    UInt32 head = 0, tail;
+
+    while (!__atomic_load_n(&run->stop, __ATOMIC_ACQUIRE)) {
+        tail = __atomic_load_n(&run->regs.tdt, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            sched_yield();
+            continue;
+        }
+        for (; head != tail; head = (head + 1) & kRingMask)
+            __atomic_store_n(&run->ring[head].status, kStatusDD, __ATOMIC_RELEASE);
+
+        __atomic_store_n(&run->regs.tdh, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* txInterrupt() with txReclaimPackets(), pktGenComplete() and pktGenCheckDone(). */
+static void *interruptThread(void *p)
+{
+    struct Run *run = (struct Run *)p;
+    UInt32 head = 0, dirty = 0, eop;
+
+    while (run->doneCount == 0) {
+        /* The posted count covers the inflight entries, like txInflightTail. */
+        while (run->gen.completed < __atomic_load_n(&run->gen.posted, __ATOMIC_ACQUIRE)) {
+            eop = run->inflight.eopIndex[head];
+
+            /* Stop at the first packet the hardware isn't done with. */
+            if (!(__atomic_load_n(&run->ring[eop].status, __ATOMIC_ACQUIRE) & kStatusDD))
+                break;
+
+            for (; dirty != ((eop + 1) & kRingMask); dirty = (dirty + 1) & kRingMask)
+                run->ring[dirty].status = 0;
+
+            run->gen.completed++;
+
+            if (pktGenIsProbe(&run->gen, head)) {
+                run->probes++;
+                pktGenEndProbe(&run->gen);
+            }
+            head = (head + 1) & kRingMask;
+            __atomic_store_n(&run->dirtyIndex, dirty, __ATOMIC_RELEASE);
+        }
+        if (pktGenRunDone(&run->gen)) {
+            run->doneCount++;
+
+            if (run->gen.completed != run->gen.count)
+                run->earlyDone++;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void testRun(UInt32 count)
+{
+    struct Run *run = new Run();
+    pthread_t output, hardware, interrupt;
+
+    run->gen.count = count;
+
+    pthread_create(&hardware, NULL, hardwareThread, run);
+    pthread_create(&interrupt, NULL, interruptThread, run);
+    pthread_create(&output, NULL, outputThread, run);
+
+    pthread_join(output, NULL);
+    pthread_join(interrupt, NULL);
+    __atomic_store_n(&run->stop, true, __ATOMIC_RELEASE);
+    pthread_join(hardware, NULL);
+
+    CHECK(run->doneCount == 1, "run of %u packets done %u times", count, run->doneCount);
+    CHECK(run->earlyDone == 0, "run done after %llu of %u packets", (unsigned long long)run->gen.completed, count);
+    CHECK(run->gen.posted == count, "%llu of %u packets posted", (unsigned long long)run->gen.posted, count);
+    CHECK(run->gen.bytes == run->sentBytes, "%llu bytes counted, %llu sent", (unsigned long long)run->gen.bytes,
+          (unsigned long long)run->sentBytes);
+    CHECK(run->gen.descs == run->sentDescs, "%llu descriptors counted, %llu used",
+          (unsigned long long)run->gen.descs, (unsigned long long)run->sentDescs);
+    CHECK(run->probes > 0, "no latency probe reclaimed");
+
+    delete run;
+}
+
+/*
+ * Compare pktGenRate() with the exact quotient. It has to be exact for
+ * runs of up to 18 seconds. For longer ones, the scaled remainder may
+ * be off by one in addition to a relative error of 1e-9.
+ */
+static void testRate(UInt64 value, UInt64 elapsed, double *maxError)
+{
+    UInt64 exact = (UInt64)(((unsigned __int128)value * NSEC_PER_SEC) / elapsed);
+    UInt64 rate = pktGenRate(value, elapsed);
+    UInt64 diff = (rate > exact) ? (rate - exact) : (exact - rate);
+
+    if (diff == 0)
+        return;
+
+    if (exact && ((double)diff / exact > *maxError))
+        *maxError = (double)diff / exact;
+
+    CHECK(elapsed > (UINT64_MAX / NSEC_PER_SEC), "rate %llu of %llu in %llu ns, exactly %llu",
+          (unsigned long long)rate, (unsigned long long)value, (unsigned long long)elapsed,
+          (unsigned long long)exact);
+    CHECK(diff <= (1 + exact / NSEC_PER_SEC), "rate %llu of %llu in %llu ns, exactly %llu",
+          (unsigned long long)rate, (unsigned long long)value, (unsigned long long)elapsed,
+          (unsigned long long)exact);
+}
+
+static void testRates()
+{
+    UInt64 maxBytes = (UInt64)kPktGenCountMax * 9018;
+    UInt64 value, elapsed;
+    double maxError = 0.0;
+    UInt32 n;
+
+    for (n = 0; n < kNumRates; n++) {
+        /* Runs from a microsecond up to a day at 10Mb/s and up. */
+        elapsed = 1000 + (((UInt64)testRandom() << 24) | testRandom()) % (86400 * NSEC_PER_SEC);
+        value = (((UInt64)testRandom() << 24) | testRandom()) % (maxBytes + 1);
+
+        testRate(value, elapsed, &maxError);
+    }
+    testRate(maxBytes, NSEC_PER_SEC, &maxError);
+    testRate(maxBytes, UINT64_MAX, &maxError);
+    testRate(UINT64_MAX / NSEC_PER_SEC + 1, NSEC_PER_SEC, &maxError);
+
+    printf("rates: largest relative error %g, %llu bytes in 10 minutes: %llu B/s, the former math gives %llu\n",
+           maxError, (unsigned long long)maxBytes, (unsigned long long)pktGenRate(maxBytes, 600 * NSEC_PER_SEC),
+           (unsigned long long)((maxBytes * NSEC_PER_SEC) / (600 * NSEC_PER_SEC)));
+}
+
+int main(int argc, char *argv[])
+{
+    UInt32 r;
+
+    for (r = 0; r < kNumRuns; r++)
+        testRun(1 + testRandomRange(0, kRunPackets));
+
+    testRates();
+
+    return testResult("PktGenTest");
+}
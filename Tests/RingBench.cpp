@@ -0,0 +1,164 @@
+//
+//  RingBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Compares the throughput of MausiRing with the spinlock protected free
+//  list the buffer pools used before. Each thread takes a buffer from a
+//  pool and returns it right away, like the workloop taking buffers and
+//  the refill thread or the mbuf free callbacks returning them. The
+//  numbers depend on the number of CPUs, which is printed along with them.
+//
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MausiRing.hpp"
+
+#define kPoolSize       256
+#define kNumOps         5000000
+#define kMaxThreads     4
+
+struct BenchBuf {
+    struct BenchBuf *next;
+};
+
+/* The old design: a singly linked free list behind a spinlock. */
+struct ListPool {
+    volatile UInt32 lock;
+    struct BenchBuf *head;
+};
+
+static inline void spinLock(volatile UInt32 *lock)
+{
+    while (!OSCompareAndSwap(0, 1, lock)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+static inline void spinUnlock(volatile UInt32 *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct BenchBuf *listGet(struct ListPool *pool)
+{
+    struct BenchBuf *buf;
+
+    spinLock(&pool->lock);
+    buf = pool->head;
+
+    if (buf)
+        pool->head = buf->next;
+
+    spinUnlock(&pool->lock);
+
+    return buf;
+}
+
+static void listPut(struct ListPool *pool, struct BenchBuf *buf)
+{
+    spinLock(&pool->lock);
+    buf->next = pool->head;
+    pool->head = buf;
+    spinUnlock(&pool->lock);
+}
+
+struct BenchArg {
+    struct MausiRing *ring;
+    struct ListPool *list;
+    UInt64 ops;
+    UInt64 empty;
+};
+
+static void *ringWorker(void *p)
+{
+    struct BenchArg *arg = (struct BenchArg *)p;
+    void *buf;
+    UInt64 i;
+
+    for (i = 0; i < arg->ops; i++) {
+        if ((buf = ringPop(arg->ring)))
+            ringPush(arg->ring, buf);
+        else
+            arg->empty++;
+    }
+    return NULL;
+}
+
+static void *listWorker(void *p)
+{
+    struct BenchArg *arg = (struct BenchArg *)p;
+    struct BenchBuf *buf;
+    UInt64 i;
+
+    for (i = 0; i < arg->ops; i++) {
+        if ((buf = listGet(arg->list)))
+            listPut(arg->list, buf);
+        else
+            arg->empty++;
+    }
+    return NULL;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double runBench(bool ring, UInt32 numThreads, UInt64 numOps)
+{
+    static struct BenchBuf bufs[kPoolSize];
+    pthread_t threads[kMaxThreads];
+    struct BenchArg args[kMaxThreads];
+    struct MausiRing r;
+    struct ListPool list = { 0, NULL };
+    double start, elapsed;
+    UInt32 i;
+
+    if (!ringInit(&r, kPoolSize))
+        return 0;
+
+    for (i = 0; i < kPoolSize; i++) {
+        ringPush(&r, &bufs[i]);
+        listPut(&list, &bufs[i]);
+    }
+    start = now();
+
+    for (i = 0; i < numThreads; i++) {
+        args[i].ring = &r;
+        args[i].list = &list;
+        args[i].ops = numOps / numThreads;
+        args[i].empty = 0;
+        pthread_create(&threads[i], NULL, ring ? ringWorker : listWorker, &args[i]);
+    }
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    elapsed = now() - start;
+    ringFree(&r);
+
+    return numOps / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    UInt64 numOps = (argc > 1) ? strtoull(argv[1], NULL, 0) : kNumOps;
+    UInt32 threads;
+
+    printf("%ld CPUs, %llu get/put pairs per run\n", sysconf(_SC_NPROCESSORS_ONLN), (unsigned long long)numOps);
+    printf("%-8s %14s %14s\n", "threads", "ring Mops/s", "list Mops/s");
+
+    for (threads = 1; threads <= kMaxThreads; threads <<= 1) {
+        printf("%-8u %14.1f %14.1f\n", threads,
+               runBench(true, threads, numOps), runBench(false, threads, numOps));
+    }
+    return 0;
+}
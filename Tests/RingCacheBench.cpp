@@ -0,0 +1,165 @@
+//
+//  RingCacheBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Measures cycles per descriptor for writing tx descriptors and for
+//  polling the status of rx descriptors, in cached ring memory and in
+//  ring memory which behaves like memory mapped with kIOMapInhibitCache.
+//  User space can't get uncached memory on Linux without a driver, so
+//  uncached accesses are emulated by flushing the cache line after
+//  each store and before each load, which makes every access go to
+//  memory. This is close to, but not the same as, the cost of real UC
+//  accesses. The tx descriptors are written field by field like before,
+//  with the two 64 bit stores of txSetDataDesc() and, for comparison,
+//  with a single 16 byte SSE store, which the kext can't use as it
+//  would have to save the FPU state.
+//
+
+#include <stddef.h>
+#include <x86intrin.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+
+#define kRingSize       512
+#define kRingMask       (kRingSize - 1)
+#define kNumDescs       4000000
+
+enum {
+    kStoreFields = 0,
+    kStore64,
+    kStore128,
+    kNumStores
+};
+
+static const char *storeNames[kNumStores] = { "tx field stores", "tx 2x64 bit stores", "tx 128 bit store" };
+
+/* The rx descriptor's write-back status lives in the upper qword. */
+struct RxDesc {
+    UInt64 bufferAddr;
+    volatile UInt32 statusError;
+    UInt32 length;
+};
+
+static inline void flushAfterStore(const void *p, bool uncached)
+{
+    if (uncached) {
+        _mm_clflush(p);
+        _mm_mfence();
+    }
+}
+
+static inline void txStore(struct e1000_data_desc *desc, UInt64 addr, UInt32 lower, UInt32 upper,
+                           UInt32 store, bool uncached)
+{
+    volatile struct e1000_data_desc *d = desc;
+
+    switch (store) {
+        case kStoreFields:
+            d->buffer_addr = addr;
+            flushAfterStore(desc, uncached);
+            d->lower = lower;
+            flushAfterStore(desc, uncached);
+            d->upper = upper;
+            flushAfterStore(desc, uncached);
+            break;
+
+        case kStore64:
+            /* Same as txSetDataDesc(), one flush per store. */
+            ((volatile UInt64 *)desc)[0] = addr;
+            flushAfterStore(desc, uncached);
+            ((volatile UInt64 *)desc)[1] = (((UInt64)upper << 32) | lower);
+            flushAfterStore(desc, uncached);
+            break;
+
+        default:
+            _mm_store_si128((__m128i *)desc, _mm_set_epi64x((long long)(((UInt64)upper << 32) | lower), (long long)addr));
+            flushAfterStore(desc, uncached);
+            break;
+    }
+}
+
+static double txCycles(struct e1000_data_desc *ring, UInt32 store, bool uncached)
+{
+    UInt32 cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | 1514);
+    UInt32 index = 0;
+    UInt32 i;
+    UInt64 start;
+
+    start = __rdtsc();
+
+    for (i = 0; i < kNumDescs; i++) {
+        txStore(&ring[index], (0x100000000ULL + i * 2048), cmd, E1000_TXD_OPTS_TXSM, store, uncached);
+        index = (index + 1) & kRingMask;
+    }
+    return (double)(__rdtsc() - start) / kNumDescs;
+}
+
+/*
+ * Poll the status of completed rx descriptors and clear it, which is
+ * what rxInterrupt() does for every received packet.
+ */
+static double rxCycles(struct RxDesc *ring, bool uncached)
+{
+    UInt32 index = 0;
+    UInt32 done = 0;
+    UInt32 i;
+    UInt64 start;
+
+    for (i = 0; i < kRingSize; i++)
+        ring[i].statusError = E1000_RXD_STAT_DD | E1000_RXD_STAT_EOP;
+
+    start = __rdtsc();
+
+    for (i = 0; i < kNumDescs; i++) {
+        if (uncached)
+            _mm_clflush(&ring[index]);
+
+        if (ring[index].statusError & E1000_RXD_STAT_DD) {
+            done++;
+            ring[index].bufferAddr = 0x200000000ULL + i * 2048;
+            ring[index].statusError = 0;
+            flushAfterStore(&ring[index], uncached);
+
+            /* The hardware writes the descriptor back again. */
+            ring[index].statusError = E1000_RXD_STAT_DD | E1000_RXD_STAT_EOP;
+        }
+        index = (index + 1) & kRingMask;
+    }
+    if (done != kNumDescs)
+        printf("rx: only %u descriptors completed\n", done);
+
+    return (double)(__rdtsc() - start) / kNumDescs;
+}
+
+int main(int argc, char *argv[])
+{
+    struct e1000_data_desc *txRing;
+    struct RxDesc *rxRing;
+    UInt32 s;
+
+    txRing = (struct e1000_data_desc *)aligned_alloc(64, kRingSize * sizeof(struct e1000_data_desc));
+    rxRing = (struct RxDesc *)aligned_alloc(64, kRingSize * sizeof(struct RxDesc));
+
+    if (!txRing || !rxRing)
+        return 1;
+
+    memset(txRing, 0, kRingSize * sizeof(struct e1000_data_desc));
+    memset(rxRing, 0, kRingSize * sizeof(struct RxDesc));
+
+    printf("%-20s %10s %10s   (TSC cycles per descriptor)\n", "access", "cached", "uncached");
+
+    for (s = 0; s < kNumStores; s++) {
+        printf("%-20s %10.1f %10.1f\n", storeNames[s], txCycles(txRing, s, false), txCycles(txRing, s, true));
+    }
+    printf("%-20s %10.1f %10.1f\n", "rx status poll", rxCycles(rxRing, false), rxCycles(rxRing, true));
+
+    free(txRing);
+    free(rxRing);
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+//
+//  RingStress.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Stress test for MausiRing with several producers and consumers. It's
+//  built with ThreadSanitizer. Every producer pushes a numbered sequence
+//  of entries, which have to be popped exactly once and, as seen by a
+//  single consumer, in the order they were pushed. A small ring is used
+//  too, so that producers run into a full ring and the positions wrap
+//  around many times. Meanwhile another thread keeps taking snapshots
+//  with ringCount(), which must never exceed the size of the ring.
+//
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "MausiRing.hpp"
+
+#define kNumProducers   4
+#define kNumConsumers   4
+#define kItemsPerThread 200000
+#define kCountSamples   20000000
+
+/* Entries encode the producer and the sequence number, never NULL. */
+#define kSeqBits        24
+#define kSeqMask        ((1 << kSeqBits) - 1)
+
+struct StressRun {
+    struct MausiRing ring;
+    UInt8 *seen;                /* pops per entry */
+    volatile SInt32 producersDone;
+    volatile SInt32 failures;
+    volatile bool stop;
+    UInt32 countErrors;
+    UInt64 countSamples;
+    UInt32 itemsPerThread;
+};
+
+struct ThreadArg {
+    struct StressRun *run;
+    UInt32 index;
+};
+
+static void *producer(void *p)
+{
+    struct ThreadArg *arg = (struct ThreadArg *)p;
+    struct StressRun *run = arg->run;
+    UInt32 i;
+
+    for (i = 0; i < run->itemsPerThread; i++) {
+        uintptr_t val = ((uintptr_t)arg->index << kSeqBits) | (i + 1);
+
+        while (!ringPush(&run->ring, (void *)val))
+            sched_yield();
+    }
+    OSIncrementAtomic(&run->producersDone);
+
+    return NULL;
+}
+
+static void *consumer(void *p)
+{
+    struct ThreadArg *arg = (struct ThreadArg *)p;
+    struct StressRun *run = arg->run;
+    UInt32 last[kNumProducers] = { 0 };
+    uintptr_t val;
+    UInt32 prod, seq;
+    bool done;
+
+    while (true) {
+        /* Check before popping, so that no entry is left behind. */
+        done = (__atomic_load_n(&run->producersDone, __ATOMIC_ACQUIRE) == kNumProducers);
+        val = (uintptr_t)ringPop(&run->ring);
+
+        if (!val) {
+            if (done)
+                break;
+
+            sched_yield();
+            continue;
+        }
+        prod = (UInt32)(val >> kSeqBits);
+        seq = (UInt32)(val & kSeqMask);
+
+        if ((prod >= kNumProducers) || (seq == 0) || (seq > run->itemsPerThread) || (seq <= last[prod])) {
+            printf("FAIL: consumer %u got %u/%u after %u\n", arg->index, prod, seq,
+                   (prod < kNumProducers) ? last[prod] : 0);
+            OSIncrementAtomic(&run->failures);
+            continue;
+        }
+        last[prod] = seq;
+        __atomic_fetch_add(&run->seen[prod * run->itemsPerThread + seq - 1], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* Like MausiRxPool's refill and trim checks of the pool depth. */
+static void *counter(void *p)
+{
+    struct StressRun *run = (struct StressRun *)p;
+    UInt32 count;
+
+    /*
+     * A bad count needs the thread to be preempted between its loads of
+     * head and tail, so that it doesn't yield. The number of samples is
+     * limited, as it takes the CPU away from the other threads.
+     */
+    while (!__atomic_load_n(&run->stop, __ATOMIC_ACQUIRE) && (run->countSamples < kCountSamples)) {
+        count = ringCount(&run->ring);
+
+        if (count > run->ring.size) {
+            if (run->countErrors++ == 0)
+                printf("FAIL: ring of %u has %u entries\n", run->ring.size, count);
+        }
+        run->countSamples++;
+    }
+    return NULL;
+}
+
+static bool runStress(UInt32 capacity, UInt32 itemsPerThread)
+{
+    pthread_t threads[kNumProducers + kNumConsumers];
+    pthread_t countThread;
+    struct ThreadArg args[kNumProducers + kNumConsumers];
+    struct StressRun run;
+    UInt32 numItems = kNumProducers * itemsPerThread;
+    UInt32 missing = 0, duplicates = 0;
+    UInt32 i;
+
+    memset(&run, 0, sizeof(run));
+    run.itemsPerThread = itemsPerThread;
+    run.seen = (UInt8 *)IOMallocZero(numItems);
+
+    if (!run.seen || !ringInit(&run.ring, capacity)) {
+        printf("FAIL: can't allocate ring of %u\n", capacity);
+        return false;
+    }
+    for (i = 0; i < (kNumProducers + kNumConsumers); i++) {
+        args[i].run = &run;
+        args[i].index = (i < kNumProducers) ? i : (i - kNumProducers);
+        pthread_create(&threads[i], NULL, (i < kNumProducers) ? producer : consumer, &args[i]);
+    }
+    pthread_create(&countThread, NULL, counter, &run);
+
+    for (i = 0; i < (kNumProducers + kNumConsumers); i++)
+        pthread_join(threads[i], NULL);
+
+    __atomic_store_n(&run.stop, true, __ATOMIC_RELEASE);
+    pthread_join(countThread, NULL);
+
+    for (i = 0; i < numItems; i++) {
+        if (run.seen[i] == 0)
+            missing++;
+        else if (run.seen[i] > 1)
+            duplicates++;
+    }
+    if (ringPop(&run.ring)) {
+        printf("FAIL: ring of %u not empty\n", capacity);
+        run.failures++;
+    }
+    printf("ring %6u: %u entries, %u missing, %u duplicates, %d order errors, %u of %llu counts too large\n",
+           run.ring.size, numItems, missing, duplicates, run.failures, run.countErrors,
+           (unsigned long long)run.countSamples);
+
+    ringFree(&run.ring);
+    IOFree(run.seen, numItems);
+
+    return (!missing && !duplicates && !run.failures && !run.countErrors);
+}
+
+/* Single threaded checks of the full and empty conditions. */
+static bool testBounds()
+{
+    struct MausiRing ring;
+    bool result = true;
+    uintptr_t i;
+
+    if (!ringInit(&ring, 5))
+        return false;
+
+    result &= (ring.size == 8);
+    result &= (ringPop(&ring) == NULL);
+
+    /* Several laps, so that the sequence numbers wrap around the slots. */
+    for (UInt32 lap = 0; lap < 3; lap++) {
+        for (i = 1; i <= 8; i++)
+            result &= ringPush(&ring, (void *)i);
+
+        result &= !ringPush(&ring, (void *)9);
+        result &= (ringCount(&ring) == 8);
+
+        for (i = 1; i <= 8; i++)
+            result &= (ringPop(&ring) == (void *)i);
+
+        result &= (ringPop(&ring) == NULL);
+    }
+    ringFree(&ring);
+
+    result &= !ringInit(&ring, 0);
+
+    if (!result)
+        printf("FAIL: bounds\n");
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    UInt32 items = (argc > 1) ? (UInt32)strtoul(argv[1], NULL, 0) : kItemsPerThread;
+    bool result = testBounds();
+
+    result &= runStress(8, items);
+    result &= runStress(1024, items);
+
+    printf("RingStress: %s\n", result ? "passed" : "FAILED");
+
+    return result ? 0 : 1;
+}
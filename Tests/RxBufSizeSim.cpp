@@ -0,0 +1,203 @@
+//
+//  RxBufSizeSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates the receive ring with the buffer sizes the driver picks for
+//  an MTU. A model of the hardware decodes the buffer size from the RCTL
+//  bits of rxCtrlBufferSize(), spreads each frame over as many
+//  descriptors as needed and checks that it never writes beyond the
+//  buffer the driver allocated. The former setup, a page per descriptor
+//  with the hardware left at 2048 bytes, is run side by side. For each
+//  MTU and traffic mix the memory pinned by the ring and the pool
+//  reserve, the descriptors per frame, the frames a full ring absorbs
+//  and the fraction of the buffers filled with data are reported.
+//
+
+#include <net/ethernet.h>
+
+#include "defines.h"
+#include "MausiRxDesc.hpp"
+#include "HostTest.h"
+
+#define kNumFrames      1000000
+#define kVlanLen        4
+
+/* As in MausiDescRing.hpp and IntelMausiEthernet.h. */
+#define kNumDescDefault 512
+#define kRxPoolClstCap  100
+#define kMaxMtu         9000
+
+enum {
+    kMixSmall = 0,
+    kMixIMIX,
+    kMixFull,
+    kMixBulk,
+    kNumMixes
+};
+
+static const char *mixNames[kNumMixes] = { "64 byte", "IMIX", "max size", "bulk" };
+
+struct Setup {
+    UInt32 bufSize;     /* allocated by the driver */
+    UInt32 rctl;        /* programmed into the hardware */
+};
+
+struct Result {
+    UInt64 memory;
+    double descsPerFrame;
+    double framesPerRing;
+    double fill;
+    UInt32 overruns;
+};
+
+/* The hardware's reading of the RCTL buffer size bits. */
+static UInt32 hwBufferSize(UInt32 rctl)
+{
+    static const UInt32 sizes[4] = { 2048, 1024, 512, 256 };
+    static const UInt32 extSizes[4] = { 0, 16384, 8192, 4096 };
+    UInt32 sz = (rctl & E1000_RCTL_SZ_256) >> 16;
+
+    return (rctl & E1000_RCTL_BSEX) ? extSizes[sz] : sizes[sz];
+}
+
+/* Frame length on the wire, including a VLAN tag in 10% of all frames. */
+static UInt32 frameLen(UInt32 mix, UInt32 mtu)
+{
+    UInt32 maxLen = mtu + ETH_HLEN + ETH_FCS_LEN;
+    UInt32 len, r = testRandomRange(0, 11);
+
+    switch (mix) {
+        case kMixSmall:
+            len = 64;
+            break;
+
+        case kMixIMIX:
+            /* 7:4:1 of 64, 594 and 1518 bytes, limited by the MTU. */
+            len = (r < 7) ? 64 : ((r < 11) ? 594 : 1518);
+            break;
+
+        case kMixFull:
+            len = maxLen;
+            break;
+
+        default:
+            /* A bulk transfer: every other frame is an ack. */
+            len = (r & 1) ? maxLen : 64;
+            break;
+    }
+    len = min(len, maxLen);
+
+    if (testRandomRange(0, 9) == 0)
+        len += kVlanLen;
+
+    return len;
+}
+
+/*
+ * Run a stream of frames through a ring. The hardware fills the ring
+ * until it's full, then the driver cleans it in one go, which is the
+ * worst case of a burst arriving while the interrupt is delayed.
+ */
+static Result simulate(const Setup *setup, UInt32 numDesc, UInt32 mtu, UInt32 mix)
+{
+    UInt32 hwSize = hwBufferSize(setup->rctl);
+    UInt64 descs = 0, bytes = 0, fills = 0, filledFrames = 0;
+    UInt32 free = numDesc - 1;
+    UInt32 n, len, chunk, need, frames = 0;
+    Result r;
+
+    memset(&r, 0, sizeof(r));
+
+    for (n = 0; n < kNumFrames; n++) {
+        len = frameLen(mix, mtu);
+        need = (len + hwSize - 1) / hwSize;
+
+        if (need > free) {
+            /* Ring full: the driver cleans it and hands it back. */
+            free = numDesc - 1;
+            filledFrames += frames;
+            frames = 0;
+            fills++;
+        }
+        descs += need;
+        bytes += len;
+        free -= need;
+        frames++;
+
+        /* The hardware writes up to its buffer size into each descriptor. */
+        for (; len; len -= chunk) {
+            chunk = min(len, hwSize);
+
+            if (chunk > setup->bufSize)
+                r.overruns++;
+        }
+    }
+    r.memory = (UInt64)(numDesc + kRxPoolClstCap) * setup->bufSize;
+    r.descsPerFrame = (double)descs / kNumFrames;
+    r.framesPerRing = (double)filledFrames / fills;
+    r.fill = (double)bytes / (descs * setup->bufSize);
+
+    return r;
+}
+
+static void testRctlBits()
+{
+    static const UInt32 sizes[] = { 256, 512, 1024, 2048, 4096, 8192, 16384 };
+    UInt32 i;
+
+    for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++)
+        CHECK(hwBufferSize(rxCtrlBufferSize(sizes[i])) == sizes[i], "RCTL bits %08x for %u byte buffers",
+              rxCtrlBufferSize(sizes[i]), sizes[i]);
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 mtus[] = { ETH_DATA_LEN, 4000, kMaxMtu };
+    static const UInt32 rings[] = { kNumDescDefault, 4096 };
+    Setup old = { kRxBufferSize, E1000_RCTL_SZ_2048 };
+    Setup cur, vtd;
+    Result ro, rc, rv;
+    UInt32 m, mix, ring;
+
+    testRctlBits();
+
+    printf("%-5s %-9s %-5s %-22s %-22s %-22s %-24s\n", "ring", "mix", "MTU", "pinned KiB old/new/VTD",
+           "descs/frame old/new", "frames/ring old/new", "buffer fill old/new/VTD");
+
+    for (ring = 0; ring < (sizeof(rings) / sizeof(rings[0])); ring++) {
+        for (m = 0; m < (sizeof(mtus) / sizeof(mtus[0])); m++) {
+            cur.bufSize = rxBufferSizeFor(mtus[m], false);
+            cur.rctl = rxCtrlBufferSize(cur.bufSize);
+            vtd.bufSize = rxBufferSizeFor(mtus[m], true);
+            vtd.rctl = rxCtrlBufferSize(vtd.bufSize);
+
+            CHECK(hwBufferSize(cur.rctl) == cur.bufSize, "MTU %u: hardware uses %u of %u bytes", mtus[m],
+                  hwBufferSize(cur.rctl), cur.bufSize);
+            CHECK(hwBufferSize(vtd.rctl) == vtd.bufSize, "MTU %u with AppleVTD: hardware uses %u of %u bytes",
+                  mtus[m], hwBufferSize(vtd.rctl), vtd.bufSize);
+            CHECK((mtus[m] > ETH_DATA_LEN) || ((ETH_DATA_LEN + ETH_HLEN + ETH_FCS_LEN + kVlanLen) <= cur.bufSize),
+                  "a standard frame doesn't fit into %u bytes", cur.bufSize);
+
+            for (mix = 0; mix < kNumMixes; mix++) {
+                ro = simulate(&old, rings[ring], mtus[m], mix);
+                rc = simulate(&cur, rings[ring], mtus[m], mix);
+                rv = simulate(&vtd, rings[ring], mtus[m], mix);
+
+                CHECK((ro.overruns + rc.overruns + rv.overruns) == 0, "MTU %u, %s: %u/%u/%u buffer overruns",
+                      mtus[m], mixNames[mix], ro.overruns, rc.overruns, rv.overruns);
+                CHECK((rc.memory <= ro.memory) && (rc.descsPerFrame <= ro.descsPerFrame),
+                      "MTU %u, %s: more memory or descriptors than before", mtus[m], mixNames[mix]);
+
+                printf("%-5u %-9s %-5u %6llu/%6llu/%6llu   %9.3f/%-9.3f   %9.1f/%-9.1f   %6.1f%%/%5.1f%%/%5.1f%%\n",
+                       rings[ring], mixNames[mix], mtus[m], (unsigned long long)(ro.memory >> 10),
+                       (unsigned long long)(rc.memory >> 10), (unsigned long long)(rv.memory >> 10),
+                       ro.descsPerFrame, rc.descsPerFrame, ro.framesPerRing, rc.framesPerRing, ro.fill * 100.0,
+                       rc.fill * 100.0, rv.fill * 100.0);
+            }
+        }
+    }
+    return testResult("RxBufSizeSim");
+}
@@ -0,0 +1,298 @@
+//
+//  RxFlipSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates receive page flipping with MausiPagePool under different
+//  hold times of the network stack. A receive ring with a page bound to
+//  each descriptor is cleaned like rxInterruptFlip() does: a frame above
+//  the copy break is passed upstream in its half of the page and the
+//  descriptor flips to the other half if that one is back, gets another
+//  page from the pool otherwise, and only copies the frame into an
+//  allocated mbuf if the pool is empty. The stack holds each mbuf for a
+//  random number of interrupts before freeing it, which returns the
+//  half through the pool's free function. The hardware's DMA writes a
+//  tag into each buffer, so that a half which is reused while the stack
+//  still holds it shows up as a corrupted frame. After each run the ring
+//  is rebound like rxResizeBuffers() does while the stack still holds
+//  the halves of slow readers, and all pages must return to the pool
+//  once the stack is done.
+//
+
+#include <math.h>
+#include <queue>
+#include <vector>
+
+#include "MausiPagePool.hpp"
+#include "HostTest.h"
+
+#define kNumDesc        512
+#define kNumTicks       50000
+#define kCopyBreak      200     /* mbuf_get_mhlen() */
+#define kFrameLen       1514
+
+/* As in IntelMausiEthernet.h. */
+#define kRxFlipSpares(n)    ((n) >> 1)
+
+enum {
+    kHoldNone = 0,
+    kHoldShort,
+    kHoldExp,
+    kHoldTail,
+    kHoldLong,
+    kNumHolds
+};
+
+static const char *holdNames[kNumHolds] = {
+    "freed at once", "0-4 irqs", "exp. mean 16", "5% 200-2000", "50-150 irqs"
+};
+
+struct Held {
+    UInt64 releaseTime;
+    mbuf_t m;
+
+    bool operator<(const Held &other) const { return releaseTime > other.releaseTime; }
+};
+
+struct Stats {
+    UInt64 large;
+    UInt64 flips;
+    UInt64 newPages;
+    UInt64 fallbackAllocs;
+    UInt64 smallCopies;
+    UInt64 corrupted;
+    UInt32 maxUpstream;
+    bool rebind;
+};
+
+/* rxPageArray */
+static struct {
+    struct MausiRxPage *page;
+    UInt32 offset;
+} pageArray[kNumDesc];
+
+static MausiPagePool *pagePool;
+static std::priority_queue<Held> stack;
+static UInt32 upstream;
+
+/* The tag written by the hardware's DMA. */
+static void setTag(UInt8 *buf, UInt64 tag)
+{
+    memcpy(buf, &tag, sizeof(tag));
+}
+
+static UInt64 getTag(const UInt8 *buf)
+{
+    UInt64 tag;
+
+    memcpy(&tag, buf, sizeof(tag));
+
+    return tag;
+}
+
+static UInt64 holdTime(UInt32 hold)
+{
+    switch (hold) {
+        case kHoldNone:
+            return 0;
+
+        case kHoldShort:
+            return testRandomRange(0, 4);
+
+        case kHoldExp:
+            /* Inverse of the CDF with a 24 bit uniform variable. */
+            return (UInt64)(-16.0 * log(1.0 - (testRandom() + 0.5) / 16777216.0));
+
+        case kHoldTail:
+            return (testRandomRange(0, 99) < 5) ? testRandomRange(200, 2000) : testRandomRange(0, 2);
+
+        default:
+            return testRandomRange(50, 150);
+    }
+}
+
+/* rxFlipBindPages() */
+static bool bindPages()
+{
+    struct MausiRxPage *page;
+    UInt32 i, j;
+
+    for (i = 0; i < kNumDesc; i++) {
+        page = pagePool->getPage();
+
+        if (!page) {
+            for (j = 0; j < i; j++) {
+                pagePool->putPage(pageArray[j].page);
+                pageArray[j].page = NULL;
+            }
+            return false;
+        }
+        pageArray[i].page = page;
+        pageArray[i].offset = 0;
+    }
+    return true;
+}
+
+/* rxFlipUnbindPages() */
+static void unbindPages()
+{
+    UInt32 i;
+
+    for (i = 0; i < kNumDesc; i++) {
+        if (pageArray[i].page) {
+            pagePool->putPage(pageArray[i].page);
+            pageArray[i].page = NULL;
+        }
+    }
+}
+
+/* The stack is done with an mbuf, its half must still hold the frame. */
+static void stackFree(const Held &held, Stats *stats)
+{
+    if (held.m->extFree) {
+        if (getTag(held.m->data) != held.m->testData[0])
+            stats->corrupted++;
+
+        upstream--;
+    }
+    mbuf_freem(held.m);
+}
+
+/*
+ * The hardware receives a frame into the descriptor and the driver
+ * cleans it right away, like rxInterruptFlip() in one pass.
+ */
+static void receive(UInt32 index, UInt32 len, UInt64 now, UInt32 hold, Stats *stats)
+{
+    struct MausiRxPage *page = pageArray[index].page;
+    struct MausiRxPage *newPage;
+    UInt32 offset = pageArray[index].offset;
+    UInt64 tag = (now << 20) | index;
+    Held held;
+    mbuf_t m = NULL;
+
+    setTag(page->addr + offset, tag);
+
+    if (len > kCopyBreak) {
+        stats->large++;
+
+        if (pagePool->canFlip(page)) {
+            m = pagePool->attachHalf(page, offset, len);
+
+            if (m) {
+                pageArray[index].offset ^= kPageHalfSize;
+                stats->flips++;
+            }
+        } else if ((newPage = pagePool->getPage()) != NULL) {
+            m = pagePool->attachHalf(page, offset, len);
+
+            if (m) {
+                pagePool->putPage(page);
+                pageArray[index].page = newPage;
+                pageArray[index].offset = 0;
+                stats->newPages++;
+            } else {
+                pagePool->putPage(newPage);
+            }
+        }
+        if (m) {
+            m->testData[0] = tag;
+            upstream++;
+            stats->maxUpstream = max(stats->maxUpstream, upstream);
+        } else {
+            stats->fallbackAllocs++;
+        }
+    } else {
+        stats->smallCopies++;
+    }
+    if (!m) {
+        /* Copy the frame and leave the half in place. */
+        m = hostMbufAlloc(page->addr + offset, sizeof(tag), len);
+    }
+    held.m = m;
+    held.releaseTime = now + holdTime(hold);
+    stack.push(held);
+}
+
+static void run(UInt32 hold, Stats *stats)
+{
+    UInt32 next = 0;
+    UInt32 burst, len, i;
+    UInt64 now;
+    struct MausiRxPage *page;
+
+    memset(stats, 0, sizeof(*stats));
+    pagePool = MausiPagePool::withCapacity(kNumDesc + kRxFlipSpares(kNumDesc));
+    CHECK(pagePool && bindPages(), "can't bind %u pages", kNumDesc);
+
+    for (now = 0; now < kNumTicks; now++) {
+        /* The stack frees what it's done with before the interrupt. */
+        while (!stack.empty() && (stack.top().releaseTime <= now)) {
+            stackFree(stack.top(), stats);
+            stack.pop();
+        }
+        /* A burst of frames, 40% of them small. */
+        for (burst = testRandomRange(1, 64); burst; burst--) {
+            len = (testRandomRange(0, 9) < 4) ? 64 : kFrameLen;
+            receive(next, len, now, hold, stats);
+            next = (next + 1) % kNumDesc;
+        }
+    }
+    /* A resize back to 2K buffers while the slow readers hold on. */
+    unbindPages();
+
+    while (!stack.empty() && (stack.top().releaseTime <= now + 10)) {
+        stackFree(stack.top(), stats);
+        stack.pop();
+    }
+    stats->rebind = bindPages();
+    unbindPages();
+
+    while (!stack.empty()) {
+        stackFree(stack.top(), stats);
+        stack.pop();
+    }
+    /* All pages are back. */
+    for (i = 0; (page = pagePool->getPage()) != NULL; i++)
+        ;
+
+    CHECK(i == (kNumDesc + kRxFlipSpares(kNumDesc)), "%s: %u of %u pages back", holdNames[hold], i,
+          kNumDesc + kRxFlipSpares(kNumDesc));
+    CHECK(upstream == 0, "%s: %u halves still upstream", holdNames[hold], upstream);
+
+    pagePool->release();
+}
+
+int main(int argc, char *argv[])
+{
+    Stats stats;
+    UInt32 hold;
+
+    printf("%-14s %10s %8s %8s %10s %12s %8s %s\n", "stack hold", "large", "flips", "new page", "allocs",
+           "allocs/1000", "max held", "rebind");
+
+    for (hold = 0; hold < kNumHolds; hold++) {
+        run(hold, &stats);
+
+        CHECK(stats.corrupted == 0, "%s: %llu frames overwritten while upstream", holdNames[hold],
+              (unsigned long long)stats.corrupted);
+        CHECK(stats.large == (stats.flips + stats.newPages + stats.fallbackAllocs), "%s: %llu large frames",
+              holdNames[hold], (unsigned long long)stats.large);
+
+        /* The allocator isn't called at steady state if the stack is quick. */
+        if ((hold == kHoldNone) || (hold == kHoldShort))
+            CHECK((stats.newPages + stats.fallbackAllocs) == 0, "%s: %llu new pages and %llu allocations",
+                  holdNames[hold], (unsigned long long)stats.newPages, (unsigned long long)stats.fallbackAllocs);
+
+        printf("%-14s %10llu %8.1f%% %7.1f%% %10llu %12.2f %8u %s\n", holdNames[hold],
+               (unsigned long long)stats.large, stats.flips * 100.0 / stats.large,
+               stats.newPages * 100.0 / stats.large, (unsigned long long)stats.fallbackAllocs,
+               stats.fallbackAllocs * 1000.0 / stats.large, stats.maxUpstream, stats.rebind ? "ok" : "clusters");
+    }
+    CHECK(hostMbufsAllocated == hostMbufsFreed, "%llu mbufs allocated, %llu freed",
+          (unsigned long long)hostMbufsAllocated, (unsigned long long)hostMbufsFreed);
+
+    return testResult("RxFlipSim");
+}
@@ -0,0 +1,197 @@
+//
+//  RxPoolSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates MausiRxPool.cpp under bursty arrivals. Bursts of minimum
+//  sized frames at line rate alternate with gaps of light traffic. The
+//  mbuf allocator is a token bucket which can't keep up with a burst,
+//  so that MBUF_DONTWAIT allocations start to fail and the cleaner takes
+//  buffers from the pool. A frame for which neither the allocator nor
+//  the pool has a buffer counts as a resource error. The pool is run
+//  with its refill thread call only and with refillNow() at the end of
+//  every cleaner pass, which only allocates while a reserve is below its
+//  refill threshold. The thread call runs once its deadline has passed
+//  and the timer adapts the capacities once per second.
+//
+
+#include "MausiRxPool.hpp"
+#include "HostTest.h"
+
+#define kNumDesc        512
+#define kSimTime        10000000    /* us */
+#define kIntrInterval   50          /* us, interrupt throttling */
+#define kTimerInterval  1000000     /* us, timerAction() */
+#define kAllocRate      800         /* allocations per ms */
+#define kAllocBurst     256         /* allocations the allocator has in stock */
+#define kLineRate       1488        /* 64 byte frames per ms at 1Gb/s */
+#define kLightRate      20          /* frames per ms between bursts */
+
+/* As in IntelMausiEthernet.h. */
+#define kRxPoolClstCap  100
+#define kRxPoolMbufCap  50
+#define kRxBufferSizeStd    2048
+
+struct Stats {
+    UInt64 frames;
+    UInt64 resourceErrors;
+    UInt64 overruns;
+    UInt64 passes;
+    UInt64 refillPasses;
+    UInt64 refillAllocs;
+    UInt64 threadCalls;
+    UInt64 bursts;
+    UInt64 burstStartDepth;
+    UInt32 maxRefill;
+};
+
+/* The allocator's stock in 1/1000 allocations. */
+static UInt64 allocTokens;
+
+static bool allocator(mbuf_how_t how, size_t size)
+{
+    if (how == MBUF_WAITOK)
+        return true;
+
+    if (allocTokens < 1000)
+        return false;
+
+    allocTokens -= 1000;
+
+    return true;
+}
+
+/* rxInterrupt() without the descriptors: every frame needs a buffer. */
+static UInt32 cleaner(MausiRxPool *pool, UInt32 pending, UInt32 maxCount, bool refill, Stats *stats)
+{
+    UInt32 goodPkts = 0;
+    UInt32 i, added;
+    UInt32 len;
+    mbuf_t m;
+
+    for (i = 0; (i < pending) && (goodPkts < maxCount); i++) {
+        /* 64 byte frames are copied, others replaced by a cluster. */
+        len = (testRandomRange(0, 9) == 0) ? kRxBufferSizeStd : 64;
+        m = pool->getPacket(len, MBUF_DONTWAIT);
+
+        if (!m) {
+            stats->resourceErrors++;
+            continue;
+        }
+        /* The stack is done with it right away. */
+        mbuf_freem(m);
+        goodPkts++;
+    }
+    stats->passes++;
+
+    if (refill && (goodPkts < maxCount)) {
+        added = pool->refillNow(maxCount - goodPkts);
+
+        if (added) {
+            stats->refillPasses++;
+            stats->refillAllocs += added;
+            stats->maxRefill = max(stats->maxRefill, added);
+        }
+    }
+    return i;
+}
+
+static void run(bool refill, Stats *stats)
+{
+    struct MausiRxPoolStats poolStats;
+    MausiRxPool *pool;
+    UInt64 now, phaseEnd = 0;
+    UInt32 rate = kLightRate;
+    UInt32 pending = 0;
+    UInt64 arrivals = 0;    /* in 1/1000 frames */
+    bool burst = false;
+    UInt32 n;
+
+    memset(stats, 0, sizeof(*stats));
+    testSeed = 1;
+    hostAbsoluteTime = 0;
+    hostMbufAllocHook = allocator;
+    allocTokens = kAllocBurst * 1000;
+
+    pool = MausiRxPool::withCapacity(kRxPoolMbufCap, kRxPoolClstCap, kRxBufferSizeStd);
+    CHECK(pool != NULL, "can't create pool");
+
+    for (now = 0; now < kSimTime; now++) {
+        hostAbsoluteTime = now * 1000;
+
+        /* The allocator recovers at a limited rate. */
+        allocTokens = min(allocTokens + kAllocRate, (UInt64)kAllocBurst * 1000);
+
+        /* Bursts of 100us to 1.5ms, gaps of 0.2 to 5ms. */
+        if (now >= phaseEnd) {
+            burst = !burst;
+            rate = burst ? kLineRate : kLightRate;
+            phaseEnd = now + (burst ? testRandomRange(100, 1500) : testRandomRange(200, 5000));
+
+            if (burst) {
+                pool->getStats(&poolStats);
+                stats->burstStartDepth += poolStats.mbufDepth;
+                stats->bursts++;
+            }
+        }
+        arrivals += rate;
+        n = (UInt32)(arrivals / 1000);
+        arrivals -= n * 1000;
+        stats->frames += n;
+
+        /* The hardware drops what doesn't fit into the ring. */
+        if ((pending + n) > (kNumDesc - 1)) {
+            stats->overruns += pending + n - (kNumDesc - 1);
+            n = kNumDesc - 1 - pending;
+        }
+        pending += n;
+
+        if (((now % kIntrInterval) == 0) && pending)
+            pending -= cleaner(pool, pending, kNumDesc, refill, stats);
+
+        stats->threadCalls += hostRunThreadCalls();
+
+        if ((now % kTimerInterval) == (kTimerInterval - 1)) {
+            /* timerAction() */
+            pool->updateCapacity();
+            pool->getStats(&poolStats);
+        }
+    }
+    hostMbufAllocHook = NULL;
+    pool->release();
+}
+
+int main(int argc, char *argv[])
+{
+    Stats base, refill;
+
+    run(false, &base);
+    run(true, &refill);
+
+    CHECK(base.frames == refill.frames, "different traffic: %llu and %llu frames",
+          (unsigned long long)base.frames, (unsigned long long)refill.frames);
+    CHECK(refill.resourceErrors <= base.resourceErrors, "refillNow() causes more resource errors: %llu instead of %llu",
+          (unsigned long long)refill.resourceErrors, (unsigned long long)base.resourceErrors);
+    CHECK(refill.maxRefill <= kPoolRefillBudget, "refillNow() allocated %u buffers in a pass", refill.maxRefill);
+    CHECK(hostMbufsAllocated == hostMbufsFreed, "%llu mbufs allocated, %llu freed",
+          (unsigned long long)hostMbufsAllocated, (unsigned long long)hostMbufsFreed);
+
+    printf("%u s, %llu frames in %llu bursts, %llu cleaner passes\n", kSimTime / 1000000,
+           (unsigned long long)base.frames, (unsigned long long)base.bursts, (unsigned long long)base.passes);
+    printf("%-22s %12s %10s %13s %14s %14s %12s\n", "refill", "res. errors", "overruns", "thread calls",
+           "passes w/alloc", "allocs/pass", "mbuf depth");
+
+    printf("%-22s %12llu %10llu %13llu %14s %14s %12.1f\n", "thread call only",
+           (unsigned long long)base.resourceErrors, (unsigned long long)base.overruns,
+           (unsigned long long)base.threadCalls, "-", "-", (double)base.burstStartDepth / base.bursts);
+
+    printf("%-22s %12llu %10llu %13llu %13.2f%% %6.3f max %2u %12.1f\n", "thread call + refillNow",
+           (unsigned long long)refill.resourceErrors, (unsigned long long)refill.overruns,
+           (unsigned long long)refill.threadCalls, refill.refillPasses * 100.0 / refill.passes,
+           (double)refill.refillAllocs / refill.passes, refill.maxRefill,
+           (double)refill.burstStartDepth / refill.bursts);
+
+    return testResult("RxPoolSim");
+}
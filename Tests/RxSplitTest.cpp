@@ -0,0 +1,381 @@
+//
+//  RxSplitTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Drives the packet split receive path with synthetic write-back
+//  descriptors. A model of the hardware takes the buffer addresses from
+//  the descriptors the driver has handed over up to RDT, writes the
+//  headers to the header buffer and the payload to the page or, if it
+//  doesn't split, the whole frame to the page, and writes back status,
+//  lengths and VLAN tag over the addresses. The cleaner follows
+//  rxInterruptPS() step by step, using rxPSReadWriteBack(),
+//  rxPSClassify(), rxPSCopyPayload() and rxPSSetDesc(). Every good
+//  frame has to arrive exactly once, byte for byte and in order, frames
+//  with receive errors or bogus lengths have to be dropped, and every
+//  payload buffer has to be owned by exactly one of the ring, the stack
+//  or the pool at any time.
+//
+
+#include <stddef.h>
+#include <net/ethernet.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+
+#include "defines.h"
+#include "MausiRxDesc.hpp"
+#include "HostTest.h"
+
+#define kRingSize       64
+#define kRingMask       (kRingSize - 1)
+#define kNumFrames      200000
+#define kNumBuffers     (kRingSize + 16)
+
+/* As in IntelMausiEthernet.h and e1000.h. */
+#define kRxPSHdrSize            256
+#define kRxPSCopyBreak          256
+#define E1000_RX_BUFFER_WRITE   16
+
+/* Space of a small mbuf with a packet header and the copy limit of the pool. */
+#define kMbufHdrSpace   200
+#define kMaxCopySize    kMbufHdrSpace
+
+/* Fake bus addresses of the header and payload buffers. */
+#define kHdrBase        0x10000000ULL
+#define kBufBase        0x20000000ULL
+#define kBufAddr(id)    (kBufBase + (UInt64)(id) * 0x1000)
+
+enum {
+    kOwnerPool = 0,
+    kOwnerRing,
+    kOwnerStack
+};
+
+/* What the hardware did with a frame. */
+enum {
+    kFrameGood = 0,
+    kFrameNoSplit,
+    kFrameCRCError,
+    kFrameNoEOP,
+    kFrameBadHdrLen,
+    kFrameBadBufLen,
+    kNumFrameKinds
+};
+
+static const char *frameNames[kNumFrameKinds] = {
+    "split", "not split", "CRC error", "no EOP", "bad header length", "bad buffer length"
+};
+
+typedef std::vector<UInt8> Frame;
+
+struct SentFrame {
+    Frame data;
+    UInt16 vlanTag;
+    UInt32 kind;
+};
+
+struct Delivered {
+    Frame data;
+    UInt16 vlanTag;
+};
+
+static union e1000_rx_desc_packet_split ring[kRingSize];
+static UInt8 hdrArray[kRingSize * kRxPSHdrSize];
+static UInt8 buffers[kNumBuffers][kRxBufferSizeStd];
+static UInt32 owner[kNumBuffers];
+static UInt32 slotBuf[kRingSize];
+static std::vector<UInt32> pool;
+
+/* Head and tail of the hardware, next index and cleaned count of the driver. */
+static UInt32 hwHead, rdt, rxNextDescIndex, rxCleanedCount;
+
+static std::deque<SentFrame> expected;
+static UInt64 deliveredCount, droppedCount, missedCount;
+static UInt64 actionCount[3], copiedCount, chainedCount, poolEmptyCount;
+
+static UInt32 getBuffer()
+{
+    UInt32 id;
+
+    if (pool.empty())
+        return kNumBuffers;
+
+    id = pool.back();
+    pool.pop_back();
+    CHECK(owner[id] == kOwnerPool, "buffer %u taken from the pool is owned by %u", id, owner[id]);
+    owner[id] = kOwnerRing;
+
+    return id;
+}
+
+static void putBuffer(UInt32 id)
+{
+    CHECK(owner[id] != kOwnerPool, "buffer %u returned twice", id);
+    owner[id] = kOwnerPool;
+    pool.push_back(id);
+}
+
+/*
+ * The hardware's side: receive a frame into the descriptor at the head,
+ * if the driver has handed it over.
+ */
+static void hwReceive(const SentFrame &f, UInt32 hdrLen)
+{
+    union e1000_rx_desc_packet_split *desc = &ring[hwHead];
+    UInt64 hdrAddr = desc->read.buffer_addr[0];
+    UInt64 bufAddr = desc->read.buffer_addr[1];
+    UInt32 len = (UInt32)f.data.size();
+    UInt32 status = E1000_RXD_STAT_DD | E1000_RXD_STAT_EOP;
+    UInt16 length0 = 0, length1 = len;
+    UInt32 id, slot;
+
+    if (hwHead == rdt) {
+        missedCount++;
+        return;
+    }
+    slot = (UInt32)((hdrAddr - kHdrBase) / kRxPSHdrSize);
+    id = (UInt32)((bufAddr - kBufBase) / 0x1000);
+
+    CHECK((hdrAddr == kHdrBase + (UInt64)hwHead * kRxPSHdrSize), "descriptor %u has header address %llx", hwHead,
+          (unsigned long long)hdrAddr);
+    CHECK((id < kNumBuffers) && (owner[id] == kOwnerRing) && (slotBuf[hwHead] == id),
+          "descriptor %u has buffer address %llx", hwHead, (unsigned long long)bufAddr);
+    CHECK((desc->read.buffer_addr[2] == ~0ULL) && (desc->read.buffer_addr[3] == ~0ULL),
+          "descriptor %u has more than one payload buffer", hwHead);
+
+    if (f.kind != kFrameNoSplit) {
+        memcpy(&hdrArray[slot * kRxPSHdrSize], &f.data[0], hdrLen);
+        memcpy(buffers[id], &f.data[hdrLen], len - hdrLen);
+        length0 = hdrLen;
+        length1 = len - hdrLen;
+    } else {
+        memcpy(buffers[id], &f.data[0], len);
+    }
+    switch (f.kind) {
+        case kFrameCRCError:
+            status |= E1000_RXDEXT_STATERR_CE;
+            break;
+
+        case kFrameNoEOP:
+            status &= ~E1000_RXD_STAT_EOP;
+            break;
+
+        case kFrameBadHdrLen:
+            length0 = kRxPSHdrSize + 1 + testRandomRange(0, 0xfe00);
+            break;
+
+        case kFrameBadBufLen:
+            length1 = kRxBufferSizeStd + 1 + testRandomRange(0, 0xf000);
+            break;
+    }
+    if (f.vlanTag)
+        status |= E1000_RXD_STAT_VP;
+
+    /* The write-back overwrites the addresses. */
+    memset(desc, 0, sizeof(*desc));
+    desc->wb.middle.length0 = length0;
+    desc->wb.middle.vlan = f.vlanTag;
+    desc->wb.upper.header_status = length0 ? E1000_RXDPS_HDRSTAT_HDRSP : 0;
+    desc->wb.upper.length[0] = length1;
+    desc->wb.middle.status_error = status;
+
+    hwHead = (hwHead + 1) & kRingMask;
+}
+
+static void deliver(const Delivered &d)
+{
+    const SentFrame *f;
+
+    /* Dropped frames are skipped, good ones have to arrive in order. */
+    while (!expected.empty() && (expected.front().kind > kFrameNoSplit)) {
+        expected.pop_front();
+        droppedCount++;
+    }
+    CHECK(!expected.empty(), "a frame arrived which wasn't sent");
+
+    if (expected.empty())
+        return;
+
+    f = &expected.front();
+    CHECK(d.data == f->data, "frame %llu differs: %zu bytes instead of %zu", (unsigned long long)deliveredCount,
+          d.data.size(), f->data.size());
+    CHECK(d.vlanTag == (f->vlanTag & E1000_RXD_SPC_VLAN_MASK), "frame %llu has VLAN tag %u instead of %u",
+          (unsigned long long)deliveredCount, d.vlanTag, f->vlanTag);
+
+    expected.pop_front();
+    deliveredCount++;
+}
+
+/*
+ * The driver's side, rxInterruptPS(). Payload buffers passed upstream
+ * are returned to the pool right away, as if the stack was done.
+ */
+static UInt32 rxCleaner(UInt32 maxCount)
+{
+    union e1000_rx_desc_packet_split *desc = &ring[rxNextDescIndex];
+    struct MausiRxPSInfo info;
+    Delivered d;
+    UInt8 *hdr;
+    UInt32 status, action, bufId, newId, hdrSpace;
+    UInt32 goodPkts = 0;
+
+    while (((status = OSSwapLittleToHostInt32(desc->wb.middle.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+        rxPSReadWriteBack(desc, status, &info);
+        action = rxPSClassify(&info, kRxPSHdrSize, kRxBufferSizeStd);
+        actionCount[action]++;
+        hdr = &hdrArray[rxNextDescIndex * kRxPSHdrSize];
+        bufId = slotBuf[rxNextDescIndex];
+
+        if (action == kRxPSDrop)
+            goto nextDesc;
+
+        d.vlanTag = info.vlanTag;
+
+        if (action == kRxPSWhole) {
+            /* replaceOrCopyPacket() */
+            d.data.assign(buffers[bufId], buffers[bufId] + info.bufSize);
+
+            if (info.bufSize > kMaxCopySize) {
+                if ((newId = getBuffer()) == kNumBuffers) {
+                    poolEmptyCount++;
+                    goto nextDesc;
+                }
+                owner[bufId] = kOwnerStack;
+                slotBuf[rxNextDescIndex] = newId;
+                putBuffer(bufId);
+            }
+        } else {
+            /* Headers longer than a small mbuf need a cluster. */
+            hdrSpace = (info.hdrSize > kMbufHdrSpace) ? kRxBufferSizeStd : kMbufHdrSpace;
+            d.data.assign(hdr, hdr + info.hdrSize);
+
+            if (rxPSCopyPayload(&info, kRxPSCopyBreak, hdrSpace)) {
+                d.data.insert(d.data.end(), buffers[bufId], buffers[bufId] + info.bufSize);
+                copiedCount++;
+            } else {
+                if ((newId = getBuffer()) == kNumBuffers) {
+                    /* Leave both original buffers in place. */
+                    poolEmptyCount++;
+                    goto nextDesc;
+                }
+                owner[bufId] = kOwnerStack;
+                slotBuf[rxNextDescIndex] = newId;
+                d.data.insert(d.data.end(), buffers[bufId], buffers[bufId] + info.bufSize);
+                putBuffer(bufId);
+                chainedCount++;
+            }
+        }
+        deliver(d);
+        goodPkts++;
+
+    nextDesc:
+        rxPSSetDesc(desc, kHdrBase + (UInt64)rxNextDescIndex * kRxPSHdrSize, kBufAddr(slotBuf[rxNextDescIndex]));
+
+        ++rxNextDescIndex &= kRingMask;
+        desc = &ring[rxNextDescIndex];
+        rxCleanedCount++;
+    }
+    if (rxCleanedCount >= E1000_RX_BUFFER_WRITE) {
+        rdt = (rxNextDescIndex - 1) & kRingMask;
+        rxCleanedCount = 0;
+    }
+    return goodPkts;
+}
+
+static SentFrame newFrame(UInt32 *hdrLen)
+{
+    SentFrame f;
+    UInt32 len, i, r = testRandomRange(0, 99);
+
+    if (r < 80)
+        f.kind = (r < 70) ? kFrameGood : kFrameNoSplit;
+    else
+        f.kind = kFrameCRCError + (r - 80) % 4;
+
+    /* Acks, small requests and full sized frames. */
+    r = testRandomRange(0, 9);
+    len = (r < 4) ? testRandomRange(60, 80) : ((r < 7) ? testRandomRange(81, 600) : testRandomRange(1000, 1514));
+    *hdrLen = min(len, testRandomRange(42, 120));
+
+    f.data.resize(len);
+
+    for (i = 0; i < len; i++)
+        f.data[i] = (UInt8)testRandom();
+
+    f.vlanTag = (testRandomRange(0, 9) == 0) ? (UInt16)testRandomRange(1, 0xffff) : 0;
+
+    return f;
+}
+
+int main(int argc, char *argv[])
+{
+    SentFrame f;
+    UInt64 kinds[kNumFrameKinds] = {};
+    UInt32 n, i, hdrLen, burst, id, budget;
+    UInt32 counts[3] = {};
+
+    for (id = 0; id < kNumBuffers; id++) {
+        owner[id] = kOwnerStack;
+        putBuffer(id);
+    }
+    /* rxPSInitDescriptors() */
+    for (i = 0; i < kRingSize; i++) {
+        slotBuf[i] = getBuffer();
+        rxPSSetDesc(&ring[i], kHdrBase + (UInt64)i * kRxPSHdrSize, kBufAddr(slotBuf[i]));
+    }
+    rdt = kRingMask;
+
+    for (n = 0; n < kNumFrames; ) {
+        /* A burst of frames arrives, then the interrupt runs with a budget. */
+        for (burst = testRandomRange(1, 48); burst && (n < kNumFrames); burst--, n++) {
+            f = newFrame(&hdrLen);
+
+            if (hwHead == rdt) {
+                missedCount++;
+                continue;
+            }
+            kinds[f.kind]++;
+            expected.push_back(f);
+            hwReceive(f, hdrLen);
+        }
+        budget = testRandomRange(4, 64);
+        rxCleaner(budget);
+
+        /* Keep track of the ownership of all buffers. */
+        memset(counts, 0, sizeof(counts));
+
+        for (id = 0; id < kNumBuffers; id++)
+            counts[owner[id]]++;
+
+        CHECK((counts[kOwnerRing] == kRingSize) && (counts[kOwnerPool] == pool.size()) &&
+              (counts[kOwnerStack] == 0), "buffers: %u in the ring, %u in the pool, %u upstream",
+              counts[kOwnerRing], counts[kOwnerPool], counts[kOwnerStack]);
+    }
+    while (rxCleaner(kRingSize))
+        ;
+
+    /* Drops at the end of the stream. */
+    while (!expected.empty() && (expected.front().kind > kFrameNoSplit)) {
+        expected.pop_front();
+        droppedCount++;
+    }
+    CHECK(expected.empty(), "%zu frames not delivered", expected.size());
+    CHECK(droppedCount == (kinds[kFrameCRCError] + kinds[kFrameNoEOP] + kinds[kFrameBadHdrLen] +
+                           kinds[kFrameBadBufLen]), "%llu frames dropped", (unsigned long long)droppedCount);
+    CHECK(actionCount[kRxPSDrop] == droppedCount, "%llu descriptors dropped for %llu bad frames",
+          (unsigned long long)actionCount[kRxPSDrop], (unsigned long long)droppedCount);
+    CHECK(poolEmptyCount == 0, "the pool ran dry %llu times", (unsigned long long)poolEmptyCount);
+
+    for (i = 0; i < kNumFrameKinds; i++)
+        printf("%-18s %8llu\n", frameNames[i], (unsigned long long)kinds[i]);
+
+    printf("delivered %llu: %llu whole, %llu with the payload copied, %llu chained; dropped %llu, missed %llu\n",
+           (unsigned long long)deliveredCount, (unsigned long long)actionCount[kRxPSWhole],
+           (unsigned long long)copiedCount, (unsigned long long)chainedCount, (unsigned long long)droppedCount,
+           (unsigned long long)missedCount);
+
+    return testResult("RxSplitTest");
+}
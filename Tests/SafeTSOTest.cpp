@@ -0,0 +1,250 @@
+//
+//  SafeTSOTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Randomized property test of the descriptor layout of txSegmentPacket()
+//  in safe TSO and software segmentation mode. Packets with random MSS
+//  and random physical segment layouts are posted in parts into random
+//  numbers of free descriptors, following the driver's loop. For every
+//  packet the test checks that
+//   - each TSO chunk carries at most kSafeTSOMaxPayload bytes and uses
+//     at most kSafeTSOMaxDescs data descriptors,
+//   - no descriptor carries more than kSafeTSOMaxPerDesc bytes,
+//   - the payload is covered exactly once and in order,
+//   - a part never uses more descriptors than the estimate based on
+//     txSegmentDescs() allows for.
+//
+
+#include <stddef.h>
+#include <vector>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+#include "HostTest.h"
+
+#define kNumPackets     100000
+
+/* As in IntelMausiEthernet.h. */
+#define kMaxSegs        32
+#define kTxDescReserve  2
+#define kNumDescMax     4096
+
+#define kPartReserve    (kMaxSegs + 1 + kTxDescReserve)
+
+struct TestTSOPacket {
+    std::vector<IOPhysicalSegment> segs;
+    UInt32 hdrLen;
+    UInt32 payloadLen;
+    UInt32 mss;
+    UInt32 numSegs;
+};
+
+struct Totals {
+    UInt64 parts;
+    UInt64 chunks;
+    UInt64 softSegs;
+    UInt32 maxChunkDescs;
+    UInt32 maxChunkPayload;
+    UInt32 minSlack;
+};
+
+/* Address of the byte at pos of the packet. */
+static IOPhysicalAddress64 addressOf(const TestTSOPacket &pkt, UInt32 pos)
+{
+    UInt32 i;
+
+    for (i = 0; pos >= pkt.segs[i].length; i++)
+        pos -= (UInt32)pkt.segs[i].length;
+
+    return pkt.segs[i].location + pos;
+}
+
+static void addSegment(TestTSOPacket &pkt, UInt32 len)
+{
+    IOPhysicalSegment seg;
+
+    seg.location = ((IOPhysicalAddress64)testRandom() << PAGE_SHIFT) + testRandomRange(0, PAGE_SIZE - 1);
+    seg.length = len;
+    pkt.segs.push_back(seg);
+}
+
+/*
+ * Split the packet into at most kMaxSegs physical segments: at random
+ * positions, at page boundaries like mbuf clusters do, or into many tiny
+ * segments which are followed by a large one.
+ */
+static TestTSOPacket randomPacket()
+{
+    static const UInt32 msses[] = { 64, 536, 1220, 1448, 1460, 4000, 4096, 8960 };
+    TestTSOPacket pkt;
+    UInt32 total, left, len, n, i;
+
+    pkt.hdrLen = testRandomRange(54, 120);
+    pkt.payloadLen = testRandomRange(1, 65535 - pkt.hdrLen);
+
+    if (testRandom() & 1)
+        pkt.mss = msses[testRandom() % (sizeof(msses) / sizeof(msses[0]))];
+    else
+        pkt.mss = testRandomRange(64, 9000);
+
+    pkt.numSegs = (pkt.payloadLen + pkt.mss - 1) / pkt.mss;
+
+    total = pkt.hdrLen + pkt.payloadLen;
+    left = total;
+    n = testRandomRange(1, kMaxSegs);
+
+    switch (testRandom() % 3) {
+        case 0:
+            for (i = 1; (i < n) && (left > 1); i++) {
+                len = testRandomRange(1, min(left - 1, (2 * total) / n));
+                addSegment(pkt, len);
+                left -= len;
+            }
+            break;
+
+        case 1:
+            len = testRandomRange(1, PAGE_SIZE);
+
+            for (i = 1; (i < n) && (left > len); i++) {
+                addSegment(pkt, len);
+                left -= len;
+                len = PAGE_SIZE;
+            }
+            break;
+
+        default:
+            for (i = 1; (i < n) && (left > 64); i++) {
+                len = testRandomRange(1, 64);
+                addSegment(pkt, len);
+                left -= len;
+            }
+            break;
+    }
+    addSegment(pkt, left);
+
+    return pkt;
+}
+
+/*
+ * Post the segments starting with firstSeg into numFree descriptors the
+ * way txSegmentPacket() does and check the descriptors.
+ * @result      The first segment which hasn't been posted.
+ */
+static UInt32 postPart(const TestTSOPacket &pkt, UInt32 numFree, UInt32 firstSeg, bool hwTSO, Totals *t)
+{
+    IOPhysicalAddress64 addr;
+    UInt32 maxSegs, endSeg, seg, unitSegs, unitLen, chunkLen, dataDescs, len, used, i, segOffset;
+    UInt32 pos = 0;
+    bool tso;
+
+    maxSegs = txSegmentsThatFit(numFree, kPartReserve, pkt.mss);
+
+    if (!maxSegs) {
+        CHECK(numFree < (txSegmentDescs(pkt.mss) + kPartReserve), "no segment posted with %u free descriptors", numFree);
+        return firstSeg;
+    }
+    endSeg = min(firstSeg + maxSegs, pkt.numSegs);
+
+    /* The checksum context in software mode, unless it's cached. */
+    used = hwTSO ? 0 : 1;
+
+    i = 0;
+    segOffset = pkt.hdrLen + firstSeg * pkt.mss;
+
+    while (segOffset >= pkt.segs[i].length) {
+        segOffset -= (UInt32)pkt.segs[i].length;
+        i++;
+    }
+    for (seg = firstSeg; seg < endSeg; seg += unitSegs) {
+        len = pkt.payloadLen - seg * pkt.mss;
+        unitSegs = 1;
+        unitLen = min(pkt.mss, len);
+        tso = false;
+
+        if (hwTSO) {
+            unitSegs = txSafeTSOChunkSegs(&pkt.segs[0], i, segOffset, pkt.mss, len, endSeg - seg);
+            unitLen = min(unitSegs * pkt.mss, len);
+            tso = txSafeTSOFits(&pkt.segs[0], i, segOffset, unitLen);
+            used++;
+
+            if (tso) {
+                t->chunks++;
+            } else {
+                CHECK(unitSegs == 1, "chunk of %u segments doesn't fit", unitSegs);
+                t->softSegs++;
+            }
+        }
+        CHECK((seg + unitSegs) <= endSeg, "chunk beyond the part");
+
+        /* The header descriptor. */
+        used++;
+        dataDescs = 1;
+        chunkLen = unitLen;
+        pos = pkt.hdrLen + seg * pkt.mss;
+
+        while (unitLen) {
+            len = txNextPayloadSlice(&pkt.segs[0], &i, &segOffset, unitLen, &addr);
+
+            CHECK((len > 0) && (len <= kSafeTSOMaxPerDesc), "descriptor with %u bytes", len);
+            CHECK(addr == addressOf(pkt, pos), "payload at %u out of order", pos);
+
+            if (!len)
+                return pkt.numSegs;
+
+            pos += len;
+            unitLen -= len;
+            dataDescs++;
+            used++;
+        }
+        if (tso) {
+            CHECK(chunkLen <= kSafeTSOMaxPayload, "chunk with %u bytes of payload", chunkLen);
+            CHECK(dataDescs <= kSafeTSOMaxDescs, "chunk with %u data descriptors", dataDescs);
+
+            t->maxChunkDescs = max(t->maxChunkDescs, dataDescs);
+            t->maxChunkPayload = max(t->maxChunkPayload, chunkLen);
+        }
+    }
+    if (endSeg == pkt.numSegs)
+        CHECK(pos == (pkt.hdrLen + pkt.payloadLen), "%u of %u bytes posted", pos, pkt.hdrLen + pkt.payloadLen);
+
+    CHECK((used + kTxDescReserve) <= numFree, "%u descriptors used, %u free, mss %u",
+          used, numFree, pkt.mss);
+
+    t->minSlack = min(t->minSlack, numFree - used);
+    t->parts++;
+
+    return endSeg;
+}
+
+static void runMode(bool hwTSO)
+{
+    Totals t = {};
+    TestTSOPacket pkt;
+    UInt32 seg, n;
+
+    t.minSlack = kNumDescMax;
+
+    for (n = 0; n < kNumPackets; n++) {
+        pkt = randomPacket();
+
+        /* Free descriptors vary between parts as the ring is reclaimed. */
+        for (seg = 0; seg < pkt.numSegs; )
+            seg = postPart(pkt, testRandomRange(1, kNumDescMax), seg, hwTSO, &t);
+    }
+    printf("%s: %llu parts, %llu chunks, %llu segments without TSO, max %u descriptors and %u bytes per chunk, "
+           "min slack %u descriptors\n", hwTSO ? "safe TSO" : "software",
+           (unsigned long long)t.parts, (unsigned long long)t.chunks, (unsigned long long)t.softSegs,
+           t.maxChunkDescs, t.maxChunkPayload, t.minSlack);
+}
+
+int main(int argc, char *argv[])
+{
+    runMode(true);
+    runMode(false);
+
+    return testResult("SafeTSOTest");
+}
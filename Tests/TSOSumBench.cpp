@@ -0,0 +1,206 @@
+//
+//  TSOSumBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Measures the pseudo header sum prepareTSO4() and prepareTSO6() put
+//  into the TCP header of a TSO packet. Three ways are compared: the
+//  scalar loop over the 16 bit address words, the former cache of the
+//  sums of recent host pairs and a sum of 32 bit words, gsoAddrSum().
+//  The flows are drawn from a set of 1, 4 or 64 host pairs, so that the
+//  cache sees runs of hits on its last entry, hits by hash and mostly
+//  misses. All three must agree on every sum.
+//
+
+#include <string.h>
+#include <time.h>
+
+#include "MausiGSO.hpp"
+
+#define kNumPackets     20000000
+#define kNumHeaders     4096
+#define kIPProtoTCP     6
+
+/* The former intelTSOCache. */
+#define kTSOCacheSize   16
+
+struct CacheEntry {
+    UInt8 addrs[32];
+    UInt16 pseudoSum;
+    UInt8 type;
+};
+
+struct TSOCache {
+    CacheEntry entries[kTSOCacheSize];
+    UInt32 last;
+};
+
+static TSOCache cache;
+static UInt8 headers[kNumHeaders][32];
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The loop of prepareTSO4() and prepareTSO6(). */
+static __attribute__((noinline)) UInt16 scalarSum(UInt8 type, const UInt8 *addrs)
+{
+    UInt32 len = (type == kGSOTypeIPv4) ? 8 : 32;
+    UInt32 csum32 = kIPProtoTCP;
+    UInt32 i;
+
+    for (i = 0; i < len; i += 2) {
+        csum32 += getBE16(&addrs[i]);
+        csum32 += (csum32 >> 16);
+        csum32 &= 0xffff;
+    }
+    return (UInt16)csum32;
+}
+
+/* The former tsoPseudoSum(). */
+static __attribute__((noinline)) UInt16 cachedSum(UInt8 type, const UInt8 *addrs)
+{
+    CacheEntry *entry = &cache.entries[cache.last];
+    UInt32 len = (type == kGSOTypeIPv4) ? 8 : 32;
+    UInt32 hash = 0;
+    UInt32 i;
+
+    if ((entry->type != type) || memcmp(entry->addrs, addrs, len)) {
+        for (i = 0; i < len; i++)
+            hash = (hash * 31) + addrs[i];
+
+        cache.last = (hash ^ (hash >> 16)) & (kTSOCacheSize - 1);
+        entry = &cache.entries[cache.last];
+
+        if ((entry->type != type) || memcmp(entry->addrs, addrs, len)) {
+            memcpy(entry->addrs, addrs, len);
+            entry->pseudoSum = scalarSum(type, addrs);
+            entry->type = type;
+        }
+    }
+    return entry->pseudoSum;
+}
+
+static __attribute__((noinline)) UInt16 wideSum(UInt8 type, const UInt8 *addrs)
+{
+    return foldSum(gsoAddrSum(addrs, (type == kGSOTypeIPv4) ? 8 : 32) + kIPProtoTCP);
+}
+
+/* Only reads the addresses, to measure the cost of the loop in run(). */
+static __attribute__((noinline)) UInt16 noSum(UInt8 type, const UInt8 *addrs)
+{
+    return addrs[0];
+}
+
+enum {
+    kSumNone = 0,
+    kSumScalar,
+    kSumCached,
+    kSumWide,
+    kNumSums
+};
+
+static const char *sumNames[kNumSums] = { "loop", "scalar", "cached", "32 bit words" };
+
+/*
+ * Compute the sums of a stream of packets. Each flow sends a burst of
+ * 1 to 16 TSO packets, like a bulk transfer fills its send window.
+ * @result  Nanoseconds per packet including the loop.
+ */
+static double run(UInt32 sum, UInt8 type, UInt32 numFlows, UInt64 *check)
+{
+    UInt32 seed = 1;
+    UInt32 flow = 0, burst = 0;
+    UInt32 n;
+    double start;
+
+    memset(&cache, 0, sizeof(cache));
+    *check = 0;
+    start = now();
+
+    for (n = 0; n < kNumPackets; n++) {
+        if (burst == 0) {
+            seed = seed * 1103515245 + 12345;
+            flow = (seed >> 8) % numFlows;
+            burst = 1 + ((seed >> 20) & 15);
+        }
+        burst--;
+
+        switch (sum) {
+            case kSumNone:
+                *check += noSum(type, headers[flow]);
+                break;
+
+            case kSumScalar:
+                *check += scalarSum(type, headers[flow]);
+                break;
+
+            case kSumCached:
+                *check += cachedSum(type, headers[flow]);
+                break;
+
+            default:
+                *check += wideSum(type, headers[flow]);
+                break;
+        }
+    }
+    return (now() - start) * 1e9 / kNumPackets;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 flows[] = { 1, 4, 64 };
+    static const UInt8 types[] = { kGSOTypeIPv4, kGSOTypeIPv6 };
+    UInt64 checks[kNumSums];
+    double ns[kNumSums];
+    UInt32 seed = 4711;
+    UInt32 i, j, t, f, s;
+    int result = 0;
+
+    for (i = 0; i < kNumHeaders; i++) {
+        for (j = 0; j < 32; j++) {
+            seed = seed * 1103515245 + 12345;
+            headers[i][j] = (UInt8)(seed >> 16);
+        }
+    }
+    /* Sums which end in 0xffff and 0 need the end-around carry. */
+    memset(headers[0], 0xff, 32);
+    memset(headers[1], 0, 32);
+
+    for (i = 0; i < kNumHeaders; i++) {
+        for (t = 0; t < 2; t++) {
+            if ((cachedSum(types[t], headers[i]) != scalarSum(types[t], headers[i])) ||
+                (wideSum(types[t], headers[i]) != scalarSum(types[t], headers[i]))) {
+                printf("FAIL: sums of header %u differ\n", i);
+                result = 1;
+            }
+        }
+    }
+    /* The sums are reported without the cost of the loop. */
+    printf("%-5s %-6s %14s %14s %14s %14s\n", "type", "flows", sumNames[0], sumNames[1], sumNames[2],
+           sumNames[3]);
+
+    for (t = 0; t < 2; t++) {
+        for (f = 0; f < (sizeof(flows) / sizeof(flows[0])); f++) {
+            for (s = 0; s < kNumSums; s++)
+                ns[s] = run(s, types[t], flows[f], &checks[s]);
+
+            printf("%-5s %-6u %11.2f ns %11.2f ns %11.2f ns %11.2f ns\n",
+                   (types[t] == kGSOTypeIPv4) ? "IPv4" : "IPv6", flows[f], ns[kSumNone],
+                   ns[kSumScalar] - ns[kSumNone], ns[kSumCached] - ns[kSumNone], ns[kSumWide] - ns[kSumNone]);
+
+            if ((checks[kSumCached] != checks[kSumScalar]) || (checks[kSumWide] != checks[kSumScalar])) {
+                printf("FAIL: the sums differ\n");
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,183 @@
+//
+//  TestPacket.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Test packets and the checksum offload engine model, see TestPacket.h.
+//
+
+#include "defines.h"
+#include "MausiGSO.hpp"
+#include "TestPacket.h"
+
+/* Next header values of the IPv6 extension headers used. */
+#define kIPv6HopByHop   0
+#define kIPv6DestOpts   60
+
+static UInt32 seed = 4711;
+
+static UInt32 nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8);
+}
+
+TestLayout testLayoutOf(const TestPacketSpec &spec)
+{
+    TestLayout l;
+
+    l.l3 = ETHER_HDR_LEN + (spec.vlan ? 4 : 0);
+    l.l4 = l.l3 + ((spec.type == kTypeIPv4) ? 20 : 40) + spec.optLen;
+    l.csum = l.l4 + ((spec.proto == kProtoTCP) ? 16 : 6);
+    l.hdrLen = l.l4 + ((spec.proto == kProtoTCP) ? 20 : 8);
+
+    return l;
+}
+
+/* Ones' complement sum over the pseudo header without length and protocol. */
+static UInt32 addressSum(const Packet &pkt, const TestPacketSpec &spec, const TestLayout &l)
+{
+    if (spec.type == kTypeIPv4)
+        return sumWords(&pkt[l.l3 + 12], 8);
+    else
+        return sumWords(&pkt[l.l3 + 8], 32);
+}
+
+/* Ones' complement sum of a buffer, odd lengths are padded with zero. */
+static UInt32 sumBytes(const UInt8 *p, UInt32 len)
+{
+    UInt32 sum = sumWords(p, len);
+
+    if (len & 1)
+        sum += (UInt32)p[len - 1] << 8;
+
+    return sum;
+}
+
+Packet testBuildPacket(const TestPacketSpec &spec, bool offload)
+{
+    TestLayout l = testLayoutOf(spec);
+    Packet pkt(l.hdrLen + spec.payloadLen);
+    UInt8 *ip = &pkt[l.l3];
+    UInt8 *th = &pkt[l.l4];
+    UInt32 l4Len = (UInt32)pkt.size() - l.l4;
+    UInt32 i;
+
+    for (i = 0; i < 12; i++)
+        pkt[i] = (UInt8)nextRandom();
+
+    if (spec.vlan) {
+        putBE16(&pkt[12], kTypeVlan);
+        putBE16(&pkt[14], 0x0123);
+    }
+    putBE16(&pkt[l.l3 - 2], spec.type);
+
+    if (spec.type == kTypeIPv4) {
+        ip[0] = 0x40 | ((20 + spec.optLen) >> 2);
+        putBE16(&ip[2], (UInt16)(pkt.size() - l.l3));
+        putBE16(&ip[4], (UInt16)nextRandom());
+        putBE16(&ip[6], 0x4000);
+        ip[8] = 64;
+        ip[9] = spec.proto;
+
+        for (i = 12; i < 20; i++)
+            ip[i] = (UInt8)nextRandom();
+
+        /* NOPs as options. */
+        for (i = 20; i < (l.l4 - l.l3); i++)
+            ip[i] = 1;
+    } else {
+        ip[0] = 0x60;
+        putBE16(&ip[4], (UInt16)(pkt.size() - l.l3 - 40));
+        ip[6] = spec.proto;
+        ip[7] = 64;
+
+        for (i = 8; i < 40; i++)
+            ip[i] = (UInt8)nextRandom();
+
+        /* A hop-by-hop header followed by destination options. */
+        if (spec.optLen) {
+            UInt8 *ext = &ip[40];
+
+            ip[6] = kIPv6HopByHop;
+            ext[0] = kIPv6DestOpts;
+            ext[1] = 0;
+            ext[8] = spec.proto;
+            ext[9] = (UInt8)((spec.optLen - 8) / 8 - 1);
+        }
+    }
+    putBE16(&th[0], (UInt16)(0xc000 | nextRandom()));
+    putBE16(&th[2], (spec.proto == kProtoTCP) ? 443 : 53);
+
+    if (spec.proto == kProtoTCP) {
+        putBE32(&th[4], nextRandom());
+        putBE32(&th[8], nextRandom());
+        th[12] = 5 << 4;
+        th[13] = 0x18;
+        putBE16(&th[14], 0xffff);
+    } else {
+        putBE16(&th[4], (UInt16)l4Len);
+    }
+    for (i = l.hdrLen; i < pkt.size(); i++)
+        pkt[i] = (UInt8)nextRandom();
+
+    /* The stack presets the pseudo header sum, including the length. */
+    putBE16(&pkt[l.csum], foldSum(addressSum(pkt, spec, l) + spec.proto + l4Len));
+
+    if (!offload) {
+        putBE16(&pkt[l.csum], (UInt16)~foldSum(sumBytes(th, l4Len)));
+
+        if (spec.type == kTypeIPv4)
+            putBE16(&ip[10], (UInt16)~foldSum(sumWords(ip, l.l4 - l.l3)));
+    }
+    return pkt;
+}
+
+bool testIPv4ChecksumValid(const Packet &pkt, const TestLayout &l)
+{
+    return (foldSum(sumWords(&pkt[l.l3], l.l4 - l.l3)) == 0xffff);
+}
+
+bool testL4ChecksumValid(const Packet &pkt, const TestPacketSpec &spec, const TestLayout &l)
+{
+    UInt32 l4Len = (UInt32)pkt.size() - l.l4;
+    UInt32 sum = addressSum(pkt, spec, l) + spec.proto + l4Len;
+
+    return (foldSum(sum + sumBytes(&pkt[l.l4], l4Len)) == 0xffff);
+}
+
+/* Sum from start to the inclusive end and store it at offset. */
+static bool insertChecksum(Packet &pkt, UInt32 start, UInt32 offset, UInt32 end)
+{
+    if ((end >= pkt.size()) || (start > end) || ((offset + 2) > pkt.size()))
+        return false;
+
+    putBE16(&pkt[offset], (UInt16)~foldSum(sumBytes(&pkt[start], end - start + 1)));
+
+    return true;
+}
+
+bool testOffloadEngine(Packet &pkt, const TestOffloadCtx &ctx, UInt32 popts)
+{
+    UInt32 css, cso, cse;
+    bool result = true;
+
+    if ((popts & (E1000_TXD_POPTS_IXSM | E1000_TXD_POPTS_TXSM)) && !ctx.valid)
+        return false;
+
+    if (popts & E1000_TXD_POPTS_IXSM) {
+        css = ctx.ipConfig & 0xff;
+        cso = (ctx.ipConfig >> 8) & 0xff;
+        cse = ctx.ipConfig >> 16;
+        result = insertChecksum(pkt, css, cso, cse);
+    }
+    if (result && (popts & E1000_TXD_POPTS_TXSM)) {
+        css = ctx.tcpConfig & 0xff;
+        cso = (ctx.tcpConfig >> 8) & 0xff;
+        cse = ctx.tcpConfig >> 16;
+        result = insertChecksum(pkt, css, cso, cse ? cse : ((UInt32)pkt.size() - 1));
+    }
+    return result;
+}
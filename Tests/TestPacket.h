@@ -0,0 +1,73 @@
+//
+//  TestPacket.h
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  TCP and UDP test packets over IPv4 and IPv6 and a model of the
+//  checksum offload engine, which inserts checksums as described by a
+//  context descriptor. Packets built for offload have their checksum
+//  fields prepared the way the network stack does it, so that only a
+//  correctly placed context turns them into valid packets.
+//
+
+#ifndef TestPacket_h
+#define TestPacket_h
+
+#include <vector>
+
+typedef std::vector<UInt8> Packet;
+
+#define kTypeIPv4   0x0800
+#define kTypeIPv6   0x86dd
+#define kTypeVlan   0x8100
+
+#define kProtoTCP   6
+#define kProtoUDP   17
+
+struct TestPacketSpec {
+    UInt16 type;
+    UInt8 proto;
+    bool vlan;
+    UInt32 optLen;      /* IPv4 options or IPv6 extension headers, multiple of 8 */
+    UInt32 payloadLen;
+};
+
+struct TestLayout {
+    UInt32 l3;
+    UInt32 l4;
+    UInt32 csum;        /* offset of the transport checksum */
+    UInt32 hdrLen;
+};
+
+TestLayout testLayoutOf(const TestPacketSpec &spec);
+
+/*
+ * Build a packet with random addresses and payload. For offload the
+ * IPv4 header checksum is zero and the transport checksum holds the
+ * pseudo header sum, otherwise both checksums are valid.
+ */
+Packet testBuildPacket(const TestPacketSpec &spec, bool offload);
+
+bool testIPv4ChecksumValid(const Packet &pkt, const TestLayout &l);
+bool testL4ChecksumValid(const Packet &pkt, const TestPacketSpec &spec, const TestLayout &l);
+
+/* Checksum offload context as loaded by the hardware. */
+struct TestOffloadCtx {
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    bool valid;
+};
+
+/*
+ * Insert the checksums selected by popts (E1000_TXD_POPTS_*) like the
+ * hardware does: the ones' complement sum from the start to the end
+ * offset, which is inclusive and means the end of the packet if zero
+ * for the transport checksum, is stored at the checksum offset.
+ * @result      false in case no context is loaded or an offset lies
+ *              outside of the packet.
+ */
+bool testOffloadEngine(Packet &pkt, const TestOffloadCtx &ctx, UInt32 popts);
+
+#endif /* TestPacket_h */
@@ -0,0 +1,160 @@
+//
+//  TxAdmissionSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates a saturated tx queue with two admission policies of
+//  outputStart(): admitting each packet by the upper bound of its
+//  descriptors with txPacketFits(), and the former rule which stopped
+//  posting as soon as less than kMaxSegs + 3 descriptors were free. Both
+//  stall the queue until txQueueWakes() lets txInterrupt() wake it. The
+//  time averaged ring occupancy, the descriptors left unused when the
+//  queue stalls and the number of stalls are reported for small packets
+//  only and for a mix with TSO packets.
+//
+
+#include "MausiTxSched.hpp"
+#include "HostTest.h"
+#include "TxLinkSim.h"
+
+#define kNsPerMs        1000000.0
+#define kSimTime        (2000 * kNsPerMs)
+#define kIrqInterval    50000.0
+#define kMbps           1000.0
+
+/* As in IntelMausiEthernet.h. */
+#define kMaxSegs        32
+#define kOldReserve     (kMaxSegs + 3)
+
+enum {
+    kMixSmall = 0,
+    kMixTSO,
+    kNumMixes
+};
+
+static const char *mixNames[kNumMixes] = { "small", "with TSO" };
+
+struct MixPacket {
+    SimPacket pkt;
+    UInt32 estimate;    /* txPacketDescs() */
+};
+
+struct SimResult {
+    double occupancy;
+    double unusedAtStall;
+    double stallsPerSec;
+    double utilization;
+};
+
+/*
+ * A packet of the mix. Small packets touch one or two pages and need a
+ * context and a data descriptor per page, TSO packets are 64KB in 4KB
+ * clusters behind a header mbuf. txPacketDescs() adds two descriptors
+ * to the pages for the context and a header pull-up.
+ */
+static MixPacket newPacket(UInt32 mix)
+{
+    MixPacket p = {};
+    UInt32 pages;
+
+    if ((mix == kMixTSO) && (testRandomRange(0, 99) < 30)) {
+        pages = 17;
+        p.pkt.bytes = 65160;
+    } else {
+        pages = (testRandomRange(0, 99) < 20) ? 2 : 1;
+        p.pkt.bytes = testRandomRange(64, 1514);
+    }
+    p.pkt.descs = 1 + pages;
+    p.estimate = min(pages, (UInt32)kMaxSegs) + 2;
+
+    return p;
+}
+
+static SimResult simulate(UInt32 ringSize, UInt32 mix, bool exact)
+{
+    TxLinkSim link(ringSize, kMbps, kIrqInterval);
+    MixPacket next;
+    SInt32 threshold = kTxQueueWakeTreshhold(ringSize);
+    UInt32 stallDescs = 0;
+    UInt64 stalls = 0;
+    UInt64 unused = 0;
+    double occupancy = 0.0;
+    double now = 0.0, last = 0.0;
+    bool stalled = false;
+    bool fits;
+    SimResult res;
+
+    testSeed = 1;
+    next = newPacket(mix);
+
+    while (now < kSimTime) {
+        occupancy += (ringSize - link.numFree) * (now - last);
+        last = now;
+
+        /* txInterrupt() */
+        link.reclaim(now, NULL);
+
+        if (stalled && txQueueWakes(link.numFree, threshold, stallDescs))
+            stalled = false;
+
+        /* outputStart(), the stack always has packets queued. */
+        while (!stalled) {
+            if (exact) {
+                fits = txPacketFits(link.numFree, next.estimate);
+                stallDescs = next.estimate + kTxDescReserve;
+            } else {
+                fits = (link.numFree >= kOldReserve);
+                stallDescs = kOldReserve;
+            }
+            if (fits) {
+                link.post(next.pkt, now);
+                next = newPacket(mix);
+                continue;
+            }
+            /* txStallQueue() */
+            if (!txQueueWakes(link.numFree, threshold, stallDescs)) {
+                stalled = true;
+                stalls++;
+                unused += link.numFree;
+            }
+        }
+        now = link.nextReclaim();
+    }
+    res.occupancy = occupancy / now / ringSize;
+    res.unusedAtStall = stalls ? ((double)unused / stalls) : 0.0;
+    res.stallsPerSec = stalls / (now / (1000 * kNsPerMs));
+    res.utilization = link.busy(now) / now;
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 ringSizes[] = { 256, 1024 };
+    SimResult exact, old;
+    UInt32 r, m;
+
+    printf("%-5s %-9s %-10s %10s %14s %12s %8s\n", "ring", "packets", "admission", "occupancy",
+           "unused/stall", "stalls/s", "util");
+
+    for (r = 0; r < (sizeof(ringSizes) / sizeof(ringSizes[0])); r++) {
+        for (m = 0; m < kNumMixes; m++) {
+            exact = simulate(ringSizes[r], m, true);
+            old = simulate(ringSizes[r], m, false);
+
+            printf("%-5u %-9s %-10s %10.3f %14.1f %12.0f %8.3f\n", ringSizes[r], mixNames[m], "exact",
+                   exact.occupancy, exact.unusedAtStall, exact.stallsPerSec, exact.utilization);
+            printf("%-5u %-9s %-10s %10.3f %14.1f %12.0f %8.3f\n", ringSizes[r], mixNames[m], "reserve",
+                   old.occupancy, old.unusedAtStall, old.stallsPerSec, old.utilization);
+
+            CHECK(exact.occupancy > old.occupancy, "exact admission doesn't fill the ring better");
+            CHECK(exact.unusedAtStall < old.unusedAtStall, "exact admission leaves more descriptors unused");
+            CHECK(exact.unusedAtStall < (kMaxSegs + 1 + kTxDescReserve), "a stall left %.1f descriptors unused",
+                  exact.unusedAtStall);
+            CHECK(exact.utilization > 0.98, "link utilization %.3f", exact.utilization);
+        }
+    }
+    return testResult("TxAdmissionSim");
+}
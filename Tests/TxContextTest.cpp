@@ -0,0 +1,191 @@
+//
+//  TxContextTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Sends a mix of TCPv4, UDPv4 and TCPv6/UDPv6 packets, with and without
+//  IPv4 options, IPv6 extension headers and VLAN tags in the payload,
+//  through the checksum context logic of outputStart(). The descriptor
+//  stream is then consumed by a model of the hardware which loads the
+//  contexts and inserts the checksums. Every packet must leave with
+//  valid checksums, no matter if its context was written or skipped,
+//  and a context must be written exactly when the offload parameters
+//  change or after the ring has been reset.
+//
+
+#include <stddef.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiGSO.hpp"
+#include "MausiTxDesc.hpp"
+#include "HostTest.h"
+#include "TestPacket.h"
+
+#define kRingSize       512
+#define kRingMask       (kRingSize - 1)
+#define kNumPackets     20000
+#define kResetInterval  1500
+
+static const struct TestPacketSpec packetKinds[] = {
+    { kTypeIPv4, kProtoTCP, false, 0, 0 },
+    { kTypeIPv4, kProtoTCP, false, 12, 0 },
+    { kTypeIPv4, kProtoTCP, true, 0, 0 },
+    { kTypeIPv4, kProtoUDP, false, 0, 0 },
+    { kTypeIPv6, kProtoTCP, false, 0, 0 },
+    { kTypeIPv6, kProtoTCP, false, 24, 0 },
+    { kTypeIPv6, kProtoUDP, true, 0, 0 },
+};
+
+#define kNumKinds   (sizeof(packetKinds) / sizeof(packetKinds[0]))
+
+struct SentPacket {
+    TestPacketSpec spec;
+    Packet pkt;
+};
+
+struct Counters {
+    UInt32 emitted;
+    UInt32 skipped;
+    UInt32 expected;
+    UInt32 descs;
+};
+
+static struct e1000_data_desc ring[kRingSize];
+static std::vector<SentPacket> sent;
+
+/*
+ * The driver's side: parse the headers, build the context and write
+ * it only if it differs from the loaded one, then write the packet's
+ * data descriptor. The buffer address is the packet's index in sent.
+ */
+static UInt32 sendPacket(UInt32 index, UInt32 id, struct MausiTxContext *ctx, bool cache, Counters *cnt)
+{
+    const SentPacket &sp = sent[id];
+    struct MausiHdrOffsets offs;
+    IOPhysicalSegment seg;
+    UInt32 ipConfig, tcpConfig, cmdLength, word2;
+    bool tcp = (sp.spec.proto == kProtoTCP);
+
+    CHECK(gsoParseOffsets(&sp.pkt[0], (UInt32)sp.pkt.size(), &offs), "packet %u not parsed", id);
+
+    txChecksumContext((sp.spec.type == kTypeIPv6), tcp, !tcp, offs.l3Offset, offs.l4Offset,
+                      (tcp ? 16 : 6), &ipConfig, &tcpConfig, &cmdLength, &word2);
+
+    if (cache && txContextMatches(ctx, ipConfig, tcpConfig, cmdLength, 0)) {
+        cnt->skipped++;
+    } else {
+        txSetContextDesc(&ring[index], ctx, ipConfig, tcpConfig, cmdLength, 0);
+        ++index &= kRingMask;
+        cnt->emitted++;
+        cnt->descs++;
+    }
+    seg.location = id;
+    seg.length = sp.pkt.size();
+    index = txFillDataDescs(ring, kRingMask, index, &seg, 1, (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+                            0, (E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS), word2);
+    cnt->descs++;
+
+    return index;
+}
+
+/*
+ * The hardware's side: consume the descriptors from head to tail,
+ * load contexts and insert the checksums of the data descriptors.
+ */
+static UInt32 consumeRing(UInt32 head, UInt32 tail, TestOffloadCtx *hw)
+{
+    struct e1000_data_desc *desc;
+    UInt32 id;
+
+    for (; head != tail; ++head &= kRingMask) {
+        desc = &ring[head];
+
+        if (!(desc->lower & E1000_TXD_DTYP_D)) {
+            hw->ipConfig = (UInt32)desc->buffer_addr;
+            hw->tcpConfig = (UInt32)(desc->buffer_addr >> 32);
+            hw->valid = true;
+            continue;
+        }
+        id = (UInt32)desc->buffer_addr;
+        SentPacket &sp = sent[id];
+        TestLayout l = testLayoutOf(sp.spec);
+
+        CHECK((desc->lower & 0xfffff) == sp.pkt.size(), "packet %u has wrong length", id);
+        CHECK(testOffloadEngine(sp.pkt, *hw, (desc->upper >> 8) & 0xff), "packet %u: no usable context", id);
+        CHECK(testL4ChecksumValid(sp.pkt, sp.spec, l), "packet %u: bad %s checksum", id,
+              (sp.spec.proto == kProtoTCP) ? "TCP" : "UDP");
+
+        if (sp.spec.type == kTypeIPv4)
+            CHECK(testIPv4ChecksumValid(sp.pkt, l), "packet %u: bad IPv4 header checksum", id);
+    }
+    return head;
+}
+
+/*
+ * Send the packets in bursts of the same kind, as a few flows do. The
+ * ring is reset from time to time which invalidates the context.
+ */
+static Counters runStream(bool cache)
+{
+    struct MausiTxContext ctx = {};
+    TestOffloadCtx hw = {};
+    Counters cnt = {};
+    UInt32 head = 0;
+    UInt32 tail = 0;
+    UInt32 kind = 0;
+    UInt32 lastKind = kNumKinds;
+    UInt32 i;
+
+    testSeed = 1;
+    sent.clear();
+
+    for (i = 0; i < kNumPackets; i++) {
+        if ((i % kResetInterval) == 0) {
+            head = consumeRing(head, tail, &hw);
+            ctx.valid = false;
+            hw.valid = false;
+            lastKind = kNumKinds;
+        }
+        if ((testRandom() % 4) == 0)
+            kind = testRandom() % kNumKinds;
+
+        if (kind != lastKind)
+            cnt.expected++;
+
+        lastKind = kind;
+
+        SentPacket sp;
+        sp.spec = packetKinds[kind];
+        sp.spec.payloadLen = testRandomRange(0, 1400);
+        sp.pkt = testBuildPacket(sp.spec, true);
+        sent.push_back(sp);
+
+        tail = sendPacket(tail, i, &ctx, cache, &cnt);
+
+        /* Hand the descriptors to the hardware in batches. */
+        if ((i % 32) == 31)
+            head = consumeRing(head, tail, &hw);
+    }
+    consumeRing(head, tail, &hw);
+
+    return cnt;
+}
+
+int main(int argc, char *argv[])
+{
+    Counters cached = runStream(true);
+    Counters always = runStream(false);
+
+    CHECK(cached.emitted == cached.expected, "%u contexts emitted, %u expected", cached.emitted, cached.expected);
+    CHECK((cached.emitted + cached.skipped) == kNumPackets, "%u packets accounted", cached.emitted + cached.skipped);
+    CHECK(always.emitted == kNumPackets, "%u contexts emitted without the cache", always.emitted);
+
+    printf("contexts: %u emitted, %u skipped, %.2f descriptors per packet (%.2f without the cache)\n",
+           cached.emitted, cached.skipped, (double)cached.descs / kNumPackets,
+           (double)always.descs / kNumPackets);
+
+    return testResult("TxContextTest");
+}
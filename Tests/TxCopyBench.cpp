@@ -0,0 +1,158 @@
+//
+//  TxCopyBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Measures packets per second of the tx copy-break path against the
+//  map path for small frames. The copy path copies the frame to the
+//  premapped bounce buffer of its descriptor and frees the mbuf right
+//  away. The map path keeps the mbuf until its descriptor has been
+//  reclaimed, like txInterrupt() does, and optionally wires its page
+//  with mlock()/munlock() as a stand-in for prepare()/complete() of the
+//  memory descriptor. The IOMMU mapping done with AppleVTD can't be
+//  reproduced outside of the kernel, so the map path is cheaper here
+//  than in the driver and the numbers are a lower bound for the gain.
+//
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+
+#define kRingSize           512
+#define kRingMask           (kRingSize - 1)
+#define kNumPackets         2000000
+
+/* As in IntelMausiEthernet.h. */
+#define kTxBounceBufSize    256
+
+/* Descriptors are reclaimed once half of the ring is in use. */
+#define kReclaimLevel       (kRingSize / 2)
+
+enum {
+    kPathCopy = 0,
+    kPathMap,
+    kPathMapWired,
+    kNumPaths
+};
+
+static const char *pathNames[kNumPaths] = { "copy", "map", "map+wire" };
+
+static struct e1000_data_desc ring[kRingSize];
+static mbuf_t inflight[kRingSize];
+static UInt8 bounce[kRingSize * kTxBounceBufSize];
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void *pageOf(const void *p)
+{
+    return (void *)((uintptr_t)p & ~((uintptr_t)PAGE_SIZE - 1));
+}
+
+static void reclaim(UInt32 *head, UInt32 tail, bool wired)
+{
+    mbuf_t m;
+
+    for (; *head != tail; ++*head &= kRingMask) {
+        m = inflight[*head];
+
+        if (m) {
+            if (wired)
+                munlock(pageOf(m->data), PAGE_SIZE);
+
+            mbuf_freem(m);
+            inflight[*head] = NULL;
+        }
+    }
+}
+
+/*
+ * Send numPackets frames of len bytes. The frame is built by the
+ * "stack" in a fresh mbuf for every packet.
+ * @result      Packets per second, 0 if wiring isn't permitted.
+ */
+static double runPath(UInt32 path, UInt32 len, UInt32 numPackets)
+{
+    static const UInt8 frame[kTxBounceBufSize] = { 0 };
+    IOPhysicalSegment seg;
+    UInt32 cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+    UInt32 lastCmd = (E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS);
+    UInt32 head = 0;
+    UInt32 tail = 0;
+    UInt32 used = 0;
+    UInt32 i;
+    mbuf_t m;
+    double start;
+
+    start = now();
+
+    for (i = 0; i < numPackets; i++) {
+        m = hostMbufAlloc(frame, len, len);
+
+        if (path == kPathCopy) {
+            memcpy(&bounce[tail * kTxBounceBufSize], mbuf_data(m), len);
+            mbuf_freem(m);
+            seg.location = 0x80000000ULL + tail * kTxBounceBufSize;
+        } else {
+            if ((path == kPathMapWired) && mlock(pageOf(m->data), PAGE_SIZE)) {
+                mbuf_freem(m);
+                reclaim(&head, tail, true);
+                return 0.0;
+            }
+            inflight[tail] = m;
+            seg.location = (uintptr_t)mbuf_data(m);
+        }
+        seg.length = len;
+        tail = txFillDataDescs(ring, kRingMask, tail, &seg, 1, cmd, 0, lastCmd, 0);
+
+        if (++used == kReclaimLevel) {
+            reclaim(&head, tail, (path == kPathMapWired));
+            used = 0;
+        }
+    }
+    reclaim(&head, tail, (path == kPathMapWired));
+
+    return numPackets / (now() - start);
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 sizes[] = { 60, 66, 128, 256 };
+    UInt32 s, p;
+    double pps;
+
+    printf("size  %12s %12s %12s   (Mpps)\n", pathNames[0], pathNames[1], pathNames[2]);
+
+    for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+        printf("%4u ", sizes[s]);
+
+        for (p = 0; p < kNumPaths; p++) {
+            /* Warm up the allocator and the caches first. */
+            runPath(p, sizes[s], kNumPackets / 10);
+            pps = runPath(p, sizes[s], kNumPackets);
+
+            if (pps > 0.0)
+                printf(" %12.2f", pps / 1e6);
+            else
+                printf(" %12s", "n/a");
+        }
+        printf("\n");
+    }
+    if (hostMbufsAllocated != hostMbufsFreed) {
+        printf("%llu packets leaked\n", (unsigned long long)(hostMbufsAllocated - hostMbufsFreed));
+        return 1;
+    }
+    return 0;
+}
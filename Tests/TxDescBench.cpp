@@ -0,0 +1,144 @@
+//
+//  TxDescBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Replays a mix of packets through the tx descriptor builder against a
+//  mocked register window and ring consumer. It reports the descriptors
+//  built per second and the number of tail register writes per packet
+//  for a tail update after every packet and after every outputStart()
+//  call, depending on how many packets are pending per call.
+//
+
+#include <stddef.h>
+#include <time.h>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+
+#define kRingSize       512
+#define kRingMask       (kRingSize - 1)
+#define kNumPackets     10000000
+
+/* A packet of the mix: number of data segments and context needed. */
+struct BenchPacket {
+    UInt32 numSegs;
+    bool context;
+};
+
+/* Small acks, medium sized and full sized frames spanning two pages. */
+static const struct BenchPacket packetMix[] = {
+    { 1, false }, { 1, false }, { 2, true }, { 1, false },
+    { 3, true },  { 2, false }, { 1, true }, { 2, false },
+};
+
+#define kMixSize    (sizeof(packetMix) / sizeof(packetMix[0]))
+
+/* The mocked register window only counts the tail updates. */
+struct MockRegs {
+    volatile UInt32 tdt;
+    UInt64 tdtWrites;
+};
+
+struct BenchResult {
+    double seconds;
+    UInt64 descs;
+    UInt64 tdtWrites;
+};
+
+static inline void writeTail(struct MockRegs *regs, UInt32 index)
+{
+    regs->tdt = index;
+    regs->tdtWrites++;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Post numPackets packets in calls of burst packets each. The ring
+ * consumer completes all descriptors after each call.
+ */
+static void runBench(struct e1000_data_desc *ring, UInt32 burst, bool tailPerPacket,
+                     UInt64 numPackets, struct BenchResult *res)
+{
+    IOPhysicalSegment segs[4];
+    struct MockRegs regs = { 0, 0 };
+    const struct BenchPacket *pkt;
+    UInt64 posted = 0;
+    UInt64 descs = 0;
+    UInt32 next = 0;
+    UInt32 cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+    UInt32 mix = 0;
+    UInt32 i, j;
+    double start;
+
+    for (i = 0; i < 4; i++) {
+        segs[i].location = 0x100000000ULL + i * PAGE_SIZE;
+        segs[i].length = 1514 / (i + 1);
+    }
+    start = now();
+
+    while (posted < numPackets) {
+        for (j = 0; (j < burst) && (posted < numPackets); j++, posted++) {
+            pkt = &packetMix[mix];
+            mix = (mix + 1) % kMixSize;
+
+            if (pkt->context) {
+                txSetDataDesc(&ring[next], (((UInt64)0x2422 << 32) | 0x220e0e), (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP), 0);
+                next = (next + 1) & kRingMask;
+                descs++;
+            }
+            next = txFillDataDescs(ring, kRingMask, next, segs, pkt->numSegs, cmd, 0,
+                                   (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | (((j + 1) == burst) ? E1000_TXD_CMD_RS : 0)), 0x300);
+            descs += pkt->numSegs;
+
+            if (tailPerPacket)
+                writeTail(&regs, next);
+        }
+        if (!tailPerPacket)
+            writeTail(&regs, next);
+
+        /* The consumer has fetched everything up to the tail. */
+    }
+    res->seconds = now() - start;
+    res->descs = descs;
+    res->tdtWrites = regs.tdtWrites;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 bursts[] = { 1, 4, 8, 32 };
+    struct e1000_data_desc *ring;
+    struct BenchResult res;
+    UInt64 numPackets = (argc > 1) ? strtoull(argv[1], NULL, 0) : kNumPackets;
+    UInt32 i, policy;
+
+    ring = (struct e1000_data_desc *)IOMallocZero(kRingSize * sizeof(struct e1000_data_desc));
+
+    if (!ring)
+        return 1;
+
+    printf("%-8s %-10s %12s %12s %12s\n", "burst", "tail", "Mdesc/s", "Mpkt/s", "TDT/pkt");
+
+    for (i = 0; i < (sizeof(bursts) / sizeof(bursts[0])); i++) {
+        for (policy = 0; policy < 2; policy++) {
+            runBench(ring, bursts[i], (policy == 0), numPackets, &res);
+
+            printf("%-8u %-10s %12.1f %12.1f %12.3f\n", bursts[i], (policy == 0) ? "packet" : "call",
+                   res.descs / res.seconds / 1e6, numPackets / res.seconds / 1e6,
+                   (double)res.tdtWrites / numPackets);
+        }
+    }
+    IOFree(ring, kRingSize * sizeof(struct e1000_data_desc));
+
+    return 0;
+}
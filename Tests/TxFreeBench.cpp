@@ -0,0 +1,150 @@
+//
+//  TxFreeBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Measures the per-call overhead of freeing completed tx mbufs with a
+//  mock allocator. Like the mbuf allocator, it takes a lock for every
+//  call, so that mbuf_freem() pays it per packet while mbuf_freem_list()
+//  pays it once per chain. Packets are reclaimed in batches of different
+//  sizes, as txInterrupt() would find them, and either freed one by one
+//  or linked into a chain by the reclaim loop like txReclaimPackets()
+//  does and freed in one call. The lock is uncontended here, so the
+//  numbers are a lower bound for a busy system.
+//
+
+#include <time.h>
+#include <pthread.h>
+
+#define kRingSize       1024
+#define kRingMask       (kRingSize - 1)
+#define kNumPackets     5000000
+
+/* Mock allocator with a free list protected by a lock. */
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct HostMbuf pool[kRingSize];
+static mbuf_t poolFree;
+static UInt64 freeLocks;
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static mbuf_t mockAlloc()
+{
+    mbuf_t m;
+
+    pthread_mutex_lock(&poolLock);
+    m = poolFree;
+    poolFree = m->nextpkt;
+    pthread_mutex_unlock(&poolLock);
+
+    m->nextpkt = NULL;
+
+    return m;
+}
+
+/* mbuf_freem() */
+static __attribute__((noinline)) void mockFree(mbuf_t m)
+{
+    pthread_mutex_lock(&poolLock);
+    m->nextpkt = poolFree;
+    poolFree = m;
+    freeLocks++;
+    pthread_mutex_unlock(&poolLock);
+}
+
+/* mbuf_freem_list() */
+static __attribute__((noinline)) void mockFreeList(mbuf_t m)
+{
+    mbuf_t tail = m;
+
+    while (tail->nextpkt)
+        tail = tail->nextpkt;
+
+    pthread_mutex_lock(&poolLock);
+    tail->nextpkt = poolFree;
+    poolFree = m;
+    freeLocks++;
+    pthread_mutex_unlock(&poolLock);
+}
+
+/*
+ * Post packets to a ring and reclaim them in batches of batchSize. The
+ * allocations cost the same in both modes, so that the difference of
+ * the results is the difference of the free paths.
+ * @result  Nanoseconds per packet for allocating, reclaiming and freeing.
+ */
+static double run(UInt32 batchSize, bool chain, double *locksPerPkt)
+{
+    static mbuf_t ring[kRingSize];
+    mbuf_t head, tail, m;
+    UInt32 next = 0, dirty = 0;
+    UInt32 n, i;
+    double start;
+
+    poolFree = NULL;
+
+    for (i = 0; i < kRingSize; i++) {
+        pool[i].nextpkt = poolFree;
+        poolFree = &pool[i];
+    }
+    freeLocks = 0;
+    start = now();
+
+    for (n = 0; n < kNumPackets; n += batchSize) {
+        for (i = 0; i < batchSize; i++) {
+            ring[next] = mockAlloc();
+            next = (next + 1) & kRingMask;
+        }
+        head = tail = NULL;
+
+        /* txReclaimPackets() */
+        for (i = 0; i < batchSize; i++) {
+            m = ring[dirty];
+            ring[dirty] = NULL;
+            dirty = (dirty + 1) & kRingMask;
+
+            if (!chain) {
+                mockFree(m);
+                continue;
+            }
+            if (tail)
+                tail->nextpkt = m;
+            else
+                head = m;
+
+            tail = m;
+        }
+        /* txInterrupt() */
+        if (head)
+            mockFreeList(head);
+    }
+    *locksPerPkt = (double)freeLocks / kNumPackets;
+
+    return (now() - start) * 1e9 / kNumPackets;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 batches[] = { 1, 4, 16, 64, 256 };
+    double single, batched, singleLocks, batchedLocks;
+    UInt32 b;
+
+    printf("%-6s %14s %14s %14s %14s\n", "batch", "freem ns/pkt", "list ns/pkt", "freem locks", "list locks");
+
+    for (b = 0; b < (sizeof(batches) / sizeof(batches[0])); b++) {
+        single = run(batches[b], false, &singleLocks);
+        batched = run(batches[b], true, &batchedLocks);
+
+        printf("%-6u %14.2f %14.2f %14.3f %14.3f\n", batches[b], single, batched, singleLocks, batchedLocks);
+    }
+    return 0;
+}
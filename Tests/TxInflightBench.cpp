@@ -0,0 +1,199 @@
+//
+//  TxInflightBench.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Compares the cost of reclaiming completed tx packets with the queue of
+//  packets in flight against the former per descriptor buffer info array.
+//  A synthetic ring is filled with packets of 1 to 32 descriptors and
+//  reclaimed in batches like txInterrupt() does: the slot walk visits
+//  every descriptor's entry from txDirtyIndex to the end index, while
+//  the queue pops one entry per packet and stops at the first packet
+//  whose last descriptor isn't in range, using descInRange(). Before
+//  reclaiming, both search the packets in flight for status report
+//  requests, all of which are assumed to be done.
+//
+
+#include <time.h>
+
+#include "MausiDescRing.hpp"
+
+#define kRingSize       1024
+#define kRingMask       (kRingSize - 1)
+#define kNumPackets     4000000
+#define kReportInterval 8
+
+/* As in IntelMausiEthernet.h. */
+#define kTxBufFlagReport    0x0004
+
+/* The former per descriptor bookkeeping. */
+struct SlotInfo {
+    mbuf_t mbuf;
+    UInt16 numDescs;
+    UInt16 flags;
+    UInt32 bytes;
+    UInt32 pad;
+};
+
+/* The queue of packets in flight, see intelTxInflight. */
+struct InflightQueue {
+    mbuf_t mbuf[kRingSize];
+    UInt32 bytes[kRingSize];
+    UInt16 eopIndex[kRingSize];
+    UInt16 numDescs[kRingSize];
+    UInt16 flags[kRingSize];
+};
+
+static SlotInfo slots[kRingSize];
+static InflightQueue inflight;
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Packet sizes in descriptors, 0 picks a random size of 1 to 32. */
+static inline UInt32 packetDescs(UInt32 size, UInt32 *seed)
+{
+    if (size)
+        return size;
+
+    *seed = *seed * 1103515245 + 12345;
+
+    return 1 + ((*seed >> 8) & 31);
+}
+
+/*
+ * Post packets into half of the ring and reclaim them, repeatedly.
+ * @size    Descriptors per packet or 0 for random sizes.
+ * @queue   Use the queue instead of the slot walk.
+ * @sum     Returns a checksum of the freed mbufs and reclaimed bytes.
+ * @result  Nanoseconds per packet spent reclaiming.
+ */
+static double run(UInt32 size, bool queue, UInt64 *sum)
+{
+    UInt32 seed = 1;
+    UInt32 next = 0, dirty = 0, numFree = kRingSize;
+    UInt32 qHead = 0, qTail = 0;
+    UInt32 posted = 0, reported = 0;
+    UInt32 n, index, end, cleaned;
+    UInt16 flags;
+    double start, spent = 0.0;
+
+    *sum = 0;
+
+    for (n = 0; n < kNumPackets; ) {
+        /* Fill half of the ring. */
+        while ((numFree > (kRingSize / 2)) && (n < kNumPackets)) {
+            cleaned = packetDescs(size, &seed);
+            index = (next + cleaned - 1) & kRingMask;
+            flags = ((++posted % kReportInterval) == 0) ? kTxBufFlagReport : 0;
+
+            if (queue) {
+                inflight.mbuf[qTail] = (mbuf_t)(uintptr_t)(posted * 64);
+                inflight.bytes[qTail] = cleaned * 1000;
+                inflight.eopIndex[qTail] = index;
+                inflight.numDescs[qTail] = cleaned;
+                inflight.flags[qTail] = flags;
+                qTail = (qTail + 1) & kRingMask;
+            } else {
+                slots[index].mbuf = (mbuf_t)(uintptr_t)(posted * 64);
+                slots[index].bytes = cleaned * 1000;
+                slots[index].numDescs = cleaned;
+                slots[index].flags = flags;
+            }
+            next = (next + cleaned) & kRingMask;
+            numFree -= cleaned;
+            n++;
+        }
+        start = now();
+
+        /* txInterrupt(): find the last packet which requested a report. */
+        end = dirty;
+
+        if (queue) {
+            for (index = qHead; index != qTail; index = (index + 1) & kRingMask) {
+                if (inflight.flags[index] & kTxBufFlagReport)
+                    end = (inflight.eopIndex[index] + 1) & kRingMask;
+            }
+        } else {
+            for (index = dirty; index != next; index = (index + 1) & kRingMask) {
+                if (slots[index].flags & kTxBufFlagReport)
+                    end = (index + 1) & kRingMask;
+            }
+        }
+        /* All packets are done, reclaim up to the report. */
+        if (end == dirty)
+            end = next;
+
+        /* txReclaimPackets() */
+        if (queue) {
+            while (qHead != qTail) {
+                index = inflight.eopIndex[qHead];
+
+                if (!descInRange(index, dirty, end, kRingMask))
+                    break;
+
+                *sum += (uintptr_t)inflight.mbuf[qHead] + inflight.bytes[qHead];
+                inflight.mbuf[qHead] = NULL;
+                numFree += inflight.numDescs[qHead];
+                dirty = (index + 1) & kRingMask;
+                qHead = (qHead + 1) & kRingMask;
+                reported++;
+            }
+        } else {
+            while (dirty != end) {
+                if (slots[dirty].numDescs) {
+                    *sum += (uintptr_t)slots[dirty].mbuf + slots[dirty].bytes;
+                    slots[dirty].mbuf = NULL;
+                    numFree += slots[dirty].numDescs;
+                    slots[dirty].numDescs = 0;
+                    slots[dirty].flags = 0;
+                    slots[dirty].bytes = 0;
+                    reported++;
+                }
+                dirty = (dirty + 1) & kRingMask;
+            }
+        }
+        spent += now() - start;
+    }
+    return spent * 1e9 / reported;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 sizes[] = { 1, 2, 4, 8, 16, 32, 0 };
+    UInt64 slotSum, queueSum;
+    double slot, queue;
+    UInt32 s;
+    int result = 0;
+
+    printf("%-12s %14s %14s %12s %12s\n", "descs/packet", "slot ns/pkt", "queue ns/pkt", "slot bytes", "queue bytes");
+
+    for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+        slot = run(sizes[s], false, &slotSum);
+        queue = run(sizes[s], true, &queueSum);
+
+        if (sizes[s])
+            printf("%-12u ", sizes[s]);
+        else
+            printf("%-12s ", "1-32");
+
+        /* Bookkeeping bytes visited per packet. */
+        printf("%14.2f %14.2f %12.1f %12.1f\n", slot, queue,
+               (sizes[s] ? sizes[s] : 16.5) * sizeof(SlotInfo),
+               (double)(sizeof(mbuf_t) + sizeof(UInt32) + 3 * sizeof(UInt16)));
+
+        if (slotSum != queueSum) {
+            printf("FAIL: the slot walk and the queue reclaimed different packets\n");
+            result = 1;
+        }
+    }
+    return result;
+}
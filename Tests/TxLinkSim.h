@@ -0,0 +1,105 @@
+//
+//  TxLinkSim.h
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Model of the tx ring and the link for the scheduling simulations.
+//  Posted packets are sent in order at the link speed. A packet's
+//  descriptors are reclaimed at the first interrupt after it has been
+//  sent, interrupts occurring every irqInterval nanoseconds while the
+//  ring is busy. Times are in nanoseconds.
+//
+
+#ifndef TxLinkSim_h
+#define TxLinkSim_h
+
+#include <math.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#define kSimWireOverhead    24      /* preamble, FCS and inter frame gap */
+
+struct SimPacket {
+    double arrival;     /* time the packet was queued by the stack */
+    double posted;      /* time it was posted to the ring */
+    double start;       /* time its transmission started */
+    double done;        /* time its descriptors are reclaimed */
+    UInt32 bytes;
+    UInt32 descs;
+    UInt32 cls;
+};
+
+class TxLinkSim {
+public:
+    TxLinkSim(UInt32 ringSize, double mbps, double irqInterval) :
+        numFree(ringSize), bytesInflight(0), busyTime(0.0),
+        nsPerByte(8000.0 / mbps), irq(irqInterval), wireFree(0.0) {}
+
+    /* Post a packet, it must fit into the free descriptors. */
+    void post(SimPacket pkt, double now)
+    {
+        double txTime = (pkt.bytes + kSimWireOverhead) * nsPerByte;
+
+        pkt.posted = now;
+        pkt.start = std::max(now, wireFree);
+        wireFree = pkt.start + txTime;
+        pkt.done = ceil(wireFree / irq) * irq;
+        busyTime += txTime;
+
+        numFree -= pkt.descs;
+        bytesInflight += pkt.bytes;
+        ring.push_back(pkt);
+    }
+
+    /* Reclaim the packets whose interrupt is due by now. */
+    void reclaim(double now, std::vector<SimPacket> *done)
+    {
+        while (!ring.empty() && (ring.front().done <= now)) {
+            numFree += ring.front().descs;
+            bytesInflight -= ring.front().bytes;
+
+            if (done)
+                done->push_back(ring.front());
+
+            ring.pop_front();
+        }
+    }
+
+    /* Time of the next interrupt reclaiming a packet. */
+    double nextReclaim() const
+    {
+        return ring.empty() ? 1e300 : ring.front().done;
+    }
+
+    /* Time the link has been sending up to now. */
+    double busy(double now) const
+    {
+        return busyTime - std::max(wireFree - now, 0.0);
+    }
+
+    UInt32 numFree;
+    UInt64 bytesInflight;
+    double busyTime;
+
+private:
+    double nsPerByte;
+    double irq;
+    double wireFree;
+    std::deque<SimPacket> ring;
+};
+
+/* Value at quantile q of the samples, which are sorted. */
+static inline double simQuantile(std::vector<double> &v, double q)
+{
+    if (v.empty())
+        return 0.0;
+
+    std::sort(v.begin(), v.end());
+
+    return v[std::min((size_t)(q * v.size()), v.size() - 1)];
+}
+
+#endif /* TxLinkSim_h */
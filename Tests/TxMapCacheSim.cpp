@@ -0,0 +1,392 @@
+//
+//  TxMapCacheSim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Drives the tx map cache of MausiTxMapCache.hpp with a mock IOMMU
+//  mapper and counts map and unmap operations per million packets.
+//  Packets use mbuf clusters from a pool which hands out recently freed
+//  clusters first, or random ones, and are reclaimed in batches like
+//  txInterrupt() does. Two policies are compared: keeping idle pages
+//  mapped up to the cache size, and unmapping them at the next reclaim
+//  as the driver used to do. Every DMA address is checked against the
+//  mock IOMMU's table and pages are never unmapped while in flight,
+//  also when freed pages are remapped to other physical pages.
+//
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "MausiTxMapCache.hpp"
+#include "HostTest.h"
+
+#define kNumPackets     250000
+#define kNumMem         256     /* IOMemoryDescriptor slots */
+#define kMaxPages       16      /* pages of a packet */
+#define kRefs           (kMaxPages + 1)
+#define kInflight       96      /* packets left in flight by a reclaim */
+#define kReclaimBatch   32
+
+/* Small packets use 2K clusters, two per page, TSO packets 4K ones. */
+#define kPoolPages      4096
+#define kTSOPercent     20
+#define kRemapChance    4096    /* a freed 4K cluster's page is remapped */
+
+#define kPageBase       0x100000000ULL
+
+struct MockMapping {
+    IOVirtualAddress page;
+    IOPhysicalAddress64 phys;
+    UInt32 inflight;
+};
+
+/* Mock IOMMU which hands out a new I/O virtual address per mapping. */
+class MockMapper {
+public:
+    MockMapper() : maps(0), unmaps(0), nextIova(0x10000000ULL) {}
+
+    IOPhysicalAddress64 map(IOVirtualAddress page, IOPhysicalAddress64 phys)
+    {
+        MockMapping m = { page, phys, 0 };
+
+        nextIova += PAGE_SIZE;
+        table[nextIova] = m;
+        maps++;
+
+        return nextIova;
+    }
+
+    void unmap(IOPhysicalAddress64 iova)
+    {
+        std::unordered_map<IOPhysicalAddress64, MockMapping>::iterator it = table.find(iova);
+
+        CHECK(it != table.end(), "unmapping unknown iova %llx", (unsigned long long)iova);
+
+        if (it != table.end()) {
+            CHECK(it->second.inflight == 0, "unmapping page %lx in flight", (unsigned long)it->second.page);
+            table.erase(it);
+        }
+        unmaps++;
+    }
+
+    MockMapping *lookup(IOPhysicalAddress64 iova)
+    {
+        std::unordered_map<IOPhysicalAddress64, MockMapping>::iterator it = table.find(iova);
+
+        return (it == table.end()) ? NULL : &it->second;
+    }
+
+    UInt64 maps;
+    UInt64 unmaps;
+
+private:
+    IOPhysicalAddress64 nextIova;
+    std::unordered_map<IOPhysicalAddress64, MockMapping> table;
+};
+
+/* Pool of cluster ids which are turned into pages by the caller. */
+class ClusterPool {
+public:
+    ClusterPool(UInt32 n, bool lifo) : lifo(lifo)
+    {
+        for (UInt32 i = n; i; i--)
+            free.push_back(i - 1);
+    }
+
+    UInt32 get()
+    {
+        UInt32 i = lifo ? (UInt32)(free.size() - 1) : testRandomRange(0, (UInt32)free.size() - 1);
+        UInt32 c = free[i];
+
+        free[i] = free.back();
+        free.pop_back();
+
+        return c;
+    }
+
+    void put(UInt32 c) { free.push_back(c); }
+
+private:
+    bool lifo;
+    std::vector<UInt32> free;
+};
+
+struct SimPacket {
+    UInt32 slot;
+    UInt32 numPages;
+    bool own;
+    bool tso;
+    UInt32 clusters[kMaxPages];
+    IOPhysicalAddress64 iova[kMaxPages];
+};
+
+struct SimResult {
+    double mapsPerM;
+    double unmapsPerM;
+    double hitRate;
+    double fallbackRate;
+    UInt32 maxMapped;
+};
+
+class CacheSim {
+public:
+    CacheSim(UInt32 size, bool lifo, bool keepIdle) :
+        small(2 * kPoolPages, lifo), large(kPoolPages, lifo), keepIdle(keepIdle),
+        nextMem2Use(0), nextMem2Free(0), hits(0), lookups(0), fallbacks(0), ownMapped(0), maxMapped(0)
+    {
+        cache.entries = (intelTxMapCacheEntry *)calloc(size, sizeof(intelTxMapCacheEntry));
+        cache.hash = (UInt16 *)calloc(kTxMapCacheBuckets, sizeof(UInt16));
+        cache.memRefs = (UInt16 *)calloc(kNumMem * kRefs, sizeof(UInt16));
+        cache.numEntries = size;
+        txMapCacheReset(&cache, kNumMem, kRefs);
+
+        for (UInt32 i = 0; i < 2 * kPoolPages; i++)
+            phys[i] = (IOPhysicalAddress64)(i + 1) << PAGE_SHIFT;
+    }
+
+    ~CacheSim()
+    {
+        ::free(cache.entries);
+        ::free(cache.hash);
+        ::free(cache.memRefs);
+    }
+
+    void run(UInt32 numPackets, SimResult *res)
+    {
+        SimPacket pkt;
+        UInt32 n;
+
+        for (n = 0; n < numPackets; n++) {
+            newPacket(&pkt);
+            mapPacket(&pkt);
+            inflight.push_back(pkt);
+
+            /* Pages mapped by the cache, without packets mapped on their own. */
+            maxMapped = max(maxMapped, (UInt32)(mapper.maps - mapper.unmaps - ownMapped));
+
+            if (((n + 1) % kReclaimBatch) == 0) {
+                while (inflight.size() > kInflight) {
+                    completePacket(&inflight.front());
+                    inflight.pop_front();
+                }
+            }
+        }
+        while (!inflight.empty()) {
+            completePacket(&inflight.front());
+            inflight.pop_front();
+        }
+        res->mapsPerM = mapper.maps * 1e6 / numPackets;
+        res->unmapsPerM = mapper.unmaps * 1e6 / numPackets;
+        res->hitRate = (double)hits / lookups;
+        res->fallbackRate = (double)fallbacks / numPackets;
+        res->maxMapped = maxMapped;
+    }
+
+private:
+    IOVirtualAddress pageOf(const SimPacket *pkt, UInt32 i) const
+    {
+        UInt32 page = pkt->tso ? (kPoolPages + pkt->clusters[i]) : (pkt->clusters[i] / 2);
+
+        return (IOVirtualAddress)(kPageBase + ((UInt64)page << PAGE_SHIFT));
+    }
+
+    IOPhysicalAddress64 physOf(IOVirtualAddress page) const
+    {
+        return phys[(page - kPageBase) >> PAGE_SHIFT];
+    }
+
+    void newPacket(SimPacket *pkt)
+    {
+        UInt32 i;
+
+        pkt->tso = (testRandomRange(0, 99) < kTSOPercent);
+        pkt->numPages = pkt->tso ? kMaxPages : 1;
+        pkt->own = false;
+
+        for (i = 0; i < pkt->numPages; i++)
+            pkt->clusters[i] = pkt->tso ? large.get() : small.get();
+    }
+
+    /* txMapPacket() */
+    void mapPacket(SimPacket *pkt)
+    {
+        UInt16 *refs;
+        IOVirtualAddress page;
+        MockMapping *m;
+        UInt16 index;
+        UInt32 i;
+        bool unmap;
+
+        release();
+
+        pkt->slot = nextMem2Use;
+        refs = &cache.memRefs[pkt->slot * kRefs];
+
+        for (i = 0; i < pkt->numPages; i++) {
+            page = pageOf(pkt, i);
+            lookups++;
+
+            switch (txMapCacheLookup(&cache, page, physOf(page), &index, &unmap)) {
+                case kTxMapCacheHit:
+                    hits++;
+                    break;
+
+                case kTxMapCacheMiss:
+                    if (unmap)
+                        mapper.unmap(cache.entries[index].iova);
+
+                    txMapCacheInsert(&cache, index, mapper.map(page, physOf(page)));
+                    break;
+
+                default:
+                    goto fallback;
+            }
+            refs[i + 1] = index;
+            pkt->iova[i] = cache.entries[index].iova;
+        }
+        refs[0] = pkt->numPages;
+        goto check;
+
+    fallback:
+        while (i--)
+            txMapCachePut(&cache, refs[i + 1]);
+
+        for (i = 0; i < pkt->numPages; i++)
+            pkt->iova[i] = mapper.map(pageOf(pkt, i), physOf(pageOf(pkt, i)));
+
+        pkt->own = true;
+        fallbacks++;
+
+    check:
+        nextMem2Use = (nextMem2Use + 1) % kNumMem;
+
+        for (i = 0; i < pkt->numPages; i++) {
+            m = mapper.lookup(pkt->iova[i]);
+            CHECK(m && (m->page == pageOf(pkt, i)) && (m->phys == physOf(pageOf(pkt, i))),
+                  "DMA address of page %lx is stale", (unsigned long)pageOf(pkt, i));
+
+            if (m)
+                m->inflight++;
+        }
+        ownMapped += pkt->own ? pkt->numPages : 0;
+    }
+
+    /* txUnmapPacket() followed by freeing the packet. */
+    void completePacket(const SimPacket *pkt)
+    {
+        IOVirtualAddress page;
+        MockMapping *m;
+        UInt32 i;
+
+        for (i = 0; i < pkt->numPages; i++) {
+            if ((m = mapper.lookup(pkt->iova[i])))
+                m->inflight--;
+        }
+        for (i = 0; i < pkt->numPages; i++) {
+            page = pageOf(pkt, i);
+
+            if (pkt->own) {
+                mapper.unmap(pkt->iova[i]);
+                ownMapped--;
+            }
+
+            if (pkt->tso) {
+                /* The page may be returned to the VM and reused. */
+                if (testRandomRange(0, kRemapChance - 1) == 0)
+                    phys[(page - kPageBase) >> PAGE_SHIFT] += (IOPhysicalAddress64)2 * kPoolPages << PAGE_SHIFT;
+
+                large.put(pkt->clusters[i]);
+            } else {
+                small.put(pkt->clusters[i]);
+            }
+        }
+        nextMem2Free = (nextMem2Free + 1) % kNumMem;
+    }
+
+    /* txMapCacheRelease() */
+    void release()
+    {
+        UInt16 *refs;
+        UInt16 index;
+        UInt32 i;
+
+        if (cache.nextMem2Release == nextMem2Free)
+            return;
+
+        /* The previous policy unmapped the pages which were idle already. */
+        while (!keepIdle && (cache.lruHead != kTxMapCacheNone)) {
+            index = cache.lruHead;
+            txMapCacheLRURemove(&cache, index);
+            txMapCacheHashRemove(&cache, index);
+            mapper.unmap(cache.entries[index].iova);
+            txMapCacheFree(&cache, index);
+        }
+        while (cache.nextMem2Release != nextMem2Free) {
+            refs = &cache.memRefs[cache.nextMem2Release * kRefs];
+
+            for (i = 1; i <= refs[0]; i++)
+                txMapCachePut(&cache, refs[i]);
+
+            refs[0] = 0;
+            cache.nextMem2Release = (cache.nextMem2Release + 1) % kNumMem;
+        }
+    }
+
+    intelTxMapCache cache;
+    MockMapper mapper;
+    ClusterPool small;
+    ClusterPool large;
+    IOPhysicalAddress64 phys[2 * kPoolPages];
+    std::deque<SimPacket> inflight;
+    bool keepIdle;
+    UInt32 nextMem2Use;
+    UInt32 nextMem2Free;
+    UInt64 hits;
+    UInt64 lookups;
+    UInt64 fallbacks;
+    UInt32 ownMapped;
+    UInt32 maxMapped;
+};
+
+static void simulate(UInt32 size, bool lifo, bool keepIdle, SimResult *res)
+{
+    CacheSim *sim = new CacheSim(size, lifo, keepIdle);
+
+    testSeed = 1;
+    sim->run(kNumPackets, res);
+
+    printf("%-6s %5u %-6s %12.0f %12.0f %8.3f %9.4f %7u\n", lifo ? "lifo" : "random", size,
+           keepIdle ? "keep" : "unmap", res->mapsPerM, res->unmapsPerM, res->hitRate, res->fallbackRate,
+           res->maxMapped);
+
+    CHECK(res->maxMapped <= size, "%u pages mapped by a cache of %u", res->maxMapped, size);
+    delete sim;
+}
+
+int main(int argc, char *argv[])
+{
+    static const UInt32 sizes[] = { 64, 256, 1024, 4096 };
+    SimResult keep, unmap;
+    UInt32 s, p;
+
+    printf("%-6s %5s %-6s %12s %12s %8s %9s %7s\n", "pool", "pages", "idle", "maps/M", "unmaps/M",
+           "hits", "fallback", "mapped");
+
+    for (p = 0; p < 2; p++) {
+        for (s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+            simulate(sizes[s], (p == 0), false, &unmap);
+            simulate(sizes[s], (p == 0), true, &keep);
+
+            CHECK(keep.mapsPerM <= unmap.mapsPerM, "keeping idle pages maps more pages");
+            CHECK(keep.unmapsPerM <= unmap.unmapsPerM, "keeping idle pages unmaps more pages");
+
+            /* Recently freed clusters fit into the larger caches. */
+            if ((p == 0) && (sizes[s] >= 1024))
+                CHECK(keep.mapsPerM < (unmap.mapsPerM / 100), "idle pages are mapped again");
+        }
+    }
+    return testResult("TxMapCacheSim");
+}
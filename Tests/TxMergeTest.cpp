@@ -0,0 +1,227 @@
+//
+//  TxMergeTest.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Checks txMergeSegments() with fixed cases and with synthetic IOVA
+//  layouts: mbuf chains mapped by a per-packet IOMemoryDescriptor, whose
+//  pages are contiguous in IOVA space, pages mapped one by one by the tx
+//  map cache and random segments. The merged segments must cover the
+//  same bytes in the same order, be at most maxLen bytes long and be as
+//  few as possible. The number of data descriptors per packet is
+//  reported for the old limit of 4096 bytes and kTxMaxMergedSegSize.
+//
+
+#include <stddef.h>
+#include <vector>
+#include <netinet/ip.h>
+
+#include "defines.h"
+#include "MausiTxDesc.hpp"
+#include "HostTest.h"
+
+#define kNumLayouts     100000
+
+/* As in IntelMausiEthernet.h. */
+#define kMaxSegs            32
+#define kTxMaxMergedSegSize 8192
+
+typedef std::vector<IOPhysicalSegment> SegVector;
+
+enum {
+    kLayoutMemDesc = 0,
+    kLayoutMapCache,
+    kLayoutRandom,
+    kNumLayoutTypes
+};
+
+static const char *layoutNames[kNumLayoutTypes] = { "IOMemoryDescriptor", "map cache", "random" };
+
+static void addSegment(SegVector &segs, IOPhysicalAddress64 addr, UInt64 len)
+{
+    IOPhysicalSegment seg;
+
+    seg.location = addr;
+    seg.length = len;
+    segs.push_back(seg);
+}
+
+/*
+ * Split a chain of mbufs at page boundaries like txMapPacket() does.
+ * All pages of the chain are mapped in one go to consecutive pages of
+ * IOVA space, or each page to a random one like the map cache does.
+ */
+static SegVector mbufLayout(bool perPage)
+{
+    SegVector segs;
+    IOPhysicalAddress64 iova = (IOPhysicalAddress64)testRandom() << PAGE_SHIFT;
+    UInt32 numMbufs = testRandomRange(1, 8);
+    UInt32 offset, len, l, m;
+
+    for (m = 0; (m < numMbufs) && (segs.size() < kMaxSegs); m++) {
+        /* Clusters often start at the beginning of a page. */
+        offset = (testRandom() & 1) ? 0 : testRandomRange(0, PAGE_SIZE - 1);
+        len = testRandomRange(1, 4 * PAGE_SIZE);
+
+        for (; len && (segs.size() < kMaxSegs); offset = 0, len -= l) {
+            l = min(len, (UInt32)PAGE_SIZE - offset);
+
+            /* The map cache's pages are adjacent only by chance. */
+            if (perPage && (testRandom() % 4))
+                iova = (IOPhysicalAddress64)testRandom() << PAGE_SHIFT;
+
+            addSegment(segs, iova + offset, l);
+            iova += PAGE_SIZE;
+        }
+    }
+    return segs;
+}
+
+/* Segments of up to a page which follow each other at random. */
+static SegVector randomLayout()
+{
+    SegVector segs;
+    IOPhysicalAddress64 addr = (IOPhysicalAddress64)testRandom() << PAGE_SHIFT;
+    UInt32 n = testRandomRange(1, kMaxSegs);
+    UInt32 len;
+
+    while (n--) {
+        len = (testRandom() & 1) ? PAGE_SIZE : testRandomRange(1, PAGE_SIZE);
+
+        if (testRandom() % 3)
+            addr = ((IOPhysicalAddress64)testRandom() << PAGE_SHIFT) + testRandomRange(0, PAGE_SIZE - 1);
+
+        addSegment(segs, addr, len);
+        addr += len;
+    }
+    return segs;
+}
+
+/* Number of descriptors the contiguous runs need at least. */
+static UInt32 minSegments(const SegVector &segs, UInt32 maxLen)
+{
+    UInt64 len;
+    UInt32 i, n;
+
+    for (i = 0, n = 0; i < segs.size(); n += (len + maxLen - 1) / maxLen) {
+        len = segs[i].length;
+
+        for (i++; (i < segs.size()) && (segs[i].location == (segs[i - 1].location + segs[i - 1].length)); i++)
+            len += segs[i].length;
+    }
+    return n;
+}
+
+/* Check that both vectors describe the same bytes in the same order. */
+static bool sameBytes(const SegVector &a, const IOPhysicalSegment *b, UInt32 numB)
+{
+    UInt64 offA = 0, offB = 0, l;
+    UInt32 i = 0, j = 0;
+
+    while ((i < a.size()) && (j < numB)) {
+        if ((a[i].location + offA) != (b[j].location + offB))
+            return false;
+
+        l = min(a[i].length - offA, b[j].length - offB);
+        offA += l;
+        offB += l;
+
+        if (offA == a[i].length) {
+            i++;
+            offA = 0;
+        }
+        if (offB == b[j].length) {
+            j++;
+            offB = 0;
+        }
+    }
+    return (i == a.size()) && (j == numB);
+}
+
+/* Merge a copy of the segments and check the result. */
+static UInt32 checkMerge(const SegVector &segs, UInt32 maxLen)
+{
+    IOPhysicalSegment vector[kMaxSegs];
+    UInt32 count = (UInt32)segs.size();
+    UInt32 n, i;
+
+    std::copy(segs.begin(), segs.end(), vector);
+    n = txMergeSegments(vector, count, maxLen);
+
+    CHECK(n <= count, "%u segments merged into %u", count, n);
+    CHECK(n == minSegments(segs, maxLen), "%u segments, %u expected", n, minSegments(segs, maxLen));
+    CHECK(sameBytes(segs, vector, n), "merged segments don't cover the packet");
+
+    for (i = 0; i < n; i++)
+        CHECK((vector[i].length > 0) && (vector[i].length <= maxLen), "segment of %llu bytes",
+              (unsigned long long)vector[i].length);
+
+    return n;
+}
+
+static void testFixed()
+{
+    static const struct {
+        UInt32 offset;
+        UInt32 lens[4];
+        bool contiguous;
+        UInt32 merged4K;
+        UInt32 merged8K;
+    } cases[] = {
+        { 0,   { 100, 0, 0, 0 },                 true,  1, 1 },
+        { 0,   { 4096, 4096, 4096, 0 },          true,  3, 2 },
+        { 0,   { 4096, 4096, 0, 0 },             false, 2, 2 },
+        { 100, { 3996, 4096, 4096, 0 },          true,  3, 2 },
+        { 100, { 3996, 4096, 4096, 4096 },       true,  4, 2 },
+        { 200, { 3896, 4096, 4096, 100 },        true,  3, 2 },
+    };
+    SegVector segs;
+    IOPhysicalAddress64 addr;
+    UInt32 c, i;
+
+    for (c = 0; c < (sizeof(cases) / sizeof(cases[0])); c++) {
+        segs.clear();
+        addr = 0x100000 + cases[c].offset;
+
+        for (i = 0; (i < 4) && cases[c].lens[i]; i++) {
+            addSegment(segs, addr, cases[c].lens[i]);
+            addr += cases[c].lens[i] + (cases[c].contiguous ? 0 : PAGE_SIZE);
+        }
+        CHECK(checkMerge(segs, 4096) == cases[c].merged4K, "case %u with 4096 bytes", c);
+        CHECK(checkMerge(segs, kTxMaxMergedSegSize) == cases[c].merged8K, "case %u with %u bytes", c,
+              kTxMaxMergedSegSize);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UInt64 segsIn[kNumLayoutTypes] = {};
+    UInt64 merged4K[kNumLayoutTypes] = {};
+    UInt64 merged8K[kNumLayoutTypes] = {};
+    SegVector segs;
+    UInt32 n, t;
+
+    testFixed();
+
+    for (n = 0; n < kNumLayouts; n++) {
+        t = n % kNumLayoutTypes;
+
+        if (t == kLayoutRandom)
+            segs = randomLayout();
+        else
+            segs = mbufLayout(t == kLayoutMapCache);
+
+        segsIn[t] += segs.size();
+        merged4K[t] += checkMerge(segs, 4096);
+        merged8K[t] += checkMerge(segs, kTxMaxMergedSegSize);
+    }
+    printf("%-20s %10s %10s %10s\n", "layout", "segments", "4096", "8192");
+
+    for (t = 0; t < kNumLayoutTypes; t++)
+        printf("%-20s %10.2f %10.2f %10.2f\n", layoutNames[t], (double)segsIn[t] * kNumLayoutTypes / kNumLayouts,
+               (double)merged4K[t] * kNumLayoutTypes / kNumLayouts, (double)merged8K[t] * kNumLayoutTypes / kNumLayouts);
+
+    return testResult("TxMergeTest");
+}
@@ -0,0 +1,180 @@
+//
+//  TxPrioritySim.cpp
+//  IntelMausiEthernet
+//
+//  Created by Laura Müller on 17.10.26.
+//  Copyright © 2026 Laura Müller. All rights reserved.
+//
+//  Simulates a saturated bulk flow and a sparse voice flow sharing the
+//  tx ring, with and without the service class priority mode. Without
+//  it, the stack's scheduler still hands out voice packets first, but
+//  they queue behind up to a full ring of bulk packets. In priority mode
+//  outputStart() stops dequeuing bulk classes once they hold
+//  kTxBulkLimit() descriptors, using the driver's txClassQuota(). The
+//  queueing delay of each class, from being queued by the stack to the
+//  start of the transmission, is reported for 100 and 1000 Mbit/s.
+//
+
+#include "MausiTxSched.hpp"
+#include "HostTest.h"
+#include "TxLinkSim.h"
+
+#define kNsPerMs        1000000.0
+#define kSimTime        (4000 * kNsPerMs)
+#define kWarmup         (500 * kNsPerMs)
+#define kIrqInterval    50000.0
+
+/* As in IntelMausiEthernet.h. */
+#define kRingSize       512
+#define kTxBatchSize    32
+
+/* Positions in the priority order of outputStart(). */
+#define kClassVoice     1
+#define kClassBulk      6
+
+#define kBulkSize       1514
+#define kBulkDescs      2
+#define kVoiceSize      200
+#define kVoiceDescs     2
+#define kVoicePeriod    (2 * kNsPerMs)
+
+struct SimResult {
+    double voiceP50;
+    double voiceP99;
+    double voiceMax;
+    double bulkP50;
+    double utilization;
+};
+
+static SimPacket newPacket(UInt32 cls, double now)
+{
+    SimPacket pkt = {};
+
+    pkt.arrival = now;
+    pkt.cls = cls;
+    pkt.bytes = (cls == kClassBulk) ? kBulkSize : kVoiceSize;
+    pkt.descs = (cls == kClassBulk) ? kBulkDescs : kVoiceDescs;
+
+    return pkt;
+}
+
+static SimResult simulate(double mbps, bool priority)
+{
+    TxLinkSim link(kRingSize, mbps, kIrqInterval);
+    std::deque<SimPacket> queues[kTxNumServiceClasses];
+    std::deque<SimPacket> pending;
+    std::vector<SimPacket> done;
+    std::vector<double> voiceDelay, bulkDelay;
+    UInt32 bulkLimit = priority ? kTxBulkLimit(kRingSize) : kRingSize;
+    SInt32 bulkDescs = 0;
+    double nextVoice = kVoicePeriod * testRandomRange(0, 1000) / 1000.0;
+    double now = 0.0;
+    UInt32 budget, quota, count, i;
+    SInt32 reserved;
+    SimResult res;
+
+    testSeed = 1;
+
+    while (now < kSimTime) {
+        now = std::min(nextVoice, link.nextReclaim());
+
+        done.clear();
+        link.reclaim(now, &done);
+
+        for (i = 0; i < done.size(); i++) {
+            if (done[i].cls == kClassBulk)
+                bulkDescs -= done[i].descs;
+
+            if (done[i].arrival < kWarmup)
+                continue;
+
+            if (done[i].cls == kClassVoice)
+                voiceDelay.push_back((done[i].start - done[i].arrival) / kNsPerMs);
+            else
+                bulkDelay.push_back((done[i].start - done[i].arrival) / kNsPerMs);
+        }
+        if (now >= nextVoice) {
+            queues[kClassVoice].push_back(newPacket(kClassVoice, now));
+            nextVoice += kVoicePeriod * testRandomRange(500, 1500) / 1000.0;
+        }
+
+        /* outputStart() */
+        while (link.numFree >= (kTxMinPktDescs + kTxDescReserve)) {
+            if (pending.empty()) {
+                budget = std::min(link.numFree / kTxMinPktDescs, (UInt32)kTxBatchSize);
+
+                for (i = 0, reserved = bulkDescs; (i < kTxNumServiceClasses) && budget; i++) {
+                    quota = txClassQuota(i, reserved, bulkLimit, budget);
+
+                    if (!quota)
+                        break;
+
+                    /* The bulk flow always has packets queued. */
+                    for (count = 0; (count < quota) && (i == kClassBulk); count++)
+                        pending.push_back(newPacket(kClassBulk, now));
+
+                    for (; (count < quota) && !queues[i].empty(); count++) {
+                        pending.push_back(queues[i].front());
+                        queues[i].pop_front();
+                    }
+                    budget -= count;
+
+                    if (i >= kTxNumPriorityClasses)
+                        reserved += count * kTxMinPktDescs;
+                }
+                if (pending.empty())
+                    break;
+            }
+            while (!pending.empty() && (link.numFree >= (pending.front().descs + kTxDescReserve))) {
+                if (pending.front().cls == kClassBulk)
+                    bulkDescs += pending.front().descs;
+
+                link.post(pending.front(), now);
+                pending.pop_front();
+            }
+            if (!pending.empty())
+                break;
+        }
+    }
+    res.voiceP50 = simQuantile(voiceDelay, 0.5);
+    res.voiceP99 = simQuantile(voiceDelay, 0.99);
+    res.voiceMax = simQuantile(voiceDelay, 1.0);
+    res.bulkP50 = simQuantile(bulkDelay, 0.5);
+    res.utilization = link.busy(now) / now;
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    static const double speeds[] = { 100.0, 1000.0 };
+    SimResult fifo, prio;
+    double bound;
+    UInt32 s;
+
+    printf("%-6s %-9s %10s %10s %10s %10s %8s\n", "Mbit/s", "mode", "voice p50", "voice p99",
+           "voice max", "bulk p50", "util");
+
+    for (s = 0; s < (sizeof(speeds) / sizeof(speeds[0])); s++) {
+        fifo = simulate(speeds[s], false);
+        prio = simulate(speeds[s], true);
+
+        printf("%-6.0f %-9s %10.3f %10.3f %10.3f %10.3f %8.3f\n", speeds[s], "fifo", fifo.voiceP50,
+               fifo.voiceP99, fifo.voiceMax, fifo.bulkP50, fifo.utilization);
+        printf("%-6.0f %-9s %10.3f %10.3f %10.3f %10.3f %8.3f\n", speeds[s], "priority", prio.voiceP50,
+               prio.voiceP99, prio.voiceMax, prio.bulkP50, prio.utilization);
+
+        /*
+         * A voice packet waits at most for the bulk limit plus one batch
+         * of bulk packets dequeued just before the limit was reached.
+         */
+        bound = ((kTxBulkLimit(kRingSize) / kBulkDescs + kTxBatchSize) * (kBulkSize + kSimWireOverhead) *
+                 8000.0 / speeds[s] + kIrqInterval) / kNsPerMs;
+
+        CHECK(prio.voiceMax <= bound, "voice waited %.3f ms, bound %.3f ms", prio.voiceMax, bound);
+        CHECK(prio.voiceP99 < (fifo.voiceP99 / 3), "priority mode doesn't lower the voice delay");
+        CHECK(prio.utilization > 0.95, "link utilization %.3f in priority mode", prio.utilization);
+        CHECK(fifo.utilization > 0.95, "link utilization %.3f without priority mode", fifo.utilization);
+    }
+    return testResult("TxPrioritySim");
+}